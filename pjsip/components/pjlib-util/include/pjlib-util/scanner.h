@@ -181,7 +181,10 @@ struct pj_scanner;
 
 /**
  * The callback function type to be called by the scanner when it encounters
- * syntax error.
+ * syntax error. The callback normally throws an exception. If it returns
+ * instead, the scanner function that detected the error returns with an
+ * empty output string at the current position, so the callback may move
+ * the scanner to EOF to make the following scanner calls fail too.
  *
  * @param scanner       The scanner instance that calls the callback .
  */
@@ -428,6 +431,18 @@ PJ_DECL(void) pj_scan_get_until_ch( pj_scanner *scanner,
 PJ_DECL(void) pj_scan_get_until_chr( pj_scanner *scanner,
 				     const char *until_spec, pj_str_t *out);
 
+/** 
+ * Get at least one character from the scanner and move the scanner
+ * position until the end of the line, i.e. until CR, LF or the end of
+ * the input. This is equal to #pj_scan_get() with a spec which matches
+ * every character except CR and LF, but scans a word at a time.
+ *
+ * @param scanner   The scanner.
+ * @param out	    String to store the result.
+ */
+PJ_DECL(void) pj_scan_get_until_newline( pj_scanner *scanner, 
+					 pj_str_t *out);
+
 /** 
  * Advance the scanner N characters, and skip whitespace
  * if necessary.
@@ -38,6 +38,66 @@ static void pj_scan_syntax_err(pj_scanner *scanner)
     (*scanner->callback)(scanner);
 }
 
+/* Report syntax error for a function with an output string. Should the
+ * callback return, leave an empty string at the current position.
+ */
+static void pj_scan_syntax_err_str(pj_scanner *scanner, pj_str_t *out)
+{
+    (*scanner->callback)(scanner);
+    pj_strset(out, scanner->curptr, 0);
+}
+
+/*
+ * Word at a time scanning for a few stop characters. A word has a zero
+ * byte iff (w - ONES) & ~w & HIGHS is non-zero, so a word contains the
+ * byte c iff the same holds for w ^ (c * ONES).
+ */
+#define SCAN_WORD_SIZE		sizeof(pj_size_t)
+#define SCAN_ONES		((pj_size_t)-1 / 0xFF)
+#define SCAN_HIGHS		(SCAN_ONES * 0x80)
+#define SCAN_HAS_ZERO(w)	(((w) - SCAN_ONES) & ~(w) & SCAN_HIGHS)
+#define SCAN_MAX_STOP		4
+
+/* Return the first position in [s, end) holding one of the n stop
+ * characters, or end.
+ */
+static char *scan_until_stop(char *s, const char *end,
+			     const char *stop, unsigned n)
+{
+    pj_size_t pat[SCAN_MAX_STOP];
+    unsigned i;
+
+    pj_assert(n > 0 && n <= SCAN_MAX_STOP);
+
+    /* Byte by byte until aligned */
+    while (s < end && ((pj_size_t)s & (SCAN_WORD_SIZE-1)) != 0) {
+	if (memchr(stop, *s, n))
+	    return s;
+	++s;
+    }
+
+    for (i=0; i<n; ++i)
+	pat[i] = SCAN_ONES * (pj_uint8_t)stop[i];
+
+    /* Skip whole words without any stop character */
+    while (end - s >= (pj_ssize_t)SCAN_WORD_SIZE) {
+	pj_size_t w, hit = 0;
+
+	pj_memcpy(&w, s, SCAN_WORD_SIZE);
+	for (i=0; i<n; ++i)
+	    hit |= SCAN_HAS_ZERO(w ^ pat[i]);
+	if (hit)
+	    break;
+	s += SCAN_WORD_SIZE;
+    }
+
+    /* Locate the stop character in the word, or finish the tail */
+    while (s < end && !memchr(stop, *s, n))
+	++s;
+
+    return s;
+}
+
 
 PJ_DEF(void) pj_cis_add_range(pj_cis_t *cis, int cstart, int cend)
 {
@@ -202,7 +262,7 @@ PJ_DEF(int) pj_scan_peek( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
-        pj_scan_syntax_err(scanner);
+        pj_scan_syntax_err_str(scanner, out);
         return -1;
     }
 
@@ -221,7 +281,7 @@ PJ_DEF(int) pj_scan_peek_n( pj_scanner *scanner,
     char *endpos = scanner->curptr + len;
 
     if (endpos > scanner->end) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return -1;
     }
 
@@ -237,7 +297,7 @@ PJ_DEF(int) pj_scan_peek_until( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return -1;
     }
 
@@ -257,7 +317,7 @@ PJ_DEF(void) pj_scan_get( pj_scanner *scanner,
 
     /* EOF is detected implicitly */
     if (!pj_cis_match(spec, *s)) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
 
@@ -292,7 +352,7 @@ PJ_DEF(void) pj_scan_get_unescape( pj_scanner *scanner,
 
     /* EOF is detected implicitly */
     if (!pj_cis_match(spec, *s) && *s != '%') {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
 
@@ -361,7 +421,7 @@ PJ_DEF(void) pj_scan_get_quotes(pj_scanner *scanner,
 	}
     }
     if (qpair == -1) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
     ++s;
@@ -369,10 +429,12 @@ PJ_DEF(void) pj_scan_get_quotes(pj_scanner *scanner,
     /* Loop until end_quote is found. 
      */
     do {
+	char stop[2];
+
 	/* loop until end_quote is found. */
-	while (PJ_SCAN_CHECK_EOF(s) && *s != '\n' && *s != end_quote[qpair]) {
-	    ++s;
-	}
+	stop[0] = '\n';
+	stop[1] = end_quote[qpair];
+	s = scan_until_stop(s, scanner->end, stop, 2);
 
 	/* check that no backslash character precedes the end_quote. */
 	if (*s == end_quote[qpair]) {
@@ -400,7 +462,7 @@ PJ_DEF(void) pj_scan_get_quotes(pj_scanner *scanner,
 
     /* Check and eat the end quote. */
     if (*s != end_quote[qpair]) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
     ++s;
@@ -419,7 +481,7 @@ PJ_DEF(void) pj_scan_get_n( pj_scanner *scanner,
 			    unsigned N, pj_str_t *out)
 {
     if (scanner->curptr + N > scanner->end) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
 
@@ -494,7 +556,7 @@ PJ_DEF(void) pj_scan_get_until( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
 
@@ -518,13 +580,13 @@ PJ_DEF(void) pj_scan_get_until_ch( pj_scanner *scanner,
     register char *s = scanner->curptr;
 
     if (s >= scanner->end) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
 
-    while (PJ_SCAN_CHECK_EOF(s) && *s != until_char) {
-	++s;
-    }
+    s = (char*)memchr(s, until_char, scanner->end - s);
+    if (!s)
+	s = scanner->end;
 
     pj_strset3(out, scanner->curptr, s);
 
@@ -542,13 +604,17 @@ PJ_DEF(void) pj_scan_get_until_chr( pj_scanner *scanner,
     pj_size_t speclen;
 
     if (s >= scanner->end) {
-	pj_scan_syntax_err(scanner);
+	pj_scan_syntax_err_str(scanner, out);
 	return;
     }
 
     speclen = strlen(until_spec);
-    while (PJ_SCAN_CHECK_EOF(s) && !memchr(until_spec, *s, speclen)) {
-	++s;
+    if (speclen <= SCAN_MAX_STOP) {
+	s = scan_until_stop(s, scanner->end, until_spec, (unsigned)speclen);
+    } else {
+	while (PJ_SCAN_CHECK_EOF(s) && !memchr(until_spec, *s, speclen)) {
+	    ++s;
+	}
     }
 
     pj_strset3(out, scanner->curptr, s);
@@ -560,6 +626,30 @@ PJ_DEF(void) pj_scan_get_until_chr( pj_scanner *scanner,
     }
 }
 
+PJ_DEF(void) pj_scan_get_until_newline( pj_scanner *scanner, 
+					pj_str_t *out)
+{
+    /* NUL is included to stop where a spec based pj_scan_get() would */
+    static const char stop[3] = { '\r', '\n', '\0' };
+    register char *s = scanner->curptr;
+
+    /* EOF is detected implicitly */
+    if (s >= scanner->end || memchr(stop, *s, sizeof(stop))) {
+	pj_scan_syntax_err_str(scanner, out);
+	return;
+    }
+
+    s = scan_until_stop(s+1, scanner->end, stop, sizeof(stop));
+
+    pj_strset3(out, scanner->curptr, s);
+
+    scanner->curptr = s;
+
+    if (PJ_SCAN_IS_PROBABLY_SPACE(*s) && scanner->skip_ws) {
+	pj_scan_skip_whitespace(scanner);
+    }
+}
+
 PJ_DEF(void) pj_scan_advance_n( pj_scanner *scanner,
 				 unsigned N, pj_bool_t skip_ws)
 {
@@ -213,6 +213,11 @@ typedef struct pj_activesock_cfg
      * on multiprocessor systems, when the ioqueue is polled by more than
      * one threads.
      *
+     * When PJ_HAS_SOCK_MMSG is enabled, this is also the number of
+     * datagrams that a datagram socket may receive with a single
+     * recvmmsg() call. Each datagram is still reported with its own
+     * \a on_data_recvfrom() callback.
+     *
      * The default value is 1.
      */
     unsigned async_cnt;
@@ -503,6 +508,34 @@ PJ_DECL(pj_status_t) pj_activesock_send(pj_activesock_t *asock,
 					pj_ssize_t *size,
 					unsigned flags);
 
+/**
+ * Send the data of several buffers using the socket with one system
+ * call, as if the buffers were concatenated (see #pj_ioqueue_sendv()).
+ * On stream sockets the operation always completes with the whole data.
+ *
+ * @param asock	    The active socket.
+ * @param send_key  The operation key to send the data.
+ * @param iov	    Array of buffers, at most PJ_SOCK_MAX_IOV. The array
+ *		    and the buffers must remain valid until the data has
+ *		    been sent.
+ * @param iovcnt    Number of buffers in the array.
+ * @param size	    Upon return with PJ_SUCCESS, the size of the data
+ *		    sent.
+ * @param flags	    Flags to be given to pj_ioqueue_sendv().
+ *
+ * @return	    PJ_SUCCESS if data has been sent immediately, or
+ *		    PJ_EPENDING if data cannot be sent immediately. In
+ *		    this case the \a on_data_sent() callback will be
+ *		    called when data is actually sent. Any other return
+ *		    value indicates error condition.
+ */
+PJ_DECL(pj_status_t) pj_activesock_sendv(pj_activesock_t *asock,
+					 pj_ioqueue_op_key_t *send_key,
+					 const pj_iovec_t iov[],
+					 unsigned iovcnt,
+					 pj_ssize_t *size,
+					 unsigned flags);
+
 /**
  * Send datagram using the socket.
  *
@@ -36,7 +36,8 @@ PJ_BEGIN_DECL
  * A hash table is a dictionary in which keys are mapped to array positions by
  * hash functions. Having the keys of more than one item map to the same 
  * position is called a collision. In this library, we will chain the nodes
- * that have the same key in a list.
+ * that have the same key in a list, or, when PJ_HASH_USE_OPEN_ADDRESSING is
+ * enabled, put them in the next free position of the array.
  */
 
 /**
@@ -89,7 +90,9 @@ PJ_DECL(pj_uint32_t) pj_hash_calc_tolower(pj_uint32_t hval,
  * Create a hash table with the specified 'bucket' size.
  *
  * @param pool	the pool from which the hash table will be allocated from.
- * @param size	the bucket size, which will be round-up to the nearest 2^n-1
+ * @param size	the bucket size, which will be round-up to the nearest 2^n-1.
+ *		With PJ_HASH_USE_OPEN_ADDRESSING, this is the initial size
+ *		and the table grows as needed.
  *
  * @return the hash table.
  */
@@ -726,7 +726,8 @@ PJ_DECL(pj_status_t) pj_ioqueue_recv( pj_ioqueue_key_t *key,
  *                  called.
  * @param buffer    The buffer to hold the read data. The caller MUST make sure
  *		    that this buffer remain valid until the framework completes
- *		    reading the handle.
+ *		    reading the handle. It may be NULL if the key has a slab
+ *		    to lend the buffer from (see #pj_ioqueue_set_slab()).
  * @param length    On input, it specifies the size of the buffer. If data is
  *                  available to be read immediately, the function returns
  *                  PJ_SUCCESS and this argument will be filled with the
@@ -758,6 +759,96 @@ PJ_DECL(pj_status_t) pj_ioqueue_recvfrom( pj_ioqueue_key_t *key,
 					  pj_sockaddr_t *addr,
 					  int *addrlen);
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+/**
+ * Opaque declaration of a slab of reference counted read buffers which
+ * the ioqueue lends to datagram reads (see #pj_ioqueue_set_slab()).
+ */
+typedef struct pj_ioqueue_slab pj_ioqueue_slab;
+
+/**
+ * Create a slab of read buffers. All buffers are allocated up front from
+ * a pool of the slab's own, so that buffers still referenced by the
+ * receivers stay valid after the owner of the slab is gone.
+ *
+ * @param pool	    Pool whose factory is used to create the slab's pool.
+ * @param buf_size  Size of each buffer, i.e. the largest datagram that
+ *		    can be received.
+ * @param buf_cnt   Number of buffers. This should cover the reads that
+ *		    are pending on the keys using the slab, plus the number
+ *		    of packets the receivers may hold at any time.
+ * @param p_slab    Pointer to receive the slab.
+ *
+ * @return	    PJ_SUCCESS or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_slab_create(pj_pool_t *pool,
+					    unsigned buf_size,
+					    unsigned buf_cnt,
+					    pj_ioqueue_slab **p_slab);
+
+/**
+ * Destroy the slab. The keys using the slab must have been unregistered
+ * or detached with #pj_ioqueue_set_slab(). Buffers which still have a
+ * reference remain valid, and the memory of the slab is released when
+ * the last of them is dropped with #pj_ioqueue_buf_dec_ref().
+ *
+ * @param slab	    The slab.
+ *
+ * @return	    PJ_SUCCESS or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_slab_destroy(pj_ioqueue_slab *slab);
+
+/**
+ * Make #pj_ioqueue_recvfrom() with NULL buffer borrow the buffer from the
+ * slab. The buffer is only taken from the slab when a datagram actually
+ * arrives, so pending reads do not tie up memory. When all buffers are
+ * in use, incoming datagrams are discarded and the reads stay pending.
+ *
+ * The lent buffer is retrieved with #pj_ioqueue_get_lent_buf() once the
+ * read completes. It stays attached to the operation key until the key
+ * is used to start the next read, at which point it is returned to the
+ * slab unless the receiver has taken a reference with
+ * #pj_ioqueue_buf_add_ref(). Operation keys used for lent reads must be
+ * initialized with #pj_ioqueue_op_key_init().
+ *
+ * @param key	    The key of a datagram socket.
+ * @param slab	    The slab, or NULL to stop lending buffers to new reads.
+ *
+ * @return	    PJ_SUCCESS or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_set_slab(pj_ioqueue_key_t *key,
+					 pj_ioqueue_slab *slab);
+
+/**
+ * Get the buffer lent to a completed read.
+ *
+ * @param op_key    The operation key of the read.
+ *
+ * @return	    The buffer containing the datagram, or NULL if the
+ *		    read did not receive any data.
+ */
+PJ_DECL(void*) pj_ioqueue_get_lent_buf(pj_ioqueue_op_key_t *op_key);
+
+/**
+ * Take a reference to a lent buffer, so that the buffer stays valid after
+ * its read operation key is reused. Each reference must be dropped with
+ * #pj_ioqueue_buf_dec_ref(). This function may be called from any
+ * thread.
+ *
+ * @param buf	    The buffer returned by #pj_ioqueue_get_lent_buf().
+ */
+PJ_DECL(void) pj_ioqueue_buf_add_ref(void *buf);
+
+/**
+ * Drop a reference to a lent buffer. The buffer goes back to its slab
+ * when the last reference is dropped.
+ *
+ * @param buf	    The buffer.
+ */
+PJ_DECL(void) pj_ioqueue_buf_dec_ref(void *buf);
+
+#endif	/* PJ_IOQUEUE_HAS_BUF_LENDING */
+
 /**
  * Instruct the I/O Queue to write to the handle. This function will return
  * immediately (i.e. non-blocking) regardless whether some data has been 
@@ -799,6 +890,39 @@ PJ_DECL(pj_status_t) pj_ioqueue_send( pj_ioqueue_key_t *key,
 				      pj_uint32_t flags );
 
 
+/**
+ * Instruct the I/O Queue to write the data of several buffers to a
+ * connected handle with one system call, as if the buffers were
+ * concatenated (see #pj_sock_sendv()). Unlike #pj_ioqueue_send(), on a
+ * stream socket the operation does not complete with partial data: when
+ * only part of the data can be sent immediately, the rest is queued and
+ * the callback reports the total length once all of it has been sent.
+ *
+ * @param key	    The key that identifies the handle.
+ * @param op_key    An operation specific key to be associated with the
+ *                  pending operation.
+ * @param iov	    Array of buffers, at most PJ_SOCK_MAX_IOV. Caller MUST
+ *		    make sure that the array and the buffers remain valid
+ *		    until the write operation completes.
+ * @param iovcnt    Number of buffers in the array.
+ * @param length    Upon return with PJ_SUCCESS, it contains the length of
+ *		    data sent.
+ * @param flags     Send flags.
+ *
+ * @return
+ *  - PJ_SUCCESS    If all data was immediately transferred. The callback
+ *                  WILL NOT be called.
+ *  - PJ_EPENDING   If the operation (or the rest of it) has been queued.
+ *  - non-zero      The return value indicates the error code.
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_sendv( pj_ioqueue_key_t *key,
+                                       pj_ioqueue_op_key_t *op_key,
+				       const pj_iovec_t iov[],
+				       unsigned iovcnt,
+				       pj_ssize_t *length,
+				       pj_uint32_t flags );
+
+
 /**
  * Instruct the I/O Queue to write to the handle. This function will return
  * immediately (i.e. non-blocking) regardless whether some data has been 
@@ -242,6 +242,56 @@ PJ_DECL(void) pj_log_set_color(int level, pj_color_t color);
  */
 PJ_DECL(pj_color_t) pj_log_get_color(int level);
 
+#if PJ_LOG_HAS_ASYNC
+
+/**
+ * Statistics of the asynchronous logging, see #pj_log_async_get_stat().
+ */
+typedef struct pj_log_async_stat
+{
+    /** Number of messages written by the logging thread. */
+    pj_size_t	written;
+
+    /** Number of messages dropped because the queue was full. */
+    pj_size_t	dropped;
+
+    /** Number of messages cut to PJ_LOG_ASYNC_MSG_SIZE. */
+    pj_size_t	truncated;
+
+} pj_log_async_stat;
+
+/**
+ * Start asynchronous logging. After this function returns, log messages
+ * are queued and written to the log writer by a background thread. See
+ * PJ_LOG_HAS_ASYNC for more info.
+ *
+ * @param pool	    Pool to allocate the queue, the formatting buffer
+ *		    and the thread. The pool must not be released before
+ *		    #pj_log_async_stop() has returned. pj_shutdown() also
+ *		    stops asynchronous logging, so a pool that is released
+ *		    before pj_shutdown() requires an explicit call to
+ *		    #pj_log_async_stop() first.
+ *
+ * @return	    PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_log_async_start(pj_pool_t *pool);
+
+/**
+ * Stop asynchronous logging. The messages that are still in the queue are
+ * written before this function returns, and subsequent log messages are
+ * written synchronously again.
+ */
+PJ_DECL(void) pj_log_async_stop(void);
+
+/**
+ * Get the statistics of the asynchronous logging.
+ *
+ * @param stat	    Structure to receive the statistics.
+ */
+PJ_DECL(void) pj_log_async_get_stat(pj_log_async_stat *stat);
+
+#endif	/* PJ_LOG_HAS_ASYNC */
+
 /**
  * Internal function to be called by pj_init()
  */
@@ -488,6 +488,52 @@
 #   define PJ_LOG_THREAD_WIDTH	    12
 #endif
 
+/**
+ * Enable asynchronous logging. When enabled and started with
+ * #pj_log_async_start(), PJ_LOG() only captures the time, sender, thread
+ * and indentation, prints the message text into a slot of a lock-free
+ * queue, and returns. A background thread adds the decorations and calls
+ * the log writer. When the queue is full the message is dropped and
+ * counted, the caller never blocks. This requires PJ_HAS_THREADS and
+ * atomic builtins (PJ_ATOMIC_USE_BUILTINS).
+ *
+ * Default: 0
+ */
+#ifndef PJ_LOG_HAS_ASYNC
+#   define PJ_LOG_HAS_ASYNC	    0
+#endif
+
+/**
+ * Number of messages that can be queued by the asynchronous logging.
+ * Must be a power of two.
+ *
+ * Default: 64
+ */
+#ifndef PJ_LOG_ASYNC_QUEUE_SIZE
+#   define PJ_LOG_ASYNC_QUEUE_SIZE  64
+#endif
+
+/**
+ * Maximum size of the message text kept for each queued message of the
+ * asynchronous logging, excluding the decorations. Longer messages are
+ * cut.
+ *
+ * Default: 256
+ */
+#ifndef PJ_LOG_ASYNC_MSG_SIZE
+#   define PJ_LOG_ASYNC_MSG_SIZE    256
+#endif
+
+/**
+ * Interval, in milliseconds, at which the asynchronous logging thread
+ * checks the queue when it is empty.
+ *
+ * Default: 10
+ */
+#ifndef PJ_LOG_ASYNC_FLUSH_INTERVAL
+#   define PJ_LOG_ASYNC_FLUSH_INTERVAL	10
+#endif
+
 /**
  * Colorfull terminal (for logging etc).
  *
@@ -538,6 +584,73 @@
 #endif
 
 
+/**
+ * Enable per-thread cache in the caching pool factory. When enabled, each
+ * thread keeps a small magazine of released pools for each pool size, so
+ * that creating and releasing pools does not need to acquire the caching
+ * pool's lock. The lock is only taken to move pools between the magazine
+ * and the shared free list, a batch at a time.
+ *
+ * Each thread keeps at most PJ_CACHING_POOL_THREAD_CACHE_SIZE pools of
+ * each size, and the pools it keeps are counted against the caching
+ * pool's max_capacity, so the total amount of cached memory is still
+ * bounded by max_capacity. A thread that exits while the caching pool
+ * is still in use should call #pj_caching_pool_release_thread_cache()
+ * before it exits, otherwise its cache is only reclaimed by
+ * #pj_caching_pool_destroy().
+ *
+ * Pools that are served from the thread cache are not put in the caching
+ * pool's used list, so they are not shown in the detailed dump and are
+ * not released by #pj_caching_pool_destroy() if the application leaks
+ * them. Use #pj_caching_pool_get_thread_cache_stat() to get the cache
+ * statistics.
+ *
+ * Default: 0
+ */
+#ifndef PJ_CACHING_POOL_HAS_THREAD_CACHE
+#  define PJ_CACHING_POOL_HAS_THREAD_CACHE	0
+#endif
+
+
+/**
+ * Maximum number of pools of each size kept in the per-thread cache of
+ * the caching pool factory. Half of this number of pools is moved to or
+ * from the shared free list each time the lock is acquired. This setting
+ * is only used when PJ_CACHING_POOL_HAS_THREAD_CACHE is enabled.
+ *
+ * Default: 8
+ */
+#ifndef PJ_CACHING_POOL_THREAD_CACHE_SIZE
+#  define PJ_CACHING_POOL_THREAD_CACHE_SIZE	8
+#endif
+
+
+/**
+ * Use open addressing hash table implementation (hash_open.c) instead of
+ * the chained hash table (hash.c). The open addressing table keeps the
+ * hash value of each entry in a flat array, so lookups mostly touch one
+ * cache line. It grows when it becomes 3/4 full, moving the entries to the
+ * larger array a few at a time on subsequent insertions, and it deletes
+ * entries by shifting the following entries back instead of leaving
+ * tombstones. The hash function processes the key a word at a time.
+ * The position of a hash value in the array is mixed with a random seed
+ * of each table (from #pj_rand()), so that keys received from remote
+ * peers can't be chosen to collide in the array. Entries that can't be
+ * placed because the larger array can't be allocated are kept in an
+ * overflow list, so insertion never fails.
+ *
+ * The arrays are allocated from the pool given to #pj_hash_create(), so
+ * that pool must be usable whenever entries are inserted. While iterating
+ * the table, the application may delete the current entry or the entries
+ * already visited, but must not insert new entries.
+ *
+ * Default: 0
+ */
+#ifndef PJ_HASH_USE_OPEN_ADDRESSING
+#  define PJ_HASH_USE_OPEN_ADDRESSING	0
+#endif
+
+
 /**
  * Enable timer debugging facility. When this is enabled, application
  * can call pj_timer_heap_dump() to show the contents of the timer
@@ -583,6 +696,34 @@
 #  define PJ_TIMER_USE_LINKED_LIST    0
 #endif
 
+
+/**
+ * If enabled, the timer heap API is implemented with a hashed hierarchical
+ * timing wheel (timer_wheel.c) instead of the binary heap (timer.c).
+ * Scheduling and cancelling a timer are O(1), and expired entries are
+ * collected a whole wheel slot at a time. Expiration is rounded up to
+ * PJ_TIMER_WHEEL_RESOLUTION, timers never fire early.
+ *
+ * The wheel always keeps its own copy of the scheduled entries, as if
+ * PJ_TIMER_USE_COPY were enabled. PJ_TIMER_USE_LINKED_LIST is ignored.
+ *
+ * Default: 0 (Use binary heap tree)
+ */
+#ifndef PJ_TIMER_USE_WHEEL
+#  define PJ_TIMER_USE_WHEEL	    0
+#endif
+
+
+/**
+ * Tick length of the timing wheel, in milliseconds. This must be a divisor
+ * of 1000. Only used when PJ_TIMER_USE_WHEEL is enabled.
+ *
+ * Default: 10
+ */
+#ifndef PJ_TIMER_WHEEL_RESOLUTION
+#  define PJ_TIMER_WHEEL_RESOLUTION   10
+#endif
+
 /**
  * Set this to 1 to enable debugging on the group lock. Default: 0
  */
@@ -664,6 +805,41 @@
 #   define PJ_ACTIVESOCK_MAX_CONSECUTIVE_ACCEPT_ERROR 50
 #endif
 
+/**
+ * Enable batched datagram I/O with recvmmsg() and sendmmsg(). When this
+ * is enabled, #pj_sock_recvmmsg() and #pj_sock_sendmmsg() are available,
+ * and the ioqueue uses them to complete several pending recvfrom() or
+ * queued sendto() operations of a datagram socket with one system call
+ * per readiness event. The calls are only provided by Linux (lwIP does
+ * not have them).
+ *
+ * Default: 0
+ */
+#ifndef PJ_HAS_SOCK_MMSG
+#   define PJ_HAS_SOCK_MMSG		0
+#endif
+
+/**
+ * Maximum number of datagrams transferred by a single recvmmsg() or
+ * sendmmsg() call. The message headers are kept on the stack.
+ *
+ * Default: 16
+ */
+#ifndef PJ_SOCK_MAX_MMSG
+#   define PJ_SOCK_MAX_MMSG		16
+#endif
+
+/**
+ * Maximum number of buffers given to a single scatter-gather send (see
+ * #pj_sock_sendv() and #pj_ioqueue_sendv()). The native iovec array is
+ * kept on the stack.
+ *
+ * Default: 16
+ */
+#ifndef PJ_SOCK_MAX_IOV
+#   define PJ_SOCK_MAX_IOV		16
+#endif
+
 /**
  * Constants for declaring the maximum handles that can be supported by
  * a single IOQ framework. This constant might not be relevant to the
@@ -676,6 +852,29 @@
 #endif
 
 
+/*
+ * I/O queue implementation.
+ * Select one of these implementations in PJ_IOQUEUE_IMP.
+ */
+#define PJ_IOQUEUE_IMP_SELECT	    1	/**< Using select().	    */
+#define PJ_IOQUEUE_IMP_EPOLL	    2	/**< Using Linux epoll().   */
+
+
+/**
+ * Select which I/O queue implementation to use. Only the selected
+ * backend is compiled, the other ioqueue sources compile to nothing.
+ *
+ * PJ_IOQUEUE_IMP_EPOLL is only available on Linux. It is not bound by
+ * FD_SETSIZE, so PJ_IOQUEUE_MAX_HANDLES is not enforced there; the
+ * maximum is the \a max_fd given to #pj_ioqueue_create().
+ *
+ * Default: PJ_IOQUEUE_IMP_SELECT
+ */
+#ifndef PJ_IOQUEUE_IMP
+#   define PJ_IOQUEUE_IMP		PJ_IOQUEUE_IMP_SELECT
+#endif
+
+
 /**
  * If PJ_IOQUEUE_HAS_SAFE_UNREG macro is defined, then ioqueue will do more
  * things to ensure thread safety of handle unregistration operation by
@@ -723,6 +922,19 @@
 #endif
 
 
+/**
+ * Enable read buffer lending in the ioqueue. A datagram key can be given a
+ * slab of reference counted buffers with #pj_ioqueue_set_slab(), and
+ * recvfrom() started without a buffer then borrows one from the slab
+ * when a datagram arrives. Receivers that need the packet after the
+ * callback returns keep a reference to the buffer instead of copying it.
+ *
+ * Default: 0
+ */
+#ifndef PJ_IOQUEUE_HAS_BUF_LENDING
+#   define PJ_IOQUEUE_HAS_BUF_LENDING	0
+#endif
+
 /**
  * When safe unregistration (PJ_IOQUEUE_HAS_SAFE_UNREG) is configured in
  * ioqueue, the PJ_IOQUEUE_KEY_FREE_DELAY macro specifies how long the
@@ -811,6 +1023,23 @@
 #endif
 
 
+/**
+ * Implement atomic variables (#pj_atomic_t) with the compiler's __atomic
+ * builtins instead of a mutex. With this enabled, pj_atomic_create() does
+ * not create a mutex and the atomic operations never block.
+ *
+ * Default: 1 if the compiler provides the __atomic builtins (GCC 4.7 or
+ * later, clang), otherwise 0.
+ */
+#ifndef PJ_ATOMIC_USE_BUILTINS
+#   if defined(__ATOMIC_SEQ_CST)
+#	define PJ_ATOMIC_USE_BUILTINS	1
+#   else
+#	define PJ_ATOMIC_USE_BUILTINS	0
+#   endif
+#endif
+
+
 /**
  * Maximum file name length.
  */
@@ -994,6 +1223,36 @@
 #endif
 
 
+/**
+ * Maximum number of TLS sessions kept for session resumption by the
+ * OpenSSL backend (OpenSSL 1.1.0 or later), in each of the client cache
+ * (keyed by remote address and server name) and the server cache (keyed
+ * by session ID). When enabled, all server contexts also share the same
+ * session ticket keys, so a ticket issued on one connection is accepted
+ * on the next one. Set to zero to always do full handshakes.
+ *
+ * The ticket keys are generated randomly on first use and are not
+ * rotated until pj_shutdown(). Anyone who obtains them can decrypt the
+ * sessions resumed with tickets issued since, so applications that need
+ * forward secrecy across long uptimes should keep this disabled.
+ *
+ * Default: 0
+ */
+#ifndef PJ_SSL_SOCK_SESS_CACHE_SIZE
+#  define PJ_SSL_SOCK_SESS_CACHE_SIZE	0
+#endif
+
+
+/**
+ * Lifetime of a cached TLS session, in seconds.
+ *
+ * Default: 300
+ */
+#ifndef PJ_SSL_SOCK_SESS_CACHE_TIMEOUT
+#  define PJ_SSL_SOCK_SESS_CACHE_TIMEOUT	300
+#endif
+
+
 /**
  * Disable WSAECONNRESET error for UDP sockets on Win32 platforms. See
  * https://trac.pjsip.org/repos/ticket/1197.
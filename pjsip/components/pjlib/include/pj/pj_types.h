@@ -265,6 +265,13 @@ typedef void pj_sockaddr_t;
 /** Forward declaration. */
 typedef struct pj_sockaddr_in pj_sockaddr_in;
 
+/** One buffer of a scatter-gather send (see #pj_sock_sendv()). */
+typedef struct pj_iovec_t
+{
+    void	*buf;	/**< The data.		    */
+    pj_size_t	 len;	/**< The length of the data.  */
+} pj_iovec_t;
+
 /** Color type. */
 typedef unsigned int pj_color_t;
 
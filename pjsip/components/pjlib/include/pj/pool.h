@@ -860,9 +860,51 @@ struct pj_caching_pool
      * Mutex.
      */
     pj_lock_t	   *lock;
+
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    /**
+     * Thread local index of the per-thread cache.
+     */
+    long	    thread_cache_tls;
+
+    /**
+     * List of per-thread caches that have been created.
+     */
+    pj_list	    thread_cache_list;
+
+    /**
+     * Number of per-thread caches that have been created.
+     */
+    unsigned	    thread_cache_cnt;
+#endif
 };
 
 
+/**
+ * Statistics of the per-thread cache of a caching pool, see
+ * #pj_caching_pool_get_thread_cache_stat().
+ */
+typedef struct pj_caching_pool_thread_cache_stat
+{
+    /** Number of threads that have a cache. */
+    unsigned	    thread_cnt;
+
+    /** Number of pools currently held in the thread caches. */
+    pj_size_t	    cached_cnt;
+
+    /** Number of pools created from the thread cache, without locking. */
+    pj_size_t	    hits;
+
+    /** Number of pools created after taking the lock. */
+    pj_size_t	    misses;
+
+    /** Number of pools released by a different thread than the one
+     *  that created them. */
+    pj_size_t	    cross_thread_frees;
+
+} pj_caching_pool_thread_cache_stat;
+
+
 
 /**
  * Initialize caching pool.
@@ -887,6 +929,35 @@ PJ_DECL(void) pj_caching_pool_init( pj_caching_pool *ch_pool,
  */
 PJ_DECL(void) pj_caching_pool_destroy( pj_caching_pool *ch_pool );
 
+/**
+ * Release the per-thread cache of the calling thread: its pools are moved
+ * to the shared free list (or destroyed if that would exceed the maximum
+ * capacity) and the cache itself is freed. pjlib has no hook to run when
+ * a thread exits, so a thread that has used the caching pool and exits
+ * before #pj_caching_pool_destroy() is called should call this function
+ * first, otherwise its cache is only reclaimed when the caching pool is
+ * destroyed. This function does nothing if the caching pool is built
+ * without PJ_CACHING_POOL_HAS_THREAD_CACHE.
+ *
+ * @param ch_pool	The caching pool.
+ */
+PJ_DECL(void) pj_caching_pool_release_thread_cache( pj_caching_pool *ch_pool );
+
+/**
+ * Get the statistics of the per-thread cache of the caching pool. The
+ * counters are updated without locking, so they are only approximate
+ * while other threads are using the pool factory.
+ *
+ * @param ch_pool	The caching pool.
+ * @param stat		Structure to receive the statistics.
+ *
+ * @return		PJ_SUCCESS, or PJ_ENOTSUP if the caching pool is
+ *			built without PJ_CACHING_POOL_HAS_THREAD_CACHE.
+ */
+PJ_DECL(pj_status_t) pj_caching_pool_get_thread_cache_stat(
+				    pj_caching_pool *ch_pool,
+				    pj_caching_pool_thread_cache_stat *stat);
+
 /**
  * @}	// PJ_CACHING_POOL
  */
@@ -1344,6 +1344,91 @@ PJ_DECL(pj_status_t) pj_sock_sendto(pj_sock_t sockfd,
 				    const pj_sockaddr_t *to,
 				    int tolen);
 
+/**
+ * Transmit data from several buffers with one sendmsg() call, as if the
+ * buffers were concatenated.
+ *
+ * @param sockfd	The socket descriptor.
+ * @param iov		Array of buffers.
+ * @param iovcnt	Number of buffers in the array, at most
+ *			PJ_SOCK_MAX_IOV.
+ * @param len		Upon return, it will be filled with the total
+ *			length of data sent, which may be less than the
+ *			total length of the buffers for stream sockets.
+ * @param flags		Flags (such as pj_MSG_DONTROUTE()).
+ *
+ * @return		PJ_SUCCESS or the status code.
+ */
+PJ_DECL(pj_status_t) pj_sock_sendv(pj_sock_t sockfd,
+				   const pj_iovec_t iov[],
+				   unsigned iovcnt,
+				   pj_ssize_t *len,
+				   unsigned flags);
+
+#if PJ_HAS_SOCK_MMSG
+/**
+ * This structure describes one datagram of a batched receive or send
+ * operation (see #pj_sock_recvmmsg() and #pj_sock_sendmmsg()).
+ */
+typedef struct pj_sock_mmsg
+{
+    /** The datagram buffer. */
+    void	    *buf;
+
+    /** On input, the size of the buffer (receive) or the length of the
+     *  datagram (send). Upon return, the number of bytes transferred. */
+    pj_ssize_t	     len;
+
+    /** The source address (receive) or destination address (send). May
+     *  be NULL for receive, or for send on a connected socket. */
+    pj_sockaddr_t   *addr;
+
+    /** The length of the address. For receive, it is filled with the
+     *  actual length of the source address upon return. */
+    int		     addr_len;
+
+} pj_sock_mmsg;
+
+/**
+ * Receive several datagrams with one recvmmsg() call. The function waits
+ * for the first datagram only (according to the blocking mode of the
+ * socket) and then returns whatever is already queued in the socket.
+ *
+ * @param sockfd	The socket descriptor.
+ * @param msg		Array of datagram descriptors.
+ * @param count		On input, the number of entries in the array. At
+ *			most PJ_SOCK_MAX_MMSG entries are used. Upon return,
+ *			the number of datagrams received.
+ * @param flags		Flags (such as pj_MSG_PEEK()).
+ *
+ * @return		PJ_SUCCESS if at least one datagram has been
+ *			received, or the error code.
+ */
+PJ_DECL(pj_status_t) pj_sock_recvmmsg(pj_sock_t sockfd,
+				      pj_sock_mmsg msg[],
+				      unsigned *count,
+				      unsigned flags);
+
+/**
+ * Transmit several datagrams with one sendmmsg() call.
+ *
+ * @param sockfd	The socket descriptor.
+ * @param msg		Array of datagram descriptors.
+ * @param count		On input, the number of entries in the array. At
+ *			most PJ_SOCK_MAX_MMSG entries are used. Upon return,
+ *			the number of datagrams sent, which may be less
+ *			than requested.
+ * @param flags		Flags (such as pj_MSG_DONTROUTE()).
+ *
+ * @return		PJ_SUCCESS if at least one datagram has been sent,
+ *			or the error code of the first datagram.
+ */
+PJ_DECL(pj_status_t) pj_sock_sendmmsg(pj_sock_t sockfd,
+				      pj_sock_mmsg msg[],
+				      unsigned *count,
+				      unsigned flags);
+#endif	/* PJ_HAS_SOCK_MMSG */
+
 #if PJ_HAS_TCP
 /**
  * The shutdown call causes all or part of a full-duplex connection on the
@@ -781,6 +781,24 @@ typedef struct pj_ssl_sock_info
      */
     unsigned long	last_native_err;
 
+    /**
+     * Whether the handshake resumed a cached TLS session (see
+     * PJ_SSL_SOCK_SESS_CACHE_SIZE).
+     */
+    pj_bool_t		session_reused;
+
+    /**
+     * Number of completed handshakes, process wide, which resumed a
+     * session while the session cache is enabled.
+     */
+    unsigned		session_cache_hits;
+
+    /**
+     * Number of completed handshakes, process wide, which had to do a
+     * full handshake while the session cache is enabled.
+     */
+    unsigned		session_cache_misses;
+
     /**
      * Group lock assigned to the ioqueue key.
      */
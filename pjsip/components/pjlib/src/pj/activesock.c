@@ -617,6 +617,13 @@ static void ioqueue_on_read_complete(pj_ioqueue_key_t *key,
 	flags = asock->read_flags;
 	if (++loop >= asock->max_loop)
 	    flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
+#if PJ_HAS_SOCK_MMSG
+	/* Keep the reads of a datagram socket pending, so that the ioqueue
+	 * can fill all of them with one recvmmsg() on the next event.
+	 */
+	if (!asock->stream_oriented && asock->async_count > 1)
+	    flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
+#endif
 
 	if (asock->read_type == TYPE_RECV) {
 	    status = pj_ioqueue_recv(key, op_key, r->pkt + r->size, 
@@ -721,6 +728,27 @@ PJ_DEF(pj_status_t) pj_activesock_send( pj_activesock_t *asock,
 }
 
 
+PJ_DEF(pj_status_t) pj_activesock_sendv( pj_activesock_t *asock,
+					 pj_ioqueue_op_key_t *send_key,
+					 const pj_iovec_t iov[],
+					 unsigned iovcnt,
+					 pj_ssize_t *size,
+					 unsigned flags)
+{
+    PJ_ASSERT_RETURN(asock && send_key && iov && iovcnt && size, PJ_EINVAL);
+
+    if (asock->shutdown & SHUT_TX)
+	return PJ_EINVALIDOP;
+
+    /* The ioqueue itself completes sendv() with the whole data, so
+     * whole_data needs no extra handling here.
+     */
+    send_key->activesock_data = NULL;
+
+    return pj_ioqueue_sendv(asock->key, send_key, iov, iovcnt, size, flags);
+}
+
+
 PJ_DEF(pj_status_t) pj_activesock_sendto( pj_activesock_t *asock,
 					  pj_ioqueue_op_key_t *send_key,
 					  const void *data,
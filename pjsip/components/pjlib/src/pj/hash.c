@@ -25,6 +25,8 @@
 #include <pj/pj_ctype.h>
 #include <pj/pj_assert.h>
 
+#if !PJ_HASH_USE_OPEN_ADDRESSING
+
 /**
  * The hash multiplier used to calculate hash value.
  */
@@ -362,4 +364,4 @@ void pj_hash_dump_collision( pj_hash_table_t *ht )
 }
 #endif
 
-
+#endif	/* !PJ_HASH_USE_OPEN_ADDRESSING */
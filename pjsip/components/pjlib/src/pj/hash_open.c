@@ -0,0 +1,683 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * hash_open.c
+ *
+ * Open addressing implementation of the hash table API, used instead of
+ * hash.c when PJ_HASH_USE_OPEN_ADDRESSING is enabled.
+ *
+ * The table is an array of 2^n (hash value, entry) slots with linear
+ * probing, wrapping around at the end of the array. The home position of
+ * a hash value is mixed with a random seed of the table, so that a remote
+ * peer can't choose keys that pile up at the same position. Deleting an
+ * entry shifts the following entries of its cluster back (backward shift
+ * deletion, no tombstones).
+ *
+ * At least one slot of the array is always free, and one of them is kept
+ * as the start slot. Clusters never span the start slot, so walking the
+ * array downwards from there, entries are only ever shifted from slots
+ * already walked over. The iterator walks the array this way, which is
+ * why deleting visited entries while iterating is safe.
+ *
+ * When the table is 3/4 full, a new array twice as large is allocated and
+ * the entries of the old array are moved GROW_STEP slots at a time on each
+ * insertion, walking the old array the same way so that the remaining
+ * entries never need to be shifted.
+ *
+ * If the larger array can't be allocated and the current one is full,
+ * new entries are kept in an overflow list instead, so insertion never
+ * fails. The iterator visits the overflow list first.
+ */
+#include <pj/hash.h>
+#include <pj/log.h>
+#include <pj/pj_string.h>
+#include <pj/pool.h>
+#include <pj/pj_os.h>
+#include <pj/pj_ctype.h>
+#include <pj/pj_assert.h>
+#include <pj/pj_errno.h>
+#include <pj/rand.h>
+
+#if PJ_HASH_USE_OPEN_ADDRESSING
+
+/**
+ * The hash multiplier used to calculate hash value (2^32 / golden ratio).
+ */
+#define PJ_HASH_MULTIPLIER	0x9E3779B1UL
+
+/* Minimum number of slots, as power of two. */
+#define MIN_BITS		4
+
+/* Number of old array slots moved on each insertion while growing. */
+#define GROW_STEP		4
+
+/* Iterator index of the entries in the overflow list. */
+#define OVERFLOW_INDEX		0xFFFFFFFFUL
+
+
+struct pj_hash_entry
+{
+    struct pj_hash_entry *next;	/* Next entry in the overflow list  */
+    void *key;
+    pj_uint32_t hash;
+    pj_uint32_t keylen;
+    void *value;
+};
+
+typedef struct hash_slot
+{
+    pj_uint32_t	    hash;
+    pj_hash_entry  *entry;
+} hash_slot;
+
+typedef struct hash_array
+{
+    hash_slot	   *slots;
+    pj_uint32_t	    mask;	/* Number of slots - 1		    */
+    unsigned	    size;	/* Number of slots		    */
+    pj_uint32_t	    seed;	/* Mixed in the home positions	    */
+    unsigned	    used;	/* Number of used slots		    */
+    unsigned	    start;	/* A free slot, where walks start   */
+} hash_array;
+
+struct pj_hash_table_t
+{
+    pj_pool_t	   *pool;	/* Pool to allocate the arrays	    */
+    pj_uint32_t	    seed;	/* Random seed of the table	    */
+    hash_array	    cur;	/* Current array		    */
+    hash_array	    old;	/* Array being moved, if growing    */
+    unsigned	    old_top;	/* Old slots walked below this are
+				   not moved yet		    */
+    pj_hash_entry  *overflow;	/* Entries that can't be placed	    */
+    unsigned	    count;
+};
+
+
+/* Convert upper case ASCII letters in the word to lower case. */
+PJ_INLINE(pj_uint32_t) lower_word(pj_uint32_t w)
+{
+    pj_uint32_t heptets = w & 0x7F7F7F7FUL;
+    pj_uint32_t ge_a = heptets + 0x3F3F3F3FUL;	/* high bit if >= 'A' */
+    pj_uint32_t gt_z = heptets + 0x25252525UL;	/* high bit if > 'Z'  */
+
+    return w | (((ge_a ^ gt_z) & ~w & 0x80808080UL) >> 2);
+}
+
+PJ_INLINE(pj_uint32_t) hash_word(pj_uint32_t hash, pj_uint32_t w)
+{
+    return (((hash << 5) | (hash >> 27)) ^ w) * PJ_HASH_MULTIPLIER;
+}
+
+/* Calculate the hash of the key, four bytes at a time. If lower is set,
+ * the key is converted to lowercase, and stored in result if it's not
+ * NULL.
+ */
+static pj_uint32_t hash_key(pj_uint32_t hash, const void *key,
+			    unsigned keylen, char *result, pj_bool_t lower)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*)key;
+    unsigned n = keylen;
+    pj_uint32_t w;
+
+    for ( ; n >= 4; p += 4, n -= 4) {
+	pj_memcpy(&w, p, 4);
+	if (lower) {
+	    w = lower_word(w);
+	    if (result) {
+		pj_memcpy(result, &w, 4);
+		result += 4;
+	    }
+	}
+	hash = hash_word(hash, w);
+    }
+
+    w = 0;
+    switch (n) {
+    case 3:
+	w |= (pj_uint32_t)p[2] << 16;
+	/* Fallthrough */
+    case 2:
+	w |= (pj_uint32_t)p[1] << 8;
+	/* Fallthrough */
+    case 1:
+	w |= p[0];
+	if (lower) {
+	    w = lower_word(w);
+	    if (result) {
+		unsigned i;
+		for (i=0; i<n; ++i)
+		    result[i] = (char)(w >> (i * 8));
+	    }
+	}
+	hash = hash_word(hash, w);
+	break;
+    }
+
+    hash = hash_word(hash, keylen);
+    return hash ^ (hash >> 16);
+}
+
+PJ_DEF(pj_uint32_t) pj_hash_calc(pj_uint32_t hash, const void *key,
+				 unsigned keylen)
+{
+    PJ_CHECK_STACK();
+
+    if (keylen==PJ_HASH_KEY_STRING)
+	keylen = (unsigned)pj_ansi_strlen((const char*)key);
+
+    return hash_key(hash, key, keylen, NULL, PJ_FALSE);
+}
+
+PJ_DEF(pj_uint32_t) pj_hash_calc_tolower( pj_uint32_t hval,
+                                          char *result,
+                                          const pj_str_t *key)
+{
+    return hash_key(hval, key->ptr, (unsigned)key->slen, result, PJ_TRUE);
+}
+
+
+static pj_status_t alloc_array(pj_pool_t *pool, unsigned bits,
+			       pj_uint32_t seed, hash_array *arr)
+{
+    unsigned size = 1U << bits;
+
+    arr->slots = (hash_slot*) pj_pool_calloc(pool, size, sizeof(hash_slot));
+    if (!arr->slots)
+	return PJ_ENOMEM;
+
+    arr->mask = size - 1;
+    arr->size = size;
+    arr->seed = seed;
+    arr->used = 0;
+    arr->start = size - 1;
+    return PJ_SUCCESS;
+}
+
+static unsigned array_bits(const hash_array *arr)
+{
+    unsigned bits = 0;
+
+    while ((1U << bits) <= arr->mask)
+	++bits;
+    return bits;
+}
+
+/* Get the home position of the hash value, mixed with the table seed. */
+PJ_INLINE(unsigned) home_slot(const hash_array *arr, pj_uint32_t hash)
+{
+    hash ^= arr->seed;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BUL;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35UL;
+    hash ^= hash >> 16;
+    return hash & arr->mask;
+}
+
+/* Get the slot at the specified distance below the start slot plus one,
+ * i.e. the slot visited when pos slots are left in a walk.
+ */
+PJ_INLINE(hash_slot*) walk_slot(const hash_array *arr, unsigned pos)
+{
+    return &arr->slots[(arr->start + 1 + pos) & arr->mask];
+}
+
+/* Put the entry in the first free slot from its home position. One slot
+ * is always left free, so that probing stops.
+ */
+static pj_bool_t insert_slot(hash_array *arr, pj_uint32_t hash,
+			     pj_hash_entry *entry)
+{
+    unsigned i;
+
+    if (arr->used + 1 >= arr->size)
+	return PJ_FALSE;
+
+    for (i = home_slot(arr, hash); arr->slots[i].entry;
+	 i = (i + 1) & arr->mask)
+	;
+
+    arr->slots[i].hash = hash;
+    arr->slots[i].entry = entry;
+    ++arr->used;
+
+    /* The start slot must stay free, pick the next free one below */
+    while (arr->slots[arr->start].entry)
+	arr->start = (arr->start - 1) & arr->mask;
+
+    return PJ_TRUE;
+}
+
+/* Remove the slot, shifting back the following entries of the cluster
+ * that may be placed at the hole.
+ */
+static void remove_slot(hash_array *arr, unsigned hole)
+{
+    unsigned i;
+
+    for (i = (hole + 1) & arr->mask; arr->slots[i].entry;
+	 i = (i + 1) & arr->mask)
+    {
+	unsigned dist = (i - home_slot(arr, arr->slots[i].hash)) & arr->mask;
+
+	if (dist >= ((i - hole) & arr->mask)) {
+	    arr->slots[hole] = arr->slots[i];
+	    hole = i;
+	}
+    }
+
+    arr->slots[hole].entry = NULL;
+    --arr->used;
+}
+
+static hash_slot *find_slot(hash_array *arr, pj_uint32_t hash,
+			    const void *key, unsigned keylen,
+			    pj_bool_t lower)
+{
+    unsigned i;
+
+    for (i = home_slot(arr, hash); arr->slots[i].entry;
+	 i = (i + 1) & arr->mask)
+    {
+	hash_slot *slot = &arr->slots[i];
+
+	if (slot->hash==hash && slot->entry->keylen==keylen &&
+            ((lower && pj_ansi_strnicmp((const char*)slot->entry->key,
+        			        (const char*)key, keylen)==0) ||
+	     (!lower && pj_memcmp(slot->entry->key, key, keylen)==0)))
+	{
+	    return slot;
+	}
+    }
+
+    return NULL;
+}
+
+static void put_overflow(pj_hash_table_t *ht, pj_hash_entry *entry)
+{
+    PJ_LOG(4, ("hashtbl", "%p: p_entry %p put in overflow list", ht,
+	       entry));
+    entry->next = ht->overflow;
+    ht->overflow = entry;
+}
+
+/* Move some entries from the old array to the current array. The old
+ * array is walked down from its start slot, the entries not moved yet
+ * keep their probe sequence since it never crosses the start slot.
+ */
+static void grow_step(pj_hash_table_t *ht, unsigned count)
+{
+    while (ht->old.slots && count--) {
+	hash_slot *slot;
+
+	if (ht->old_top == 0) {
+	    ht->old.slots = NULL;
+	    break;
+	}
+
+	slot = walk_slot(&ht->old, ht->old_top - 1);
+	if (slot->entry) {
+	    if (!insert_slot(&ht->cur, slot->hash, slot->entry))
+		put_overflow(ht, slot->entry);
+	    slot->entry = NULL;
+	    --ht->old.used;
+	}
+	--ht->old_top;
+    }
+}
+
+static void start_grow(pj_hash_table_t *ht)
+{
+    hash_array arr;
+
+    /* Finish the previous growing first */
+    if (ht->old.slots)
+	grow_step(ht, ht->old_top + 1);
+
+    if (alloc_array(ht->pool, array_bits(&ht->cur) + 1, ht->seed,
+		    &arr) != PJ_SUCCESS)
+    {
+	return;
+    }
+
+    PJ_LOG(6, ("hashtbl", "%p: growing from %u to %u slots", ht,
+	       ht->cur.size, arr.size));
+
+    ht->old = ht->cur;
+    ht->old_top = ht->old.size;
+    ht->cur = arr;
+}
+
+static void insert_entry(pj_hash_table_t *ht, pj_uint32_t hash,
+			 pj_hash_entry *entry)
+{
+    if (ht->count + 1 > ht->cur.size / 4 * 3)
+	start_grow(ht);
+
+    grow_step(ht, GROW_STEP);
+
+    if (!insert_slot(&ht->cur, hash, entry))
+	put_overflow(ht, entry);
+
+    ++ht->count;
+}
+
+/* Find the link to the entry in the overflow list. */
+static pj_hash_entry **find_overflow( pj_hash_table_t *ht, pj_uint32_t hash,
+				      const void *key, unsigned keylen,
+				      pj_bool_t lower)
+{
+    pj_hash_entry **p_entry;
+
+    for (p_entry = &ht->overflow; *p_entry; p_entry = &(*p_entry)->next) {
+	pj_hash_entry *entry = *p_entry;
+
+	if (entry->hash==hash && entry->keylen==keylen &&
+            ((lower && pj_ansi_strnicmp((const char*)entry->key,
+        			        (const char*)key, keylen)==0) ||
+	     (!lower && pj_memcmp(entry->key, key, keylen)==0)))
+	{
+	    return p_entry;
+	}
+    }
+
+    return NULL;
+}
+
+
+PJ_DEF(pj_hash_table_t*) pj_hash_create(pj_pool_t *pool, unsigned size)
+{
+    pj_hash_table_t *h;
+    unsigned bits;
+
+    /* Check that PJ_HASH_ENTRY_BUF_SIZE is correct. */
+    PJ_ASSERT_RETURN(sizeof(pj_hash_entry)<=PJ_HASH_ENTRY_BUF_SIZE, NULL);
+
+    h = PJ_POOL_ZALLOC_T(pool, pj_hash_table_t);
+    h->pool = pool;
+    h->seed = ((pj_uint32_t)pj_rand() << 16) ^ (pj_uint32_t)pj_rand();
+
+    PJ_LOG( 6, ("hashtbl", "hash table %p created from pool %s", h, pj_pool_getobjname(pool)));
+
+    for (bits = MIN_BITS; bits < 31 && (1U << bits) < size; ++bits)
+	;
+
+    if (alloc_array(pool, bits, h->seed, &h->cur) != PJ_SUCCESS)
+	return NULL;
+
+    return h;
+}
+
+static hash_slot *find_entry( pj_hash_table_t *ht,
+			      const void *key, unsigned *keylen,
+			      pj_uint32_t *hval, pj_bool_t lower,
+			      hash_array **p_arr)
+{
+    pj_uint32_t hash;
+    hash_slot *slot;
+
+    if (*keylen==PJ_HASH_KEY_STRING)
+	*keylen = (unsigned)pj_ansi_strlen((const char*)key);
+
+    if (*hval != 0) {
+	hash = *hval;
+    } else {
+	hash = hash_key(0, key, *keylen, NULL, lower);
+	*hval = hash;
+    }
+
+    slot = find_slot(&ht->cur, hash, key, *keylen, lower);
+    if (slot) {
+	*p_arr = &ht->cur;
+	return slot;
+    }
+
+    if (ht->old.slots) {
+	slot = find_slot(&ht->old, hash, key, *keylen, lower);
+	if (slot) {
+	    *p_arr = &ht->old;
+	    return slot;
+	}
+    }
+
+    return NULL;
+}
+
+static void *hash_get( pj_hash_table_t *ht,
+		       const void *key, unsigned keylen,
+		       pj_uint32_t *hval, pj_bool_t lower )
+{
+    pj_uint32_t hash = hval ? *hval : 0;
+    hash_array *arr;
+    hash_slot *slot;
+
+    slot = find_entry(ht, key, &keylen, &hash, lower, &arr);
+
+    /* Report back the computed hash. */
+    if (hval)
+	*hval = hash;
+
+    if (slot)
+	return slot->entry->value;
+
+    if (ht->overflow) {
+	pj_hash_entry **p_entry;
+
+	p_entry = find_overflow(ht, hash, key, keylen, lower);
+	if (p_entry)
+	    return (*p_entry)->value;
+    }
+
+    return NULL;
+}
+
+PJ_DEF(void *) pj_hash_get( pj_hash_table_t *ht,
+			    const void *key, unsigned keylen,
+			    pj_uint32_t *hval)
+{
+    return hash_get(ht, key, keylen, hval, PJ_FALSE);
+}
+
+PJ_DEF(void *) pj_hash_get_lower( pj_hash_table_t *ht,
+			          const void *key, unsigned keylen,
+			          pj_uint32_t *hval)
+{
+    return hash_get(ht, key, keylen, hval, PJ_TRUE);
+}
+
+static void hash_set( pj_pool_t *pool, pj_hash_table_t *ht,
+	              const void *key, unsigned keylen, pj_uint32_t hval,
+		      void *value, void *entry_buf, pj_bool_t lower )
+{
+    hash_array *arr;
+    hash_slot *slot;
+    pj_hash_entry *entry;
+
+    slot = find_entry(ht, key, &keylen, &hval, lower, &arr);
+    if (slot) {
+	if (value == NULL) {
+	    /* delete entry */
+	    PJ_LOG(6, ("hashtbl", "%p: p_entry %p deleted", ht, slot->entry));
+	    remove_slot(arr, (unsigned)(slot - arr->slots));
+	    --ht->count;
+
+	} else {
+	    /* overwrite */
+	    slot->entry->value = value;
+	    PJ_LOG(6, ("hashtbl", "%p: p_entry %p value set to %p", ht,
+		       slot->entry, value));
+	}
+	return;
+    }
+
+    if (ht->overflow) {
+	pj_hash_entry **p_entry;
+
+	p_entry = find_overflow(ht, hval, key, keylen, lower);
+	if (p_entry) {
+	    if (value == NULL) {
+		/* delete entry, leaving its next pointer intact for
+		 * an iterator that is positioned on it.
+		 */
+		PJ_LOG(6, ("hashtbl", "%p: p_entry %p deleted", ht,
+			   *p_entry));
+		*p_entry = (*p_entry)->next;
+		--ht->count;
+	    } else {
+		(*p_entry)->value = value;
+	    }
+	    return;
+	}
+    }
+
+    if (value == NULL)
+	return;
+
+    /* Entry not found, create a new one.
+     * If entry_buf is specified, use it. Otherwise allocate from pool.
+     */
+    if (entry_buf) {
+	entry = (pj_hash_entry*)entry_buf;
+    } else {
+	/* Pool must be specified! */
+	PJ_ASSERT_ON_FAIL(pool != NULL, return);
+
+	entry = PJ_POOL_ALLOC_T(pool, pj_hash_entry);
+	PJ_LOG(6, ("hashtbl",
+		   "%p: New p_entry %p created, pool used=%u, cap=%u",
+		   ht, entry,  pj_pool_get_used_size(pool),
+		   pj_pool_get_capacity(pool)));
+    }
+    entry->hash = hval;
+    if (pool) {
+	entry->key = pj_pool_alloc(pool, keylen);
+	pj_memcpy(entry->key, key, keylen);
+    } else {
+	entry->key = (void*)key;
+    }
+    entry->keylen = keylen;
+    entry->value = value;
+    entry->next = NULL;
+
+    insert_entry(ht, hval, entry);
+}
+
+PJ_DEF(void) pj_hash_set( pj_pool_t *pool, pj_hash_table_t *ht,
+			  const void *key, unsigned keylen, pj_uint32_t hval,
+			  void *value )
+{
+    hash_set(pool, ht, key, keylen, hval, value, NULL, PJ_FALSE);
+}
+
+PJ_DEF(void) pj_hash_set_lower( pj_pool_t *pool, pj_hash_table_t *ht,
+			        const void *key, unsigned keylen,
+                                pj_uint32_t hval, void *value )
+{
+    hash_set(pool, ht, key, keylen, hval, value, NULL, PJ_TRUE);
+}
+
+PJ_DEF(void) pj_hash_set_np( pj_hash_table_t *ht,
+			     const void *key, unsigned keylen,
+			     pj_uint32_t hval, pj_hash_entry_buf entry_buf,
+			     void *value)
+{
+    hash_set(NULL, ht, key, keylen, hval, value, (void *)entry_buf, PJ_FALSE);
+}
+
+PJ_DEF(void) pj_hash_set_np_lower( pj_hash_table_t *ht,
+			           const void *key, unsigned keylen,
+			           pj_uint32_t hval,
+                                   pj_hash_entry_buf entry_buf,
+			           void *value)
+{
+    hash_set(NULL, ht, key, keylen, hval, value, (void *)entry_buf, PJ_TRUE);
+}
+
+PJ_DEF(unsigned) pj_hash_count( pj_hash_table_t *ht )
+{
+    return ht->count;
+}
+
+/* Find the next used slot below the index. Index counts the slots of the
+ * current array first, then the slots of the old array, in the order they
+ * are walked down from the start slot of the array.
+ */
+static pj_hash_iterator_t *iterate( pj_hash_table_t *ht,
+				    pj_hash_iterator_t *it,
+				    pj_uint32_t index )
+{
+    while (index-- > 0) {
+	hash_slot *slot;
+
+	if (index >= ht->cur.size) {
+	    if (!ht->old.slots)
+		continue;
+	    slot = walk_slot(&ht->old, index - ht->cur.size);
+	} else {
+	    slot = walk_slot(&ht->cur, index);
+	}
+
+	if (slot->entry) {
+	    it->index = index;
+	    it->entry = slot->entry;
+	    return it;
+	}
+    }
+
+    it->entry = NULL;
+    return NULL;
+}
+
+PJ_DEF(pj_hash_iterator_t*) pj_hash_first( pj_hash_table_t *ht,
+					   pj_hash_iterator_t *it )
+{
+    if (ht->overflow) {
+	it->index = OVERFLOW_INDEX;
+	it->entry = ht->overflow;
+	return it;
+    }
+
+    return iterate(ht, it, ht->cur.size + (ht->old.slots ? ht->old_top : 0));
+}
+
+PJ_DEF(pj_hash_iterator_t*) pj_hash_next( pj_hash_table_t *ht,
+					  pj_hash_iterator_t *it )
+{
+    if (it->index == OVERFLOW_INDEX) {
+	if (it->entry->next) {
+	    it->entry = it->entry->next;
+	    return it;
+	}
+	return iterate(ht, it,
+		       ht->cur.size + (ht->old.slots ? ht->old_top : 0));
+    }
+
+    return iterate(ht, it, it->index);
+}
+
+PJ_DEF(void*) pj_hash_this( pj_hash_table_t *ht, pj_hash_iterator_t *it )
+{
+    PJ_CHECK_STACK();
+    PJ_UNUSED_ARG(ht);
+    return it->entry->value;
+}
+
+#endif	/* PJ_HASH_USE_OPEN_ADDRESSING */
@@ -31,19 +31,13 @@
 #include <pj/pj_assert.h>
 #include <pj/pj_string.h>
 #include <pj/pj_os.h>
+#include <pj/pool.h>
 #include <pj/sock_select.h>
 #include "lwip/sockets.h"
 #include "ioqueue_common_abs.h"
  
 #define PENDING_RETRY	2
 
-static void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
-                                pj_ioqueue_key_t *key,
-                                enum ioqueue_event_type event_type );
-
-static void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
-                                     pj_ioqueue_key_t *key, 
-                                     enum ioqueue_event_type event_type);
 /*
  * pj_ioqueue_set_lock()
  */
@@ -90,37 +84,454 @@ PJ_DEF(pj_status_t) pj_ioqueue_set_user_data( pj_ioqueue_key_t *key,
     return PJ_SUCCESS;
 }
 
-/* ioqueue_remove_from_set()
- * This function is called from ioqueue_dispatch_event() to instruct
- * the ioqueue to remove the specified descriptor from ioqueue's descriptor
- * set for the specified event.
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+/*
+ * Header placed in front of every buffer of a slab.
  */
-static void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
-                                     pj_ioqueue_key_t *key, 
-                                     enum ioqueue_event_type event_type)
+struct slab_buf
 {
-    pj_lock_acquire(ioqueue->lock);
+    pj_ioqueue_slab	*slab;
+    struct slab_buf	*next;		/* Next free buffer.		    */
+    unsigned		 ref_cnt;
+};
 
-    if (event_type == READABLE_EVENT)
-        PJ_FD_CLR((pj_sock_t)key->fd, &ioqueue->rfdset);
-    else if (event_type == WRITEABLE_EVENT)
-        PJ_FD_CLR((pj_sock_t)key->fd, &ioqueue->wfdset);
-#if defined(PJ_HAS_TCP) && PJ_HAS_TCP!=0
-    else if (event_type == EXCEPTION_EVENT)
-        PJ_FD_CLR((pj_sock_t)key->fd, &ioqueue->xfdset);
+/* Header size, rounded up to keep the buffers 8 bytes aligned */
+#define SLAB_HDR_SIZE	((sizeof(struct slab_buf) + 7) & ~7)
+#define SLAB_HDR(buf)	((struct slab_buf*)((char*)(buf) - SLAB_HDR_SIZE))
+#define SLAB_DATA(hdr)	((void*)((char*)(hdr) + SLAB_HDR_SIZE))
+
+struct pj_ioqueue_slab
+{
+    pj_pool_t		*pool;
+    pj_lock_t		*lock;
+    unsigned		 buf_size;
+    struct slab_buf	*free_list;
+    unsigned		 ref_cnt;	/* Owner + buffers in use.	    */
+};
+
+/*
+ * Drop a reference to the slab, and free its memory when the owner has
+ * destroyed it and all buffers have been returned. The slab lock must
+ * be held by the caller, and it will be released on return.
+ */
+static void slab_dec_ref_and_unlock(pj_ioqueue_slab *slab)
+{
+    pj_assert(slab->ref_cnt > 0);
+    if (--slab->ref_cnt == 0) {
+	pj_lock_release(slab->lock);
+	pj_lock_destroy(slab->lock);
+	pj_pool_release(slab->pool);
+    } else {
+	pj_lock_release(slab->lock);
+    }
+}
+
+/*
+ * pj_ioqueue_slab_create()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_slab_create( pj_pool_t *pool,
+					    unsigned buf_size,
+					    unsigned buf_cnt,
+					    pj_ioqueue_slab **p_slab)
+{
+    pj_pool_t *slab_pool;
+    pj_ioqueue_slab *slab;
+    unsigned i, stride;
+    char *mem;
+    pj_status_t rc;
+
+    PJ_ASSERT_RETURN(pool && buf_size && buf_cnt && p_slab, PJ_EINVAL);
+
+    /* The slab has its own pool, since lent buffers may outlive the
+     * owner of the slab.
+     */
+    stride = SLAB_HDR_SIZE + ((buf_size + 7) & ~7);
+    slab_pool = pj_pool_create(pool->factory, "ioqslab%p",
+			       stride * buf_cnt + 512, 512, NULL);
+    if (!slab_pool)
+	return PJ_ENOMEM;
+
+    slab = PJ_POOL_ZALLOC_T(slab_pool, pj_ioqueue_slab);
+    slab->pool = slab_pool;
+    slab->buf_size = buf_size;
+    slab->ref_cnt = 1;
+
+    rc = pj_lock_create_simple_mutex(slab_pool, "ioqslab%p", &slab->lock);
+    if (rc != PJ_SUCCESS) {
+	pj_pool_release(slab_pool);
+	return rc;
+    }
+
+    mem = (char*) pj_pool_alloc(slab_pool, stride * buf_cnt);
+    for (i=buf_cnt; i>0; --i) {
+	struct slab_buf *hdr = (struct slab_buf*)(mem + (i-1) * stride);
+
+	hdr->slab = slab;
+	hdr->ref_cnt = 0;
+	hdr->next = slab->free_list;
+	slab->free_list = hdr;
+    }
+
+    *p_slab = slab;
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_slab_destroy()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_slab_destroy(pj_ioqueue_slab *slab)
+{
+    PJ_ASSERT_RETURN(slab, PJ_EINVAL);
+
+    /* Buffers still in use keep the slab alive */
+    pj_lock_acquire(slab->lock);
+    slab_dec_ref_and_unlock(slab);
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_set_slab()
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_set_slab( pj_ioqueue_key_t *key,
+					 pj_ioqueue_slab *slab)
+{
+    PJ_ASSERT_RETURN(key, PJ_EINVAL);
+    PJ_ASSERT_RETURN(key->fd_type == pj_SOCK_DGRAM(), PJ_EINVALIDOP);
+
+    pj_ioqueue_lock_key(key);
+    key->slab = slab;
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_get_lent_buf()
+ */
+PJ_DEF(void*) pj_ioqueue_get_lent_buf(pj_ioqueue_op_key_t *op_key)
+{
+    PJ_ASSERT_RETURN(op_key, NULL);
+    return ((struct read_operation*)op_key)->lent;
+}
+
+/*
+ * pj_ioqueue_buf_add_ref()
+ */
+PJ_DEF(void) pj_ioqueue_buf_add_ref(void *buf)
+{
+    struct slab_buf *hdr = SLAB_HDR(buf);
+
+    pj_lock_acquire(hdr->slab->lock);
+    pj_assert(hdr->ref_cnt > 0);
+    ++hdr->ref_cnt;
+    pj_lock_release(hdr->slab->lock);
+}
+
+/*
+ * pj_ioqueue_buf_dec_ref()
+ */
+PJ_DEF(void) pj_ioqueue_buf_dec_ref(void *buf)
+{
+    struct slab_buf *hdr = SLAB_HDR(buf);
+    pj_ioqueue_slab *slab = hdr->slab;
+
+    pj_lock_acquire(slab->lock);
+    pj_assert(hdr->ref_cnt > 0);
+    if (--hdr->ref_cnt == 0) {
+	hdr->next = slab->free_list;
+	slab->free_list = hdr;
+	slab_dec_ref_and_unlock(slab);
+    } else {
+	pj_lock_release(slab->lock);
+    }
+}
+
+/*
+ * Attach a buffer from the key's slab to a lent read which is about to
+ * receive a datagram. Returns PJ_FALSE if all buffers are in use.
+ */
+static pj_bool_t lend_buf(pj_ioqueue_key_t *h, struct read_operation *read_op)
+{
+    pj_ioqueue_slab *slab = h->slab;
+    struct slab_buf *hdr;
+
+    if (!slab)
+	return PJ_FALSE;
+
+    pj_lock_acquire(slab->lock);
+    hdr = slab->free_list;
+    if (hdr) {
+	slab->free_list = hdr->next;
+	hdr->ref_cnt = 1;
+	++slab->ref_cnt;
+    }
+    pj_lock_release(slab->lock);
+
+    if (!hdr)
+	return PJ_FALSE;
+
+    read_op->buf = read_op->lent = SLAB_DATA(hdr);
+    read_op->size = slab->buf_size;
+    return PJ_TRUE;
+}
+
+/*
+ * Take back the buffer lent to a read that did not get any data, and
+ * make the read a lent one again.
+ */
+static void unlend_buf(struct read_operation *read_op)
+{
+    pj_ioqueue_buf_dec_ref(read_op->lent);
+    read_op->buf = read_op->lent = NULL;
+}
+
+/*
+ * ioqueue_release_lent_bufs()
+ */
+void ioqueue_release_lent_bufs(pj_ioqueue_key_t *key)
+{
+    struct read_operation *read_op;
+
+    for (read_op = key->read_list.next; read_op != &key->read_list;
+	 read_op = read_op->next)
+    {
+	if (read_op->lent)
+	    unlend_buf(read_op);
+    }
+}
+
+/*
+ * Drop the datagram at the head of the socket queue when there is no
+ * buffer to lend for it.
+ */
+static void discard_datagram(pj_ioqueue_key_t *h)
+{
+    char buf[1];
+    pj_ssize_t size = sizeof(buf);
+
+    pj_sock_recv(h->fd, buf, &size, 0);
+}
+#endif	/* PJ_IOQUEUE_HAS_BUF_LENDING */
+
+#if PJ_HAS_SOCK_MMSG
+/*
+ * Complete up to PJ_SOCK_MAX_MMSG pending recvfrom() operations of a
+ * datagram key with a single recvmmsg(). The key must be locked by the
+ * caller, and it will be unlocked on return.
+ */
+static void dispatch_read_batch( pj_ioqueue_t *ioqueue,
+				 pj_ioqueue_key_t *h )
+{
+    struct read_operation *op[PJ_SOCK_MAX_MMSG];
+    pj_ssize_t bytes_read[PJ_SOCK_MAX_MMSG];
+    pj_sock_mmsg msg[PJ_SOCK_MAX_MMSG];
+    struct read_operation *read_op;
+    unsigned i, cnt, done, flags;
+    pj_bool_t has_lock;
+    pj_status_t rc;
+
+    /* Take the consecutive recvfrom() operations with the same flags. */
+    flags = h->read_list.next->flags;
+    cnt = 0;
+    for (read_op = h->read_list.next; 
+	 read_op != &h->read_list && cnt < PJ_SOCK_MAX_MMSG &&
+	 read_op->op == PJ_IOQUEUE_OP_RECV_FROM && read_op->flags == flags;
+	 read_op = read_op->next)
+    {
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	if (read_op->buf == NULL && !lend_buf(h, read_op))
+	    break;
+#endif
+	msg[cnt].buf = read_op->buf;
+	msg[cnt].len = read_op->size;
+	msg[cnt].addr = read_op->rmt_addr;
+	msg[cnt].addr_len = read_op->rmt_addrlen ? *read_op->rmt_addrlen : 0;
+	op[cnt++] = read_op;
+    }
+
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    if (cnt == 0) {
+	/* All buffers of the slab are held by the receivers */
+	discard_datagram(h);
+	pj_ioqueue_unlock_key(h);
+	return;
+    }
+#endif
+
+    done = cnt;
+    rc = pj_sock_recvmmsg(h->fd, msg, &done, flags);
+    if (rc == PJ_SUCCESS) {
+	for (i=0; i<done; ++i) {
+	    bytes_read[i] = msg[i].len;
+	    if (op[i]->rmt_addrlen)
+		*op[i]->rmt_addrlen = msg[i].addr_len;
+	}
+    } else {
+	/* Report the error with the first operation, as recvfrom() would */
+	bytes_read[0] = -rc;
+	done = 1;
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	if (op[0]->lent)
+	    unlend_buf(op[0]);
+#endif
+    }
+
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    /* Take back the buffers of the reads that stay pending. */
+    for (i=done; i<cnt; ++i) {
+	if (op[i]->lent)
+	    unlend_buf(op[i]);
+    }
+#endif
+
+    /* The operations that did not get a datagram stay pending. */
+    for (i=0; i<done; ++i) {
+	pj_list_erase(op[i]);
+	op[i]->op = PJ_IOQUEUE_OP_NONE;
+    }
+    if (pj_list_empty(&h->read_list))
+	ioqueue_remove_from_set(ioqueue, h, READABLE_EVENT);
+
+    /* Unlock; from this point we don't need to hold key's mutex
+     * (unless concurrency is disabled, which in this case we should
+     * hold the mutex while calling the callback) */
+    if (h->allow_concurrent) {
+	has_lock = PJ_FALSE;
+	pj_ioqueue_unlock_key(h);
+	PJ_RACE_ME(5);
+    } else {
+	has_lock = PJ_TRUE;
+    }
+
+    /* Call callback for each datagram, in the order of arrival. */
+    for (i=0; i<done; ++i) {
+	if (!h->cb.on_read_complete || IS_CLOSING(h))
+	    break;
+	(*h->cb.on_read_complete)(h, (pj_ioqueue_op_key_t*)op[i],
+				  bytes_read[i]);
+    }
+
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    /* Nobody will see the datagrams left when the key is closing. */
+    for (; i<done; ++i) {
+	if (op[i]->lent)
+	    unlend_buf(op[i]);
+    }
 #endif
-    else
-        pj_assert(0);
 
-    pj_lock_release(ioqueue->lock);
+    if (has_lock) {
+	pj_ioqueue_unlock_key(h);
+    }
 }
 
+/*
+ * Send up to PJ_SOCK_MAX_MMSG queued sendto() operations of a datagram
+ * key with a single sendmmsg(). The key must be locked by the caller,
+ * and it will be unlocked on return.
+ */
+static void dispatch_write_batch( pj_ioqueue_t *ioqueue,
+				  pj_ioqueue_key_t *h )
+{
+    struct write_operation *op[PJ_SOCK_MAX_MMSG];
+    pj_ssize_t written[PJ_SOCK_MAX_MMSG];
+    pj_sock_mmsg msg[PJ_SOCK_MAX_MMSG];
+    struct write_operation *write_op;
+    unsigned i, cnt, done, flags;
+    pj_bool_t has_lock;
+    pj_status_t rc;
+
+    /* Take the consecutive sendto() operations with the same flags. */
+    flags = h->write_list.next->flags;
+    cnt = 0;
+    for (write_op = h->write_list.next; 
+	 write_op != &h->write_list && cnt < PJ_SOCK_MAX_MMSG &&
+	 write_op->op == PJ_IOQUEUE_OP_SEND_TO && write_op->flags == flags;
+	 write_op = write_op->next)
+    {
+	msg[cnt].buf = write_op->buf;
+	msg[cnt].len = write_op->size;
+	msg[cnt].addr = &write_op->rmt_addr;
+	msg[cnt].addr_len = write_op->rmt_addrlen;
+	op[cnt++] = write_op;
+    }
+
+    done = cnt;
+    rc = pj_sock_sendmmsg(h->fd, msg, &done, flags);
+    if (rc == PJ_SUCCESS) {
+	for (i=0; i<done; ++i)
+	    written[i] = msg[i].len;
+    } else {
+	/* Report the error with the first operation, as sendto() would */
+	pj_assert(rc > 0);
+	written[0] = -rc;
+	done = 1;
+    }
+
+    /* The datagrams that were not sent stay in the queue. */
+    for (i=0; i<done; ++i) {
+	pj_list_erase(op[i]);
+	op[i]->written = written[i];
+	op[i]->op = PJ_IOQUEUE_OP_NONE;
+    }
+    if (pj_list_empty(&h->write_list))
+	ioqueue_remove_from_set(ioqueue, h, WRITEABLE_EVENT);
+
+    /* Unlock; from this point we don't need to hold key's mutex
+     * (unless concurrency is disabled, which in this case we should
+     * hold the mutex while calling the callback) */
+    if (h->allow_concurrent) {
+	has_lock = PJ_FALSE;
+	pj_ioqueue_unlock_key(h);
+	PJ_RACE_ME(5);
+    } else {
+	has_lock = PJ_TRUE;
+    }
+
+    /* Call callback. */
+    for (i=0; i<done; ++i) {
+	if (!h->cb.on_write_complete || IS_CLOSING(h))
+	    break;
+	(*h->cb.on_write_complete)(h, (pj_ioqueue_op_key_t*)op[i],
+				   written[i]);
+    }
+
+    if (has_lock) {
+	pj_ioqueue_unlock_key(h);
+    }
+}
+#endif	/* PJ_HAS_SOCK_MMSG */
+
 /*
  * ioqueue_dispatch_event()
  *
  * Report occurence of an event in the key to be processed by the
  * framework.
  */
+/*
+ * Send the part of a sendv() operation which has not been written yet.
+ */
+static pj_status_t send_iov_remaining(pj_ioqueue_key_t *h,
+				      struct write_operation *write_op,
+				      pj_ssize_t *sent)
+{
+    pj_iovec_t iov[PJ_SOCK_MAX_IOV];
+    pj_size_t skip = write_op->written;
+    unsigned i, cnt = 0;
+
+    for (i=0; i<write_op->iovcnt; ++i) {
+	if (skip >= write_op->iov[i].len) {
+	    skip -= write_op->iov[i].len;
+	    continue;
+	}
+	iov[cnt].buf = (char*)write_op->iov[i].buf + skip;
+	iov[cnt].len = write_op->iov[i].len - skip;
+	skip = 0;
+	++cnt;
+    }
+
+    return pj_sock_sendv(h->fd, iov, cnt, sent, write_op->flags);
+}
+
 pj_bool_t ioqueue_dispatch_write_event( pj_ioqueue_t *ioqueue,
 				        pj_ioqueue_key_t *h)
 {
@@ -220,6 +631,15 @@ pj_bool_t ioqueue_dispatch_write_event( pj_ioqueue_t *ioqueue,
 
     } else 
 #endif /* PJ_HAS_TCP */
+#if PJ_HAS_SOCK_MMSG
+    if (key_has_pending_write(h) && h->fd_type == pj_SOCK_DGRAM() &&
+	h->write_list.next->op == PJ_IOQUEUE_OP_SEND_TO &&
+	h->write_list.next->next != &h->write_list)
+    {
+	/* More than one datagram is queued, send them together. */
+	dispatch_write_batch(ioqueue, h);
+    } else
+#endif
     if (key_has_pending_write(h)) {
 	/* Socket is writable. */
         struct write_operation *write_op;
@@ -245,7 +665,9 @@ pj_bool_t ioqueue_dispatch_write_event( pj_ioqueue_t *ioqueue,
          * preventing parallel write on a single key.. :-((
          */
         sent = write_op->size - write_op->written;
-        if (write_op->op == PJ_IOQUEUE_OP_SEND) {
+        if (write_op->op == PJ_IOQUEUE_OP_SEND && write_op->iov) {
+	    send_rc = send_iov_remaining(h, write_op, &sent);
+        } else if (write_op->op == PJ_IOQUEUE_OP_SEND) {
             send_rc = pj_sock_send(h->fd, write_op->buf+write_op->written,
                                    &sent, write_op->flags);
 	    /* Can't do this. We only clear "op" after we're finished sending
@@ -421,6 +843,16 @@ pj_bool_t ioqueue_dispatch_read_event( pj_ioqueue_t *ioqueue,
 	}
     }
     else
+#   endif
+#   if PJ_HAS_SOCK_MMSG
+    if (key_has_pending_read(h) && h->fd_type == pj_SOCK_DGRAM() &&
+	h->read_list.next->op == PJ_IOQUEUE_OP_RECV_FROM &&
+	h->read_list.next->next != &h->read_list)
+    {
+	/* More than one recvfrom() is pending, fill them together. */
+	dispatch_read_batch(ioqueue, h);
+    }
+    else
 #   endif
     if (key_has_pending_read(h)) {
         struct read_operation *read_op;
@@ -429,6 +861,14 @@ pj_bool_t ioqueue_dispatch_read_event( pj_ioqueue_t *ioqueue,
 
         /* Get one pending read operation from the list. */
         read_op = h->read_list.next;
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	if (read_op->buf == NULL && !lend_buf(h, read_op)) {
+	    /* All buffers of the slab are held by the receivers */
+	    discard_datagram(h);
+	    pj_ioqueue_unlock_key(h);
+	    return PJ_TRUE;
+	}
+#endif
         pj_list_erase(read_op);
 
         /* Clear fdset if there is no pending read. */
@@ -498,6 +938,11 @@ pj_bool_t ioqueue_dispatch_read_event( pj_ioqueue_t *ioqueue,
             /* In any case we would report this to caller. */
             bytes_read = -rc;
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	    if (read_op->lent)
+		unlend_buf(read_op);
+#endif
+
 #if defined(PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT) && \
     PJ_IPHONE_OS_HAS_MULTITASKING_SUPPORT!=0
 	    /* Special treatment for dead UDP sockets here, see ticket #1107 */
@@ -532,6 +977,11 @@ pj_bool_t ioqueue_dispatch_read_event( pj_ioqueue_t *ioqueue,
                                       (pj_ioqueue_op_key_t*)read_op,
                                       bytes_read);
         }
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	else if (read_op->lent) {
+	    unlend_buf(read_op);
+	}
+#endif
 
 	if (has_lock) {
 	    pj_ioqueue_unlock_key(h);
@@ -620,32 +1070,6 @@ pj_bool_t ioqueue_dispatch_exception_event( pj_ioqueue_t *ioqueue,
     return PJ_TRUE;
 }
 
-/*
- * ioqueue_add_to_set()
- * This function is called from pj_ioqueue_recv(), pj_ioqueue_send() etc
- * to instruct the ioqueue to add the specified handle to ioqueue's descriptor
- * set for the specified event.
- */
-static void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
-                                pj_ioqueue_key_t *key,
-                                enum ioqueue_event_type event_type )
-{
-    pj_lock_acquire(ioqueue->lock);
-
-    if (event_type == READABLE_EVENT)
-        PJ_FD_SET((pj_sock_t)key->fd, &ioqueue->rfdset);
-    else if (event_type == WRITEABLE_EVENT)
-        PJ_FD_SET((pj_sock_t)key->fd, &ioqueue->wfdset);
-#if defined(PJ_HAS_TCP) && PJ_HAS_TCP!=0
-    else if (event_type == EXCEPTION_EVENT)
-        PJ_FD_SET((pj_sock_t)key->fd, &ioqueue->xfdset);
-#endif
-    else
-        pj_assert(0);
-
-    pj_lock_release(ioqueue->lock);
-}
-
 /*
  * pj_ioqueue_recv()
  *
@@ -736,17 +1160,42 @@ PJ_DEF(pj_status_t) pj_ioqueue_recvfrom( pj_ioqueue_key_t *key,
 {
     struct read_operation *read_op;
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    PJ_ASSERT_RETURN(key && op_key && length, PJ_EINVAL);
+    PJ_ASSERT_RETURN(buffer || key->slab, PJ_EINVAL);
+#else
     PJ_ASSERT_RETURN(key && op_key && buffer && length, PJ_EINVAL);
+#endif
     PJ_CHECK_STACK();
 
+    read_op = (struct read_operation*)op_key;
+    PJ_ASSERT_RETURN(read_op->op == PJ_IOQUEUE_OP_NONE, PJ_EPENDING);
+
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    /* Return the buffer lent to the previous read of this op_key, even
+     * if the key has stopped lending or is closing.
+     */
+    if (read_op->lent) {
+	pj_ioqueue_buf_dec_ref(read_op->lent);
+	read_op->lent = NULL;
+    }
+#endif
+
     /* Check if key is closing. */
     if (IS_CLOSING(key))
 	return PJ_ECANCELLED;
 
-    read_op = (struct read_operation*)op_key;
-    PJ_ASSERT_RETURN(read_op->op == PJ_IOQUEUE_OP_NONE, PJ_EPENDING);
     read_op->op = PJ_IOQUEUE_OP_NONE;
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+
+    /* Lent reads always complete asynchronously, the buffer is only
+     * taken from the slab when a datagram arrives.
+     */
+    if (buffer == NULL)
+	flags |= PJ_IOQUEUE_ALWAYS_ASYNC;
+#endif
+
     /* Try to see if there's data immediately available. 
      */
     if ((flags & PJ_IOQUEUE_ALWAYS_ASYNC) == 0) {
@@ -895,6 +1344,7 @@ PJ_DEF(pj_status_t) pj_ioqueue_send( pj_ioqueue_key_t *key,
     write_op->size = *length;
     write_op->written = 0;
     write_op->flags = flags;
+    write_op->iov = NULL;
     
     pj_ioqueue_lock_key(key);
     /* Check again. Handle may have been closed after the previous check
@@ -913,6 +1363,93 @@ PJ_DEF(pj_status_t) pj_ioqueue_send( pj_ioqueue_key_t *key,
 }
 
 
+/*
+ * pj_ioqueue_sendv()
+ *
+ * Start asynchronous sendmsg() of several buffers to the descriptor.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_sendv( pj_ioqueue_key_t *key,
+                                      pj_ioqueue_op_key_t *op_key,
+				      const pj_iovec_t iov[],
+				      unsigned iovcnt,
+				      pj_ssize_t *length,
+                                      pj_uint32_t flags)
+{
+    struct write_operation *write_op;
+    pj_status_t status;
+    pj_size_t total = 0;
+    pj_ssize_t sent = 0;
+    unsigned i, retry;
+
+    PJ_ASSERT_RETURN(key && op_key && iov && iovcnt && length, PJ_EINVAL);
+    PJ_ASSERT_RETURN(iovcnt <= PJ_SOCK_MAX_IOV, PJ_ETOOMANY);
+    PJ_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return PJ_ECANCELLED;
+
+    /* We can not use PJ_IOQUEUE_ALWAYS_ASYNC for socket write. */
+    flags &= ~(PJ_IOQUEUE_ALWAYS_ASYNC);
+
+    for (i=0; i<iovcnt; ++i)
+	total += iov[i].len;
+
+    /* Fast track, see pj_ioqueue_send() */
+    if (pj_list_empty(&key->write_list)) {
+        status = pj_sock_sendv(key->fd, iov, iovcnt, &sent, flags);
+        if (status == PJ_SUCCESS) {
+	    if (sent == (pj_ssize_t)total || key->fd_type == pj_SOCK_DGRAM()) {
+		*length = sent;
+		return PJ_SUCCESS;
+	    }
+	    /* Partially sent, queue the rest. */
+        } else if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL)) {
+	    return status;
+	} else {
+	    sent = 0;
+	}
+    }
+
+    /*
+     * Schedule asynchronous send.
+     */
+    write_op = (struct write_operation*)op_key;
+
+    /* Spin if write_op has pending operation */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	pj_thread_sleep(0);
+
+    /* Last chance */
+    if (write_op->op) {
+	/* See pj_ioqueue_send() */
+	return PJ_EBUSY;
+    }
+
+    write_op->op = PJ_IOQUEUE_OP_SEND;
+    write_op->buf = NULL;
+    write_op->iov = iov;
+    write_op->iovcnt = iovcnt;
+    write_op->size = total;
+    write_op->written = sent;
+    write_op->flags = flags;
+    
+    pj_ioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app. See #913
+     */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_ECANCELLED;
+    }
+    pj_list_insert_before(&key->write_list, write_op);
+    ioqueue_add_to_set(key->ioqueue, key, WRITEABLE_EVENT);
+    pj_ioqueue_unlock_key(key);
+
+    return PJ_EPENDING;
+}
+
+
 /*
  * pj_ioqueue_sendto()
  *
@@ -28,6 +28,7 @@
 #include <pj/pj_list.h>
 #include <pj/ioqueue.h>
 #include <pj/sock.h>
+#include <pj/sock_select.h>
 #include <pj/pj_errno.h>
 
 /*
@@ -60,6 +61,9 @@ struct read_operation
     unsigned                flags;
     pj_sockaddr_t	   *rmt_addr;
     int			   *rmt_addrlen;
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    void		   *lent;	/* Buffer lent to the last read.    */
+#endif
 };
 
 struct write_operation
@@ -73,6 +77,8 @@ struct write_operation
     unsigned                flags;
     pj_sockaddr_in	    rmt_addr;
     int			    rmt_addrlen;
+    const pj_iovec_t	   *iov;	/* For sendv(), buf is NULL	*/
+    unsigned		    iovcnt;
 };
 
 struct accept_operation
@@ -106,6 +112,13 @@ union operation_key
 #   define UNREG_FIELDS
 #endif
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+#   define SLAB_FIELDS			\
+	pj_ioqueue_slab	   *slab;
+#else
+#   define SLAB_FIELDS
+#endif
+
 #define DECLARE_COMMON_KEY                          \
     PJ_DECL_LIST_MEMBER(struct pj_ioqueue_key_t);   \
     pj_ioqueue_t           *ioqueue;                \
@@ -122,6 +135,7 @@ union operation_key
     struct read_operation   read_list;              \
     struct write_operation  write_list;             \
     struct accept_operation accept_list;	    \
+    SLAB_FIELDS					    \
     UNREG_FIELDS
 
 
@@ -145,6 +159,11 @@ enum ioqueue_event_type
 struct pj_ioqueue_key_t
 {
     DECLARE_COMMON_KEY
+#if PJ_IOQUEUE_IMP == PJ_IOQUEUE_IMP_EPOLL
+    pj_uint32_t		    ev_wanted;	/* Events needed by pending ops.    */
+    pj_uint32_t		    ev_armed;	/* Events currently set in epoll.   */
+    pj_bool_t		    ev_attached;/* Is the fd in the epoll set?	    */
+#endif
 };
 
 /*
@@ -155,13 +174,17 @@ struct pj_ioqueue_t
     DECLARE_COMMON_IOQUEUE
 
     unsigned		max, count;	/* Max and current key count	    */
-    int			nfds;		/* The largest fd value (for select)*/
     pj_ioqueue_key_t	active_list;	/* List of active keys.		    */
+#if PJ_IOQUEUE_IMP == PJ_IOQUEUE_IMP_EPOLL
+    int			epfd;		/* The epoll descriptor.	    */
+#else
+    int			nfds;		/* The largest fd value (for select)*/
     pj_fd_set_t		rfdset;
     pj_fd_set_t		wfdset;
 #if PJ_HAS_TCP
     pj_fd_set_t		xfdset;
 #endif
+#endif
 
 #if PJ_IOQUEUE_HAS_SAFE_UNREG
     pj_mutex_t	       *ref_cnt_mutex;
@@ -181,9 +204,34 @@ PJ_INLINE(int) key_has_pending_read(pj_ioqueue_key_t *key)
     return !pj_list_empty(&key->read_list);
 }
 
+/*
+ * ioqueue_add_to_set()/ioqueue_remove_from_set()
+ *
+ * Instruct the backend (select, epoll) to start or stop watching the
+ * descriptor of the key for the specified event. These are implemented
+ * by each ioqueue backend.
+ */
+void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
+                         pj_ioqueue_key_t *key,
+                         enum ioqueue_event_type event_type );
+
+void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
+                              pj_ioqueue_key_t *key,
+                              enum ioqueue_event_type event_type );
+
 pj_bool_t ioqueue_dispatch_read_event( pj_ioqueue_t *ioqueue,
 				       pj_ioqueue_key_t *h );
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+/*
+ * ioqueue_release_lent_bufs()
+ *
+ * Return the buffers lent to the pending reads of the key to their slab.
+ * Called by the backend with the key locked when it is unregistered.
+ */
+void ioqueue_release_lent_bufs( pj_ioqueue_key_t *key );
+#endif
+
 /*
  * ioqueue_dispatch_event()
  *
@@ -0,0 +1,902 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * ioqueue_epoll.c
+ *
+ * This is the implementation of IOQueue using Linux epoll.
+ * It shares the key and operation machinery with the select ioqueue
+ * (ioqueue_common_abs.c), only the event demultiplexing differs: the
+ * kernel keeps the interest set, so pj_ioqueue_poll() only visits the
+ * descriptors that are ready instead of copying and scanning fd_sets.
+ *
+ * Select this backend with PJ_IOQUEUE_IMP = PJ_IOQUEUE_IMP_EPOLL.
+ */
+
+#include <pj/ioqueue.h>
+#include <pj/pj_os.h>
+#include <pj/pj_lock.h>
+#include <pj/log.h>
+#include <pj/pj_list.h>
+#include <pj/pool.h>
+#include <pj/pj_string.h>
+#include <pj/pj_assert.h>
+#include <pj/sock.h>
+#include <pj/compat/socket.h>
+#include <pj/pj_errno.h>
+#include "ioqueue_common_abs.h"
+
+#if PJ_IOQUEUE_IMP == PJ_IOQUEUE_IMP_EPOLL
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define THIS_FILE   "ioq_epoll"
+
+#if 0
+#  define TRACE__(args)	PJ_LOG(3,args)
+#else
+#  define TRACE__(args)
+#endif
+
+/*
+ * Notes on the interest set:
+ *
+ *  - the common code asks for an event with ioqueue_add_to_set() when an
+ *    operation is queued, and gives it back with ioqueue_remove_from_set()
+ *    when the last operation of that kind is completed. Each key keeps
+ *    the events its pending operations need (ev_wanted) and the events
+ *    currently registered in the kernel (ev_armed).
+ *
+ *  - EPOLLIN is disarmed lazily. A datagram socket normally re-posts its
+ *    read right from the read callback, so clearing EPOLLIN on every
+ *    completion would cost two epoll_ctl() per packet. Instead EPOLLIN is
+ *    only removed when epoll reports it for a key that has no pending
+ *    read anymore. EPOLLOUT is disarmed immediately, since an idle socket
+ *    is almost always writable.
+ *
+ *  - EPOLLERR and EPOLLHUP are always reported by the kernel. When they
+ *    are reported for a key without any pending operation, the descriptor
+ *    is removed from the epoll set until an operation is queued again,
+ *    otherwise the poll would spin on it.
+ *
+ *  - ev_wanted/ev_armed are protected by the ioqueue lock, like the
+ *    fd_sets in the select ioqueue.
+ */
+
+/* Proto */
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+/* Scan closing keys to be put to free list again */
+static void scan_closing_keys(pj_ioqueue_t *ioqueue);
+#endif
+
+/*
+ * pj_ioqueue_name()
+ */
+PJ_DEF(const char*) pj_ioqueue_name(void)
+{
+    return "epoll";
+}
+
+/* Apply the key's armed events to the epoll set.
+ * Must be called with ioqueue's lock held.
+ */
+static void update_epoll(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    struct epoll_event ev;
+    int rc;
+
+    if (key->fd == PJ_INVALID_SOCKET)
+	return;
+
+    pj_bzero(&ev, sizeof(ev));
+    ev.events = key->ev_armed;
+    ev.data.ptr = key;
+
+    if (key->ev_attached) {
+	rc = epoll_ctl(ioqueue->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+    } else {
+	rc = epoll_ctl(ioqueue->epfd, EPOLL_CTL_ADD, key->fd, &ev);
+	if (rc == 0)
+	    key->ev_attached = PJ_TRUE;
+    }
+
+    if (rc != 0) {
+	PJ_PERROR(4,(THIS_FILE, pj_get_os_error(),
+		     "epoll_ctl() error on fd %d", key->fd));
+    }
+}
+
+/* Remove the key's descriptor from the epoll set.
+ * Must be called with ioqueue's lock held.
+ */
+static void detach_epoll(pj_ioqueue_t *ioqueue, pj_ioqueue_key_t *key)
+{
+    struct epoll_event ev;
+
+    if (key->ev_attached && key->fd != PJ_INVALID_SOCKET) {
+	/* Non-NULL event is required by kernels older than 2.6.9 */
+	pj_bzero(&ev, sizeof(ev));
+	epoll_ctl(ioqueue->epfd, EPOLL_CTL_DEL, key->fd, &ev);
+    }
+    key->ev_attached = PJ_FALSE;
+    key->ev_armed = 0;
+}
+
+/* ioqueue_add_to_set()
+ * This function is called from pj_ioqueue_recv(), pj_ioqueue_send() etc
+ * to instruct the ioqueue to watch the specified handle for the
+ * specified event.
+ */
+void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
+                         pj_ioqueue_key_t *key,
+                         enum ioqueue_event_type event_type )
+{
+    pj_uint32_t events;
+
+    if (event_type == READABLE_EVENT)
+	events = EPOLLIN;
+    else if (event_type == WRITEABLE_EVENT)
+	events = EPOLLOUT;
+#if defined(PJ_HAS_TCP) && PJ_HAS_TCP!=0
+    else if (event_type == EXCEPTION_EVENT)
+	events = 0;	/* EPOLLERR is always reported */
+#endif
+    else {
+	pj_assert(0);
+	return;
+    }
+
+    pj_lock_acquire(ioqueue->lock);
+
+    key->ev_wanted |= events;
+    if ((key->ev_armed & key->ev_wanted) != key->ev_wanted ||
+	!key->ev_attached)
+    {
+	key->ev_armed |= key->ev_wanted;
+	update_epoll(ioqueue, key);
+    }
+
+    pj_lock_release(ioqueue->lock);
+}
+
+/* ioqueue_remove_from_set()
+ * This function is called from ioqueue_dispatch_event() to instruct
+ * the ioqueue to stop watching the specified handle for the specified
+ * event.
+ */
+void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
+                              pj_ioqueue_key_t *key,
+                              enum ioqueue_event_type event_type)
+{
+    pj_lock_acquire(ioqueue->lock);
+
+    if (event_type == READABLE_EVENT) {
+	/* EPOLLIN is disarmed lazily, see notes above */
+	key->ev_wanted &= ~EPOLLIN;
+    } else if (event_type == WRITEABLE_EVENT) {
+	key->ev_wanted &= ~EPOLLOUT;
+	if (key->ev_armed & EPOLLOUT) {
+	    key->ev_armed &= ~EPOLLOUT;
+	    update_epoll(ioqueue, key);
+	}
+    }
+#if defined(PJ_HAS_TCP) && PJ_HAS_TCP!=0
+    else if (event_type == EXCEPTION_EVENT) {
+	/* Nothing to do */
+    }
+#endif
+    else {
+	pj_assert(0);
+    }
+
+    pj_lock_release(ioqueue->lock);
+}
+
+static void ioqueue_init( pj_ioqueue_t *ioqueue )
+{
+    ioqueue->lock = NULL;
+    ioqueue->auto_delete_lock = 0;
+    ioqueue->default_concurrency = PJ_IOQUEUE_DEFAULT_ALLOW_CONCURRENCY;
+}
+
+static pj_status_t ioqueue_destroy(pj_ioqueue_t *ioqueue)
+{
+    if (ioqueue->auto_delete_lock && ioqueue->lock ) {
+	pj_lock_release(ioqueue->lock);
+        return pj_lock_destroy(ioqueue->lock);
+    }
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t ioqueue_init_key( pj_pool_t *pool,
+                                     pj_ioqueue_t *ioqueue,
+                                     pj_ioqueue_key_t *key,
+                                     pj_sock_t sock,
+                                     pj_grp_lock_t *grp_lock,
+                                     void *user_data,
+                                     const pj_ioqueue_callback *cb)
+{
+    pj_status_t rc;
+    int optlen;
+
+    PJ_UNUSED_ARG(pool);
+
+    key->ioqueue = ioqueue;
+    key->fd = sock;
+    key->user_data = user_data;
+    key->ev_wanted = 0;
+    key->ev_armed = 0;
+    key->ev_attached = PJ_FALSE;
+    pj_list_init(&key->read_list);
+    pj_list_init(&key->write_list);
+#if PJ_HAS_TCP
+    pj_list_init(&key->accept_list);
+    key->connecting = 0;
+#endif
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    key->slab = NULL;
+#endif
+
+    /* Save callback. */
+    pj_memcpy(&key->cb, cb, sizeof(pj_ioqueue_callback));
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+    /* Set initial reference count to 1 */
+    pj_assert(key->ref_count == 0);
+    ++key->ref_count;
+
+    key->closing = 0;
+#endif
+
+    rc = pj_ioqueue_set_concurrency(key, ioqueue->default_concurrency);
+    if (rc != PJ_SUCCESS)
+	return rc;
+
+    /* Get socket type. When socket type is datagram, some optimization
+     * will be performed during send to allow parallel send operations.
+     */
+    optlen = sizeof(key->fd_type);
+    rc = pj_sock_getsockopt(sock, pj_SOL_SOCKET(), pj_SO_TYPE(),
+                            &key->fd_type, &optlen);
+    if (rc != PJ_SUCCESS)
+        key->fd_type = pj_SOCK_STREAM();
+
+    /* Create mutex for the key. */
+#if !PJ_IOQUEUE_HAS_SAFE_UNREG
+    rc = pj_lock_create_simple_mutex(pool, NULL, &key->lock);
+    if (rc != PJ_SUCCESS)
+	return rc;
+#endif
+
+    /* Group lock */
+    key->grp_lock = grp_lock;
+    if (key->grp_lock) {
+	pj_grp_lock_add_ref_dbg(key->grp_lock, "ioqueue", 0);
+    }
+
+    return PJ_SUCCESS;
+}
+
+PJ_INLINE(int) key_has_pending_connect(pj_ioqueue_key_t *key)
+{
+    return key->connecting;
+}
+
+PJ_INLINE(int) key_has_pending_accept(pj_ioqueue_key_t *key)
+{
+#if PJ_HAS_TCP
+    return !pj_list_empty(&key->accept_list);
+#else
+    PJ_UNUSED_ARG(key);
+    return 0;
+#endif
+}
+
+/*
+ * pj_ioqueue_create()
+ *
+ * Create epoll ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
+                                       pj_size_t max_fd,
+                                       pj_ioqueue_t **p_ioqueue)
+{
+    pj_ioqueue_t *ioqueue;
+    pj_lock_t *lock;
+    unsigned i;
+    pj_status_t rc;
+
+    /* Check that arguments are valid. */
+    PJ_ASSERT_RETURN(pool != NULL && p_ioqueue != NULL &&
+                     max_fd > 0, PJ_EINVAL);
+
+    /* Check that size of pj_ioqueue_op_key_t is sufficient */
+    PJ_ASSERT_RETURN(sizeof(pj_ioqueue_op_key_t)-sizeof(void*) >=
+                     sizeof(union operation_key), PJ_EBUG);
+
+    /* Create and init common ioqueue stuffs */
+    ioqueue = PJ_POOL_ALLOC_T(pool, pj_ioqueue_t);
+    ioqueue_init(ioqueue);
+
+    ioqueue->max = (unsigned)max_fd;
+    ioqueue->count = 0;
+    pj_list_init(&ioqueue->active_list);
+
+    /* The size argument is only a hint (and ignored since Linux 2.6.8) */
+    ioqueue->epfd = epoll_create((int)max_fd);
+    if (ioqueue->epfd < 0)
+	return PJ_RETURN_OS_ERROR(pj_get_native_os_error());
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+    /* When safe unregistration is used (the default), we pre-create
+     * all keys and put them in the free list.
+     */
+
+    /* Mutex to protect key's reference counter
+     * We don't want to use key's mutex or ioqueue's mutex because
+     * that would create deadlock situation in some cases.
+     */
+    rc = pj_mutex_create_simple(pool, NULL, &ioqueue->ref_cnt_mutex);
+    if (rc != PJ_SUCCESS) {
+	close(ioqueue->epfd);
+	return rc;
+    }
+
+    /* Init key list */
+    pj_list_init(&ioqueue->free_list);
+    pj_list_init(&ioqueue->closing_list);
+
+
+    /* Pre-create all keys according to max_fd */
+    for (i=0; i<max_fd; ++i) {
+	pj_ioqueue_key_t *key;
+
+	key = PJ_POOL_ALLOC_T(pool, pj_ioqueue_key_t);
+	key->ref_count = 0;
+	rc = pj_lock_create_recursive_mutex(pool, NULL, &key->lock);
+	if (rc != PJ_SUCCESS) {
+	    key = ioqueue->free_list.next;
+	    while (key != &ioqueue->free_list) {
+		pj_lock_destroy(key->lock);
+		key = key->next;
+	    }
+	    pj_mutex_destroy(ioqueue->ref_cnt_mutex);
+	    close(ioqueue->epfd);
+	    return rc;
+	}
+	pj_list_push_back(&ioqueue->free_list, key);
+    }
+#else
+    PJ_UNUSED_ARG(i);
+#endif
+
+    /* Create and init ioqueue mutex */
+    rc = pj_lock_create_simple_mutex(pool, "ioq%p", &lock);
+    if (rc != PJ_SUCCESS) {
+	close(ioqueue->epfd);
+	return rc;
+    }
+
+    rc = pj_ioqueue_set_lock(ioqueue, lock, PJ_TRUE);
+    if (rc != PJ_SUCCESS) {
+	close(ioqueue->epfd);
+        return rc;
+    }
+
+    PJ_LOG(4, ("pjlib", "epoll I/O Queue created (%p)", ioqueue));
+    *p_ioqueue = ioqueue;
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_ioqueue_destroy()
+ *
+ * Destroy ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
+{
+    pj_ioqueue_key_t *key;
+
+    PJ_ASSERT_RETURN(ioqueue, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+
+    if (ioqueue->epfd >= 0) {
+	close(ioqueue->epfd);
+	ioqueue->epfd = -1;
+    }
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+    /* Destroy reference counters */
+    key = ioqueue->active_list.next;
+    while (key != &ioqueue->active_list) {
+	pj_lock_destroy(key->lock);
+	key = key->next;
+    }
+
+    key = ioqueue->closing_list.next;
+    while (key != &ioqueue->closing_list) {
+	pj_lock_destroy(key->lock);
+	key = key->next;
+    }
+
+    key = ioqueue->free_list.next;
+    while (key != &ioqueue->free_list) {
+	pj_lock_destroy(key->lock);
+	key = key->next;
+    }
+
+    pj_mutex_destroy(ioqueue->ref_cnt_mutex);
+#else
+    PJ_UNUSED_ARG(key);
+#endif
+
+    return ioqueue_destroy(ioqueue);
+}
+
+
+/*
+ * pj_ioqueue_register_sock()
+ *
+ * Register socket handle to ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_register_sock2(pj_pool_t *pool,
+					      pj_ioqueue_t *ioqueue,
+					      pj_sock_t sock,
+					      pj_grp_lock_t *grp_lock,
+					      void *user_data,
+					      const pj_ioqueue_callback *cb,
+                                              pj_ioqueue_key_t **p_key)
+{
+    pj_ioqueue_key_t *key = NULL;
+    pj_uint32_t value;
+    pj_status_t rc = PJ_SUCCESS;
+
+    PJ_ASSERT_RETURN(pool && ioqueue && sock != PJ_INVALID_SOCKET &&
+                     cb && p_key, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+
+    if (ioqueue->count >= ioqueue->max) {
+        rc = PJ_ETOOMANY;
+	goto on_return;
+    }
+
+    /* If safe unregistration (PJ_IOQUEUE_HAS_SAFE_UNREG) is used, get
+     * the key from the free list. Otherwise allocate a new one.
+     */
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+
+    /* Scan closing_keys first to let them come back to free_list */
+    scan_closing_keys(ioqueue);
+
+    pj_assert(!pj_list_empty(&ioqueue->free_list));
+    if (pj_list_empty(&ioqueue->free_list)) {
+	rc = PJ_ETOOMANY;
+	goto on_return;
+    }
+
+    key = ioqueue->free_list.next;
+    pj_list_erase(key);
+#else
+    key = (pj_ioqueue_key_t*)pj_pool_zalloc(pool, sizeof(pj_ioqueue_key_t));
+#endif
+
+    rc = ioqueue_init_key(pool, ioqueue, key, sock, grp_lock, user_data, cb);
+    if (rc != PJ_SUCCESS) {
+	key = NULL;
+	goto on_return;
+    }
+
+    /* Set socket to nonblocking. */
+    value = 1;
+    if (ioctl(sock, FIONBIO, &value)) {
+        rc = pj_get_netos_error();
+	goto on_return;
+    }
+
+    /* Add the descriptor to the epoll set with no event armed yet. The
+     * events are armed when an operation is queued to the key.
+     */
+    update_epoll(ioqueue, key);
+    if (!key->ev_attached) {
+	rc = pj_get_os_error();
+	goto on_return;
+    }
+
+    /* Put in active list. */
+    pj_list_insert_before(&ioqueue->active_list, key);
+    ++ioqueue->count;
+
+on_return:
+    /* On error, socket may be left in non-blocking mode. */
+    if (rc != PJ_SUCCESS) {
+	if (key && key->grp_lock)
+	    pj_grp_lock_dec_ref_dbg(key->grp_lock, "ioqueue", 0);
+    }
+    *p_key = key;
+    pj_lock_release(ioqueue->lock);
+
+    return rc;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_register_sock( pj_pool_t *pool,
+					      pj_ioqueue_t *ioqueue,
+					      pj_sock_t sock,
+					      void *user_data,
+					      const pj_ioqueue_callback *cb,
+					      pj_ioqueue_key_t **p_key)
+{
+    return pj_ioqueue_register_sock2(pool, ioqueue, sock, NULL, user_data,
+                                     cb, p_key);
+}
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+/* Increment key's reference counter */
+static void increment_counter(pj_ioqueue_key_t *key)
+{
+    pj_mutex_lock(key->ioqueue->ref_cnt_mutex);
+    ++key->ref_count;
+    pj_mutex_unlock(key->ioqueue->ref_cnt_mutex);
+}
+
+/* Decrement the key's reference counter, and when the counter reach zero,
+ * destroy the key.
+ *
+ * Note: MUST NOT CALL THIS FUNCTION WHILE HOLDING ioqueue's LOCK.
+ */
+static void decrement_counter(pj_ioqueue_key_t *key)
+{
+    pj_lock_acquire(key->ioqueue->lock);
+    pj_mutex_lock(key->ioqueue->ref_cnt_mutex);
+    --key->ref_count;
+    if (key->ref_count == 0) {
+
+	pj_assert(key->closing == 1);
+	pj_gettickcount(&key->free_time);
+	key->free_time.msec += PJ_IOQUEUE_KEY_FREE_DELAY;
+	pj_time_val_normalize(&key->free_time);
+
+	pj_list_erase(key);
+	pj_list_push_back(&key->ioqueue->closing_list, key);
+    }
+    pj_mutex_unlock(key->ioqueue->ref_cnt_mutex);
+    pj_lock_release(key->ioqueue->lock);
+}
+#endif
+
+
+/*
+ * pj_ioqueue_unregister()
+ *
+ * Unregister handle from ioqueue.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_unregister( pj_ioqueue_key_t *key)
+{
+    pj_ioqueue_t *ioqueue;
+
+    PJ_ASSERT_RETURN(key, PJ_EINVAL);
+
+    ioqueue = key->ioqueue;
+
+    /* Lock the key to make sure no callback is simultaneously modifying
+     * the key. We need to lock the key before ioqueue here to prevent
+     * deadlock.
+     */
+    pj_ioqueue_lock_key(key);
+
+    /* Best effort to avoid double key-unregistration */
+    if (IS_CLOSING(key)) {
+	pj_ioqueue_unlock_key(key);
+	return PJ_SUCCESS;
+    }
+
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    /* The pending reads will never complete */
+    ioqueue_release_lent_bufs(key);
+#endif
+
+    /* Also lock ioqueue */
+    pj_lock_acquire(ioqueue->lock);
+
+    /* Avoid "negative" ioqueue count */
+    if (ioqueue->count > 0) {
+	--ioqueue->count;
+    } else {
+	/* If this happens, very likely there is double unregistration
+	 * of a key.
+	 */
+	pj_assert(!"Bad ioqueue count in key unregistration!");
+	PJ_LOG(1,(THIS_FILE, "Bad ioqueue count in key unregistration!"));
+    }
+
+#if !PJ_IOQUEUE_HAS_SAFE_UNREG
+    /* Ticket #520, key will be erased more than once */
+    pj_list_erase(key);
+#endif
+
+    /* Remove from the epoll set before the descriptor is closed (and
+     * possibly reused by another socket).
+     */
+    detach_epoll(ioqueue, key);
+    key->ev_wanted = 0;
+
+    /* Close socket. */
+    if (key->fd != PJ_INVALID_SOCKET) {
+        pj_sock_close(key->fd);
+        key->fd = PJ_INVALID_SOCKET;
+    }
+
+    /* Clear callback */
+    key->cb.on_accept_complete = NULL;
+    key->cb.on_connect_complete = NULL;
+    key->cb.on_read_complete = NULL;
+    key->cb.on_write_complete = NULL;
+
+    /* Must release ioqueue lock first before decrementing counter, to
+     * prevent deadlock.
+     */
+    pj_lock_release(ioqueue->lock);
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+    /* Mark key is closing. */
+    key->closing = 1;
+
+    /* Decrement counter. */
+    decrement_counter(key);
+
+    /* Done. */
+    if (key->grp_lock) {
+	/* just dec_ref and unlock. we will set grp_lock to NULL
+	 * elsewhere */
+	pj_grp_lock_t *grp_lock = key->grp_lock;
+	// Don't set grp_lock to NULL otherwise the other thread
+	// will crash. Just leave it as dangling pointer, but this
+	// should be safe
+	//key->grp_lock = NULL;
+	pj_grp_lock_dec_ref_dbg(grp_lock, "ioqueue", 0);
+	pj_grp_lock_release(grp_lock);
+    } else {
+	pj_ioqueue_unlock_key(key);
+    }
+#else
+    if (key->grp_lock) {
+	/* set grp_lock to NULL and unlock */
+	pj_grp_lock_t *grp_lock = key->grp_lock;
+	// Don't set grp_lock to NULL otherwise the other thread
+	// will crash. Just leave it as dangling pointer, but this
+	// should be safe
+	//key->grp_lock = NULL;
+	pj_grp_lock_dec_ref_dbg(grp_lock, "ioqueue", 0);
+	pj_grp_lock_release(grp_lock);
+    } else {
+	pj_ioqueue_unlock_key(key);
+    }
+
+    pj_lock_destroy(key->lock);
+#endif
+
+    return PJ_SUCCESS;
+}
+
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+/* Scan closing keys to be put to free list again */
+static void scan_closing_keys(pj_ioqueue_t *ioqueue)
+{
+    pj_time_val now;
+    pj_ioqueue_key_t *h;
+
+    pj_gettickcount(&now);
+    h = ioqueue->closing_list.next;
+    while (h != &ioqueue->closing_list) {
+	pj_ioqueue_key_t *next = h->next;
+
+	pj_assert(h->closing != 0);
+
+	if (PJ_TIME_VAL_GTE(now, h->free_time)) {
+	    pj_list_erase(h);
+	    // Don't set grp_lock to NULL otherwise the other thread
+	    // will crash. Just leave it as dangling pointer, but this
+	    // should be safe
+	    //h->grp_lock = NULL;
+	    pj_list_push_back(&ioqueue->free_list, h);
+	}
+	h = next;
+    }
+}
+#endif
+
+
+/*
+ * pj_ioqueue_poll()
+ *
+ * Same event collection and dispatch scheme as the select ioqueue: the
+ * ready keys are collected into the event array while holding the
+ * ioqueue lock, then dispatched without it. Only the keys reported by
+ * epoll_wait() are visited.
+ */
+PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
+{
+    enum { MAX_EVENTS = PJ_IOQUEUE_MAX_CAND_EVENTS };
+    struct epoll_event ready[MAX_EVENTS];
+    int i, count, event_cnt, processed_cnt;
+    int msec;
+    struct event
+    {
+        pj_ioqueue_key_t	*key;
+        enum ioqueue_event_type  event_type;
+    } event[MAX_EVENTS];
+
+    PJ_ASSERT_RETURN(ioqueue, -PJ_EINVAL);
+
+    msec = timeout ? PJ_TIME_VAL_MSEC(*timeout) : -1;
+
+    TRACE__((THIS_FILE, "start epoll_wait, msec=%d", msec));
+    count = epoll_wait(ioqueue->epfd, ready, MAX_EVENTS, msec);
+    TRACE__((THIS_FILE, "     epoll_wait returns %d", count));
+
+    if (count == 0) {
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+	/* Check the closing keys only when there's no activity and when
+	 * there are pending closing keys.
+	 */
+	if (!pj_list_empty(&ioqueue->closing_list)) {
+	    pj_lock_acquire(ioqueue->lock);
+	    scan_closing_keys(ioqueue);
+	    pj_lock_release(ioqueue->lock);
+	}
+#endif
+	return 0;
+    } else if (count < 0) {
+	if (pj_get_native_os_error() == EINTR)
+	    return 0;
+	return -pj_get_os_error();
+    }
+
+    /* Collect the events to be processed later in this function, so that
+     * events can be processed in parallel without holding ioqueue lock.
+     */
+    pj_lock_acquire(ioqueue->lock);
+
+    event_cnt = 0;
+
+    for (i=0; i<count; ++i) {
+	pj_ioqueue_key_t *h = (pj_ioqueue_key_t*)ready[i].data.ptr;
+	pj_uint32_t ev = ready[i].events;
+	pj_bool_t handled = PJ_FALSE;
+
+	/* The key may have been unregistered while we were waiting */
+	if (h->fd == PJ_INVALID_SOCKET || !h->ev_attached || IS_CLOSING(h))
+	    continue;
+
+	/* Writable sockets first to handle piggy-back data coming with
+	 * accept().
+	 */
+	if ((ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)) &&
+	    (key_has_pending_write(h) || key_has_pending_connect(h)))
+	{
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+	    increment_counter(h);
+#endif
+	    event[event_cnt].key = h;
+	    event[event_cnt].event_type = WRITEABLE_EVENT;
+	    ++event_cnt;
+	    handled = PJ_TRUE;
+	}
+
+	if ((ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) &&
+	    (key_has_pending_read(h) || key_has_pending_accept(h)) &&
+	    event_cnt < MAX_EVENTS)
+	{
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+	    increment_counter(h);
+#endif
+	    event[event_cnt].key = h;
+	    event[event_cnt].event_type = READABLE_EVENT;
+	    ++event_cnt;
+	    handled = PJ_TRUE;
+	}
+
+#if PJ_HAS_TCP
+	if ((ev & EPOLLERR) && key_has_pending_connect(h) &&
+	    event_cnt < MAX_EVENTS)
+	{
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+	    increment_counter(h);
+#endif
+	    event[event_cnt].key = h;
+	    event[event_cnt].event_type = EXCEPTION_EVENT;
+	    ++event_cnt;
+	    handled = PJ_TRUE;
+	}
+#endif
+
+	/* Disarm events that no pending operation is waiting for */
+	if ((ev & EPOLLIN) && !(h->ev_wanted & EPOLLIN) &&
+	    !key_has_pending_read(h) && !key_has_pending_accept(h))
+	{
+	    h->ev_armed &= ~EPOLLIN;
+	    update_epoll(ioqueue, h);
+	}
+	if (!handled && (ev & (EPOLLERR | EPOLLHUP)) && h->ev_wanted == 0)
+	    detach_epoll(ioqueue, h);
+
+	if (event_cnt == MAX_EVENTS)
+	    break;
+    }
+
+    for (i=0; i<event_cnt; ++i) {
+	if (event[i].key->grp_lock)
+	    pj_grp_lock_add_ref_dbg(event[i].key->grp_lock, "ioqueue", 0);
+    }
+
+    PJ_RACE_ME(5);
+
+    pj_lock_release(ioqueue->lock);
+
+    PJ_RACE_ME(5);
+
+    processed_cnt = 0;
+
+    /* Now process all events. The dispatch functions will take care
+     * of locking in each of the key
+     */
+    for (i=0; i<event_cnt; ++i) {
+
+	/* Just do not exceed PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL */
+	if (processed_cnt < PJ_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL) {
+	    switch (event[i].event_type) {
+	    case READABLE_EVENT:
+		if (ioqueue_dispatch_read_event(ioqueue, event[i].key))
+		    ++processed_cnt;
+		break;
+	    case WRITEABLE_EVENT:
+		if (ioqueue_dispatch_write_event(ioqueue, event[i].key))
+		    ++processed_cnt;
+		break;
+	    case EXCEPTION_EVENT:
+		if (ioqueue_dispatch_exception_event(ioqueue, event[i].key))
+		    ++processed_cnt;
+		break;
+	    case NO_EVENT:
+		pj_assert(!"Invalid event!");
+		break;
+	    }
+	}
+
+#if PJ_IOQUEUE_HAS_SAFE_UNREG
+	decrement_counter(event[i].key);
+#endif
+
+	if (event[i].key->grp_lock)
+	    pj_grp_lock_dec_ref_dbg(event[i].key->grp_lock,
+	                            "ioqueue", 0);
+    }
+
+    TRACE__((THIS_FILE, "     poll: count=%d events=%d processed=%d",
+	     count, event_cnt, processed_cnt));
+
+    return processed_cnt;
+}
+
+#endif	/* PJ_IOQUEUE_IMP == PJ_IOQUEUE_IMP_EPOLL */
@@ -42,6 +42,8 @@
 #include <pj/rand.h>
 #include "ioqueue_common_abs.h"
 
+#if PJ_IOQUEUE_IMP == PJ_IOQUEUE_IMP_SELECT
+
 /* Now that we have access to OS'es <sys/select>, lets check again that
  * PJ_IOQUEUE_MAX_HANDLES is not greater than FD_SETSIZE
  */
@@ -108,6 +110,56 @@ PJ_DEF(const char*) pj_ioqueue_name(void)
     return "select";
 }
 
+/* ioqueue_add_to_set()
+ * This function is called from pj_ioqueue_recv(), pj_ioqueue_send() etc
+ * to instruct the ioqueue to add the specified handle to ioqueue's descriptor
+ * set for the specified event.
+ */
+void ioqueue_add_to_set( pj_ioqueue_t *ioqueue,
+                         pj_ioqueue_key_t *key,
+                         enum ioqueue_event_type event_type )
+{
+    pj_lock_acquire(ioqueue->lock);
+
+    if (event_type == READABLE_EVENT)
+        PJ_FD_SET((pj_sock_t)key->fd, &ioqueue->rfdset);
+    else if (event_type == WRITEABLE_EVENT)
+        PJ_FD_SET((pj_sock_t)key->fd, &ioqueue->wfdset);
+#if defined(PJ_HAS_TCP) && PJ_HAS_TCP!=0
+    else if (event_type == EXCEPTION_EVENT)
+        PJ_FD_SET((pj_sock_t)key->fd, &ioqueue->xfdset);
+#endif
+    else
+        pj_assert(0);
+
+    pj_lock_release(ioqueue->lock);
+}
+
+/* ioqueue_remove_from_set()
+ * This function is called from ioqueue_dispatch_event() to instruct
+ * the ioqueue to remove the specified descriptor from ioqueue's descriptor
+ * set for the specified event.
+ */
+void ioqueue_remove_from_set( pj_ioqueue_t *ioqueue,
+                              pj_ioqueue_key_t *key,
+                              enum ioqueue_event_type event_type)
+{
+    pj_lock_acquire(ioqueue->lock);
+
+    if (event_type == READABLE_EVENT)
+        PJ_FD_CLR((pj_sock_t)key->fd, &ioqueue->rfdset);
+    else if (event_type == WRITEABLE_EVENT)
+        PJ_FD_CLR((pj_sock_t)key->fd, &ioqueue->wfdset);
+#if defined(PJ_HAS_TCP) && PJ_HAS_TCP!=0
+    else if (event_type == EXCEPTION_EVENT)
+        PJ_FD_CLR((pj_sock_t)key->fd, &ioqueue->xfdset);
+#endif
+    else
+        pj_assert(0);
+
+    pj_lock_release(ioqueue->lock);
+}
+
 /* 
  * Scan the socket descriptor sets for the largest descriptor.
  * This value is needed by select().
@@ -172,6 +224,9 @@ static pj_status_t ioqueue_init_key( pj_pool_t *pool,
     pj_list_init(&key->accept_list);
     key->connecting = 0;
 #endif
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    key->slab = NULL;
+#endif
 
     /* Save callback. */
     pj_memcpy(&key->cb, cb, sizeof(pj_ioqueue_callback));
@@ -533,6 +588,11 @@ PJ_DEF(pj_status_t) pj_ioqueue_unregister( pj_ioqueue_key_t *key)
 	return PJ_SUCCESS;
     }
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    /* The pending reads will never complete */
+    ioqueue_release_lent_bufs(key);
+#endif
+
     /* Also lock ioqueue */
     pj_lock_acquire(ioqueue->lock);
 
@@ -1095,3 +1155,4 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
     return processed_cnt;
 }
 
+#endif	/* PJ_IOQUEUE_IMP == PJ_IOQUEUE_IMP_SELECT */
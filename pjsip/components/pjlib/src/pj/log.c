@@ -21,6 +21,9 @@
 #include <pj/log.h>
 #include <pj/pj_string.h>
 #include <pj/pj_os.h>
+#include <pj/pool.h>
+#include <pj/pj_assert.h>
+#include <pj/pj_errno.h>
 #include <pj/compat/compat_stdarg.h>
 
 #if PJ_LOG_MAX_LEVEL >= 1
@@ -87,6 +90,9 @@ static char log_buffer[PJ_LOG_MAX_SIZE];
 #if PJ_HAS_THREADS
 static void logging_shutdown(void)
 {
+#  if PJ_LOG_HAS_ASYNC
+    pj_log_async_stop();
+#  endif
     if (thread_suspended_tls_id != -1) {
 	pj_thread_local_free(thread_suspended_tls_id);
 	thread_suspended_tls_id = -1;
@@ -313,34 +319,15 @@ static pj_bool_t is_logging_suspended(void)
     }
 }
 
-PJ_DEF(void) pj_log( const char *sender, int level, 
-		     const char *format, va_list marker)
+/* Print the decorations of a log message, returning the length. */
+static int print_decor(char *log_buffer, int level, const pj_time_val *now,
+		       const char *sender, const char *thread_name,
+		       void *current_thread, int indent)
 {
-    pj_time_val now;
     pj_parsed_time ptime;
     char *pre;
-#if PJ_LOG_USE_STACK_BUFFER
-    char log_buffer[PJ_LOG_MAX_SIZE];
-#endif
-    int saved_level, len, print_len, indent;
-
-    PJ_CHECK_STACK();
 
-    if (level > pj_log_max_level)
-	return;
-
-    if (is_logging_suspended())
-	return;
-
-    /* Temporarily disable logging for this thread. Some of PJLIB APIs that
-     * this function calls below will recursively call the logging function 
-     * back, hence it will cause infinite recursive calls if we allow that.
-     */
-    suspend_logging(&saved_level);
-
-    /* Get current date/time. */
-    pj_gettimeofday(&now);
-    pj_time_decode(&now, &ptime);
+    pj_time_decode(now, &ptime);
 
     pre = log_buffer;
     if (log_decor & PJ_LOG_HAS_LEVEL_TEXT) {
@@ -396,8 +383,9 @@ PJ_DEF(void) pj_log( const char *sender, int level,
     }
     if (log_decor & PJ_LOG_HAS_THREAD_ID) {
 	enum { THREAD_WIDTH = PJ_LOG_THREAD_WIDTH };
-	const char *thread_name = pj_thread_get_name(pj_thread_this());
-	pj_size_t thread_len = strlen(thread_name);
+	pj_size_t thread_len;
+	if (!thread_name) thread_name = "";
+	thread_len = strlen(thread_name);
 	*pre++ = ' ';
 	if (thread_len <= THREAD_WIDTH) {
 	    while (thread_len < THREAD_WIDTH)
@@ -415,7 +403,6 @@ PJ_DEF(void) pj_log( const char *sender, int level,
 	*pre++ = ' ';
 
     if (log_decor & PJ_LOG_HAS_THREAD_SWC) {
-	void *current_thread = (void*)pj_thread_this();
 	if (current_thread != g_last_thread) {
 	    *pre++ = '!';
 	    g_last_thread = current_thread;
@@ -428,29 +415,22 @@ PJ_DEF(void) pj_log( const char *sender, int level,
 
 #if PJ_LOG_ENABLE_INDENT
     if (log_decor & PJ_LOG_HAS_INDENT) {
-	indent = log_get_indent();
 	if (indent > 0) {
 	    pj_memset(pre, PJ_LOG_INDENT_CHAR, indent);
 	    pre += indent;
 	}
     }
+#else
+    PJ_UNUSED_ARG(indent);
 #endif
 
-    len = (int)(pre - log_buffer);
+    return (int)(pre - log_buffer);
+}
 
-    /* Print the whole message to the string log_buffer. */
-    print_len = pj_ansi_vsnprintf(pre, sizeof(log_buffer)-len, format, 
-				  marker);
-    if (print_len < 0) {
-	level = 1;
-	print_len = pj_ansi_snprintf(pre, sizeof(log_buffer)-len, 
-				     "<logging error: msg too long>");
-    }
-    if (print_len < 1 || print_len >= (int)(sizeof(log_buffer)-len)) {
-	print_len = sizeof(log_buffer) - len - 1;
-    }
-    len = len + print_len;
-    if (len > 0 && len < (int)sizeof(log_buffer)-2) {
+/* Terminate the log message, returning the final length. */
+static int terminate_log(char *log_buffer, int size, int len)
+{
+    if (len > 0 && len < size-2) {
 	if (log_decor & PJ_LOG_HAS_CR) {
 	    log_buffer[len++] = '\r';
 	}
@@ -459,16 +439,359 @@ PJ_DEF(void) pj_log( const char *sender, int level,
 	}
 	log_buffer[len] = '\0';
     } else {
-	len = sizeof(log_buffer)-1;
+	len = size-1;
 	if (log_decor & PJ_LOG_HAS_CR) {
-	    log_buffer[sizeof(log_buffer)-3] = '\r';
+	    log_buffer[size-3] = '\r';
 	}
 	if (log_decor & PJ_LOG_HAS_NEWLINE) {
-	    log_buffer[sizeof(log_buffer)-2] = '\n';
+	    log_buffer[size-2] = '\n';
+	}
+	log_buffer[size-1] = '\0';
+    }
+    return len;
+}
+
+#if PJ_LOG_HAS_ASYNC
+
+#if !PJ_HAS_THREADS || !PJ_ATOMIC_USE_BUILTINS
+#   error "PJ_LOG_HAS_ASYNC requires PJ_HAS_THREADS and PJ_ATOMIC_USE_BUILTINS"
+#endif
+
+#if (PJ_LOG_ASYNC_QUEUE_SIZE & (PJ_LOG_ASYNC_QUEUE_SIZE-1)) != 0
+#   error "PJ_LOG_ASYNC_QUEUE_SIZE must be a power of two"
+#endif
+
+#define ASYNC_QUEUE_MASK    (PJ_LOG_ASYNC_QUEUE_SIZE - 1)
+
+/* A queued log message. The sequence number tells whether the record is
+ * free for the producer at that position (seq == pos) or ready for the
+ * consumer (seq == pos + 1).
+ */
+typedef struct log_record
+{
+    unsigned	    seq;
+    int		    level;
+    int		    indent;
+    void	   *thread;
+    pj_time_val	    time;
+    int		    len;
+    char	    sender[PJ_LOG_SENDER_WIDTH+1];
+    char	    thread_name[PJ_LOG_THREAD_WIDTH+1];
+    char	    msg[PJ_LOG_ASYNC_MSG_SIZE];
+} log_record;
+
+static struct log_async
+{
+    log_record	   *queue;
+    unsigned	    enqueue_pos;
+    unsigned	    dequeue_pos;
+    int		    running;	/* Producers may use the queue	    */
+    int		    busy;	/* Number of producers in the queue */
+    int		    quit;	/* Tell the thread to quit	    */
+    pj_thread_t	   *thread;
+    char	   *buffer;	/* Formatting buffer of the thread  */
+    pj_size_t	    written;
+    pj_size_t	    dropped;
+    pj_size_t	    truncated;
+    pj_size_t	    reported_dropped;
+} log_async;
+
+/* Queue the message. Returns PJ_FALSE if asynchronous logging is not
+ * running, in which case the message must be written synchronously.
+ */
+static pj_bool_t log_async_push(const char *sender, int level,
+				const char *format, va_list marker)
+{
+    log_record *rec;
+    unsigned pos;
+    int len;
+
+    __atomic_add_fetch(&log_async.busy, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&log_async.running, __ATOMIC_SEQ_CST)) {
+	__atomic_sub_fetch(&log_async.busy, 1, __ATOMIC_SEQ_CST);
+	return PJ_FALSE;
+    }
+
+    /* Claim a record */
+    pos = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+	int dif;
+
+	rec = &log_async.queue[pos & ASYNC_QUEUE_MASK];
+	dif = (int)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) - pos);
+	if (dif == 0) {
+	    if (__atomic_compare_exchange_n(&log_async.enqueue_pos, &pos,
+					    pos + 1, PJ_TRUE,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+	    {
+		break;
+	    }
+	} else if (dif < 0) {
+	    /* Queue is full, drop the message */
+	    __atomic_add_fetch(&log_async.dropped, 1, __ATOMIC_RELAXED);
+	    __atomic_sub_fetch(&log_async.busy, 1, __ATOMIC_SEQ_CST);
+	    return PJ_TRUE;
+	} else {
+	    pos = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED);
 	}
-	log_buffer[sizeof(log_buffer)-1] = '\0';
     }
 
+    pj_gettimeofday(&rec->time);
+    rec->level = level;
+    rec->thread = NULL;
+    rec->thread_name[0] = '\0';
+    rec->indent = 0;
+
+    if (log_decor & (PJ_LOG_HAS_THREAD_SWC | PJ_LOG_HAS_THREAD_ID))
+	rec->thread = pj_thread_this();
+    if (log_decor & PJ_LOG_HAS_THREAD_ID) {
+	pj_ansi_strncpy(rec->thread_name,
+			pj_thread_get_name((pj_thread_t*)rec->thread),
+			PJ_LOG_THREAD_WIDTH);
+	rec->thread_name[PJ_LOG_THREAD_WIDTH] = '\0';
+    }
+#if PJ_LOG_ENABLE_INDENT
+    if (log_decor & PJ_LOG_HAS_INDENT)
+	rec->indent = log_get_indent();
+#endif
+
+    pj_ansi_strncpy(rec->sender, sender, PJ_LOG_SENDER_WIDTH);
+    rec->sender[PJ_LOG_SENDER_WIDTH] = '\0';
+
+    len = pj_ansi_vsnprintf(rec->msg, sizeof(rec->msg), format, marker);
+    if (len < 0) {
+	rec->level = 1;
+	len = pj_ansi_snprintf(rec->msg, sizeof(rec->msg),
+			       "<logging error: msg too long>");
+    }
+    if (len >= (int)sizeof(rec->msg)) {
+	__atomic_add_fetch(&log_async.truncated, 1, __ATOMIC_RELAXED);
+	len = sizeof(rec->msg) - 1;
+    }
+    rec->len = len;
+
+    /* Publish the record */
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_sub_fetch(&log_async.busy, 1, __ATOMIC_SEQ_CST);
+    return PJ_TRUE;
+}
+
+/* Decorate the message and write it to the log writer. */
+static void log_async_write(int level, const pj_time_val *time,
+			    const char *sender, const char *thread_name,
+			    void *thread, int indent,
+			    const char *msg, int msg_len)
+{
+    char *log_buffer = log_async.buffer;
+    int len;
+
+    len = print_decor(log_buffer, level, time, sender, thread_name,
+		      thread, indent);
+    if (msg_len > PJ_LOG_MAX_SIZE - len - 1)
+	msg_len = PJ_LOG_MAX_SIZE - len - 1;
+    pj_memcpy(log_buffer + len, msg, msg_len);
+    len = terminate_log(log_buffer, PJ_LOG_MAX_SIZE, len + msg_len);
+
+    if (log_writer)
+	(*log_writer)(level, log_buffer, len);
+}
+
+/* Write all messages in the queue, returning the number of messages. */
+static unsigned log_async_flush(void)
+{
+    unsigned count = 0;
+    pj_size_t dropped;
+    int saved_level;
+
+    /* Messages logged by the log writer would be queued again, which may
+     * never end. Suspend logging for this thread while writing.
+     */
+    suspend_logging(&saved_level);
+
+    for (;;) {
+	unsigned pos = log_async.dequeue_pos;
+	log_record *rec = &log_async.queue[pos & ASYNC_QUEUE_MASK];
+
+	if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + 1)
+	    break;
+
+	log_async_write(rec->level, &rec->time, rec->sender,
+			rec->thread_name, rec->thread, rec->indent,
+			rec->msg, rec->len);
+
+	/* Release the record for the next round */
+	__atomic_store_n(&rec->seq, pos + PJ_LOG_ASYNC_QUEUE_SIZE,
+			 __ATOMIC_RELEASE);
+	log_async.dequeue_pos = pos + 1;
+	__atomic_add_fetch(&log_async.written, 1, __ATOMIC_RELAXED);
+	++count;
+    }
+
+    dropped = __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+    if (dropped != log_async.reported_dropped) {
+	char msg[64];
+	pj_time_val now;
+	int len;
+
+	len = pj_ansi_snprintf(msg, sizeof(msg),
+			       "%lu log messages dropped",
+			       (unsigned long)
+			       (dropped - log_async.reported_dropped));
+	log_async.reported_dropped = dropped;
+
+	pj_gettimeofday(&now);
+	log_async_write(2, &now, "log.c", pj_thread_get_name(log_async.thread),
+			log_async.thread, 0, msg, len);
+    }
+
+    resume_logging(&saved_level);
+
+    return count;
+}
+
+static int log_async_thread(void *arg)
+{
+    PJ_UNUSED_ARG(arg);
+
+    while (!__atomic_load_n(&log_async.quit, __ATOMIC_ACQUIRE)) {
+	if (log_async_flush() == 0)
+	    pj_thread_sleep(PJ_LOG_ASYNC_FLUSH_INTERVAL);
+    }
+
+    return 0;
+}
+
+PJ_DEF(pj_status_t) pj_log_async_start(pj_pool_t *pool)
+{
+    unsigned i;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pool, PJ_EINVAL);
+    PJ_ASSERT_RETURN(log_async.thread == NULL, PJ_EINVALIDOP);
+
+    log_async.queue = (log_record*)
+		      pj_pool_calloc(pool, PJ_LOG_ASYNC_QUEUE_SIZE,
+				     sizeof(log_record));
+    log_async.buffer = (char*) pj_pool_alloc(pool, PJ_LOG_MAX_SIZE);
+    if (!log_async.queue || !log_async.buffer)
+	return PJ_ENOMEM;
+
+    for (i=0; i<PJ_LOG_ASYNC_QUEUE_SIZE; ++i)
+	log_async.queue[i].seq = i;
+    log_async.enqueue_pos = log_async.dequeue_pos = 0;
+    log_async.written = log_async.dropped = log_async.truncated = 0;
+    log_async.reported_dropped = 0;
+    log_async.quit = 0;
+
+    /* Run below the SIP and media threads */
+    status = pj_thread_create(pool, "log", &log_async_thread, NULL,
+			      0, 0, &log_async.thread, 5);
+    if (status != PJ_SUCCESS) {
+	log_async.thread = NULL;
+	return status;
+    }
+
+    __atomic_store_n(&log_async.running, 1, __ATOMIC_SEQ_CST);
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(void) pj_log_async_stop(void)
+{
+    if (log_async.thread == NULL)
+	return;
+
+    /* Stop accepting messages and wait for the producers to finish */
+    __atomic_store_n(&log_async.running, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&log_async.busy, __ATOMIC_SEQ_CST))
+	pj_thread_sleep(1);
+
+    __atomic_store_n(&log_async.quit, 1, __ATOMIC_RELEASE);
+    pj_thread_join(log_async.thread);
+    pj_thread_destroy(log_async.thread);
+
+    /* Write the remaining messages */
+    log_async_flush();
+    log_async.thread = NULL;
+
+    /* These belong to the application's pool, which may now be released */
+    log_async.queue = NULL;
+    log_async.buffer = NULL;
+}
+
+PJ_DEF(void) pj_log_async_get_stat(pj_log_async_stat *stat)
+{
+    stat->written = __atomic_load_n(&log_async.written, __ATOMIC_RELAXED);
+    stat->dropped = __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+    stat->truncated = __atomic_load_n(&log_async.truncated,
+				      __ATOMIC_RELAXED);
+}
+
+#endif	/* PJ_LOG_HAS_ASYNC */
+
+PJ_DEF(void) pj_log( const char *sender, int level, 
+		     const char *format, va_list marker)
+{
+    pj_time_val now;
+    char *pre;
+#if PJ_LOG_USE_STACK_BUFFER
+    char log_buffer[PJ_LOG_MAX_SIZE];
+#endif
+    const char *thread_name = NULL;
+    void *current_thread = NULL;
+    int saved_level, len, print_len, indent = 0;
+
+    PJ_CHECK_STACK();
+
+    if (level > pj_log_max_level)
+	return;
+
+    if (is_logging_suspended())
+	return;
+
+    /* Temporarily disable logging for this thread. Some of PJLIB APIs that
+     * this function calls below will recursively call the logging function 
+     * back, hence it will cause infinite recursive calls if we allow that.
+     */
+    suspend_logging(&saved_level);
+
+#if PJ_LOG_HAS_ASYNC
+    if (log_async_push(sender, level, format, marker)) {
+	resume_logging(&saved_level);
+	return;
+    }
+#endif
+
+    /* Get current date/time. */
+    pj_gettimeofday(&now);
+
+    if (log_decor & PJ_LOG_HAS_THREAD_ID)
+	thread_name = pj_thread_get_name(pj_thread_this());
+    if (log_decor & PJ_LOG_HAS_THREAD_SWC)
+	current_thread = (void*)pj_thread_this();
+#if PJ_LOG_ENABLE_INDENT
+    if (log_decor & PJ_LOG_HAS_INDENT)
+	indent = log_get_indent();
+#endif
+
+    len = print_decor(log_buffer, level, &now, sender, thread_name,
+		      current_thread, indent);
+    pre = log_buffer + len;
+
+    /* Print the whole message to the string log_buffer. */
+    print_len = pj_ansi_vsnprintf(pre, sizeof(log_buffer)-len, format, 
+				  marker);
+    if (print_len < 0) {
+	level = 1;
+	print_len = pj_ansi_snprintf(pre, sizeof(log_buffer)-len, 
+				     "<logging error: msg too long>");
+    }
+    if (print_len < 1 || print_len >= (int)(sizeof(log_buffer)-len)) {
+	print_len = sizeof(log_buffer) - len - 1;
+    }
+    len = terminate_log(log_buffer, sizeof(log_buffer), len + print_len);
+
     /* It should be safe to resume logging at this point. Application can
      * recursively call the logging function inside the callback.
      */
@@ -79,7 +79,9 @@ struct pj_thread_t
 
 struct pj_atomic_t
 {
+#if !PJ_ATOMIC_USE_BUILTINS
     pj_mutex_t	       *mutex;
+#endif
     pj_atomic_value_t	value;
 };
 
@@ -707,6 +709,94 @@ PJ_DEF(pj_status_t) pj_thread_get_stack_info( pj_thread_t *thread,
 #endif	/* PJ_OS_HAS_CHECK_STACK */
 
 ///////////////////////////////////////////////////////////////////////////////
+#if PJ_ATOMIC_USE_BUILTINS
+/*
+ * Atomic variables with the compiler's __atomic builtins. No mutex is
+ * needed, the value is operated on directly. Sequentially consistent
+ * ordering is used everywhere to keep the same guarantees as the mutex
+ * based implementation below.
+ */
+
+/*
+ * pj_atomic_create()
+ */
+PJ_DEF(pj_status_t) pj_atomic_create( pj_pool_t *pool,
+				      pj_atomic_value_t initial,
+				      pj_atomic_t **ptr_atomic)
+{
+    pj_atomic_t *atomic_var;
+
+    atomic_var = PJ_POOL_ZALLOC_T(pool, pj_atomic_t);
+
+    PJ_ASSERT_RETURN(atomic_var, PJ_ENOMEM);
+
+    __atomic_store_n(&atomic_var->value, initial, __ATOMIC_SEQ_CST);
+
+    *ptr_atomic = atomic_var;
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_atomic_destroy()
+ */
+PJ_DEF(pj_status_t) pj_atomic_destroy( pj_atomic_t *atomic_var )
+{
+    PJ_ASSERT_RETURN(atomic_var, PJ_EINVAL);
+    return PJ_SUCCESS;
+}
+
+/*
+ * pj_atomic_set()
+ */
+PJ_DEF(void) pj_atomic_set(pj_atomic_t *atomic_var, pj_atomic_value_t value)
+{
+    PJ_CHECK_STACK();
+    PJ_ASSERT_ON_FAIL(atomic_var, return);
+
+    __atomic_store_n(&atomic_var->value, value, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * pj_atomic_get()
+ */
+PJ_DEF(pj_atomic_value_t) pj_atomic_get(pj_atomic_t *atomic_var)
+{
+    PJ_CHECK_STACK();
+
+    return __atomic_load_n(&atomic_var->value, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * pj_atomic_inc_and_get()
+ */
+PJ_DEF(pj_atomic_value_t) pj_atomic_inc_and_get(pj_atomic_t *atomic_var)
+{
+    PJ_CHECK_STACK();
+
+    return __atomic_add_fetch(&atomic_var->value, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * pj_atomic_dec_and_get()
+ */
+PJ_DEF(pj_atomic_value_t) pj_atomic_dec_and_get(pj_atomic_t *atomic_var)
+{
+    PJ_CHECK_STACK();
+
+    return __atomic_sub_fetch(&atomic_var->value, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * pj_atomic_add_and_get()
+ */
+PJ_DEF(pj_atomic_value_t) pj_atomic_add_and_get( pj_atomic_t *atomic_var,
+                                                 pj_atomic_value_t value )
+{
+    return __atomic_add_fetch(&atomic_var->value, value, __ATOMIC_SEQ_CST);
+}
+
+#else	/* PJ_ATOMIC_USE_BUILTINS */
+
 /*
  * pj_atomic_create()
  */
@@ -812,15 +902,6 @@ PJ_DEF(pj_atomic_value_t) pj_atomic_inc_and_get(pj_atomic_t *atomic_var)
 
     return new_value;
 }
-/*
- * pj_atomic_inc()
- */
-PJ_DEF(void) pj_atomic_inc(pj_atomic_t *atomic_var)
-{
-    PJ_ASSERT_ON_FAIL(atomic_var, return);
-    pj_atomic_inc_and_get(atomic_var);
-}
-
 /*
  * pj_atomic_dec_and_get()
  */
@@ -841,15 +922,6 @@ PJ_DEF(pj_atomic_value_t) pj_atomic_dec_and_get(pj_atomic_t *atomic_var)
     return new_value;
 }
 
-/*
- * pj_atomic_dec()
- */
-PJ_DEF(void) pj_atomic_dec(pj_atomic_t *atomic_var)
-{
-    PJ_ASSERT_ON_FAIL(atomic_var, return);
-    pj_atomic_dec_and_get(atomic_var);
-}
-
 /*
  * pj_atomic_add_and_get()
  */
@@ -872,6 +944,26 @@ PJ_DEF(pj_atomic_value_t) pj_atomic_add_and_get( pj_atomic_t *atomic_var,
     return new_value;
 }
 
+#endif	/* PJ_ATOMIC_USE_BUILTINS */
+
+/*
+ * pj_atomic_inc()
+ */
+PJ_DEF(void) pj_atomic_inc(pj_atomic_t *atomic_var)
+{
+    PJ_ASSERT_ON_FAIL(atomic_var, return);
+    pj_atomic_inc_and_get(atomic_var);
+}
+
+/*
+ * pj_atomic_dec()
+ */
+PJ_DEF(void) pj_atomic_dec(pj_atomic_t *atomic_var)
+{
+    PJ_ASSERT_ON_FAIL(atomic_var, return);
+    pj_atomic_dec_and_get(atomic_var);
+}
+
 /*
  * pj_atomic_add()
  */
@@ -24,6 +24,7 @@
 #include <pj/pj_lock.h>
 #include <pj/pj_os.h>
 #include <pj/pool_buf.h>
+#include <pj/pj_errno.h>
 
 #if !PJ_HAS_POOL_ALT_API
 
@@ -49,6 +50,77 @@ static pj_size_t pool_sizes[PJ_CACHING_POOL_ARRAY_SIZE] =
  */
 #define START_SIZE  5
 
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+
+/* Number of pools moved between the thread cache and the shared free list
+ * each time the lock is acquired.
+ */
+#define CACHE_BATCH	((PJ_CACHING_POOL_THREAD_CACHE_SIZE + 1) / 2)
+
+#if PJ_CACHING_POOL_THREAD_CACHE_SIZE < 1
+#   error "PJ_CACHING_POOL_THREAD_CACHE_SIZE must be at least 1"
+#endif
+
+/* The pool's factory data holds the index of the pool size in the lower
+ * bits and the ID of the thread cache that gave out the pool in the
+ * upper bits.
+ */
+#define IDX_BITS	8
+#define IDX_MASK	((1 << IDX_BITS) - 1)
+#define GET_IDX(pool)	((unsigned)(pj_ssize_t)(pool)->factory_data & IDX_MASK)
+#define GET_OWNER(pool)	((unsigned)((pj_ssize_t)(pool)->factory_data >> \
+				    IDX_BITS))
+#define SET_FACTORY_DATA(pool, idx, owner) \
+	    (pool)->factory_data = (void*)(pj_ssize_t) \
+				   ((idx) | ((pj_ssize_t)(owner) << IDX_BITS))
+
+/* Per-thread cache. */
+typedef struct thread_cache
+{
+    PJ_DECL_LIST_MEMBER(struct thread_cache);
+
+    /* ID of this cache, starting from 1. */
+    unsigned	    id;
+
+    /* Released pools, indexed by pool size. */
+    pj_list	    mag[PJ_CACHING_POOL_ARRAY_SIZE];
+    unsigned	    mag_cnt[PJ_CACHING_POOL_ARRAY_SIZE];
+
+    /* Total capacity of the pools in the magazines. */
+    pj_size_t	    cached_size;
+
+    /* Capacity reserved from the caching pool's max_capacity, at least
+     * cached_size. The surplus lets released pools be cached without
+     * taking the lock.
+     */
+    pj_size_t	    reserved;
+
+    /* Statistics. */
+    pj_size_t	    hits;
+    pj_size_t	    misses;
+    pj_size_t	    cross_thread_frees;
+
+} thread_cache;
+
+/* With the thread cache, the used count is also updated without the lock,
+ * so every update must be atomic.
+ */
+#if defined(__GNUC__)
+#   define USED_COUNT_ADD(cp, n)    __atomic_add_fetch(&(cp)->used_count, \
+						       (pj_size_t)(n), \
+						       __ATOMIC_RELAXED)
+#   define HAS_ATOMIC_USED_COUNT    1
+#else
+#   define USED_COUNT_ADD(cp, n)    ((cp)->used_count += (pj_size_t)(n))
+#   define HAS_ATOMIC_USED_COUNT    0
+#endif
+
+static void drain_thread_cache(pj_caching_pool *cp, thread_cache *tc);
+
+#else
+#   define USED_COUNT_ADD(cp, n)    ((cp)->used_count += (pj_size_t)(n))
+#endif	/* PJ_CACHING_POOL_HAS_THREAD_CACHE */
+
 
 PJ_DEF(void) pj_caching_pool_init( pj_caching_pool *cp, 
 				   const pj_pool_factory_policy *policy,
@@ -79,6 +151,15 @@ PJ_DEF(void) pj_caching_pool_init( pj_caching_pool *cp,
 
     pool = pj_pool_create_on_buf("cachingpool", cp->pool_buf, sizeof(cp->pool_buf));
     pj_lock_create_simple_mutex(pool, "cachingpool", &cp->lock);
+
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    pj_list_init(&cp->thread_cache_list);
+    if (pj_thread_local_alloc(&cp->thread_cache_tls) != PJ_SUCCESS) {
+	PJ_LOG(4,("cachpool", "Unable to allocate thread local, "
+			      "thread cache is disabled"));
+	cp->thread_cache_tls = -1;
+    }
+#endif
 }
 
 PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
@@ -88,6 +169,19 @@ PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
 
     PJ_CHECK_STACK();
 
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    /* Move the pools in the thread caches to the free list, they will be
+     * deleted below.
+     */
+    if (cp->thread_cache_tls != -1) {
+	pj_thread_local_free(cp->thread_cache_tls);
+	cp->thread_cache_tls = -1;
+    }
+    while (!pj_list_empty(&cp->thread_cache_list)) {
+	drain_thread_cache(cp, (thread_cache*) cp->thread_cache_list.next);
+    }
+#endif
+
     /* Delete all pool in free list */
     for (i=0; i < PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
 	pj_pool_t *next;
@@ -116,6 +210,320 @@ PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
     }
 }
 
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+/*
+ * Get the cache of the calling thread, creating it if necessary.
+ */
+static thread_cache *get_thread_cache(pj_caching_pool *cp)
+{
+    thread_cache *tc;
+    unsigned i;
+
+    if (cp->thread_cache_tls == -1)
+	return NULL;
+
+    tc = (thread_cache*) pj_thread_local_get(cp->thread_cache_tls);
+    if (tc)
+	return tc;
+
+    tc = (thread_cache*)
+	 cp->factory.policy.block_alloc(&cp->factory, sizeof(*tc));
+    if (!tc)
+	return NULL;
+
+    pj_bzero(tc, sizeof(*tc));
+    for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i)
+	pj_list_init(&tc->mag[i]);
+
+    if (pj_thread_local_set(cp->thread_cache_tls, tc) != PJ_SUCCESS) {
+	cp->factory.policy.block_free(&cp->factory, tc, sizeof(*tc));
+	return NULL;
+    }
+
+    pj_lock_acquire(cp->lock);
+    tc->id = ++cp->thread_cache_cnt;
+    pj_list_push_back(&cp->thread_cache_list, tc);
+    pj_lock_release(cp->lock);
+
+    return tc;
+}
+
+/*
+ * Update the used count from the thread cache path, where the lock is
+ * not held.
+ */
+static void thread_cache_add_used(pj_caching_pool *cp, int n)
+{
+#if HAS_ATOMIC_USED_COUNT
+    USED_COUNT_ADD(cp, n);
+#else
+    pj_lock_acquire(cp->lock);
+    USED_COUNT_ADD(cp, n);
+    pj_lock_release(cp->lock);
+#endif
+}
+
+/*
+ * Return the surplus reservation of the thread cache to the caching pool,
+ * then try to reserve extra bytes for a pool about to be cached. Returns
+ * PJ_FALSE if that would exceed max_capacity. Must be called with the
+ * lock held.
+ */
+static pj_bool_t reserve_capacity(pj_caching_pool *cp, thread_cache *tc,
+				  pj_size_t extra)
+{
+    cp->capacity -= tc->reserved - tc->cached_size;
+    tc->reserved = tc->cached_size;
+
+    if (cp->capacity + extra > cp->max_capacity)
+	return PJ_FALSE;
+
+    cp->capacity += extra;
+    tc->reserved += extra;
+    return PJ_TRUE;
+}
+
+/*
+ * Put the pool in the shared free list, or destroy it if the free list
+ * is full. Must be called with the lock held.
+ */
+static void put_free_list(pj_caching_pool *cp, pj_pool_t *pool,
+			  unsigned idx)
+{
+    pj_size_t pool_capacity = pj_pool_get_capacity(pool);
+
+    if (cp->capacity + pool_capacity > cp->max_capacity) {
+	pj_pool_destroy_int(pool);
+	return;
+    }
+
+    pj_list_insert_after(&cp->free_list[idx], pool);
+    cp->capacity += pool_capacity;
+}
+
+/*
+ * Get a pool from the shared free list, or NULL if the list is empty.
+ * Must be called with the lock held.
+ */
+static pj_pool_t *get_free_list(pj_caching_pool *cp, unsigned idx)
+{
+    pj_pool_t *pool;
+
+    if (pj_list_empty(&cp->free_list[idx]))
+	return NULL;
+
+    pool = (pj_pool_t*) cp->free_list[idx].next;
+    pj_list_erase(pool);
+
+    if (cp->capacity > pj_pool_get_capacity(pool)) {
+	cp->capacity -= pj_pool_get_capacity(pool);
+    } else {
+	cp->capacity = 0;
+    }
+
+    return pool;
+}
+
+static pj_pool_t* thread_cache_create_pool(pj_caching_pool *cp,
+					   unsigned idx,
+					   const char *name,
+					   pj_size_t increment_sz,
+					   pj_pool_callback *callback)
+{
+    thread_cache *tc = get_thread_cache(cp);
+    pj_pool_t *pool = NULL;
+
+    if (tc) {
+	if (tc->mag_cnt[idx] == 0) {
+	    /* Refill the magazine from the shared free list. The pools stay
+	     * counted in the caching pool's capacity, now as reserved by
+	     * this thread.
+	     */
+	    ++tc->misses;
+
+	    pj_lock_acquire(cp->lock);
+	    reserve_capacity(cp, tc, 0);
+	    while (tc->mag_cnt[idx] < CACHE_BATCH &&
+		   (pool = get_free_list(cp, idx)) != NULL)
+	    {
+		pj_size_t pool_capacity = pj_pool_get_capacity(pool);
+
+		cp->capacity += pool_capacity;
+		tc->reserved += pool_capacity;
+		tc->cached_size += pool_capacity;
+		pj_list_push_back(&tc->mag[idx], pool);
+		++tc->mag_cnt[idx];
+	    }
+	    pj_lock_release(cp->lock);
+	} else {
+	    ++tc->hits;
+	}
+
+	if (tc->mag_cnt[idx]) {
+	    pool = (pj_pool_t*) tc->mag[idx].next;
+	    pj_list_erase(pool);
+	    --tc->mag_cnt[idx];
+	    tc->cached_size -= pj_pool_get_capacity(pool);
+
+	    pj_pool_init_int(pool, name, increment_sz, callback);
+	    PJ_LOG(6, (pool->obj_name, "pool reused, size=%u",
+		       pool->capacity));
+	} else {
+	    pool = pj_pool_create_int(&cp->factory, name, pool_sizes[idx],
+				      increment_sz, callback);
+	    if (!pool)
+		return NULL;
+	}
+
+	thread_cache_add_used(cp, 1);
+
+    } else {
+	/* No thread cache, use the shared free list */
+	pj_lock_acquire(cp->lock);
+	pool = get_free_list(cp, idx);
+	if (pool) {
+	    pj_pool_init_int(pool, name, increment_sz, callback);
+	} else {
+	    pool = pj_pool_create_int(&cp->factory, name, pool_sizes[idx],
+				      increment_sz, callback);
+	}
+	if (pool)
+	    USED_COUNT_ADD(cp, 1);
+	pj_lock_release(cp->lock);
+
+	if (!pool)
+	    return NULL;
+    }
+
+    /* Mark factory data */
+    SET_FACTORY_DATA(pool, idx, (tc ? tc->id : 0));
+
+    return pool;
+}
+
+static void thread_cache_release_pool(pj_caching_pool *cp, pj_pool_t *pool)
+{
+    thread_cache *tc = get_thread_cache(cp);
+    unsigned idx = GET_IDX(pool);
+    pj_size_t pool_capacity;
+
+    pool_capacity = pj_pool_get_capacity(pool);
+
+    /* Destroy the pool if it has grown larger than our size. */
+    if (pool_capacity > pool_sizes[PJ_CACHING_POOL_ARRAY_SIZE-1]) {
+	pj_pool_destroy_int(pool);
+	pool = NULL;
+    } else {
+	PJ_LOG(6, (pool->obj_name, "recycle(): cap=%d, used=%d(%d%%)",
+		   pool_capacity, pj_pool_get_used_size(pool),
+		   pj_pool_get_used_size(pool)*100/pool_capacity));
+	pj_pool_reset(pool);
+    }
+
+    if (!tc) {
+	pj_lock_acquire(cp->lock);
+	USED_COUNT_ADD(cp, -1);
+	if (pool)
+	    put_free_list(cp, pool, idx);
+	pj_lock_release(cp->lock);
+	return;
+    }
+
+    thread_cache_add_used(cp, -1);
+    if (!pool)
+	return;
+
+    if (GET_OWNER(pool) != tc->id)
+	++tc->cross_thread_frees;
+
+    pool_capacity = pj_pool_get_capacity(pool);
+
+    if (tc->mag_cnt[idx] >= PJ_CACHING_POOL_THREAD_CACHE_SIZE ||
+	tc->cached_size + pool_capacity > tc->reserved)
+    {
+	pj_lock_acquire(cp->lock);
+
+	if (tc->mag_cnt[idx] >= PJ_CACHING_POOL_THREAD_CACHE_SIZE) {
+	    /* Move the oldest pools to the shared free list */
+	    unsigned i;
+
+	    for (i=0; i < CACHE_BATCH; ++i) {
+		pj_pool_t *old = (pj_pool_t*) tc->mag[idx].prev;
+		pj_size_t old_capacity = pj_pool_get_capacity(old);
+
+		pj_list_erase(old);
+		--tc->mag_cnt[idx];
+		tc->cached_size -= old_capacity;
+		tc->reserved -= old_capacity;
+		cp->capacity -= old_capacity;
+		put_free_list(cp, old, idx);
+	    }
+	}
+
+	/* Count the pool against max_capacity, or destroy it. */
+	if (!reserve_capacity(cp, tc, pool_capacity)) {
+	    put_free_list(cp, pool, idx);
+	    pj_lock_release(cp->lock);
+	    return;
+	}
+
+	pj_lock_release(cp->lock);
+    }
+
+    pj_list_insert_after(&tc->mag[idx], pool);
+    ++tc->mag_cnt[idx];
+    tc->cached_size += pool_capacity;
+}
+
+/*
+ * Move the pools of a thread cache to the shared free list and free the
+ * cache. Must be called with the lock held.
+ */
+static void drain_thread_cache(pj_caching_pool *cp, thread_cache *tc)
+{
+    unsigned i;
+
+    pj_list_erase(tc);
+    cp->capacity -= tc->reserved;
+
+    for (i=0; i < PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
+	while (!pj_list_empty(&tc->mag[i])) {
+	    pj_pool_t *pool = (pj_pool_t*) tc->mag[i].next;
+
+	    pj_list_erase(pool);
+	    put_free_list(cp, pool, i);
+	}
+    }
+
+    cp->factory.policy.block_free(&cp->factory, tc, sizeof(*tc));
+}
+
+#endif	/* PJ_CACHING_POOL_HAS_THREAD_CACHE */
+
+PJ_DEF(void) pj_caching_pool_release_thread_cache( pj_caching_pool *cp )
+{
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    thread_cache *tc;
+
+    PJ_ASSERT_ON_FAIL(cp, return);
+
+    if (cp->thread_cache_tls == -1)
+	return;
+
+    tc = (thread_cache*) pj_thread_local_get(cp->thread_cache_tls);
+    if (!tc)
+	return;
+
+    pj_thread_local_set(cp->thread_cache_tls, NULL);
+
+    pj_lock_acquire(cp->lock);
+    drain_thread_cache(cp, tc);
+    pj_lock_release(cp->lock);
+#else
+    PJ_UNUSED_ARG(cp);
+#endif
+}
+
 static pj_pool_t* cpool_create_pool(pj_pool_factory *pf, 
 					      const char *name, 
 					      pj_size_t initial_size, 
@@ -128,8 +536,6 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
 
     PJ_CHECK_STACK();
 
-    pj_lock_acquire(cp->lock);
-
     /* Use pool factory's policy when callback is NULL */
     if (callback == NULL) {
 	callback = pf->policy.callback;
@@ -154,6 +560,15 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
 	    ;
     }
 
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    if (idx < PJ_CACHING_POOL_ARRAY_SIZE) {
+	return thread_cache_create_pool(cp, idx, name, increment_sz,
+					callback);
+    }
+#endif
+
+    pj_lock_acquire(cp->lock);
+
     /* Check whether there's a pool in the list. */
     if (idx==PJ_CACHING_POOL_ARRAY_SIZE || pj_list_empty(&cp->free_list[idx])) {
 	/* No pool is available. */
@@ -194,7 +609,7 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
     pool->factory_data = (void*) (pj_ssize_t) idx;
 
     /* Increment used count. */
-    ++cp->used_count;
+    USED_COUNT_ADD(cp, 1);
 
     pj_lock_release(cp->lock);
     return pool;
@@ -210,6 +625,13 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
 
     PJ_ASSERT_ON_FAIL(pf && pool, return);
 
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    if (GET_IDX(pool) < PJ_CACHING_POOL_ARRAY_SIZE) {
+	thread_cache_release_pool(cp, pool);
+	return;
+    }
+#endif
+
     pj_lock_acquire(cp->lock);
 
 #if PJ_SAFE_POOL
@@ -224,7 +646,7 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
     pj_list_erase(pool);
 
     /* Decrement used count. */
-    --cp->used_count;
+    USED_COUNT_ADD(cp, -1);
 
     pool_capacity = pj_pool_get_capacity(pool);
 
@@ -267,6 +689,52 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
     pj_lock_release(cp->lock);
 }
 
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+/*
+ * Collect the statistics of all thread caches. Must be called with the
+ * lock held.
+ */
+static void get_thread_cache_stat(pj_caching_pool *cp,
+				  pj_caching_pool_thread_cache_stat *stat)
+{
+    thread_cache *tc;
+
+    pj_bzero(stat, sizeof(*stat));
+
+    tc = (thread_cache*) cp->thread_cache_list.next;
+    while (tc != (void*)&cp->thread_cache_list) {
+	unsigned i;
+
+	++stat->thread_cnt;
+	for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i)
+	    stat->cached_cnt += tc->mag_cnt[i];
+	stat->hits += tc->hits;
+	stat->misses += tc->misses;
+	stat->cross_thread_frees += tc->cross_thread_frees;
+
+	tc = tc->next;
+    }
+}
+#endif	/* PJ_CACHING_POOL_HAS_THREAD_CACHE */
+
+PJ_DEF(pj_status_t) pj_caching_pool_get_thread_cache_stat(
+				    pj_caching_pool *cp,
+				    pj_caching_pool_thread_cache_stat *stat)
+{
+    PJ_ASSERT_RETURN(cp && stat, PJ_EINVAL);
+
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    pj_lock_acquire(cp->lock);
+    get_thread_cache_stat(cp, stat);
+    pj_lock_release(cp->lock);
+
+    return PJ_SUCCESS;
+#else
+    pj_bzero(stat, sizeof(*stat));
+    return PJ_ENOTSUP;
+#endif
+}
+
 static void cpool_dump_status(pj_pool_factory *factory, pj_bool_t detail )
 {
 #if PJ_LOG_MAX_LEVEL >= 3
@@ -275,8 +743,24 @@ static void cpool_dump_status(pj_pool_factory *factory, pj_bool_t detail )
     pj_lock_acquire(cp->lock);
 
     PJ_LOG(3,("cachpool", " Dumping caching pool:"));
-    PJ_LOG(3,("cachpool", "   Capacity=%u, max_capacity=%u, used_cnt=%u", \
-			     cp->capacity, cp->max_capacity, cp->used_count));
+    PJ_LOG(3,("cachpool", "   Capacity=%lu, max_capacity=%lu, used_cnt=%lu", \
+			     (unsigned long)cp->capacity,
+			     (unsigned long)cp->max_capacity,
+			     (unsigned long)cp->used_count));
+#if PJ_CACHING_POOL_HAS_THREAD_CACHE
+    {
+	pj_caching_pool_thread_cache_stat stat;
+
+	get_thread_cache_stat(cp, &stat);
+	PJ_LOG(3,("cachpool", "   Thread caches=%u, cached_cnt=%lu, hits=%lu, "
+			      "misses=%lu, cross_thread_frees=%lu",
+			      stat.thread_cnt,
+			      (unsigned long)stat.cached_cnt,
+			      (unsigned long)stat.hits,
+			      (unsigned long)stat.misses,
+			      (unsigned long)stat.cross_thread_frees));
+    }
+#endif
     if (detail) {
 	pj_pool_t *pool = (pj_pool_t*) cp->used_list.next;
 	pj_size_t total_used = 0, total_capacity = 0;
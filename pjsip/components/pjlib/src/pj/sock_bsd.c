@@ -17,6 +17,11 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
+/* Needed for recvmmsg() and sendmmsg() */
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
 #include <pj/sock.h>
 #include <pj/pj_os.h>
 #include <pj/pj_assert.h>
@@ -24,6 +29,7 @@
 #include <pj/compat/socket.h>
 #include <pj/addr_resolv.h>
 #include <pj/pj_errno.h>
+#include <pj/pj_math.h>
 #include <pj/unicode.h>
 
 #define THIS_FILE	"sock_bsd.c"
@@ -685,6 +691,45 @@ PJ_DEF(pj_status_t) pj_sock_sendto(pj_sock_t sock,
 	return PJ_SUCCESS;
 }
 
+/*
+ * Send data from several buffers.
+ */
+PJ_DEF(pj_status_t) pj_sock_sendv(pj_sock_t sock,
+				  const pj_iovec_t iov[],
+				  unsigned iovcnt,
+				  pj_ssize_t *len,
+				  unsigned flags)
+{
+    struct msghdr hdr;
+    struct iovec vec[PJ_SOCK_MAX_IOV];
+    unsigned i;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(iov && iovcnt && len, PJ_EINVAL);
+    PJ_ASSERT_RETURN(iovcnt <= PJ_SOCK_MAX_IOV, PJ_ETOOMANY);
+
+#ifdef MSG_NOSIGNAL
+    /* Suppress SIGPIPE. See https://trac.pjsip.org/repos/ticket/1538 */
+    flags |= MSG_NOSIGNAL;
+#endif
+
+    for (i=0; i<iovcnt; ++i) {
+	vec[i].iov_base = iov[i].buf;
+	vec[i].iov_len = iov[i].len;
+    }
+
+    pj_bzero(&hdr, sizeof(hdr));
+    hdr.msg_iov = vec;
+    hdr.msg_iovlen = iovcnt;
+
+    *len = sendmsg(sock, &hdr, flags);
+
+    if (*len < 0) 
+	return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    else 
+	return PJ_SUCCESS;
+}
+
 /*
  * Receive data.
  */
@@ -730,6 +775,101 @@ PJ_DEF(pj_status_t) pj_sock_recvfrom(pj_sock_t sock,
     }
 }
 
+#if PJ_HAS_SOCK_MMSG
+/*
+ * Receive several datagrams.
+ */
+PJ_DEF(pj_status_t) pj_sock_recvmmsg(pj_sock_t sock,
+				     pj_sock_mmsg msg[],
+				     unsigned *count,
+				     unsigned flags)
+{
+    struct mmsghdr hdr[PJ_SOCK_MAX_MMSG];
+    struct iovec iov[PJ_SOCK_MAX_MMSG];
+    unsigned i, cnt;
+    int rc;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msg && count && *count, PJ_EINVAL);
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    pj_bzero(hdr, cnt * sizeof(hdr[0]));
+    for (i=0; i<cnt; ++i) {
+	iov[i].iov_base = msg[i].buf;
+	iov[i].iov_len = msg[i].len;
+	hdr[i].msg_hdr.msg_iov = &iov[i];
+	hdr[i].msg_hdr.msg_iovlen = 1;
+	if (msg[i].addr) {
+	    hdr[i].msg_hdr.msg_name = msg[i].addr;
+	    hdr[i].msg_hdr.msg_namelen = msg[i].addr_len;
+	}
+    }
+
+    /* Only the first datagram may block */
+    rc = recvmmsg(sock, hdr, cnt, flags | MSG_WAITFORONE, NULL);
+    if (rc < 0) {
+	*count = 0;
+	return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    }
+
+    for (i=0; i<(unsigned)rc; ++i) {
+	msg[i].len = hdr[i].msg_len;
+	if (msg[i].addr) {
+	    msg[i].addr_len = hdr[i].msg_hdr.msg_namelen;
+	    PJ_SOCKADDR_RESET_LEN(msg[i].addr);
+	}
+    }
+    *count = rc;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Send several datagrams.
+ */
+PJ_DEF(pj_status_t) pj_sock_sendmmsg(pj_sock_t sock,
+				     pj_sock_mmsg msg[],
+				     unsigned *count,
+				     unsigned flags)
+{
+    struct mmsghdr hdr[PJ_SOCK_MAX_MMSG];
+    struct iovec iov[PJ_SOCK_MAX_MMSG];
+    unsigned i, cnt;
+    int rc;
+
+    PJ_CHECK_STACK();
+    PJ_ASSERT_RETURN(msg && count && *count, PJ_EINVAL);
+
+#ifdef MSG_NOSIGNAL
+    /* Suppress SIGPIPE. See https://trac.pjsip.org/repos/ticket/1538 */
+    flags |= MSG_NOSIGNAL;
+#endif
+
+    cnt = PJ_MIN(*count, PJ_SOCK_MAX_MMSG);
+    pj_bzero(hdr, cnt * sizeof(hdr[0]));
+    for (i=0; i<cnt; ++i) {
+	iov[i].iov_base = msg[i].buf;
+	iov[i].iov_len = msg[i].len;
+	hdr[i].msg_hdr.msg_iov = &iov[i];
+	hdr[i].msg_hdr.msg_iovlen = 1;
+	hdr[i].msg_hdr.msg_name = msg[i].addr;
+	hdr[i].msg_hdr.msg_namelen = msg[i].addr_len;
+    }
+
+    rc = sendmmsg(sock, hdr, cnt, flags);
+    if (rc < 0) {
+	*count = 0;
+	return PJ_RETURN_OS_ERROR(pj_get_native_netos_error());
+    }
+
+    for (i=0; i<(unsigned)rc; ++i)
+	msg[i].len = hdr[i].msg_len;
+    *count = rc;
+
+    return PJ_SUCCESS;
+}
+#endif	/* PJ_HAS_SOCK_MMSG */
+
 /*
  * Get socket option.
  */
@@ -1416,8 +1416,15 @@ PJ_DEF(pj_status_t) pj_ssl_sock_get_info (pj_ssl_sock_t *ssock,
 
 	/* Verification status */
 	info->verify_status = ssock->verify_status;
+
+	/* Session resumption */
+	info->session_reused = ssock->session_reused;
     }
 
+    /* Session cache statistics */
+    info->session_cache_hits = ssl_sess_hits;
+    info->session_cache_misses = ssl_sess_misses;
+
     /* Last known SSL error code */
     info->last_native_err = ssock->last_err;
 
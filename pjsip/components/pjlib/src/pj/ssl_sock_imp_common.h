@@ -113,6 +113,7 @@ struct pj_ssl_sock_t
     pj_ioqueue_op_key_t	  shutdown_op_key;
     pj_timer_entry	  timer;
     pj_status_t		  verify_status;
+    pj_bool_t		  session_reused;
 
     unsigned long	  last_err;
 
@@ -177,6 +178,10 @@ static struct ssl_curves_t {
     const char	    *name;
 } ssl_curves[PJ_SSL_SOCK_MAX_CURVES];
 
+/* Session cache statistics, maintained by the backend */
+static unsigned ssl_sess_hits;
+static unsigned ssl_sess_misses;
+
 /*
  *******************************************************************
  * I/O functions.
@@ -449,6 +449,18 @@ static pj_status_t io_write(pj_ssl_sock_t *ssock, circ_buf_t *cb,
  *******************************************************************
  */
 
+#if PJ_SSL_SOCK_SESS_CACHE_SIZE && !USING_LIBRESSL && \
+    OPENSSL_VERSION_NUMBER >= 0x10100000L
+#  define SSL_SESS_CACHE    1
+#else
+#  define SSL_SESS_CACHE    0
+#endif
+
+#if SSL_SESS_CACHE
+static pj_status_t sess_cache_init(void);
+static void sess_cache_shutdown(void);
+#endif
+
 /* OpenSSL library initialization counter */
 static int openssl_init_count;
 
@@ -457,12 +469,17 @@ static int sslsock_idx;
 
 
 /* Initialize OpenSSL */
+static void shutdown_openssl(void);
+
 static pj_status_t init_openssl(void)
 {
     pj_status_t status;
 
-    if (openssl_init_count)
+    pj_enter_critical_section();
+    if (openssl_init_count) {
+	pj_leave_critical_section();
 	return PJ_SUCCESS;
+    }
 
     openssl_init_count = 1;
 
@@ -588,16 +605,331 @@ static pj_status_t init_openssl(void)
     /* Create OpenSSL application data index for SSL socket */
     sslsock_idx = SSL_get_ex_new_index(0, "SSL socket", NULL, NULL, NULL);
 
+#if SSL_SESS_CACHE
+    /* The session cache lives as long as the library */
+    if (sess_cache_init() != PJ_SUCCESS)
+	PJ_LOG(2,(THIS_FILE, "Failed creating TLS session cache"));
+#endif
+
+    pj_atexit(&shutdown_openssl);
+    pj_leave_critical_section();
+
     return status;
 }
 
 
-/* Shutdown OpenSSL */
+/* Shutdown OpenSSL, called by pj_shutdown() */
 static void shutdown_openssl(void)
 {
-    PJ_UNUSED_ARG(openssl_init_count);
+#if SSL_SESS_CACHE
+    sess_cache_shutdown();
+#endif
+    openssl_init_count = 0;
+}
+
+
+
+/*
+ *******************************************************************
+ * TLS session cache.
+ *
+ * Each SSL socket has its own SSL_CTX, so OpenSSL's internal session
+ * cache and ticket keys are never shared between connections. Keep the
+ * sessions in a process wide cache instead, and give every server
+ * context the same ticket keys.
+ *******************************************************************
+ */
+#if SSL_SESS_CACHE
+
+/* Client sessions are keyed by "address:port/server name", server
+ * sessions by session ID.
+ */
+#define SESS_KEY_LEN	(PJ_INET6_ADDRSTRLEN + 10 + PJ_MAX_HOSTNAME)
+
+typedef struct sess_entry
+{
+    PJ_DECL_LIST_MEMBER(struct sess_entry);
+    unsigned char	 key[SESS_KEY_LEN];
+    unsigned		 key_len;
+    SSL_SESSION		*sess;
+    pj_time_val		 expire;
+} sess_entry;
+
+typedef struct sess_cache
+{
+    sess_entry		 used;		/* Most recently used first.	*/
+    sess_entry		 free;
+    sess_entry		 entries[PJ_SSL_SOCK_SESS_CACHE_SIZE];
+} sess_cache;
+
+static CRYPTO_RWLOCK *sess_lock;
+static sess_cache    client_sess_cache;
+static sess_cache    server_sess_cache;
+static unsigned char sess_ticket_keys[80];
+static int	     sess_ticket_keys_len;
+
+
+static void sess_cache_reset(sess_cache *cache)
+{
+    unsigned i;
+
+    pj_list_init(&cache->used);
+    pj_list_init(&cache->free);
+    for (i = 0; i < PJ_ARRAY_SIZE(cache->entries); ++i)
+	pj_list_push_back(&cache->free, &cache->entries[i]);
 }
 
+static void sess_entry_free(sess_cache *cache, sess_entry *e)
+{
+    SSL_SESSION_free(e->sess);
+    e->sess = NULL;
+    pj_list_erase(e);
+    pj_list_push_back(&cache->free, e);
+}
+
+static void sess_cache_clear(sess_cache *cache)
+{
+    while (!pj_list_empty(&cache->used))
+	sess_entry_free(cache, cache->used.next);
+}
+
+/* Called once by init_openssl(). The lock comes from OpenSSL rather than
+ * from a pool, since the cache is only torn down by pj_shutdown(), when
+ * the pool factory of the application may already be gone.
+ */
+static pj_status_t sess_cache_init(void)
+{
+    sess_lock = CRYPTO_THREAD_lock_new();
+    if (!sess_lock)
+	return PJ_ENOMEM;
+
+    sess_cache_reset(&client_sess_cache);
+    sess_cache_reset(&server_sess_cache);
+
+    return PJ_SUCCESS;
+}
+
+static void sess_cache_shutdown(void)
+{
+    if (!sess_lock)
+	return;
+
+    sess_cache_clear(&client_sess_cache);
+    sess_cache_clear(&server_sess_cache);
+    pj_bzero(sess_ticket_keys, sizeof(sess_ticket_keys));
+    sess_ticket_keys_len = 0;
+
+    CRYPTO_THREAD_lock_free(sess_lock);
+    sess_lock = NULL;
+}
+
+/* Find a live entry and make it the most recently used. Must be called
+ * with sess_lock held.
+ */
+static sess_entry *sess_find(sess_cache *cache, const unsigned char *key,
+			     unsigned key_len)
+{
+    sess_entry *e;
+    pj_time_val now;
+
+    pj_gettickcount(&now);
+    for (e = cache->used.next; e != &cache->used; e = e->next) {
+	if (e->key_len != key_len || pj_memcmp(e->key, key, key_len) != 0)
+	    continue;
+
+	if (PJ_TIME_VAL_GTE(now, e->expire)) {
+	    sess_entry_free(cache, e);
+	    return NULL;
+	}
+
+	pj_list_erase(e);
+	pj_list_push_front(&cache->used, e);
+	return e;
+    }
+
+    return NULL;
+}
+
+/* Store a session, the cache takes over the reference. */
+static void sess_put(sess_cache *cache, const unsigned char *key,
+		     unsigned key_len, SSL_SESSION *sess)
+{
+    sess_entry *e;
+
+    if (key_len > SESS_KEY_LEN) {
+	SSL_SESSION_free(sess);
+	return;
+    }
+
+    CRYPTO_THREAD_write_lock(sess_lock);
+
+    e = sess_find(cache, key, key_len);
+    if (e) {
+	SSL_SESSION_free(e->sess);
+    } else {
+	/* Evict the least recently used one when full */
+	if (pj_list_empty(&cache->free))
+	    sess_entry_free(cache, cache->used.prev);
+
+	e = cache->free.next;
+	pj_list_erase(e);
+	pj_list_push_front(&cache->used, e);
+	pj_memcpy(e->key, key, key_len);
+	e->key_len = key_len;
+    }
+
+    e->sess = sess;
+    pj_gettickcount(&e->expire);
+    e->expire.sec += PJ_SSL_SOCK_SESS_CACHE_TIMEOUT;
+
+    CRYPTO_THREAD_unlock(sess_lock);
+}
+
+static unsigned sess_client_key(pj_ssl_sock_t *ssock, unsigned char *key)
+{
+    char *p = (char*)key;
+    int len;
+
+    pj_sockaddr_print(&ssock->rem_addr, p, PJ_INET6_ADDRSTRLEN + 10, 3);
+    len = (int)pj_ansi_strlen(p);
+    len += pj_ansi_snprintf(p + len, SESS_KEY_LEN - len, "/%.*s",
+			    (int)ssock->param.server_name.slen,
+			    ssock->param.server_name.ptr);
+
+    return (len < SESS_KEY_LEN) ? len : SESS_KEY_LEN;
+}
+
+/* New client session, e.g: after handshake or TLS 1.3 ticket. */
+static int client_new_sess_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    pj_ssl_sock_t *ssock;
+    unsigned char key[SESS_KEY_LEN];
+
+    ssock = (pj_ssl_sock_t*)SSL_get_ex_data(ssl, sslsock_idx);
+    if (!ssock)
+	return 0;
+
+    sess_put(&client_sess_cache, key, sess_client_key(ssock, key), sess);
+    return 1;
+}
+
+/* Offer the cached session of the remote peer, if any. */
+static void client_resume_sess(pj_ssl_sock_t *ssock)
+{
+    ossl_sock_t *ossock = (ossl_sock_t *)ssock;
+    unsigned char key[SESS_KEY_LEN];
+    unsigned key_len;
+    sess_entry *e;
+
+    key_len = sess_client_key(ssock, key);
+
+    CRYPTO_THREAD_write_lock(sess_lock);
+    e = sess_find(&client_sess_cache, key, key_len);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (e && !SSL_SESSION_is_resumable(e->sess)) {
+	sess_entry_free(&client_sess_cache, e);
+	e = NULL;
+    }
+#endif
+    if (e)
+	SSL_set_session(ossock->ossl_ssl, e->sess);
+    CRYPTO_THREAD_unlock(sess_lock);
+}
+
+static int server_new_sess_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    const unsigned char *id;
+    unsigned int id_len;
+
+    PJ_UNUSED_ARG(ssl);
+
+    id = SSL_SESSION_get_id(sess, &id_len);
+    sess_put(&server_sess_cache, id, id_len, sess);
+    return 1;
+}
+
+static SSL_SESSION *server_get_sess_cb(SSL *ssl, const unsigned char *id,
+				       int id_len, int *copy)
+{
+    SSL_SESSION *sess = NULL;
+    sess_entry *e;
+
+    PJ_UNUSED_ARG(ssl);
+
+    CRYPTO_THREAD_write_lock(sess_lock);
+    e = sess_find(&server_sess_cache, id, id_len);
+    if (e) {
+	/* Let OpenSSL take its own reference */
+	sess = e->sess;
+	*copy = 1;
+    }
+    CRYPTO_THREAD_unlock(sess_lock);
+
+    return sess;
+}
+
+static void server_remove_sess_cb(SSL_CTX *ctx, SSL_SESSION *sess)
+{
+    const unsigned char *id;
+    unsigned int id_len;
+    sess_entry *e;
+
+    PJ_UNUSED_ARG(ctx);
+
+    id = SSL_SESSION_get_id(sess, &id_len);
+
+    CRYPTO_THREAD_write_lock(sess_lock);
+    e = sess_find(&server_sess_cache, id, id_len);
+    if (e)
+	sess_entry_free(&server_sess_cache, e);
+    CRYPTO_THREAD_unlock(sess_lock);
+}
+
+/* Setup session caching of a new SSL context. */
+static void sess_cache_setup_ctx(pj_ssl_sock_t *ssock, SSL_CTX *ctx)
+{
+    static const unsigned char sid_ctx[] = "pjlib";
+
+    if (!sess_lock)
+	return;
+
+    if (!ssock->is_server) {
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+					    SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, &client_new_sess_cb);
+	return;
+    }
+
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER |
+					SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_set_timeout(ctx, PJ_SSL_SOCK_SESS_CACHE_TIMEOUT);
+    SSL_CTX_sess_set_new_cb(ctx, &server_new_sess_cb);
+    SSL_CTX_sess_set_get_cb(ctx, &server_get_sess_cb);
+    SSL_CTX_sess_set_remove_cb(ctx, &server_remove_sess_cb);
+
+    /* Share the ticket keys among all server contexts. The keys are made
+     * once and only renewed after pj_shutdown(), see
+     * PJ_SSL_SOCK_SESS_CACHE_SIZE.
+     */
+    CRYPTO_THREAD_write_lock(sess_lock);
+    if (sess_ticket_keys_len == 0) {
+	int len = (int)SSL_CTX_get_tlsext_ticket_keys(ctx, NULL, 0);
+
+	if (len > 0 && len <= (int)sizeof(sess_ticket_keys) &&
+	    RAND_bytes(sess_ticket_keys, len) == 1)
+	{
+	    sess_ticket_keys_len = len;
+	}
+    }
+    if (sess_ticket_keys_len) {
+	SSL_CTX_set_tlsext_ticket_keys(ctx, sess_ticket_keys,
+				       sess_ticket_keys_len);
+    }
+    CRYPTO_THREAD_unlock(sess_lock);
+}
+
+#endif	/* SSL_SESS_CACHE */
 
 /* SSL password callback. */
 static int password_cb(char *buf, int num, int rwflag, void *user_data)
@@ -1134,6 +1466,11 @@ static pj_status_t ssl_create(pj_ssl_sock_t *ssock)
             SSL_CTX_set_client_CA_list(ctx, ca_dn);
     }
 
+#if SSL_SESS_CACHE
+    /* Session resumption */
+    sess_cache_setup_ctx(ssock, ctx);
+#endif
+
     /* Early sensitive data cleanup after OpenSSL context setup. However,
      * this cannot be done for listener sockets, as the data will still
      * be needed by accepted sockets.
@@ -1202,10 +1539,9 @@ static void ssl_destroy(pj_ssl_sock_t *ssock)
 	ossock->ossl_ctx = NULL;
     }
 
-    /* Potentially shutdown OpenSSL library if this is the last
-     * context exists.
+    /* OpenSSL library is shut down by pj_shutdown(), so that cached
+     * sessions outlive the connections.
      */
-    shutdown_openssl();
 }
 
 
@@ -1246,7 +1582,6 @@ static void ssl_ciphers_populate()
 {
     if (ssl_cipher_num == 0 || ssl_curves_num == 0) {
 	init_openssl();
-	shutdown_openssl();
     }
 }
 
@@ -1753,6 +2088,10 @@ static void ssl_set_state(pj_ssl_sock_t *ssock, pj_bool_t is_server)
     if (is_server) {
         SSL_set_accept_state(ossock->ossl_ssl);
     } else {
+#if SSL_SESS_CACHE
+	if (sess_lock)
+	    client_resume_sess(ssock);
+#endif
 	SSL_set_connect_state(ossock->ossl_ssl);
     }
 }
@@ -1813,6 +2152,18 @@ static pj_status_t ssl_do_handshake(pj_ssl_sock_t *ssock)
     /* Check if handshake has been completed */
     if (SSL_is_init_finished(ossock->ossl_ssl)) {
 	ssock->ssl_state = SSL_STATE_ESTABLISHED;
+
+#if SSL_SESS_CACHE
+	ssock->session_reused = SSL_session_reused(ossock->ossl_ssl);
+	if (sess_lock) {
+	    CRYPTO_THREAD_write_lock(sess_lock);
+	    if (ssock->session_reused)
+		++ssl_sess_hits;
+	    else
+		++ssl_sess_misses;
+	    CRYPTO_THREAD_unlock(sess_lock);
+	}
+#endif
 	return PJ_SUCCESS;
     }
 
@@ -38,6 +38,8 @@
 #include <pj/rand.h>
 #include <pj/pj_limits.h>
 
+#if !PJ_TIMER_USE_WHEEL
+
 #define THIS_FILE	"timer.c"
 
 #define HEAP_PARENT(X)	(X == 0 ? 0 : (((X) - 1) / 2))
@@ -1013,3 +1015,4 @@ PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
 }
 #endif
 
+#endif	/* !PJ_TIMER_USE_WHEEL */
@@ -0,0 +1,947 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * timer_wheel.c
+ *
+ * Implementation of the timer heap API using a hashed hierarchical timing
+ * wheel (Varghese & Lauck). It is used instead of timer.c when
+ * PJ_TIMER_USE_WHEEL is enabled.
+ *
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots each. Level 0
+ * slots are one tick (PJ_TIMER_WHEEL_RESOLUTION msec) wide, each slot of
+ * the next level spans a whole turn of the level below. A timer is put in
+ * the lowest level that can hold its expiration tick, which is O(1), and
+ * removing it is a list erase, also O(1). When the current tick crosses a
+ * level boundary, the matching slot of the upper level is cascaded down.
+ *
+ * Expiration ticks are rounded up, so all timers in a level 0 slot are due
+ * once the wheel has passed that slot, and the whole slot is moved to the
+ * expired list at once. Timers further than the wheel range are clamped
+ * to the last slot, and re-inserted if they are still not due when they
+ * come out of it.
+ */
+#include <pj/timer.h>
+#include <pj/pool.h>
+#include <pj/pj_os.h>
+#include <pj/pj_string.h>
+#include <pj/pj_assert.h>
+#include <pj/pj_errno.h>
+#include <pj/pj_lock.h>
+#include <pj/pj_list.h>
+#include <pj/log.h>
+#include <pj/pj_limits.h>
+
+#if PJ_TIMER_USE_WHEEL
+
+#define THIS_FILE	"timer_wheel.c"
+
+#if 1000 % PJ_TIMER_WHEEL_RESOLUTION != 0
+#   error "PJ_TIMER_WHEEL_RESOLUTION must be a divisor of 1000"
+#endif
+
+#define DEFAULT_MAX_TIMED_OUT_PER_POLL  (64)
+
+#define WHEEL_BITS	    6
+#define WHEEL_SLOTS	    (1 << WHEEL_BITS)
+#define WHEEL_MASK	    (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS	    4
+#define WHEEL_RANGE	    ((pj_uint32_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+#define TICKS_PER_SEC	    (1000 / PJ_TIMER_WHEEL_RESOLUTION)
+
+/* Smallest number of timer nodes allocated at once */
+#define MIN_CHUNK_SIZE	    16
+
+enum
+{
+    F_DONT_CALL = 1,
+    F_DONT_ASSERT = 2,
+    F_SET_ID = 4
+};
+
+/*
+ * The wheel's copy of a scheduled timer entry. Nodes are allocated in
+ * chunks which are never moved, and the internal timer ID of an entry is
+ * the index of its node.
+ */
+typedef struct wheel_node
+{
+    PJ_DECL_LIST_MEMBER(struct wheel_node);
+
+    /** Internal timer ID of this node (fixed). */
+    pj_timer_id_t   _timer_id;
+
+    /** The original timer entry, NULL when the node is free. */
+    pj_timer_entry *entry;
+
+    /** Copy of the entry's fields, to detect premature deallocation. */
+    void	   *user_data;
+    int		    id;
+    pj_timer_heap_callback *cb;
+
+    /** The time when the timer expires. */
+    pj_time_val     _timer_value;
+
+    /** The group lock used by this entry. */
+    pj_grp_lock_t  *_grp_lock;
+
+    /** Non-zero if the node is in a wheel slot (not in the expired list). */
+    pj_bool_t	    in_wheel;
+
+#if PJ_TIMER_DEBUG
+    const char	   *src_file;
+    int		    src_line;
+#endif
+
+} wheel_node;
+
+/* List head of a wheel slot. */
+typedef struct wheel_list
+{
+    PJ_DECL_LIST_MEMBER(struct wheel_node);
+} wheel_list;
+
+#define LIST_HEAD(lst)	((wheel_node*)(lst))
+
+/**
+ * The implementation of timer heap.
+ */
+struct pj_timer_heap_t
+{
+    /** Pool from which the timer nodes are allocated. */
+    pj_pool_t *pool;
+
+    /** Number of timer nodes allocated. */
+    pj_size_t max_size;
+
+    /** Number of scheduled timers. */
+    pj_size_t cur_size;
+
+    /** Number of scheduled timers that are in the wheel slots. */
+    pj_size_t wheel_count;
+
+    /** Max timed out entries to process per poll. */
+    unsigned max_entries_per_poll;
+
+    /** Lock object. */
+    pj_lock_t *lock;
+
+    /** Autodelete lock. */
+    pj_bool_t auto_delete_lock;
+
+    /** Timer nodes, in chunks of chunk_size nodes. */
+    wheel_node **chunks;
+    unsigned chunk_cnt;
+    unsigned chunk_max;
+    pj_size_t chunk_size;
+
+    /** Free timer nodes. */
+    wheel_list free_list;
+
+    /** Time of tick zero. */
+    pj_time_val base;
+
+    /** Next tick to be processed. */
+    pj_uint32_t cur_tick;
+
+    /** The wheel. */
+    wheel_list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+    /** Timers that are due, waiting for their callback to be called. */
+    wheel_list expired;
+};
+
+
+PJ_INLINE(void) lock_timer_heap( pj_timer_heap_t *ht )
+{
+    if (ht->lock) {
+	pj_lock_acquire(ht->lock);
+    }
+}
+
+PJ_INLINE(void) unlock_timer_heap( pj_timer_heap_t *ht )
+{
+    if (ht->lock) {
+	pj_lock_release(ht->lock);
+    }
+}
+
+PJ_INLINE(wheel_node*) get_node( pj_timer_heap_t *ht, pj_timer_id_t id )
+{
+    pj_size_t idx = (pj_size_t)(id - 1);
+    return &ht->chunks[idx / ht->chunk_size][idx % ht->chunk_size];
+}
+
+/* Convert time to the number of ticks since the wheel base. The tick
+ * counter wraps around, ticks are only ever compared by their difference.
+ */
+static pj_uint32_t time_to_tick( const pj_timer_heap_t *ht,
+				 const pj_time_val *t,
+				 pj_bool_t round_up )
+{
+    pj_time_val d = *t;
+    pj_uint32_t tick;
+
+    PJ_TIME_VAL_SUB(d, ht->base);
+    if (d.sec < 0)
+	return 0;
+
+    tick = (pj_uint32_t)d.sec * TICKS_PER_SEC +
+	   (pj_uint32_t)d.msec / PJ_TIMER_WHEEL_RESOLUTION;
+    if (round_up && (d.msec % PJ_TIMER_WHEEL_RESOLUTION) != 0)
+	++tick;
+
+    return tick;
+}
+
+/* Get the delay from now until the start of the specified tick. */
+static void tick_to_delay( const pj_timer_heap_t *ht,
+			   pj_uint32_t tick,
+			   const pj_time_val *now,
+			   pj_time_val *delay )
+{
+    pj_time_val d = *now;
+    pj_int32_t diff;
+    long msec;
+
+    diff = (pj_int32_t)(tick - time_to_tick(ht, now, PJ_FALSE));
+    if (diff <= 0) {
+	delay->sec = delay->msec = 0;
+	return;
+    }
+
+    PJ_TIME_VAL_SUB(d, ht->base);
+    msec = (long)diff * PJ_TIMER_WHEEL_RESOLUTION -
+	   (d.msec % PJ_TIMER_WHEEL_RESOLUTION);
+    delay->sec = msec / 1000;
+    delay->msec = msec % 1000;
+}
+
+static pj_status_t grow_nodes( pj_timer_heap_t *ht )
+{
+    wheel_node *chunk;
+    pj_size_t i;
+
+    if (ht->chunk_cnt == ht->chunk_max) {
+	unsigned new_max = ht->chunk_max ? ht->chunk_max * 2 : 4;
+	wheel_node **new_chunks;
+
+	new_chunks = (wheel_node**)
+		     pj_pool_calloc(ht->pool, new_max, sizeof(wheel_node*));
+	if (!new_chunks)
+	    return PJ_ENOMEM;
+	if (ht->chunk_cnt)
+	    pj_memcpy(new_chunks, ht->chunks,
+		      ht->chunk_cnt * sizeof(wheel_node*));
+	ht->chunks = new_chunks;
+	ht->chunk_max = new_max;
+    }
+
+    chunk = (wheel_node*)
+	    pj_pool_calloc(ht->pool, ht->chunk_size, sizeof(wheel_node));
+    if (!chunk)
+	return PJ_ENOMEM;
+
+    PJ_LOG(6,(THIS_FILE, "Growing timer wheel nodes from %d to %d",
+			 (int)ht->max_size,
+			 (int)(ht->max_size + ht->chunk_size)));
+
+    for (i = 0; i < ht->chunk_size; ++i) {
+	chunk[i]._timer_id = (pj_timer_id_t)(ht->max_size + i + 1);
+	pj_list_push_back(&ht->free_list, &chunk[i]);
+    }
+
+    ht->chunks[ht->chunk_cnt++] = chunk;
+    ht->max_size += ht->chunk_size;
+
+    return PJ_SUCCESS;
+}
+
+/* Put the node in the wheel slot according to its expiration time. */
+static void insert_node( pj_timer_heap_t *ht, wheel_node *node )
+{
+    pj_uint32_t expire, delta;
+    unsigned level;
+
+    expire = time_to_tick(ht, &node->_timer_value, PJ_TRUE);
+    if ((pj_int32_t)(expire - ht->cur_tick) < 0)
+	expire = ht->cur_tick;
+
+    delta = expire - ht->cur_tick;
+    if (delta >= WHEEL_RANGE) {
+	/* Too far, park it in the last slot. It will be re-inserted when
+	 * it comes out of the wheel.
+	 */
+	delta = WHEEL_RANGE - 1;
+	expire = ht->cur_tick + delta;
+    }
+
+    for (level = 0; level < WHEEL_LEVELS - 1; ++level) {
+	if (delta < ((pj_uint32_t)1 << (WHEEL_BITS * (level + 1))))
+	    break;
+    }
+
+    pj_list_push_back(&ht->wheel[level][(expire >> (WHEEL_BITS * level)) &
+					 WHEEL_MASK], node);
+    node->in_wheel = PJ_TRUE;
+    ++ht->wheel_count;
+}
+
+/* Move all nodes of the current slot of the specified level down. */
+static void cascade( pj_timer_heap_t *ht, unsigned level )
+{
+    wheel_list *slot;
+    wheel_list tmp;
+
+    slot = &ht->wheel[level][(ht->cur_tick >> (WHEEL_BITS * level)) &
+			     WHEEL_MASK];
+    if (pj_list_empty(slot))
+	return;
+
+    pj_list_init(&tmp);
+    pj_list_merge_last(&tmp, slot);
+
+    while (!pj_list_empty(&tmp)) {
+	wheel_node *node = tmp.next;
+
+	pj_list_erase(node);
+	--ht->wheel_count;
+	insert_node(ht, node);
+    }
+}
+
+/* Find the next tick where something has to be done: either a level 0
+ * slot is due or an upper level slot has to be cascaded.
+ */
+static pj_bool_t find_next_tick( const pj_timer_heap_t *ht,
+				 pj_uint32_t *p_tick )
+{
+    pj_bool_t found = PJ_FALSE;
+    pj_uint32_t best = 0;
+    unsigned level;
+
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+	unsigned shift = WHEEL_BITS * level;
+	pj_uint32_t pos = ht->cur_tick >> shift;
+	unsigned k = 0, k_max = WHEEL_SLOTS - 1;
+
+	/* The current slot of an upper level has already been cascaded,
+	 * unless the current tick is the boundary which is yet to be
+	 * processed. Past the boundary, insert_node() may reuse that slot
+	 * for the tick one whole turn ahead, so look at it last.
+	 */
+	if (level > 0 && (ht->cur_tick & (((pj_uint32_t)1 << shift) - 1))) {
+	    k = 1;
+	    k_max = WHEEL_SLOTS;
+	}
+
+	for (; k <= k_max; ++k) {
+	    if (!pj_list_empty(&ht->wheel[level][(pos + k) & WHEEL_MASK])) {
+		pj_uint32_t tick = (pos + k) << shift;
+
+		if (!found || (pj_int32_t)(tick - best) < 0) {
+		    best = tick;
+		    found = PJ_TRUE;
+		}
+		break;
+	    }
+	}
+
+	/* Nothing in the upper levels can come before this */
+	if (found && level == 0 && best == ht->cur_tick)
+	    break;
+    }
+
+    *p_tick = best;
+    return found;
+}
+
+/* Move the wheel forward up to and including now_tick, putting the timers
+ * of the elapsed slots in the expired list. Empty ticks are skipped.
+ */
+static void advance_wheel( pj_timer_heap_t *ht, pj_uint32_t now_tick )
+{
+    while ((pj_int32_t)(now_tick - ht->cur_tick) >= 0) {
+	wheel_list *slot;
+	pj_uint32_t tick;
+	wheel_node *node;
+	unsigned level;
+
+	if (ht->wheel_count == 0 || !find_next_tick(ht, &tick) ||
+	    (pj_int32_t)(tick - now_tick) > 0)
+	{
+	    ht->cur_tick = now_tick + 1;
+	    break;
+	}
+
+	if ((pj_int32_t)(tick - ht->cur_tick) > 0)
+	    ht->cur_tick = tick;
+
+	/* Cascade the upper levels when crossing their boundary */
+	for (level = 1; level < WHEEL_LEVELS; ++level) {
+	    if ((ht->cur_tick >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+		break;
+	    cascade(ht, level);
+	}
+
+	slot = &ht->wheel[0][ht->cur_tick & WHEEL_MASK];
+	for (node = slot->next; node != LIST_HEAD(slot); node = node->next) {
+	    node->in_wheel = PJ_FALSE;
+	    --ht->wheel_count;
+	}
+	pj_list_merge_last(&ht->expired, slot);
+
+	++ht->cur_tick;
+    }
+}
+
+static wheel_node *alloc_node( pj_timer_heap_t *ht )
+{
+    wheel_node *node;
+
+    if (pj_list_empty(&ht->free_list) && grow_nodes(ht) != PJ_SUCCESS)
+	return NULL;
+
+    node = ht->free_list.next;
+    pj_list_erase(node);
+    return node;
+}
+
+static void remove_node( pj_timer_heap_t *ht, wheel_node *node )
+{
+    pj_list_erase(node);
+    if (node->in_wheel) {
+	node->in_wheel = PJ_FALSE;
+	--ht->wheel_count;
+    }
+    --ht->cur_size;
+
+    if (node->entry->_timer_id != node->_timer_id) {
+#if PJ_TIMER_DEBUG
+	PJ_LOG(3,(THIS_FILE, "Bug! Trying to remove entry %p from %s "
+			     "line %d, which has been deallocated "
+			     "without being cancelled",
+			     node->entry, node->src_file, node->src_line));
+#else
+	PJ_LOG(3,(THIS_FILE, "Bug! Trying to remove entry %p "
+			     "which has been deallocated "
+			     "without being cancelled",
+			     node->entry));
+#endif
+    }
+    node->entry->_timer_id = -1;
+    node->entry = NULL;
+
+    pj_list_push_back(&ht->free_list, node);
+}
+
+static pj_status_t schedule_entry( pj_timer_heap_t *ht,
+				   pj_timer_entry *entry,
+				   const pj_time_val *future_time,
+				   wheel_node **p_node )
+{
+    wheel_node *node;
+
+    node = alloc_node(ht);
+    if (!node)
+	return PJ_ENOMEM;
+
+    node->entry = entry;
+    node->user_data = entry->user_data;
+    node->id = entry->id;
+    node->cb = entry->cb;
+    node->_timer_value = *future_time;
+    node->_grp_lock = NULL;
+    entry->_timer_id = node->_timer_id;
+
+    insert_node(ht, node);
+    ++ht->cur_size;
+
+    *p_node = node;
+    return PJ_SUCCESS;
+}
+
+static int cancel( pj_timer_heap_t *ht,
+		   pj_timer_entry *entry,
+		   unsigned flags,
+		   pj_grp_lock_t **p_grp_lock )
+{
+    wheel_node *node;
+
+    PJ_CHECK_STACK();
+
+    *p_grp_lock = NULL;
+
+    // Check to see if the timer_id is out of range
+    if (entry->_timer_id < 1 || (pj_size_t)entry->_timer_id > ht->max_size) {
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    node = get_node(ht, entry->_timer_id);
+
+    if (node->entry == NULL) { // Check to see if timer_id is still valid.
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    if (entry != node->entry) {
+	if ((flags & F_DONT_ASSERT) == 0)
+	    pj_assert(entry == node->entry);
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    *p_grp_lock = node->_grp_lock;
+    remove_node(ht, node);
+    return 1;
+}
+
+
+/*
+ * Calculate memory size required to create a timer heap.
+ */
+PJ_DEF(pj_size_t) pj_timer_heap_mem_size(pj_size_t count)
+{
+    if (count < MIN_CHUNK_SIZE)
+	count = MIN_CHUNK_SIZE;
+
+    return /* size of the timer heap itself: */
+	   sizeof(pj_timer_heap_t) +
+	   /* size of each entry: */
+	   count * sizeof(wheel_node) +
+	   /* chunk table, lock, pool etc: */
+	   4 * sizeof(wheel_node*) + 132;
+}
+
+/*
+ * Create a new timer heap.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
+					  pj_size_t size,
+					  pj_timer_heap_t **p_heap)
+{
+    pj_timer_heap_t *ht;
+    unsigned i, j;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pool && p_heap, PJ_EINVAL);
+
+    *p_heap = NULL;
+
+    /* Allocate timer heap data structure from the pool */
+    ht = PJ_POOL_ZALLOC_T(pool, pj_timer_heap_t);
+    if (!ht)
+	return PJ_ENOMEM;
+
+    ht->pool = pool;
+    ht->max_entries_per_poll = DEFAULT_MAX_TIMED_OUT_PER_POLL;
+    ht->chunk_size = size < MIN_CHUNK_SIZE ? MIN_CHUNK_SIZE : size;
+
+    /* Lock. */
+    ht->lock = NULL;
+    ht->auto_delete_lock = 0;
+
+    pj_list_init(&ht->free_list);
+    pj_list_init(&ht->expired);
+    for (i = 0; i < WHEEL_LEVELS; ++i) {
+	for (j = 0; j < WHEEL_SLOTS; ++j)
+	    pj_list_init(&ht->wheel[i][j]);
+    }
+
+    pj_gettickcount(&ht->base);
+    ht->cur_tick = 0;
+
+    status = grow_nodes(ht);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    *p_heap = ht;
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(void) pj_timer_heap_destroy( pj_timer_heap_t *ht )
+{
+    if (ht->lock && ht->auto_delete_lock) {
+	pj_lock_destroy(ht->lock);
+	ht->lock = NULL;
+    }
+}
+
+PJ_DEF(void) pj_timer_heap_set_lock(  pj_timer_heap_t *ht,
+				      pj_lock_t *lock,
+				      pj_bool_t auto_del )
+{
+    if (ht->lock && ht->auto_delete_lock)
+	pj_lock_destroy(ht->lock);
+
+    ht->lock = lock;
+    ht->auto_delete_lock = auto_del;
+}
+
+
+PJ_DEF(unsigned) pj_timer_heap_set_max_timed_out_per_poll(pj_timer_heap_t *ht,
+							  unsigned count )
+{
+    unsigned old_count = ht->max_entries_per_poll;
+    ht->max_entries_per_poll = count;
+    return old_count;
+}
+
+PJ_DEF(pj_timer_entry*) pj_timer_entry_init( pj_timer_entry *entry,
+					     int id,
+					     void *user_data,
+					     pj_timer_heap_callback *cb )
+{
+    pj_assert(entry && cb);
+
+    entry->_timer_id = -1;
+    entry->id = id;
+    entry->user_data = user_data;
+    entry->cb = cb;
+#if !PJ_TIMER_USE_COPY
+    entry->_grp_lock = NULL;
+#endif
+
+    return entry;
+}
+
+PJ_DEF(pj_bool_t) pj_timer_entry_running( pj_timer_entry *entry )
+{
+    return (entry->_timer_id >= 1);
+}
+
+#if PJ_TIMER_DEBUG
+static pj_status_t schedule_w_grp_lock_dbg(pj_timer_heap_t *ht,
+					   pj_timer_entry *entry,
+					   const pj_time_val *delay,
+					   pj_bool_t set_id,
+					   int id_val,
+					   pj_grp_lock_t *grp_lock,
+					   const char *src_file,
+					   int src_line)
+#else
+static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
+				       pj_timer_entry *entry,
+				       const pj_time_val *delay,
+				       pj_bool_t set_id,
+				       int id_val,
+				       pj_grp_lock_t *grp_lock)
+#endif
+{
+    pj_status_t status;
+    pj_time_val expires;
+    wheel_node *node;
+
+    PJ_ASSERT_RETURN(ht && entry && delay, PJ_EINVAL);
+    PJ_ASSERT_RETURN(entry->cb != NULL, PJ_EINVAL);
+
+    pj_gettickcount(&expires);
+    PJ_TIME_VAL_ADD(expires, *delay);
+
+    lock_timer_heap(ht);
+
+    /* Prevent same entry from being scheduled more than once */
+    if (pj_timer_entry_running(entry)) {
+	unlock_timer_heap(ht);
+	PJ_LOG(3,(THIS_FILE, "Warning! Rescheduling outstanding entry (%p)",
+		  entry));
+	return PJ_EINVALIDOP;
+    }
+
+    status = schedule_entry(ht, entry, &expires, &node);
+    if (status == PJ_SUCCESS) {
+	if (set_id)
+	    node->id = entry->id = id_val;
+	node->_grp_lock = grp_lock;
+	if (node->_grp_lock) {
+	    pj_grp_lock_add_ref(node->_grp_lock);
+	}
+#if PJ_TIMER_DEBUG
+	node->src_file = src_file;
+	node->src_line = src_line;
+#endif
+    }
+    unlock_timer_heap(ht);
+
+    return status;
+}
+
+
+#if PJ_TIMER_DEBUG
+PJ_DEF(pj_status_t) pj_timer_heap_schedule_dbg( pj_timer_heap_t *ht,
+						pj_timer_entry *entry,
+						const pj_time_val *delay,
+						const char *src_file,
+						int src_line)
+{
+    return schedule_w_grp_lock_dbg(ht, entry, delay, PJ_FALSE, 1, NULL,
+				   src_file, src_line);
+}
+
+PJ_DEF(pj_status_t) pj_timer_heap_schedule_w_grp_lock_dbg(
+						pj_timer_heap_t *ht,
+						pj_timer_entry *entry,
+						const pj_time_val *delay,
+						int id_val,
+						pj_grp_lock_t *grp_lock,
+						const char *src_file,
+						int src_line)
+{
+    return schedule_w_grp_lock_dbg(ht, entry, delay, PJ_TRUE, id_val,
+				   grp_lock, src_file, src_line);
+}
+
+#else
+PJ_DEF(pj_status_t) pj_timer_heap_schedule( pj_timer_heap_t *ht,
+					    pj_timer_entry *entry,
+					    const pj_time_val *delay)
+{
+    return schedule_w_grp_lock(ht, entry, delay, PJ_FALSE, 1, NULL);
+}
+
+PJ_DEF(pj_status_t) pj_timer_heap_schedule_w_grp_lock(pj_timer_heap_t *ht,
+						      pj_timer_entry *entry,
+						      const pj_time_val *delay,
+						      int id_val,
+						      pj_grp_lock_t *grp_lock)
+{
+    return schedule_w_grp_lock(ht, entry, delay, PJ_TRUE, id_val, grp_lock);
+}
+#endif
+
+static int cancel_timer(pj_timer_heap_t *ht,
+			pj_timer_entry *entry,
+			unsigned flags,
+			int id_val)
+{
+    pj_grp_lock_t *grp_lock;
+    int count;
+
+    PJ_ASSERT_RETURN(ht && entry, PJ_EINVAL);
+
+    lock_timer_heap(ht);
+
+    count = cancel(ht, entry, flags | F_DONT_CALL, &grp_lock);
+    if (count > 0) {
+	/* Timer entry found & cancelled */
+	if (flags & F_SET_ID) {
+	    entry->id = id_val;
+	}
+	if (grp_lock) {
+	    pj_grp_lock_dec_ref(grp_lock);
+	}
+    }
+    unlock_timer_heap(ht);
+
+    return count;
+}
+
+PJ_DEF(int) pj_timer_heap_cancel( pj_timer_heap_t *ht,
+				  pj_timer_entry *entry)
+{
+    return cancel_timer(ht, entry, 0, 0);
+}
+
+PJ_DEF(int) pj_timer_heap_cancel_if_active(pj_timer_heap_t *ht,
+					   pj_timer_entry *entry,
+					   int id_val)
+{
+    return cancel_timer(ht, entry, F_SET_ID | F_DONT_ASSERT, id_val);
+}
+
+/* Get the delay until the wheel needs to be polled again. */
+static void get_next_delay( pj_timer_heap_t *ht,
+			    const pj_time_val *now,
+			    pj_time_val *next_delay )
+{
+    pj_uint32_t tick;
+
+    if (!pj_list_empty(&ht->expired)) {
+	next_delay->sec = next_delay->msec = 0;
+    } else if (ht->wheel_count && find_next_tick(ht, &tick)) {
+	tick_to_delay(ht, tick, now, next_delay);
+    } else {
+	next_delay->sec = next_delay->msec = PJ_MAXINT32;
+    }
+}
+
+PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
+				     pj_time_val *next_delay )
+{
+    pj_time_val now;
+    unsigned count;
+
+    PJ_ASSERT_RETURN(ht, 0);
+
+    lock_timer_heap(ht);
+    if (!ht->cur_size && next_delay) {
+	next_delay->sec = next_delay->msec = PJ_MAXINT32;
+	unlock_timer_heap(ht);
+	return 0;
+    }
+
+    count = 0;
+    pj_gettickcount(&now);
+
+    advance_wheel(ht, time_to_tick(ht, &now, PJ_FALSE));
+
+    while (!pj_list_empty(&ht->expired) &&
+	   count < ht->max_entries_per_poll)
+    {
+	wheel_node *node = ht->expired.next;
+	pj_timer_entry *entry;
+	pj_grp_lock_t *grp_lock;
+	pj_bool_t valid = PJ_TRUE;
+
+	if (PJ_TIME_VAL_GT(node->_timer_value, now)) {
+	    /* A timer that was further than the wheel range */
+	    pj_list_erase(node);
+	    insert_node(ht, node);
+	    continue;
+	}
+
+	entry = node->entry;
+	grp_lock = node->_grp_lock;
+	node->_grp_lock = NULL;
+
+	if (node->cb != entry->cb || node->user_data != entry->user_data) {
+	    valid = PJ_FALSE;
+#if PJ_TIMER_DEBUG
+	    PJ_LOG(3,(THIS_FILE, "Bug! Polling entry %p from %s line %d has "
+				 "been deallocated without being cancelled",
+				 entry, node->src_file, node->src_line));
+#else
+	    PJ_LOG(3,(THIS_FILE, "Bug! Polling entry %p has "
+				 "been deallocated without being cancelled",
+				 entry));
+#endif
+	}
+
+	remove_node(ht, node);
+	++count;
+
+	unlock_timer_heap(ht);
+
+	PJ_RACE_ME(5);
+
+	if (valid && entry->cb)
+	    (*entry->cb)(ht, entry);
+
+	if (valid && grp_lock)
+	    pj_grp_lock_dec_ref(grp_lock);
+
+	lock_timer_heap(ht);
+    }
+
+    if (next_delay) {
+	if (ht->cur_size)
+	    get_next_delay(ht, &now, next_delay);
+	else
+	    next_delay->sec = next_delay->msec = PJ_MAXINT32;
+    }
+    unlock_timer_heap(ht);
+
+    return count;
+}
+
+PJ_DEF(pj_size_t) pj_timer_heap_count( pj_timer_heap_t *ht )
+{
+    PJ_ASSERT_RETURN(ht, 0);
+
+    return ht->cur_size;
+}
+
+/*
+ * The wheel does not keep the exact minimum: the returned time is the
+ * start of the first tick at which the wheel has work to do, which is
+ * never later than the earliest timer.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
+						 pj_time_val *timeval)
+{
+    pj_time_val now, delay;
+
+    pj_assert(ht->cur_size != 0);
+    if (ht->cur_size == 0)
+	return PJ_ENOTFOUND;
+
+    lock_timer_heap(ht);
+    pj_gettickcount(&now);
+    get_next_delay(ht, &now, &delay);
+    *timeval = now;
+    PJ_TIME_VAL_ADD(*timeval, delay);
+    unlock_timer_heap(ht);
+
+    return PJ_SUCCESS;
+}
+
+#if PJ_TIMER_DEBUG
+static void dump_list(const wheel_list *lst, const pj_time_val *now)
+{
+    const wheel_node *e;
+
+    for (e = lst->next; e != LIST_HEAD(lst); e = e->next) {
+	pj_time_val delta;
+
+	if (PJ_TIME_VAL_LTE(e->_timer_value, *now))
+	    delta.sec = delta.msec = 0;
+	else {
+	    delta = e->_timer_value;
+	    PJ_TIME_VAL_SUB(delta, *now);
+	}
+
+	PJ_LOG(3,(THIS_FILE, "    %d\t%d\t%d.%03d\t%s:%d",
+		  e->_timer_id, e->id,
+		  (int)delta.sec, (int)delta.msec,
+		  e->src_file, e->src_line));
+    }
+}
+
+PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
+{
+    lock_timer_heap(ht);
+
+    PJ_LOG(3,(THIS_FILE, "Dumping timer wheel:"));
+    PJ_LOG(3,(THIS_FILE, "  Cur size: %d entries, max: %d",
+			 (int)ht->cur_size, (int)ht->max_size));
+
+    if (ht->cur_size) {
+	pj_time_val now;
+	unsigned i, j;
+
+	PJ_LOG(3,(THIS_FILE, "  Entries: "));
+	PJ_LOG(3,(THIS_FILE, "    _id\tId\tElapsed\tSource"));
+	PJ_LOG(3,(THIS_FILE, "    ----------------------------------"));
+
+	pj_gettickcount(&now);
+
+	dump_list(&ht->expired, &now);
+	for (i = 0; i < WHEEL_LEVELS; ++i) {
+	    for (j = 0; j < WHEEL_SLOTS; ++j)
+		dump_list(&ht->wheel[i][j], &now);
+	}
+    }
+
+    unlock_timer_heap(ht);
+}
+#endif
+
+#endif	/* PJ_TIMER_USE_WHEEL */
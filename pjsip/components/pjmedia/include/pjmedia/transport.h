@@ -584,7 +584,10 @@ typedef struct pjmedia_tp_cb_param
     void 	       *user_data;
 
     /**
-     * Packet buffer.
+     * Packet buffer. When PJ_IOQUEUE_HAS_BUF_LENDING is enabled, the UDP
+     * transport lends the buffer of its ioqueue slab, and the receiver
+     * may call pj_ioqueue_buf_add_ref() to keep the packet after the
+     * callback returns, and pj_ioqueue_buf_dec_ref() when done with it.
      */
     void 	       *pkt;
 
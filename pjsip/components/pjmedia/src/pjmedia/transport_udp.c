@@ -34,6 +34,29 @@
 /* Maximum size of incoming RTCP packet */
 #define RTCP_LEN    600
 
+/* Number of pending RTP read operations. With batched socket I/O, the
+ * ioqueue fills all of them with one recvmmsg() when packets queue up.
+ * The RTP key must stay non-concurrent: the ioqueue then holds the key
+ * lock while it calls on_rx_rtp() for each datagram of a batch, so the
+ * callbacks run one at a time in arrival order, and the source address
+ * learning is serialized.
+ */
+#if PJ_HAS_SOCK_MMSG
+#   define RTP_READ_CNT	    PJ_SOCK_MAX_MMSG
+#   define RTP_READ_FLAGS   PJ_IOQUEUE_ALWAYS_ASYNC
+#else
+#   define RTP_READ_CNT	    1
+#   define RTP_READ_FLAGS   0
+#endif
+
+/* With ioqueue buffer lending, RTP packets are received into buffers of
+ * a slab owned by the transport, and the receiver may keep a packet by
+ * adding a reference to it. The extra buffers cover the packets held.
+ */
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+#   define RTP_SLAB_CNT	    (RTP_READ_CNT * 2)
+#endif
+
 /* Maximum pending write operations */
 #define MAX_PENDING 4
 
@@ -45,6 +68,19 @@ typedef struct pending_write
     pj_bool_t		is_pending;
 } pending_write;
 
+/* Pending RTP read buffer */
+typedef struct rtp_read
+{
+    pj_ioqueue_op_key_t	op_key;
+    pj_sockaddr		src_addr;
+    int			addrlen;
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    char	       *pkt;		/* Lent by the ioqueue		    */
+#else
+    char		pkt[RTP_LEN];
+#endif
+} rtp_read;
+
 
 struct transport_udp
 {
@@ -74,12 +110,13 @@ struct transport_udp
     pj_sock_t	        rtp_sock;	/**< RTP socket			    */
     pj_sockaddr		rtp_addr_name;	/**< Published RTP address.	    */
     pj_ioqueue_key_t   *rtp_key;	/**< RTP socket key in ioqueue	    */
-    pj_ioqueue_op_key_t	rtp_read_op;	/**< Pending read operation	    */
     unsigned		rtp_write_op_id;/**< Next write_op to use	    */
     pending_write	rtp_pending_write[MAX_PENDING];  /**< Pending write */
     pj_sockaddr		rtp_src_addr;	/**< Actual packet src addr.	    */
-    int			rtp_addrlen;	/**< Address length.		    */
-    char		rtp_pkt[RTP_LEN];/**< Incoming RTP packet buffer    */
+    rtp_read		rtp_read[RTP_READ_CNT]; /**< Pending RTP reads	    */
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    pj_ioqueue_slab    *rtp_slab;	/**< RTP packet buffers.	    */
+#endif
 
     pj_bool_t		enable_rtcp_mux;/**< Enable RTP & RTCP multiplexing?*/
     pj_bool_t		use_rtcp_mux;	/**< Use RTP & RTCP multiplexing?   */
@@ -355,7 +392,21 @@ PJ_DEF(pj_status_t) pjmedia_transport_udp_attach( pjmedia_endpt *endpt,
     if (status != PJ_SUCCESS)
 		goto on_error;
 
-    pj_ioqueue_op_key_init(&tp->rtp_read_op, sizeof(tp->rtp_read_op));
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    status = pj_ioqueue_slab_create(pool, RTP_LEN, RTP_SLAB_CNT,
+				    &tp->rtp_slab);
+    if (status != PJ_SUCCESS)
+		goto on_error;
+
+    status = pj_ioqueue_set_slab(tp->rtp_key, tp->rtp_slab);
+    if (status != PJ_SUCCESS)
+		goto on_error;
+#endif
+
+    for (i=0; i<RTP_READ_CNT; ++i) {
+		pj_ioqueue_op_key_init(&tp->rtp_read[i].op_key,
+					sizeof(tp->rtp_read[i].op_key));
+    }
     for (i=0; i<PJ_ARRAY_SIZE(tp->rtp_pending_write); ++i) {
         tp->rtp_pending_write[i].is_pending = PJ_FALSE;
 		pj_ioqueue_op_key_init(&tp->rtp_pending_write[i].op_key, 
@@ -425,14 +476,21 @@ static pj_status_t transport_destroy(pjmedia_transport *tp)
 	udp->rtcp_sock = PJ_INVALID_SOCKET;
     }
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    if (udp->rtp_slab) {
+	pj_ioqueue_slab_destroy(udp->rtp_slab);
+	udp->rtp_slab = NULL;
+    }
+#endif
+
     pj_pool_release(udp->pool);
 
     return PJ_SUCCESS;
 }
 
 /* Call RTP cb. */
-static void call_rtp_cb(struct transport_udp *udp, pj_ssize_t bytes_read, 
-			pj_bool_t *rem_switch)
+static void call_rtp_cb(struct transport_udp *udp, void *pkt,
+			pj_ssize_t bytes_read, pj_bool_t *rem_switch)
 {
     void (*cb)(void*,void*,pj_ssize_t);
     void (*cb2)(pjmedia_tp_cb_param*);
@@ -446,7 +504,7 @@ static void call_rtp_cb(struct transport_udp *udp, pj_ssize_t bytes_read,
 	pjmedia_tp_cb_param param;
 
 	param.user_data = user_data;
-	param.pkt = udp->rtp_pkt;
+	param.pkt = pkt;
 	param.size = bytes_read;
 	param.src_addr = &udp->rtp_src_addr;
 	param.rem_switch = PJ_FALSE;
@@ -454,7 +512,7 @@ static void call_rtp_cb(struct transport_udp *udp, pj_ssize_t bytes_read,
 	if (rem_switch)
 	    *rem_switch = param.rem_switch;
     } else if (cb) {
-	(*cb)(user_data, udp->rtp_pkt, bytes_read);
+	(*cb)(user_data, pkt, bytes_read);
     }
 }
 
@@ -477,24 +535,27 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 		      pj_ssize_t bytes_read)
 {
     struct transport_udp *udp;
+    rtp_read *r = (rtp_read*) op_key;
     pj_status_t status;
     pj_bool_t rem_switch = PJ_FALSE;
     pj_bool_t transport_restarted = PJ_FALSE;
     unsigned num_err = 0;
     pj_status_t last_err = PJ_SUCCESS;
 
-    PJ_UNUSED_ARG(op_key);
-
     if (-bytes_read == PJ_ECANCELLED) return;
 
     udp = (struct transport_udp*) pj_ioqueue_get_user_data(key);
 
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+    r->pkt = (char*) pj_ioqueue_get_lent_buf(op_key);
+#endif
+
     if (-bytes_read == PJ_ESOCKETSTOP) {
 	/* Try to recover by restarting the transport. */
 	status = transport_restart(PJ_TRUE, udp);
 	if (status != PJ_SUCCESS) {
 	    bytes_read = -PJ_ESOCKETSTOP;
-	    call_rtp_cb(udp, bytes_read, NULL);
+	    call_rtp_cb(udp, r->pkt, bytes_read, NULL);
 	}
 	return;
     }
@@ -502,6 +563,10 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
     do {
 	pj_bool_t discard = PJ_FALSE;
 
+	/* Remember the source address of the latest packet */
+	if (bytes_read > 0)
+	    pj_sockaddr_cp(&udp->rtp_src_addr, &r->src_addr);
+
 	/* Simulate packet lost on RX direction */
 	if (udp->rx_drop_pct) {
 	    if ((pj_rand() % 100) <= (int)udp->rx_drop_pct) {
@@ -516,7 +581,7 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 	if (!discard && 
 	    (-bytes_read != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL))) 
 	{
-	    call_rtp_cb(udp, bytes_read, &rem_switch);
+	    call_rtp_cb(udp, r->pkt, bytes_read, &rem_switch);
 	}
 
 #if defined(PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR) && \
@@ -559,18 +624,23 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 	}
 #endif
 
-	bytes_read = sizeof(udp->rtp_pkt);
-	udp->rtp_addrlen = sizeof(udp->rtp_src_addr);
-	status = pj_ioqueue_recvfrom(udp->rtp_key, &udp->rtp_read_op,
-					udp->rtp_pkt, &bytes_read, 0,
-					&udp->rtp_src_addr,
-					&udp->rtp_addrlen);
+	bytes_read = RTP_LEN;
+	r->addrlen = sizeof(r->src_addr);
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	status = pj_ioqueue_recvfrom(udp->rtp_key, &r->op_key,
+					NULL, &bytes_read, RTP_READ_FLAGS,
+					&r->src_addr, &r->addrlen);
+#else
+	status = pj_ioqueue_recvfrom(udp->rtp_key, &r->op_key,
+					r->pkt, &bytes_read, RTP_READ_FLAGS,
+					&r->src_addr, &r->addrlen);
+#endif
 
 	if (status != PJ_EPENDING && status != PJ_SUCCESS) {	    
 	    if (transport_restarted && last_err == status) {
 		/* Still the same error after restart */
 		bytes_read = -PJ_ESOCKETSTOP;
-		call_rtp_cb(udp, bytes_read, NULL);
+		call_rtp_cb(udp, r->pkt, bytes_read, NULL);
 		break;
 	    } else if (PJMEDIA_IGNORE_RECV_ERR_CNT) {
 		if (last_err == status) {
@@ -586,7 +656,7 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 		    status = transport_restart(PJ_TRUE, udp);		    
 		    if (status != PJ_SUCCESS) {
 			bytes_read = -PJ_ESOCKETSTOP;
-			call_rtp_cb(udp, bytes_read, NULL);
+			call_rtp_cb(udp, r->pkt, bytes_read, NULL);
 			break;
 		    }
 		    transport_restarted = PJ_TRUE;
@@ -1174,6 +1244,33 @@ static pj_status_t transport_encode_sdp(pjmedia_transport *tp,
     return PJ_SUCCESS;
 }
 
+/* Post all pending RTP read operations to the ioqueue */
+static pj_status_t start_rtp_read(struct transport_udp *udp)
+{
+    unsigned i;
+
+    for (i=0; i<RTP_READ_CNT; ++i) {
+	rtp_read *r = &udp->rtp_read[i];
+	pj_ssize_t size = RTP_LEN;
+	pj_status_t status;
+
+	r->addrlen = sizeof(r->src_addr);
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	status = pj_ioqueue_recvfrom(udp->rtp_key, &r->op_key,
+				     NULL, &size, PJ_IOQUEUE_ALWAYS_ASYNC,
+				     &r->src_addr, &r->addrlen);
+#else
+	status = pj_ioqueue_recvfrom(udp->rtp_key, &r->op_key,
+				     r->pkt, &size, PJ_IOQUEUE_ALWAYS_ASYNC,
+				     &r->src_addr, &r->addrlen);
+#endif
+	if (status != PJ_EPENDING)
+	    return status;
+    }
+
+    return PJ_EPENDING;
+}
+
 static pj_status_t transport_media_start(pjmedia_transport *tp,
 				  pj_pool_t *pool,
 				  const pjmedia_sdp_session *sdp_local,
@@ -1196,11 +1293,7 @@ static pj_status_t transport_media_start(pjmedia_transport *tp,
 	return PJ_SUCCESS;
 
     /* Kick off pending RTP read from the ioqueue */
-    udp->rtp_addrlen = sizeof(udp->rtp_src_addr);
-    size = sizeof(udp->rtp_pkt);
-    status = pj_ioqueue_recvfrom(udp->rtp_key, &udp->rtp_read_op,
-			         udp->rtp_pkt, &size, PJ_IOQUEUE_ALWAYS_ASYNC,
-				 &udp->rtp_src_addr, &udp->rtp_addrlen);
+    status = start_rtp_read(udp);
     if (status != PJ_EPENDING)
 	return status;
 
@@ -1222,6 +1315,7 @@ static pj_status_t transport_media_start(pjmedia_transport *tp,
 static pj_status_t transport_media_stop(pjmedia_transport *tp)
 {
     struct transport_udp *udp = (struct transport_udp*)tp;
+    unsigned i;
 
     PJ_ASSERT_RETURN(tp, PJ_EINVAL);
 
@@ -1229,8 +1323,10 @@ static pj_status_t transport_media_stop(pjmedia_transport *tp)
     if (!udp->started)
 	return PJ_SUCCESS;
 
-    pj_ioqueue_post_completion(udp->rtp_key, &udp->rtp_read_op,
-			       -PJ_ECANCELLED);
+    for (i=0; i<RTP_READ_CNT; ++i) {
+	pj_ioqueue_post_completion(udp->rtp_key, &udp->rtp_read[i].op_key,
+				   -PJ_ECANCELLED);
+    }
 
     pj_ioqueue_post_completion(udp->rtcp_key, &udp->rtcp_read_op,
 			       -PJ_ECANCELLED);
@@ -1336,12 +1432,19 @@ static pj_status_t transport_restart(pj_bool_t is_rtp,
     if (status != PJ_SUCCESS)
 	goto on_error;
 
+    /* Keep the new key non-concurrent too, see RTP_READ_CNT */
+    status = pj_ioqueue_set_concurrency(is_rtp? udp->rtp_key : udp->rtcp_key,
+					PJ_FALSE);
+    if (status != PJ_SUCCESS)
+	goto on_error;
+
     if (is_rtp) {
-	size = sizeof(udp->rtp_pkt);
-	status = pj_ioqueue_recvfrom(udp->rtp_key, &udp->rtp_read_op,
-				     udp->rtp_pkt, &size, 
-				     PJ_IOQUEUE_ALWAYS_ASYNC,
-				     &udp->rtp_src_addr, &udp->rtp_addrlen);
+#if PJ_IOQUEUE_HAS_BUF_LENDING
+	status = pj_ioqueue_set_slab(udp->rtp_key, udp->rtp_slab);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+#endif
+	status = start_rtp_read(udp);
     } else {
 	size = sizeof(udp->rtcp_pkt);
 	status = pj_ioqueue_recvfrom(udp->rtcp_key, &udp->rtcp_read_op,
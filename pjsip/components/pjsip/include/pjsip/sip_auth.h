@@ -176,6 +176,10 @@ typedef struct pjsip_cached_auth
     pj_str_t			 cnonce;    /**< Cnonce value.		    */
 #endif
     pjsip_www_authenticate_hdr	*last_chal; /**< Last challenge seen.	    */
+#if PJSIP_AUTH_CACHE_HA1
+    const pjsip_cred_info	*ha1_cred;  /**< Credential of cached HA1.  */
+    char			 ha1[PJSIP_MD5STRLEN]; /**< Cached HA1.	    */
+#endif
 #if PJSIP_AUTH_HEADER_CACHING
     pjsip_cached_auth_hdr	 cached_hdr;/**< List of cached header for
 						 each method.		    */
@@ -320,6 +324,9 @@ typedef struct pjsip_auth_srv
     pjsip_auth_lookup_cred  *lookup;	/**< Lookup function.		    */
     pjsip_auth_lookup_cred2 *lookup2;	/**< Lookup function with additional
 					     info in its input param.	    */
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    struct pjsip_auth_srv_cache *cache;	/**< HA1 and nonce cache.	    */
+#endif
 } pjsip_auth_srv;
 
 
@@ -519,6 +526,17 @@ PJ_DECL(pj_status_t) pjsip_auth_srv_init2(
 				    pjsip_auth_srv *auth_srv,
 				    const pjsip_auth_srv_init_param *param);
 
+/**
+ * Release resources held by the server authorization session. This is
+ * only needed when PJSIP_AUTH_SRV_CACHE_SIZE is enabled, and is a no-op
+ * otherwise.
+ *
+ * @param auth_srv	The server authentication structure.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjsip_auth_srv_deinit(pjsip_auth_srv *auth_srv);
+
 /**
  * Request the authorization server framework to verify the authorization 
  * information in the specified request in rdata.
@@ -537,6 +555,8 @@ PJ_DECL(pj_status_t) pjsip_auth_srv_init2(
  *			- PJSIP_EAUTHACCDISABLED
  *			- PJSIP_EAUTHINVALIDREALM
  *			- PJSIP_EAUTHINVALIDDIGEST
+ *			- PJSIP_EAUTHINNONCE (only with
+ *			  PJSIP_AUTH_SRV_CACHE_SIZE)
  */
 PJ_DECL(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
 					    pjsip_rx_data *rdata,
@@ -557,7 +577,9 @@ PJ_DECL(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
  * @param tdata		The outgoing response message. The response must have
  *			401 or 407 response code.
  *
- * @return		PJ_SUCCESS on success.
+ * @return		PJ_SUCCESS on success, or PJ_ETOOBIG if the nonce
+ *			is too long for the nonce cache (see
+ *			PJSIP_AUTH_SRV_CACHE_SIZE).
  */
 PJ_DECL(pj_status_t) pjsip_auth_srv_challenge( pjsip_auth_srv *auth_srv,
 					       const pj_str_t *qop,
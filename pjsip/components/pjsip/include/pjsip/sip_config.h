@@ -291,6 +291,48 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_MAX_TSX_COUNT		(1024-1)
 #endif
 
+/**
+ * Specify the number of shards of the transaction hash table. Each shard
+ * is a separate hash table with its own mutex, and a transaction is put
+ * in the shard selected by the hash value of its key, so that threads
+ * looking up different transactions rarely contend for the same mutex.
+ * The transaction count is divided evenly among the shards.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_TSX_LAYER_SHARD_CNT
+#   define PJSIP_TSX_LAYER_SHARD_CNT	1
+#endif
+
+/**
+ * Tick of the retransmission timer wheel of the transaction layer, in
+ * milliseconds. When non-zero, the retransmission timers of the
+ * transactions (timer A, E and G, and the retransmission of INVITE 2xx
+ * responses) are not scheduled one by one in the endpoint timer heap.
+ * They are put in the slot of a timer wheel shared by all transactions,
+ * and a single timer that runs every tick while the wheel is not empty
+ * retransmits all the transactions of the expired slots. A retransmission
+ * may then be sent up to one tick late.
+ *
+ * Delays longer than #PJSIP_TSX_RTX_WHEEL_SIZE ticks (such as the
+ * retransmission of provisional responses) still use the timer heap.
+ *
+ * Default: 0 (use the timer heap)
+ */
+#ifndef PJSIP_TSX_RTX_WHEEL_TICK
+#   define PJSIP_TSX_RTX_WHEEL_TICK	0
+#endif
+
+/**
+ * Number of slots of the retransmission timer wheel, see
+ * #PJSIP_TSX_RTX_WHEEL_TICK. The wheel should span at least T2.
+ *
+ * Default: 256
+ */
+#ifndef PJSIP_TSX_RTX_WHEEL_SIZE
+#   define PJSIP_TSX_RTX_WHEEL_SIZE	256
+#endif
+
 /**
  * Specify maximum number of dialogs in the dialog hash table.
  * For efficiency, the value should be 2^n-1 since it will be
@@ -302,6 +344,20 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_MAX_DIALOG_COUNT	(512-1)
 #endif
 
+/**
+ * Specify the number of shards of the dialog hash table of the user agent
+ * layer. Each shard is a separate hash table with its own mutex, and a
+ * dialog set is put in the shard selected by the hash value of its local
+ * tag, so that in-dialog requests and responses of different calls rarely
+ * contend for the same mutex. The dialog count is divided evenly among
+ * the shards.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_UA_LAYER_SHARD_CNT
+#   define PJSIP_UA_LAYER_SHARD_CNT	1
+#endif
+
 
 /**
  * Specify maximum number of transports.
@@ -478,6 +534,27 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Number of sockets opened by a UDP transport created with
+ * #pjsip_udp_transport_start2(). When greater than one, all the sockets
+ * are bound to the same address with SO_REUSEPORT, each one registered to
+ * the ioqueue with its own key and its own set of \a async_cnt pending
+ * reads, so that the kernel spreads incoming datagrams over the sockets
+ * and several ioqueue pollers can read them at the same time. Outgoing
+ * messages are always sent with the first socket. The transport is still
+ * seen as a single transport by the transport manager.
+ *
+ * Transports created with #pjsip_udp_transport_attach() only use the
+ * socket given by the application. If the platform does not support
+ * SO_REUSEPORT, only one socket is opened.
+ *
+ * Default: 1
+ */
+#ifndef PJSIP_UDP_SOCK_CNT
+#   define PJSIP_UDP_SOCK_CNT		1
+#endif
+
+
 /**
  * Encode SIP headers in their short forms to reduce size. By default,
  * SIP headers in outgoing messages will be encoded in their full names. 
@@ -577,6 +654,116 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * If non-zero, #pjsip_parse_msg() and #pjsip_parse_rdata() parse the
+ * message without installing an exception handler. Syntax errors are
+ * flagged by the scanner instead of being thrown, and the parser then
+ * reports the error and skips the bad header itself, so the result and
+ * the error list are the same as the exception based parser gives.
+ *
+ * Header and URI parsers registered by other modules (e.g. the
+ * authentication headers and the tel: URI) are still called under an
+ * exception handler.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_PARSER_FAST_PATH
+#   define PJSIP_PARSER_FAST_PATH	0
+#endif
+
+
+/**
+ * If non-zero, #pjsip_parse_rdata() only parses the headers that are
+ * needed by the rdata's msg_info (Via, From, To, Call-ID, CSeq, etc.).
+ * The other headers that have a built-in parser (Accept, Allow, Contact,
+ * Expires, Min-Expires, Retry-After, Unsupported and the authentication
+ * headers) are added to the message as #pjsip_lazy_hdr, and are only
+ * parsed when they are looked up with #pjsip_msg_find_hdr() and friends.
+ *
+ * Syntax errors in these headers are not reported in the parse_err list.
+ * The header is removed from the message instead when it fails to parse.
+ * Code that walks the header list itself must parse such headers with
+ * #pjsip_lazy_hdr_parse().
+ *
+ * Looking up a header may parse it, which modifies the message even when
+ * it is passed as const. Hence the find functions are not thread-safe on
+ * a received message that is accessed by several threads at once.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_PARSER_LAZY_HDRS
+#   define PJSIP_PARSER_LAZY_HDRS	0
+#endif
+
+
+/**
+ * If non-zero, the endpoint prints its capability headers (Accept, Allow,
+ * Supported) and the additional request headers (Max-Forwards) once, and
+ * copies of these headers in outgoing messages are printed by copying the
+ * pre-encoded text. The text is re-encoded by #pjsip_endpt_add_capability().
+ * A copy whose values have been modified, or printed with a different
+ * compact form setting, is printed normally.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_ENDPT_PREENCODE_HDRS
+#   define PJSIP_ENDPT_PREENCODE_HDRS	0
+#endif
+
+
+/**
+ * Number of receive worker threads of the endpoint. When non-zero,
+ * incoming messages are still parsed by the thread that polls the
+ * transport, but the rest of the processing (transaction, dialog and
+ * application callbacks) is done by one of these worker threads, chosen
+ * by the hash of the Call-ID so that the messages of a dialog are
+ * processed in the order they were received. A slow callback then only
+ * delays the messages of the Call-IDs that share its worker.
+ *
+ * Messages are cloned with #pjsip_rx_data_clone() to be queued. See
+ * #pjsip_endpt_get_rx_worker_stat() for the queue statistics.
+ *
+ * Default: 0 (messages are processed by the polling thread)
+ */
+#ifndef PJSIP_RX_WORKER_CNT
+#   define PJSIP_RX_WORKER_CNT		0
+#endif
+
+
+/**
+ * Maximum number of messages waiting in the queue of each receive worker
+ * thread (see #PJSIP_RX_WORKER_CNT). When the queue is full, the polling
+ * thread waits until the worker has taken a message, which in turn slows
+ * down the reading of the transports, unless
+ * #PJSIP_RX_WORKER_DROP_WHEN_FULL is set.
+ *
+ * While the polling thread waits, it doesn't poll the ioqueue nor the
+ * timer heap. Hence the callbacks run by the workers must not block
+ * waiting for something that needs polling (e.g. a synchronous DNS
+ * query through the endpoint's resolver, or the completion of a send),
+ * otherwise a full queue deadlocks the worker and the polling thread.
+ * When that can't be avoided, enable #PJSIP_RX_WORKER_DROP_WHEN_FULL.
+ *
+ * Default: 32
+ */
+#ifndef PJSIP_RX_WORKER_QUEUE_SIZE
+#   define PJSIP_RX_WORKER_QUEUE_SIZE	32
+#endif
+
+
+/**
+ * If non-zero, a message whose receive worker queue is full is dropped
+ * instead of blocking the polling thread (see
+ * #PJSIP_RX_WORKER_QUEUE_SIZE), and it's counted as dropped in the worker
+ * statistics. The sender's retransmission then recovers it.
+ *
+ * Default: 0
+ */
+#ifndef PJSIP_RX_WORKER_DROP_WHEN_FULL
+#   define PJSIP_RX_WORKER_DROP_WHEN_FULL	0
+#endif
+
+
 /**
  * Specify port number should be allowed to appear in To and From
  * header. Note that RFC 3261 disallow this, see Table 1 in section
@@ -1129,6 +1316,69 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_AUTH_QOP_SUPPORT	    1
 #endif
 
+/**
+ * Cache the digest HA1 value (MD5 of username, realm and password) in
+ * each client authentication session, so that it is computed once per
+ * realm and credential rather than on every challenge. This is most
+ * useful together with PJSIP_AUTH_AUTO_SEND_NEXT, where a fresh
+ * Authorization header is computed for every outgoing request.
+ *
+ * Default: 0
+ */
+#if !defined(PJSIP_AUTH_CACHE_HA1)
+#   define PJSIP_AUTH_CACHE_HA1		    0
+#endif
+
+/**
+ * Number of slots in the credential cache of each server authentication
+ * session (pjsip_auth_srv). When non-zero, the server keeps the HA1 of
+ * recently verified users and a table of the nonces it has issued, so
+ * that a repeat request from a known user is verified without calling
+ * the lookup callback or allocating from a pool. A request carrying an
+ * unknown, expired or replayed (non-increasing nonce-count) nonce is
+ * rejected with PJSIP_EAUTHINNONCE, and should be answered with a fresh
+ * challenge with stale=true.
+ *
+ * Since cached users skip the lookup callback, this should not be used
+ * when the lookup decision depends on the request itself. Each slot
+ * takes about 200 bytes, and pjsip_auth_srv_deinit() must be called
+ * to release the session. A nonce given to pjsip_auth_srv_challenge()
+ * must not be longer than 64 characters.
+ *
+ * The nonce table is 4-way set-associative and a new nonce replaces the
+ * oldest one of its set. Every challenge adds a nonce, so a flood of
+ * unauthenticated requests can still evict the nonces of legitimate
+ * clients, who then get a stale=true challenge and retry. Size the table
+ * for the number of challenges expected per PJSIP_AUTH_SRV_NONCE_EXPIRY
+ * period, and rate-limit challenges when flooding is a concern.
+ *
+ * Default: 0 (disabled)
+ */
+#if !defined(PJSIP_AUTH_SRV_CACHE_SIZE)
+#   define PJSIP_AUTH_SRV_CACHE_SIZE	    0
+#endif
+
+/**
+ * Lifetime of a nonce issued by pjsip_auth_srv_challenge(), in seconds.
+ * Only used when PJSIP_AUTH_SRV_CACHE_SIZE is non-zero.
+ *
+ * Default: 300
+ */
+#if !defined(PJSIP_AUTH_SRV_NONCE_EXPIRY)
+#   define PJSIP_AUTH_SRV_NONCE_EXPIRY	    300
+#endif
+
+/**
+ * How long a cached HA1 is used before the lookup callback is asked
+ * again, in seconds. Only used when PJSIP_AUTH_SRV_CACHE_SIZE is
+ * non-zero.
+ *
+ * Default: 60
+ */
+#if !defined(PJSIP_AUTH_SRV_HA1_EXPIRY)
+#   define PJSIP_AUTH_SRV_HA1_EXPIRY	    60
+#endif
+
 
 /**
  * Maximum number of stale retries when server keeps rejecting our request
@@ -1361,6 +1611,23 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #   define PJSIP_HAS_TX_DATA_LIST		0
 #endif
 
+
+/**
+ * Maximum number of destroyed transmit buffers that the transport manager
+ * keeps for reuse by #pjsip_tx_data_create(). A recycled transmit buffer
+ * keeps its pool (which is reset), lock, reference counter and print
+ * buffer, so creating it does not need to create a pool or a lock. Each
+ * cached instance holds about PJSIP_POOL_LEN_TDATA + PJSIP_MAX_PKT_LEN
+ * bytes of memory. The hit rate is shown by #pjsip_endpt_dump().
+ *
+ * Set to zero to disable the cache.
+ *
+ * Default: 0 (disabled)
+ */
+#ifndef PJSIP_TDATA_CACHE_SIZE
+#   define PJSIP_TDATA_CACHE_SIZE		0
+#endif
+
 /** 
  * Specify whether to accept INVITE/re-INVITE with unknown content type,
  * by default the stack will reject this type of message as specified in 
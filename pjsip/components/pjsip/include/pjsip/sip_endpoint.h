@@ -647,6 +647,37 @@ PJ_DECL(pj_status_t) pjsip_endpt_add_capability( pjsip_endpoint *endpt,
 PJ_DECL(const pjsip_hdr*) pjsip_endpt_get_request_headers(pjsip_endpoint *e);
 
 
+/**
+ * Statistics of a receive worker thread (see #PJSIP_RX_WORKER_CNT).
+ */
+typedef struct pjsip_rx_worker_stat
+{
+    unsigned	queued;	    /**< Messages currently in the queue.	    */
+    unsigned	max_queued; /**< Highest number of messages in the queue.   */
+    pj_uint32_t	dispatched; /**< Messages queued to the worker.		    */
+    pj_uint32_t	full_waits; /**< Times the polling thread had to wait for
+				 room in the queue.			    */
+    pj_uint32_t	dropped;    /**< Messages dropped because they could not
+				 be cloned, or because the queue was full
+				 (see PJSIP_RX_WORKER_DROP_WHEN_FULL).	    */
+} pjsip_rx_worker_stat;
+
+
+/**
+ * Get the statistics of a receive worker thread of the endpoint.
+ *
+ * @param endpt		The endpoint.
+ * @param index		Index of the worker, less than #PJSIP_RX_WORKER_CNT.
+ * @param stat		Structure to receive the statistics.
+ *
+ * @return		PJ_SUCCESS on success, PJ_ENOTSUP if the endpoint
+ *			has no receive worker threads.
+ */
+PJ_DECL(pj_status_t) pjsip_endpt_get_rx_worker_stat(pjsip_endpoint *endpt,
+						    unsigned index,
+						    pjsip_rx_worker_stat *stat);
+
+
 /**
  * Dump endpoint status to the log. This will print the status to the log
  * with log level 3.
@@ -47,6 +47,12 @@ PJ_BEGIN_DECL
  * to read the document for more information.
  */
 
+/**
+ * Get the bit of the specified method ID (#pjsip_method_e) in the
+ * \a rx_method_mask field of #pjsip_module.
+ */
+#define PJSIP_MOD_RX_METHOD(id)	    (1U << (id))
+
 /**
  * The declaration for SIP module. This structure would be passed to
  * #pjsip_endpt_register_module() to register the module to PJSIP.
@@ -177,6 +183,17 @@ struct pjsip_module
      */
     void (*on_tsx_state)(pjsip_transaction *tsx, pjsip_event *event);
 
+    /**
+     * Optional mask of the methods of the incoming messages that the
+     * endpoint will pass to on_rx_request() and on_rx_response(), made of
+     * #PJSIP_MOD_RX_METHOD() bits. For responses, the method in the CSeq
+     * header is used. Zero means all methods.
+     *
+     * This field is read when the module is registered. It is not used
+     * when a dialog passes a message to its usages.
+     */
+    unsigned rx_method_mask;
+
 };
 
 
@@ -851,7 +851,10 @@ PJ_DECL(pjsip_msg*) pjsip_msg_clone( pj_pool_t *pool, const pjsip_msg *msg);
 
 
 /** 
- * Find a header in the message by the header type.
+ * Find a header in the message by the header type. With
+ * PJSIP_PARSER_LAZY_HDRS, this and the other find functions may parse the
+ * header and modify the message, so they must not be called on the same
+ * message from several threads at once.
  *
  * @param msg	    The message.
  * @param type	    The header type to find.
@@ -285,6 +285,46 @@ PJ_DECL(pj_status_t) pjsip_find_msg(const char *buf,
 				    pj_bool_t is_datagram, 
                                     pj_size_t *msg_size);
 
+/**
+ * This structure keeps the progress of #pjsip_find_msg2() on a partially
+ * received message, so that subsequent calls only need to examine the
+ * newly received data. All offsets are relative to the start of the
+ * message. Zero-initialize the structure before the first call, and
+ * again whenever the start of the message changes.
+ */
+typedef struct pjsip_find_msg_state
+{
+    pj_size_t	line;		/**< Start of the current header.	    */
+    pj_size_t	scan;		/**< Where the newline search resumes.	    */
+    pj_size_t	body;		/**< Start of the body, zero if unknown.    */
+    int		content_length;	/**< Content-Length plus one, zero if no
+				     valid Content-Length has been found.   */
+    pj_status_t	status;		/**< Error of the last Content-Length
+				     parsing, zero if none.		    */
+} pjsip_find_msg_state;
+
+/**
+ * Variant of #pjsip_find_msg() for stream oriented transports, which
+ * resumes the scanning from where the previous call on the same message
+ * stopped instead of starting from the beginning of the buffer.
+ *
+ * @param buf		The input buffer, which must be NULL terminated.
+ *			The buffer must start at the same message as in the
+ *			previous call with the same state.
+ * @param size		The length of the string (not counting NULL terminator).
+ * @param is_datagram	Put non-zero if transport is datagram oriented.
+ * @param state		The scanning state.
+ * @param msg_size	[out] If message is valid, this parameter will contain
+ *			the size of the SIP message (including body, if any).
+ *
+ * @return		PJ_SUCCESS if a message is found, or an error code.
+ */
+PJ_DECL(pj_status_t) pjsip_find_msg2(const char *buf,
+				     pj_size_t size,
+				     pj_bool_t is_datagram,
+				     pjsip_find_msg_state *state,
+				     pj_size_t *msg_size);
+
 /**
  * Parse the content of a header and return the header instance.
  * This function parses the content of a header (ie. part after colon) according
@@ -340,6 +380,41 @@ PJ_DECL(pj_status_t) pjsip_parse_headers( pj_pool_t *pool, char *input,
 				          pj_size_t size, pjsip_hdr *hlist,
 				          unsigned options);
 
+/**
+ * Header which value has not been parsed yet, see PJSIP_PARSER_LAZY_HDRS.
+ * The header has PJSIP_H_OTHER type and the name as it appears in the
+ * message, and it can be printed and cloned like generic string header.
+ */
+typedef struct pjsip_lazy_hdr
+{
+    /** Standard header field. */
+    PJSIP_DECL_HDR_MEMBER(struct pjsip_lazy_hdr);
+    pj_str_t	hvalue;	    /**< Unparsed header value.		    */
+    pjsip_hdr_e	htype;	    /**< Header type once it is parsed.	    */
+    pj_pool_t  *pool;	    /**< Pool for the parsed header.	    */
+} pjsip_lazy_hdr;
+
+/**
+ * Check if the header is a #pjsip_lazy_hdr.
+ *
+ * @param hdr		The header.
+ *
+ * @return		PJ_TRUE if the header has not been parsed yet.
+ */
+PJ_DECL(pj_bool_t) pjsip_hdr_is_lazy(const void *hdr);
+
+/**
+ * Parse lazy header, and replace it with the parsed header(s) in the
+ * header list. If the header fails to parse, it is removed from the
+ * list.
+ *
+ * @param hdr		The lazy header, which must be in a header list.
+ *
+ * @return		The first parsed header, or the header that followed
+ *			the lazy header in the list if parsing has failed.
+ */
+PJ_DECL(pjsip_hdr*) pjsip_lazy_hdr_parse(pjsip_lazy_hdr *hdr);
+
 
 /**
  * @}
@@ -139,6 +139,16 @@ struct pjsip_transaction
     pj_timer_entry		retransmit_timer;/**< Retransmit timer.     */
     pj_timer_entry		timeout_timer;  /**< Timeout timer.         */
 
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    /** Node of the retransmission timer wheel (internal). */
+    struct pjsip_tsx_rtx_node
+    {
+	PJ_DECL_LIST_MEMBER(struct pjsip_tsx_rtx_node);
+	pjsip_transaction      *tsx;		/**< The transaction.	    */
+	int			slot;		/**< Wheel slot, or -1.	    */
+    } rtx_node;
+#endif
+
     /** Module specific data. */
     void		       *mod_data[PJSIP_MAX_MODULE];
 };
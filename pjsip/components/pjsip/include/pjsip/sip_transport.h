@@ -345,6 +345,12 @@ struct pjsip_rx_data
 	/** The IP source port number. */
 	int			 src_port;
 
+	/** Framing state of the partially received message at the start
+	 *  of the packet, used by stream oriented transports. Transport
+	 *  must zero-initialize this when it creates the rdata.
+	 */
+	pjsip_find_msg_state	 find_state;
+
     } pkt_info;
 
 
@@ -570,6 +576,18 @@ struct pjsip_tx_data
     /** Reference counter. */
     pj_atomic_t		*ref_cnt;
 
+#if PJSIP_TDATA_CACHE_SIZE
+    /** Pool holding this structure, the lock, the reference counter and
+     *  the print buffer, which are kept when the transmit data is recycled
+     *  (see #PJSIP_TDATA_CACHE_SIZE). The message is allocated from
+     *  \a pool, which is reset.
+     */
+    pj_pool_t		*cache_pool;
+
+    /** Print buffer kept across recycling, allocated on first use. */
+    char		*cache_buf;
+#endif
+
     /** Being processed by transport? */
     int			 is_pending;
 
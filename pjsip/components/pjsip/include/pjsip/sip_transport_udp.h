@@ -91,6 +91,9 @@ typedef struct pjsip_udp_transport_cfg
      * the number of processors in the system (or the number of SIP
      * worker threads).
      *
+     * When PJ_HAS_SOCK_MMSG is enabled, at least PJ_SOCK_MAX_MMSG reads
+     * are kept pending so that they can be filled with one recvmmsg().
+     *
      * Default: 1
      */
     unsigned	        async_cnt;
@@ -136,28 +136,16 @@ static void digest2str(const unsigned char digest[], char *output)
 
 
 /*
- * Create response digest based on the parameters and store the
- * digest ASCII in 'result'.
+ * Calculate HA1 for the credential and realm and store the ASCII
+ * digest in 'ha1' (not NULL terminated).
  */
-PJ_DEF(void) pjsip_auth_create_digest( pj_str_t *result,
-				       const pj_str_t *nonce,
-				       const pj_str_t *nc,
-				       const pj_str_t *cnonce,
-				       const pj_str_t *qop,
-				       const pj_str_t *uri,
-				       const pj_str_t *realm,
-				       const pjsip_cred_info *cred_info,
-				       const pj_str_t *method)
+static void create_ha1( char ha1[],
+			const pj_str_t *realm,
+			const pjsip_cred_info *cred_info)
 {
-    char ha1[PJSIP_MD5STRLEN];
-    char ha2[PJSIP_MD5STRLEN];
     unsigned char digest[16];
     pj_md5_context pms;
 
-    pj_assert(result->slen >= PJSIP_MD5STRLEN);
-
-    AUTH_TRACE_((THIS_FILE, "Begin creating digest"));
-
     if ((cred_info->data_type & PASSWD_MASK) == PJSIP_CRED_DATA_PLAIN_PASSWD) {
 	/***
 	 *** ha1 = MD5(username ":" realm ":" password)
@@ -180,6 +168,26 @@ PJ_DEF(void) pjsip_auth_create_digest( pj_str_t *result,
     }
 
     AUTH_TRACE_((THIS_FILE, "  ha1=%.32s", ha1));
+}
+
+/*
+ * Create response digest from a precalculated HA1 and store the
+ * digest ASCII in 'result'.
+ */
+static void create_digest_from_ha1( pj_str_t *result,
+				    const char ha1[],
+				    const pj_str_t *nonce,
+				    const pj_str_t *nc,
+				    const pj_str_t *cnonce,
+				    const pj_str_t *qop,
+				    const pj_str_t *uri,
+				    const pj_str_t *method)
+{
+    char ha2[PJSIP_MD5STRLEN];
+    unsigned char digest[16];
+    pj_md5_context pms;
+
+    pj_assert(result->slen >= PJSIP_MD5STRLEN);
 
     /***
      *** ha2 = MD5(method ":" req_uri)
@@ -226,6 +234,29 @@ PJ_DEF(void) pjsip_auth_create_digest( pj_str_t *result,
     AUTH_TRACE_((THIS_FILE, "Digest created"));
 }
 
+
+/*
+ * Create response digest based on the parameters and store the
+ * digest ASCII in 'result'.
+ */
+PJ_DEF(void) pjsip_auth_create_digest( pj_str_t *result,
+				       const pj_str_t *nonce,
+				       const pj_str_t *nc,
+				       const pj_str_t *cnonce,
+				       const pj_str_t *qop,
+				       const pj_str_t *uri,
+				       const pj_str_t *realm,
+				       const pjsip_cred_info *cred_info,
+				       const pj_str_t *method)
+{
+    char ha1[PJSIP_MD5STRLEN];
+
+    AUTH_TRACE_((THIS_FILE, "Begin creating digest"));
+
+    create_ha1(ha1, realm, cred_info);
+    create_digest_from_ha1(result, ha1, nonce, nc, cnonce, qop, uri, method);
+}
+
 /*
  * Finds out if qop offer contains "auth" token.
  */
@@ -265,12 +296,14 @@ static pj_bool_t has_auth_qop( pj_pool_t *pool, const pj_str_t *qop_offer)
  *
  * The resulting digest will be stored in cred->response.
  * The pool is used to allocate 32 bytes to store the digest in cred->response.
+ * If ha1 is not NULL, it is used instead of calculating HA1 from cred_info.
  */
 static pj_status_t respond_digest( pj_pool_t *pool,
 				   pjsip_digest_credential *cred,
 				   const pjsip_digest_challenge *chal,
 				   const pj_str_t *uri,
 				   const pjsip_cred_info *cred_info,
+				   const char *ha1,
 				   const pj_str_t *cnonce,
 				   pj_uint32_t nc,
 				   const pj_str_t *method)
@@ -310,6 +343,10 @@ static pj_status_t respond_digest( pj_pool_t *pool,
 	    return (*cred_info->ext.aka.cb)(pool, chal, cred_info,
 					    method, cred);
 	}
+	else if (ha1) {
+	    create_digest_from_ha1( &cred->response, ha1, &cred->nonce, NULL,
+				    NULL, NULL, uri, method);
+	}
 	else {
 	    /* Convert digest to string and store in chal->response. */
 	    pjsip_auth_create_digest( &cred->response, &cred->nonce, NULL,
@@ -337,6 +374,11 @@ static pj_status_t respond_digest( pj_pool_t *pool,
 	    return (*cred_info->ext.aka.cb)(pool, chal, cred_info,
 					    method, cred);
 	}
+	else if (ha1) {
+	    create_digest_from_ha1( &cred->response, ha1, &cred->nonce,
+				    &cred->nc, &cred->cnonce, &pjsip_AUTH_STR,
+				    uri, method );
+	}
 	else {
 	    pjsip_auth_create_digest( &cred->response, &cred->nonce,
 				      &cred->nc, &cred->cnonce, &pjsip_AUTH_STR,
@@ -711,6 +753,7 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
     /* Only support digest scheme at the moment. */
     if (!pj_stricmp(&hdr->scheme, &pjsip_DIGEST_STR)) {
 	pj_str_t *cnonce = NULL;
+	const char *ha1 = NULL;
 	pj_uint32_t nc = 1;
 
 	/* Update the session (nonce-count etc) if required. */
@@ -725,10 +768,28 @@ static pj_status_t auth_respond( pj_pool_t *req_pool,
 	}
 #	endif	/* PJSIP_AUTH_QOP_SUPPORT */
 
+	/* Reuse HA1 calculated for the same realm and credential. */
+#	if PJSIP_AUTH_CACHE_HA1
+	{
+	    if (cached_auth &&
+		(cred_info->data_type & EXT_MASK) != PJSIP_CRED_DATA_EXT_AKA &&
+		pj_strcmp(&cached_auth->realm,
+			  &hdr->challenge.digest.realm) == 0)
+	    {
+		if (cached_auth->ha1_cred != cred_info) {
+		    create_ha1(cached_auth->ha1, &cached_auth->realm,
+			       cred_info);
+		    cached_auth->ha1_cred = cred_info;
+		}
+		ha1 = cached_auth->ha1;
+	    }
+	}
+#	endif	/* PJSIP_AUTH_CACHE_HA1 */
+
 	hauth->scheme = pjsip_DIGEST_STR;
 	status = respond_digest( pool, &hauth->credential.digest,
 				 &hdr->challenge.digest, &uri_str, cred_info,
-				 cnonce, nc, &method->name);
+				 ha1, cnonce, nc, &method->name);
 	if (status != PJ_SUCCESS)
 	    return status;
 
@@ -798,7 +859,7 @@ static pj_status_t new_auth_for_req( pjsip_tx_data *tdata,
     pjsip_authorization_hdr *hauth;
     pj_status_t status;
 
-    PJ_ASSERT_RETURN(tdata && sess && auth, PJ_EINVAL);
+    PJ_ASSERT_RETURN(tdata && sess && auth && p_h_auth, PJ_EINVAL);
     PJ_ASSERT_RETURN(auth->last_chal != NULL, PJSIP_EAUTHNOPREVCHAL);
 
     cred = auth_find_cred( sess, &auth->realm, &auth->last_chal->scheme );
@@ -812,10 +873,7 @@ static pj_status_t new_auth_for_req( pjsip_tx_data *tdata,
     if (status != PJ_SUCCESS)
 	return status;
 
-    pjsip_msg_add_hdr( tdata->msg, (pjsip_hdr*)hauth);
-
-    if (p_h_auth)
-	*p_h_auth = hauth;
+    *p_h_auth = hauth;
 
     return PJ_SUCCESS;
 }
@@ -883,8 +941,13 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_init_req( pjsip_auth_clt_sess *sess,
 #		if defined(PJSIP_AUTH_AUTO_SEND_NEXT) && \
 			   PJSIP_AUTH_AUTO_SEND_NEXT!=0
 		{
-		    if (entry == &auth->cached_hdr)
-			new_auth_for_req( tdata, sess, auth, NULL);
+		    pjsip_authorization_hdr *hauth;
+
+		    if (entry == &auth->cached_hdr &&
+			new_auth_for_req(tdata, sess, auth, &hauth)==PJ_SUCCESS)
+		    {
+			pj_list_push_back(&added, hauth);
+		    }
 		}
 #		endif
 
@@ -892,7 +955,10 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_init_req( pjsip_auth_clt_sess *sess,
 #	    elif defined(PJSIP_AUTH_AUTO_SEND_NEXT) && \
 		 PJSIP_AUTH_AUTO_SEND_NEXT!=0
 	    {
-		new_auth_for_req( tdata, sess, auth, NULL);
+		pjsip_authorization_hdr *hauth;
+
+		if (new_auth_for_req(tdata, sess, auth, &hauth)==PJ_SUCCESS)
+		    pj_list_push_back(&added, hauth);
 	    }
 #	    endif
 
@@ -1190,6 +1256,12 @@ PJ_DEF(pj_status_t) pjsip_auth_clt_reinit_req(	pjsip_auth_clt_sess *sess,
 	       hdr->type != PJSIP_H_WWW_AUTHENTICATE &&
 	       hdr->type != PJSIP_H_PROXY_AUTHENTICATE)
 	{
+#if PJSIP_PARSER_LAZY_HDRS
+	    if (pjsip_hdr_is_lazy(hdr)) {
+		hdr = pjsip_lazy_hdr_parse((pjsip_lazy_hdr*)hdr);
+		continue;
+	    }
+#endif
 	    hdr = hdr->next;
 	}
 	if (hdr == &rdata->msg_info.msg->hdr)
@@ -25,6 +25,272 @@
 #include <pjsip/sip_transport.h>
 #include <pj/pj_string.h>
 #include <pj/pj_assert.h>
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+#   include <pjlib-util/pj_md5.h>
+#   include <pj/hash.h>
+#   include <pj/pj_ctype.h>
+#   include <pj/pj_lock.h>
+#   include <pj/pj_os.h>
+#   include <pj/pool.h>
+#endif
+
+
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+
+/* Longest username and nonce that fit in a cache entry. Longer usernames
+ * are still verified, they are just never cached. Longer nonces can't be
+ * checked for replay, so they are not issued nor accepted.
+ */
+#define CACHE_USER_LEN	    64
+#define CACHE_NONCE_LEN	    64
+
+/* The nonce table is set-associative, a new nonce replaces the oldest
+ * entry of its set, so that other requests can't easily evict a nonce
+ * that has just been issued.
+ */
+#define NONCE_WAYS	    4
+#define NONCE_SETS	    ((PJSIP_AUTH_SRV_CACHE_SIZE+NONCE_WAYS-1) / \
+			     NONCE_WAYS)
+
+/* HA1 of a verified user in the served realm. */
+typedef struct ha1_entry
+{
+    unsigned	    user_len;
+    char	    user[CACHE_USER_LEN];
+    char	    ha1[PJSIP_MD5STRLEN];
+    pj_time_val	    expire;
+} ha1_entry;
+
+/* Nonce issued by pjsip_auth_srv_challenge() and the highest nonce-count
+ * accepted with it so far.
+ */
+typedef struct nonce_entry
+{
+    unsigned	    nonce_len;
+    char	    nonce[CACHE_NONCE_LEN];
+    pj_uint32_t	    nc;
+    pj_time_val	    expire;
+} nonce_entry;
+
+/* The HA1 table is direct-mapped, a new entry simply replaces whatever
+ * was in its slot.
+ */
+struct pjsip_auth_srv_cache
+{
+    pj_lock_t	   *lock;
+    ha1_entry	    ha1[PJSIP_AUTH_SRV_CACHE_SIZE];
+    nonce_entry	    nonce[NONCE_SETS * NONCE_WAYS];
+};
+
+static pj_status_t cache_create(pj_pool_t *pool, pjsip_auth_srv *auth_srv)
+{
+    auth_srv->cache = PJ_POOL_ZALLOC_T(pool, struct pjsip_auth_srv_cache);
+    return pj_lock_create_simple_mutex(pool, "auth_srv%p",
+				       &auth_srv->cache->lock);
+}
+
+static ha1_entry *ha1_slot(struct pjsip_auth_srv_cache *cache,
+			   const pj_str_t *user)
+{
+    pj_uint32_t hval = pj_hash_calc(0, user->ptr, (unsigned)user->slen);
+    return &cache->ha1[hval % PJSIP_AUTH_SRV_CACHE_SIZE];
+}
+
+/* Get the first of the NONCE_WAYS entries the nonce may be in. */
+static nonce_entry *nonce_set(struct pjsip_auth_srv_cache *cache,
+			      const pj_str_t *nonce)
+{
+    pj_uint32_t hval = pj_hash_calc(0, nonce->ptr, (unsigned)nonce->slen);
+    return &cache->nonce[(hval % NONCE_SETS) * NONCE_WAYS];
+}
+
+static nonce_entry *nonce_find(nonce_entry set[], const pj_str_t *nonce)
+{
+    unsigned i;
+
+    for (i=0; i<NONCE_WAYS; ++i) {
+	if (set[i].nonce_len == (unsigned)nonce->slen &&
+	    pj_memcmp(set[i].nonce, nonce->ptr, nonce->slen) == 0)
+	{
+	    return &set[i];
+	}
+    }
+    return NULL;
+}
+
+/* Copy the cached HA1 of the user to ha1, if it is still valid. */
+static pj_bool_t cache_get_ha1(struct pjsip_auth_srv_cache *cache,
+			       const pj_str_t *user,
+			       char ha1[])
+{
+    ha1_entry *e;
+    pj_time_val now;
+    pj_bool_t found = PJ_FALSE;
+
+    if (user->slen > CACHE_USER_LEN)
+	return PJ_FALSE;
+
+    pj_gettickcount(&now);
+
+    pj_lock_acquire(cache->lock);
+    e = ha1_slot(cache, user);
+    if (e->user_len == (unsigned)user->slen &&
+	pj_memcmp(e->user, user->ptr, user->slen) == 0 &&
+	PJ_TIME_VAL_LT(now, e->expire))
+    {
+	pj_memcpy(ha1, e->ha1, PJSIP_MD5STRLEN);
+	found = PJ_TRUE;
+    }
+    pj_lock_release(cache->lock);
+
+    return found;
+}
+
+/* Calculate HA1 from the credential returned by the lookup callback
+ * and store it for the user.
+ */
+static void cache_put_ha1(struct pjsip_auth_srv_cache *cache,
+			  const pj_str_t *user,
+			  const pjsip_cred_info *cred_info)
+{
+    char ha1[PJSIP_MD5STRLEN];
+    ha1_entry *e;
+    pj_time_val now;
+
+    if (user->slen > CACHE_USER_LEN)
+	return;
+
+    if (cred_info->data_type == PJSIP_CRED_DATA_PLAIN_PASSWD) {
+	unsigned char digest[16];
+	pj_md5_context pms;
+	int i;
+
+	pj_md5_init(&pms);
+	pj_md5_update(&pms, (const pj_uint8_t*)cred_info->username.ptr,
+		      (unsigned)cred_info->username.slen);
+	pj_md5_update(&pms, (const pj_uint8_t*)":", 1);
+	pj_md5_update(&pms, (const pj_uint8_t*)cred_info->realm.ptr,
+		      (unsigned)cred_info->realm.slen);
+	pj_md5_update(&pms, (const pj_uint8_t*)":", 1);
+	pj_md5_update(&pms, (const pj_uint8_t*)cred_info->data.ptr,
+		      (unsigned)cred_info->data.slen);
+	pj_md5_final(&pms, digest);
+
+	for (i = 0; i < 16; ++i)
+	    pj_val_to_hex_digit(digest[i], ha1 + i*2);
+
+    } else if (cred_info->data_type == PJSIP_CRED_DATA_DIGEST &&
+	       cred_info->data.slen == PJSIP_MD5STRLEN)
+    {
+	pj_memcpy(ha1, cred_info->data.ptr, PJSIP_MD5STRLEN);
+    } else {
+	return;
+    }
+
+    pj_gettickcount(&now);
+    now.sec += PJSIP_AUTH_SRV_HA1_EXPIRY;
+
+    pj_lock_acquire(cache->lock);
+    e = ha1_slot(cache, user);
+    e->user_len = (unsigned)user->slen;
+    pj_memcpy(e->user, user->ptr, user->slen);
+    pj_memcpy(e->ha1, ha1, PJSIP_MD5STRLEN);
+    e->expire = now;
+    pj_lock_release(cache->lock);
+}
+
+/* Forget the cached HA1 of the user, e.g. because it no longer matches. */
+static void cache_del_ha1(struct pjsip_auth_srv_cache *cache,
+			  const pj_str_t *user)
+{
+    ha1_entry *e;
+
+    if (user->slen > CACHE_USER_LEN)
+	return;
+
+    pj_lock_acquire(cache->lock);
+    e = ha1_slot(cache, user);
+    if (e->user_len == (unsigned)user->slen &&
+	pj_memcmp(e->user, user->ptr, user->slen) == 0)
+    {
+	e->user_len = 0;
+    }
+    pj_lock_release(cache->lock);
+}
+
+/* Remember a nonce sent in a challenge. */
+static void cache_add_nonce(struct pjsip_auth_srv_cache *cache,
+			    const pj_str_t *nonce)
+{
+    nonce_entry *set, *e;
+    pj_time_val now;
+    unsigned i;
+
+    pj_assert(nonce->slen <= CACHE_NONCE_LEN);
+
+    pj_gettickcount(&now);
+    now.sec += PJSIP_AUTH_SRV_NONCE_EXPIRY;
+
+    pj_lock_acquire(cache->lock);
+    set = nonce_set(cache, nonce);
+    e = nonce_find(set, nonce);
+    if (!e) {
+	/* Take an unused entry, or else the one issued first. Since all
+	 * nonces live equally long, that's also the first to expire.
+	 */
+	e = &set[0];
+	for (i=0; i<NONCE_WAYS && e->nonce_len; ++i) {
+	    if (set[i].nonce_len == 0 ||
+		PJ_TIME_VAL_LT(set[i].expire, e->expire))
+	    {
+		e = &set[i];
+	    }
+	}
+    }
+    e->nonce_len = (unsigned)nonce->slen;
+    pj_memcpy(e->nonce, nonce->ptr, nonce->slen);
+    e->nc = 0;
+    e->expire = now;
+    pj_lock_release(cache->lock);
+}
+
+/* Check that the nonce in the credential was issued by us, has not
+ * expired, and (with qop) that its nonce-count has not been seen yet.
+ * When commit is set, the nonce-count is also recorded as used.
+ */
+static pj_status_t cache_check_nonce(struct pjsip_auth_srv_cache *cache,
+				     const pjsip_digest_credential *dig,
+				     pj_bool_t commit)
+{
+    nonce_entry *e;
+    pj_uint32_t nc = 0;
+    pj_time_val now;
+    pj_status_t status = PJ_SUCCESS;
+
+    /* Such a nonce can't have been issued by us */
+    if (dig->nonce.slen > CACHE_NONCE_LEN)
+	return PJSIP_EAUTHINNONCE;
+
+    if (dig->qop.slen)
+	nc = (pj_uint32_t) pj_strtoul2(&dig->nc, NULL, 16);
+
+    pj_gettickcount(&now);
+
+    pj_lock_acquire(cache->lock);
+    e = nonce_find(nonce_set(cache, &dig->nonce), &dig->nonce);
+    if (!e || PJ_TIME_VAL_GTE(now, e->expire)) {
+	status = PJSIP_EAUTHINNONCE;
+    } else if (dig->qop.slen && nc <= e->nc) {
+	status = PJSIP_EAUTHINNONCE;
+    } else if (commit && dig->qop.slen) {
+	e->nc = nc;
+    }
+    pj_lock_release(cache->lock);
+
+    return status;
+}
+
+#endif	/* PJSIP_AUTH_SRV_CACHE_SIZE */
 
 
 /*
@@ -45,7 +311,11 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_init(  pj_pool_t *pool,
     auth_srv->lookup = lookup;
     auth_srv->is_proxy = (options & PJSIP_AUTH_SRV_IS_PROXY);
 
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    return cache_create(pool, auth_srv);
+#else
     return PJ_SUCCESS;
+#endif
 }
 
 /*
@@ -65,6 +335,28 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_init2(
     auth_srv->lookup2 = param->lookup2;
     auth_srv->is_proxy = (param->options & PJSIP_AUTH_SRV_IS_PROXY);
 
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    return cache_create(pool, auth_srv);
+#else
+    return PJ_SUCCESS;
+#endif
+}
+
+
+/*
+ * Release resources held by the server authorization session.
+ */
+PJ_DEF(pj_status_t) pjsip_auth_srv_deinit(pjsip_auth_srv *auth_srv)
+{
+    PJ_ASSERT_RETURN(auth_srv, PJ_EINVAL);
+
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    if (auth_srv->cache) {
+	pj_lock_destroy(auth_srv->cache->lock);
+	auth_srv->cache = NULL;
+    }
+#endif
+
     return PJ_SUCCESS;
 }
 
@@ -116,6 +408,27 @@ static pj_status_t pjsip_auth_verify( const pjsip_authorization_hdr *hdr,
 }
 
 
+/* Find the credential information for the account. */
+static pj_status_t lookup_cred( pjsip_auth_srv *auth_srv,
+				pjsip_rx_data *rdata,
+				const pj_str_t *acc_name,
+				pjsip_cred_info *cred_info)
+{
+    if (auth_srv->lookup2) {
+	pjsip_auth_lookup_cred_param param;
+
+	pj_bzero(&param, sizeof(param));
+	param.realm = auth_srv->realm;
+	param.acc_name = *acc_name;
+	param.rdata = rdata;
+	return (*auth_srv->lookup2)(rdata->tp_info.pool, &param, cred_info);
+    } else {
+	return (*auth_srv->lookup)(rdata->tp_info.pool, &auth_srv->realm,
+				   acc_name, cred_info);
+    }
+}
+
+
 /*
  * Request the authorization server framework to verify the authorization 
  * information in the specified request in rdata.
@@ -129,6 +442,7 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
     pjsip_hdr_e htype;
     pj_str_t acc_name;
     pjsip_cred_info cred_info;
+    pj_bool_t verified = PJ_FALSE;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(auth_srv && rdata, PJ_EINVAL);
@@ -168,35 +482,76 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_verify( pjsip_auth_srv *auth_srv,
 	return PJSIP_EINVALIDAUTHSCHEME;
     }
 
-    /* Find the credential information for the account. */
-    if (auth_srv->lookup2) {
-	pjsip_auth_lookup_cred_param param;
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    if (auth_srv->cache) {
+	char ha1[PJSIP_MD5STRLEN];
 
-	pj_bzero(&param, sizeof(param));
-	param.realm = auth_srv->realm;
-	param.acc_name = acc_name;
-	param.rdata = rdata;
-	status = (*auth_srv->lookup2)(rdata->tp_info.pool, &param, &cred_info);
+	/* Reject unknown, expired and replayed nonces before doing
+	 * any digest calculation.
+	 */
+	status = cache_check_nonce(auth_srv->cache,
+				   &h_auth->credential.digest, PJ_FALSE);
+	if (status != PJ_SUCCESS) {
+	    *status_code = auth_srv->is_proxy ? 407 : 401;
+	    return status;
+	}
+
+	/* Verify against the cached HA1 without asking the application. */
+	if (cache_get_ha1(auth_srv->cache, &acc_name, ha1)) {
+	    pj_bzero(&cred_info, sizeof(cred_info));
+	    cred_info.realm = h_auth->credential.digest.realm;
+	    cred_info.username = acc_name;
+	    cred_info.data_type = PJSIP_CRED_DATA_DIGEST;
+	    cred_info.data.ptr = ha1;
+	    cred_info.data.slen = PJSIP_MD5STRLEN;
+
+	    status = pjsip_auth_verify(h_auth, &msg->line.req.method.name,
+				       &cred_info);
+	    if (status == PJ_SUCCESS) {
+		verified = PJ_TRUE;
+	    } else {
+		/* The credential may have changed, look it up again. */
+		cache_del_ha1(auth_srv->cache, &acc_name);
+	    }
+	}
+    }
+#endif
+
+    if (!verified) {
+	/* Find the credential information for the account. */
+	status = lookup_cred(auth_srv, rdata, &acc_name, &cred_info);
 	if (status != PJ_SUCCESS) {
 	    *status_code = PJSIP_SC_FORBIDDEN;
 	    return status;
 	}
-    } else {
-	status = (*auth_srv->lookup)(rdata->tp_info.pool, &auth_srv->realm,
-				     &acc_name, &cred_info);
+
+	/* Authenticate with the specified credential. */
+	status = pjsip_auth_verify(h_auth, &msg->line.req.method.name, 
+				   &cred_info);
 	if (status != PJ_SUCCESS) {
 	    *status_code = PJSIP_SC_FORBIDDEN;
 	    return status;
 	}
+
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+	if (auth_srv->cache)
+	    cache_put_ha1(auth_srv->cache, &acc_name, &cred_info);
+#endif
     }
 
-    /* Authenticate with the specified credential. */
-    status = pjsip_auth_verify(h_auth, &msg->line.req.method.name, 
-			       &cred_info);
-    if (status != PJ_SUCCESS) {
-	*status_code = PJSIP_SC_FORBIDDEN;
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    /* Consume the nonce-count, another request may have raced us. */
+    if (auth_srv->cache) {
+	status = cache_check_nonce(auth_srv->cache,
+				   &h_auth->credential.digest, PJ_TRUE);
+	if (status != PJ_SUCCESS) {
+	    *status_code = auth_srv->is_proxy ? 407 : 401;
+	    return status;
+	}
     }
-    return status;
+#endif
+
+    return PJ_SUCCESS;
 }
 
 
@@ -219,6 +574,12 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_challenge(  pjsip_auth_srv *auth_srv,
 
     PJ_ASSERT_RETURN( auth_srv && tdata, PJ_EINVAL );
 
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    /* The nonce must fit in the cache to be accepted later */
+    if (auth_srv->cache && nonce && nonce->slen > CACHE_NONCE_LEN)
+	return PJ_ETOOBIG;
+#endif
+
     random.ptr = nonce_buf;
     random.slen = sizeof(nonce_buf);
 
@@ -253,6 +614,11 @@ PJ_DEF(pj_status_t) pjsip_auth_srv_challenge(  pjsip_auth_srv *auth_srv,
     pj_strdup(tdata->pool, &hdr->challenge.digest.realm, &auth_srv->realm);
     hdr->challenge.digest.stale = stale;
 
+#if PJSIP_AUTH_SRV_CACHE_SIZE
+    if (auth_srv->cache)
+	cache_add_nonce(auth_srv->cache, &hdr->challenge.digest.nonce);
+#endif
+
     pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr*)hdr);
 
     return PJ_SUCCESS;
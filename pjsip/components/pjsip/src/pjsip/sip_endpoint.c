@@ -49,6 +49,26 @@ typedef struct exit_cb
 } exit_cb;
 
 
+
+#if PJSIP_RX_WORKER_CNT
+/**
+ * Receive worker thread, processing the messages of the Call-IDs that
+ * hash to it in the order they were queued.
+ */
+typedef struct rx_worker
+{
+    pjsip_endpoint	*endpt;
+    pj_thread_t		*thread;
+    pj_mutex_t		*mutex;
+    pj_sem_t		*sem_msg;	/* Number of queued messages.	    */
+    pj_sem_t		*sem_room;	/* Number of free queue entries.    */
+    pjsip_rx_data	*queue[PJSIP_RX_WORKER_QUEUE_SIZE];
+    unsigned		 head;
+    unsigned		 waiting;	/* Pollers waiting for room.	    */
+    pjsip_rx_worker_stat stat;
+} rx_worker;
+#endif
+
 /**
  * The SIP endpoint.
  */
@@ -90,6 +110,15 @@ struct pjsip_endpoint
     /** Module list, sorted by priority. */
     pjsip_module	 module_list;
 
+    /** Position of the modules in the module list, by module ID. */
+    unsigned		 mod_pos[PJSIP_MAX_MODULE];
+
+    /** The modules to pass incoming requests (index 0) and responses
+     *  (index 1) to, for each method ID, in module list order and NULL
+     *  terminated.
+     */
+    pjsip_module	*rx_chain[2][PJSIP_OTHER_METHOD+1][PJSIP_MAX_MODULE+1];
+
     /** Capability header list. */
     pjsip_hdr		 cap_hdr;
 
@@ -98,6 +127,14 @@ struct pjsip_endpoint
 
     /** List of exit callback. */
     exit_cb		 exit_cb_list;
+
+#if PJSIP_RX_WORKER_CNT
+    /** Receive worker threads. */
+    rx_worker		 rx_worker[PJSIP_RX_WORKER_CNT];
+
+    /** Flag to tell the receive worker threads to quit. */
+    pj_bool_t		 rx_worker_quit;
+#endif
 };
 
 
@@ -120,6 +157,12 @@ static pj_status_t endpt_on_tx_msg( pjsip_endpoint *endpt,
 				    pjsip_tx_data *tdata );
 static pj_status_t unload_module(pjsip_endpoint *endpt,
 				 pjsip_module *mod);
+static void update_rx_chains(pjsip_endpoint *endpt);
+#if PJSIP_RX_WORKER_CNT
+static pj_status_t rx_workers_create(pjsip_endpoint *endpt);
+static void rx_workers_stop(pjsip_endpoint *endpt);
+static void rx_workers_destroy(pjsip_endpoint *endpt);
+#endif
 
 /* Defined in sip_parser.c */
 void init_sip_parser(void);
@@ -212,6 +255,9 @@ PJ_DEF(pj_status_t) pjsip_endpt_register_module( pjsip_endpoint *endpt,
     }
     pj_list_insert_before(m, mod);
 
+    /* Update the dispatch chains of incoming messages. */
+    update_rx_chains(endpt);
+
     /* Done. */
 
     PJ_LOG(4,(THIS_FILE, "Module \"%.*s\" registered", 
@@ -288,6 +334,9 @@ static pj_status_t unload_module(pjsip_endpoint *endpt,
     /* Remove module from list. */
     pj_list_erase(mod);
 
+    /* Update the dispatch chains of incoming messages. */
+    update_rx_chains(endpt);
+
     /* Set module Id to -1. */
     mod->id = -1;
 
@@ -300,6 +349,168 @@ static pj_status_t unload_module(pjsip_endpoint *endpt,
     return status;
 }
 
+/*
+ * Rebuild the list of modules to pass incoming messages to, for each
+ * message type and method. Module write lock must be held.
+ */
+static void update_rx_chains(pjsip_endpoint *endpt)
+{
+    unsigned type, method, pos;
+    pjsip_module *mod;
+
+    for (type=0; type<2; ++type) {
+	for (method=0; method<=PJSIP_OTHER_METHOD; ++method) {
+	    pjsip_module **chain = endpt->rx_chain[type][method];
+	    unsigned cnt = 0;
+
+	    for (mod=endpt->module_list.next; mod!=&endpt->module_list;
+		 mod=mod->next)
+	    {
+		if ((type==0 ? mod->on_rx_request==NULL :
+			       mod->on_rx_response==NULL) ||
+		    (mod->rx_method_mask &&
+		     (mod->rx_method_mask & PJSIP_MOD_RX_METHOD(method))==0))
+		{
+		    continue;
+		}
+		chain[cnt++] = mod;
+	    }
+	    chain[cnt] = NULL;
+	}
+    }
+
+    pos = 0;
+    for (mod=endpt->module_list.next; mod!=&endpt->module_list; mod=mod->next)
+	endpt->mod_pos[mod->id] = pos++;
+}
+
+
+#if PJSIP_ENDPT_PREENCODE_HDRS
+/*
+ * Pre-encoded header. The header's vptr is replaced with this structure,
+ * which is shared by all (shallow) clones of the header, so that the
+ * clones can be printed by copying the text as long as they still have
+ * the values that the text was encoded from.
+ */
+typedef struct encoded_hdr_vptr
+{
+    pjsip_hdr_vptr	     vptr;	/* Must be the first member.	    */
+    const pjsip_hdr_vptr    *orig;	/* The original vptr of the header. */
+    pj_bool_t		     compact;	/* Compact form setting when encoded*/
+    pj_str_t		     name;	/* Header name when encoded.	    */
+    pj_str_t		     sname;	/* Compact name when encoded.	    */
+    unsigned		     ivalue;	/* Value of integer header.	    */
+    unsigned		     count;	/* Number of values of array header.*/
+    pj_str_t		    *values;	/* Values of array header.	    */
+    pj_str_t		     text;	/* The encoded header.		    */
+    pj_size_t		     text_size;	/* Size of the text buffer.	    */
+} encoded_hdr_vptr;
+
+static int encoded_hdr_print(void *hdr, char *buf, pj_size_t size);
+
+/* Check if the header still has the values the text was encoded from. */
+static pj_bool_t encoded_hdr_match(const encoded_hdr_vptr *enc,
+				   const pjsip_hdr *hdr)
+{
+    if (enc->compact != pjsip_cfg()->endpt.use_compact_form ||
+	hdr->name.ptr != enc->name.ptr || hdr->name.slen != enc->name.slen ||
+	hdr->sname.ptr != enc->sname.ptr || hdr->sname.slen != enc->sname.slen)
+    {
+	return PJ_FALSE;
+    }
+
+    if (hdr->type == PJSIP_H_MAX_FORWARDS) {
+	return ((const pjsip_max_fwd_hdr*)hdr)->ivalue == enc->ivalue;
+    } else {
+	const pjsip_generic_array_hdr *ahdr =
+	    (const pjsip_generic_array_hdr*)hdr;
+
+	return ahdr->count == enc->count &&
+	       pj_memcmp(ahdr->values, enc->values,
+			 enc->count * sizeof(pj_str_t)) == 0;
+    }
+}
+
+static int encoded_hdr_print(void *hdr, char *buf, pj_size_t size)
+{
+    const encoded_hdr_vptr *enc = (const encoded_hdr_vptr*)
+				  ((pjsip_hdr*)hdr)->vptr;
+
+    if (!encoded_hdr_match(enc, (const pjsip_hdr*)hdr))
+	return (*enc->orig->print_on)(hdr, buf, size);
+
+    if ((pj_size_t)enc->text.slen >= size)
+	return -1;
+
+    pj_memcpy(buf, enc->text.ptr, enc->text.slen);
+    return (int)enc->text.slen;
+}
+
+/*
+ * Print the header with its original print function, and make the header
+ * and its future clones print the result. A header that has been encoded
+ * before is re-encoded into its vptr. Clones made earlier then no longer
+ * match the values and print themselves.
+ */
+static void encode_hdr(pjsip_endpoint *endpt, pjsip_hdr *hdr)
+{
+    encoded_hdr_vptr *enc;
+    pj_size_t size;
+    int len;
+
+    if (hdr->vptr->print_on == &encoded_hdr_print) {
+	enc = (encoded_hdr_vptr*) hdr->vptr;
+    } else {
+	enc = PJ_POOL_ZALLOC_T(endpt->pool, encoded_hdr_vptr);
+	enc->orig = hdr->vptr;
+	pj_memcpy(&enc->vptr, enc->orig, sizeof(pjsip_hdr_vptr));
+	enc->vptr.print_on = &encoded_hdr_print;
+    }
+
+    /* No header matches the text while it's being updated */
+    enc->name.ptr = NULL;
+    hdr->vptr = &enc->vptr;
+
+    enc->compact = pjsip_cfg()->endpt.use_compact_form;
+    size = PJ_MAX(hdr->name.slen, hdr->sname.slen) + 16;
+
+    if (hdr->type == PJSIP_H_MAX_FORWARDS) {
+	enc->ivalue = ((pjsip_max_fwd_hdr*)hdr)->ivalue;
+    } else {
+	pjsip_generic_array_hdr *ahdr = (pjsip_generic_array_hdr*)hdr;
+	unsigned i;
+
+	/* Room for the values of the header is allocated once */
+	if (!enc->values) {
+	    enc->values = (pj_str_t*)
+			  pj_pool_alloc(endpt->pool,
+					PJ_ARRAY_SIZE(ahdr->values) *
+					sizeof(pj_str_t));
+	}
+	pj_memcpy(enc->values, ahdr->values, ahdr->count * sizeof(pj_str_t));
+	enc->count = ahdr->count;
+	for (i=0; i<ahdr->count; ++i)
+	    size += ahdr->values[i].slen + 2;
+    }
+
+    /* Grow the text buffer by doubling, as capabilities are usually
+     * added one by one.
+     */
+    if (size > enc->text_size) {
+	enc->text_size = PJ_MAX(size, enc->text_size * 2);
+	enc->text.ptr = (char*) pj_pool_alloc(endpt->pool, enc->text_size);
+    }
+
+    len = (*enc->orig->print_on)(hdr, enc->text.ptr, enc->text_size);
+    if (len < 0)
+	return;
+    enc->text.slen = len;
+
+    enc->sname = hdr->sname;
+    enc->name = hdr->name;
+}
+#endif	/* PJSIP_ENDPT_PREENCODE_HDRS */
+
 
 /*
  * Get the value of the specified capability header field.
@@ -406,6 +617,11 @@ PJ_DEF(pj_status_t) pjsip_endpt_add_capability( pjsip_endpoint *endpt,
 	++hdr->count;
     }
 
+#if PJSIP_ENDPT_PREENCODE_HDRS
+    /* Re-encode the header. */
+    encode_hdr(endpt, (pjsip_hdr*)hdr);
+#endif
+
     /* Done. */
     return PJ_SUCCESS;
 }
@@ -533,10 +749,21 @@ PJ_DEF(pj_status_t) pjsip_endpt_create(pj_pool_factory *pf,
     mf_hdr = pjsip_max_fwd_hdr_create(endpt->pool,
 				      PJSIP_MAX_FORWARDS_VALUE);
     pj_list_insert_before( &endpt->req_hdr, mf_hdr);
+#if PJSIP_ENDPT_PREENCODE_HDRS
+    encode_hdr(endpt, (pjsip_hdr*)mf_hdr);
+#endif
 
     /* Initialize capability header list. */
     pj_list_init(&endpt->cap_hdr);
 
+#if PJSIP_RX_WORKER_CNT
+    /* Start receive worker threads. */
+    status = rx_workers_create(endpt);
+    if (status != PJ_SUCCESS) {
+	goto on_error;
+    }
+#endif
+
     /* Done. */
     *p_endpt = endpt;
     return status;
@@ -579,6 +806,13 @@ PJ_DEF(void) pjsip_endpt_destroy(pjsip_endpoint *endpt)
 
     PJ_LOG(5, (THIS_FILE, "Destroying endpoint instance.."));
 
+#if PJSIP_RX_WORKER_CNT
+    /* Stop receive worker threads before the modules go away. Messages
+     * still received from now on are processed by the polling thread.
+     */
+    rx_workers_stop(endpt);
+#endif
+
     /* Phase 1: stop all modules */
     mod = endpt->module_list.prev;
     while (mod != &endpt->module_list) {
@@ -606,6 +840,11 @@ PJ_DEF(void) pjsip_endpt_destroy(pjsip_endpoint *endpt)
     /* Destroy ioqueue */
     pj_ioqueue_destroy(endpt->ioqueue);
 
+#if PJSIP_RX_WORKER_CNT
+    /* No polling thread can be dispatching to the workers anymore. */
+    rx_workers_destroy(endpt);
+#endif
+
     /* Destroy timer heap */
 #if PJ_TIMER_DEBUG
     pj_timer_heap_dump(endpt->timer_heap);
@@ -869,6 +1108,8 @@ PJ_DEF(pj_status_t) pjsip_endpt_process_rx_data( pjsip_endpoint *endpt,
     pjsip_msg *msg;
     pjsip_process_rdata_param def_prm;
     pjsip_module *mod;
+    pjsip_module **chain;
+    pjsip_method_e method;
     pj_bool_t handled = PJ_FALSE;
     unsigned i;
     pj_status_t status;
@@ -920,23 +1161,27 @@ PJ_DEF(pj_status_t) pjsip_endpt_process_rx_data( pjsip_endpoint *endpt,
 	goto on_return;
     }
 
+    /* Get the modules that handle this type of message and method,
+     * starting with the start module.
+     */
+    if (msg->type == PJSIP_REQUEST_MSG)
+	method = msg->line.req.method.id;
+    else if (rdata->msg_info.cseq)
+	method = rdata->msg_info.cseq->method.id;
+    else
+	method = PJSIP_OTHER_METHOD;
+
+    chain = endpt->rx_chain[msg->type==PJSIP_REQUEST_MSG ? 0 : 1][method];
+    while (*chain && endpt->mod_pos[(*chain)->id] < endpt->mod_pos[mod->id])
+	++chain;
+
     /* Distribute */
     if (msg->type == PJSIP_REQUEST_MSG) {
-	do {
-	    if (mod->on_rx_request)
-		handled = (*mod->on_rx_request)(rdata);
-	    if (handled)
-		break;
-	    mod = mod->next;
-	} while (mod != &endpt->module_list);
+	for (; *chain && !handled; ++chain)
+	    handled = (*(*chain)->on_rx_request)(rdata);
     } else {
-	do {
-	    if (mod->on_rx_response)
-		handled = (*mod->on_rx_response)(rdata);
-	    if (handled)
-		break;
-	    mod = mod->next;
-	} while (mod != &endpt->module_list);
+	for (; *chain && !handled; ++chain)
+	    handled = (*(*chain)->on_rx_response)(rdata);
     }
 
     status = PJ_SUCCESS;
@@ -952,6 +1197,292 @@ on_return:
     return status;
 }
 
+/*
+ * Process a message that has passed the checks in endpt_on_rx_msg().
+ */
+static void endpt_process_rx(pjsip_endpoint *endpt, pjsip_rx_data *rdata)
+{
+    pjsip_process_rdata_param proc_prm;
+    pj_bool_t handled = PJ_FALSE;
+
+    pjsip_process_rdata_param_default(&proc_prm);
+    proc_prm.silent = PJ_TRUE;
+
+    pjsip_endpt_process_rx_data(endpt, rdata, &proc_prm, &handled);
+
+    /* No module is able to handle the message */
+    if (!handled) {
+	PJ_LOG(4,(THIS_FILE, "%s from %s:%d was dropped/unhandled by"
+			     " any modules",
+			     pjsip_rx_data_get_info(rdata),
+			     rdata->pkt_info.src_name,
+			     rdata->pkt_info.src_port));
+    }
+
+    /* Must clear mod_data before returning rdata to transport, since
+     * rdata may be reused.
+     */
+    pj_bzero(&rdata->endpt_info, sizeof(rdata->endpt_info));
+}
+
+#if PJSIP_RX_WORKER_CNT
+/* Receive worker thread. */
+static int rx_worker_thread(void *arg)
+{
+    rx_worker *w = (rx_worker*) arg;
+
+    for (;;) {
+	pjsip_rx_data *rdata;
+
+	pj_sem_wait(w->sem_msg);
+	if (w->endpt->rx_worker_quit)
+	    break;
+
+	pj_mutex_lock(w->mutex);
+	rdata = w->queue[w->head];
+	w->head = (w->head + 1) % PJSIP_RX_WORKER_QUEUE_SIZE;
+	--w->stat.queued;
+	pj_mutex_unlock(w->mutex);
+
+	pj_sem_post(w->sem_room);
+
+	endpt_process_rx(w->endpt, rdata);
+	pjsip_rx_data_free_cloned(rdata);
+    }
+
+    return 0;
+}
+
+/* Queue a clone of the message to the worker of its Call-ID. */
+static void rx_worker_dispatch(pjsip_endpoint *endpt, pjsip_rx_data *rdata)
+{
+    const pjsip_cid_hdr *cid = rdata->msg_info.cid;
+    pj_uint32_t hval = 0;
+    pjsip_rx_data *clone;
+    rx_worker *w;
+    unsigned i;
+    pj_status_t status;
+
+    /* A worker dispatching to its own full queue would wait forever, so
+     * process the message right away when called from a worker.
+     */
+    for (i=0; i<PJSIP_RX_WORKER_CNT; ++i) {
+	if (endpt->rx_worker[i].thread == pj_thread_this()) {
+	    endpt_process_rx(endpt, rdata);
+	    return;
+	}
+    }
+
+    if (cid)
+	hval = pj_hash_calc(0, cid->id.ptr, (unsigned)cid->id.slen);
+    w = &endpt->rx_worker[hval % PJSIP_RX_WORKER_CNT];
+
+    /* The workers have been stopped by pjsip_endpt_destroy() */
+    if (endpt->rx_worker_quit) {
+	endpt_process_rx(endpt, rdata);
+	return;
+    }
+
+    status = pjsip_rx_data_clone(rdata, 0, &clone);
+    if (status != PJ_SUCCESS) {
+	pj_mutex_lock(w->mutex);
+	++w->stat.dropped;
+	pj_mutex_unlock(w->mutex);
+	PJ_PERROR(2,(THIS_FILE, status, "Dropping %s from %s:%d",
+		     pjsip_rx_data_get_info(rdata),
+		     rdata->pkt_info.src_name,
+		     rdata->pkt_info.src_port));
+	return;
+    }
+
+    if (pj_sem_trywait(w->sem_room) != PJ_SUCCESS) {
+#if PJSIP_RX_WORKER_DROP_WHEN_FULL
+	pj_mutex_lock(w->mutex);
+	++w->stat.dropped;
+	pj_mutex_unlock(w->mutex);
+	PJ_LOG(2,(THIS_FILE, "Dropping %s from %s:%d, rx worker queue is "
+		  "full", pjsip_rx_data_get_info(rdata),
+		  rdata->pkt_info.src_name, rdata->pkt_info.src_port));
+	pjsip_rx_data_free_cloned(clone);
+	return;
+#else
+	/* Wait for room in the queue. This blocks the polling thread, so
+	 * the transports are read only as fast as the workers can process.
+	 * The quit flag is checked under the mutex, so that
+	 * rx_workers_stop() either sees this thread waiting and wakes it
+	 * up, or this thread sees the flag.
+	 */
+	pj_mutex_lock(w->mutex);
+	if (endpt->rx_worker_quit) {
+	    pj_mutex_unlock(w->mutex);
+	    pjsip_rx_data_free_cloned(clone);
+	    endpt_process_rx(endpt, rdata);
+	    return;
+	}
+	++w->stat.full_waits;
+	++w->waiting;
+	pj_mutex_unlock(w->mutex);
+
+	pj_sem_wait(w->sem_room);
+
+	pj_mutex_lock(w->mutex);
+	--w->waiting;
+	pj_mutex_unlock(w->mutex);
+#endif
+    }
+
+    pj_mutex_lock(w->mutex);
+    if (endpt->rx_worker_quit) {
+	/* The worker has stopped while this thread was getting room */
+	pj_mutex_unlock(w->mutex);
+	pjsip_rx_data_free_cloned(clone);
+	endpt_process_rx(endpt, rdata);
+	return;
+    }
+    w->queue[(w->head + w->stat.queued) % PJSIP_RX_WORKER_QUEUE_SIZE] = clone;
+    ++w->stat.queued;
+    if (w->stat.queued > w->stat.max_queued)
+	w->stat.max_queued = w->stat.queued;
+    ++w->stat.dispatched;
+    pj_mutex_unlock(w->mutex);
+
+    pj_sem_post(w->sem_msg);
+}
+
+/* Stop the receive worker threads and drop the messages left in their
+ * queues. The polling threads may still dispatch messages, which are then
+ * processed right away, so the semaphores and mutexes are kept until
+ * rx_workers_destroy().
+ */
+static void rx_workers_stop(pjsip_endpoint *endpt)
+{
+    unsigned i, n;
+
+    endpt->rx_worker_quit = PJ_TRUE;
+
+    for (i=0; i<PJSIP_RX_WORKER_CNT; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+
+	if (!w->mutex)
+	    continue;
+
+	/* Wake up the polling threads waiting for room in the queue */
+	pj_mutex_lock(w->mutex);
+	for (n=w->waiting; n; --n)
+	    pj_sem_post(w->sem_room);
+	pj_mutex_unlock(w->mutex);
+
+	if (w->thread) {
+	    pj_sem_post(w->sem_msg);
+	    pj_thread_join(w->thread);
+	    pj_thread_destroy(w->thread);
+	    w->thread = NULL;
+	}
+
+	pj_mutex_lock(w->mutex);
+	while (w->stat.queued) {
+	    pjsip_rx_data_free_cloned(w->queue[w->head]);
+	    w->head = (w->head + 1) % PJSIP_RX_WORKER_QUEUE_SIZE;
+	    --w->stat.queued;
+	}
+	pj_mutex_unlock(w->mutex);
+    }
+}
+
+/* Destroy the resources of the stopped receive worker threads, once no
+ * polling thread can be dispatching to them.
+ */
+static void rx_workers_destroy(pjsip_endpoint *endpt)
+{
+    unsigned i;
+
+    for (i=0; i<PJSIP_RX_WORKER_CNT; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+
+	if (w->sem_room) {
+	    pj_sem_destroy(w->sem_room);
+	    w->sem_room = NULL;
+	}
+	if (w->sem_msg) {
+	    pj_sem_destroy(w->sem_msg);
+	    w->sem_msg = NULL;
+	}
+	if (w->mutex) {
+	    pj_mutex_destroy(w->mutex);
+	    w->mutex = NULL;
+	}
+    }
+}
+
+/* Create the receive worker threads. */
+static pj_status_t rx_workers_create(pjsip_endpoint *endpt)
+{
+    unsigned i;
+    pj_status_t status;
+
+    for (i=0; i<PJSIP_RX_WORKER_CNT; ++i) {
+	rx_worker *w = &endpt->rx_worker[i];
+	char name[PJ_MAX_OBJ_NAME];
+
+	w->endpt = endpt;
+	pj_ansi_snprintf(name, sizeof(name), "rxwrk%d", i);
+
+	status = pj_mutex_create_simple(endpt->pool, name, &w->mutex);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+
+	status = pj_sem_create(endpt->pool, name, 0,
+			       PJSIP_RX_WORKER_QUEUE_SIZE, &w->sem_msg);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+
+	status = pj_sem_create(endpt->pool, name, PJSIP_RX_WORKER_QUEUE_SIZE,
+			       PJSIP_RX_WORKER_QUEUE_SIZE, &w->sem_room);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+
+	status = pj_thread_create(endpt->pool, name, &rx_worker_thread, w,
+				  0, 0, &w->thread, 18);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+    }
+
+    return PJ_SUCCESS;
+
+on_error:
+    rx_workers_stop(endpt);
+    rx_workers_destroy(endpt);
+    return status;
+}
+#endif	/* PJSIP_RX_WORKER_CNT */
+
+/*
+ * Get the statistics of a receive worker thread.
+ */
+PJ_DEF(pj_status_t) pjsip_endpt_get_rx_worker_stat(pjsip_endpoint *endpt,
+						   unsigned index,
+						   pjsip_rx_worker_stat *stat)
+{
+#if PJSIP_RX_WORKER_CNT
+    rx_worker *w;
+
+    PJ_ASSERT_RETURN(endpt && index < PJSIP_RX_WORKER_CNT && stat,
+		     PJ_EINVAL);
+
+    w = &endpt->rx_worker[index];
+    pj_mutex_lock(w->mutex);
+    pj_memcpy(stat, &w->stat, sizeof(*stat));
+    pj_mutex_unlock(w->mutex);
+
+    return PJ_SUCCESS;
+#else
+    PJ_UNUSED_ARG(endpt);
+    PJ_UNUSED_ARG(index);
+    PJ_UNUSED_ARG(stat);
+    return PJ_ENOTSUP;
+#endif
+}
+
 /*
  * This is the callback that is called by the transport manager when it 
  * receives a message from the network.
@@ -961,8 +1492,6 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
 			     pjsip_rx_data *rdata )
 {
     pjsip_msg *msg = rdata->msg_info.msg;
-    pjsip_process_rdata_param proc_prm;
-    pj_bool_t handled = PJ_FALSE;
 
     PJ_UNUSED_ARG(msg);
 
@@ -1071,24 +1600,11 @@ static void endpt_on_rx_msg( pjsip_endpoint *endpt,
     }
 #endif
 
-    pjsip_process_rdata_param_default(&proc_prm);
-    proc_prm.silent = PJ_TRUE;
-
-    pjsip_endpt_process_rx_data(endpt, rdata, &proc_prm, &handled);
-
-    /* No module is able to handle the message */
-    if (!handled) {
-	PJ_LOG(4,(THIS_FILE, "%s from %s:%d was dropped/unhandled by"
-			     " any modules",
-			     pjsip_rx_data_get_info(rdata),
-			     rdata->pkt_info.src_name,
-			     rdata->pkt_info.src_port));
-    }
-
-    /* Must clear mod_data before returning rdata to transport, since
-     * rdata may be reused.
-     */
-    pj_bzero(&rdata->endpt_info, sizeof(rdata->endpt_info));
+#if PJSIP_RX_WORKER_CNT
+    rx_worker_dispatch(endpt, rdata);
+#else
+    endpt_process_rx(endpt, rdata);
+#endif
 
     pj_log_pop_indent();
 }
@@ -1325,6 +1841,24 @@ PJ_DEF(void) pjsip_endpt_dump( pjsip_endpoint *endpt, pj_bool_t detail )
      */
     pjsip_tpmgr_dump_transports( endpt->transport_mgr );
 
+#if PJSIP_RX_WORKER_CNT
+    /* Receive worker threads. */
+    {
+	unsigned i;
+
+	for (i=0; i<PJSIP_RX_WORKER_CNT; ++i) {
+	    pjsip_rx_worker_stat stat;
+
+	    pjsip_endpt_get_rx_worker_stat(endpt, i, &stat);
+	    PJ_LOG(3,(THIS_FILE, " Rx worker %d: queued=%u (max %u/%u), "
+		      "dispatched=%u, full waits=%u, dropped=%u",
+		      i, stat.queued, stat.max_queued,
+		      PJSIP_RX_WORKER_QUEUE_SIZE, stat.dispatched,
+		      stat.full_waits, stat.dropped));
+	}
+    }
+#endif
+
     /* Timer. */
 #if PJ_TIMER_DEBUG
     pj_timer_heap_dump(endpt->timer_heap);
@@ -354,6 +354,35 @@ PJ_DEF(pjsip_msg*) pjsip_msg_clone( pj_pool_t *pool, const pjsip_msg *src)
     return dst;
 }
 
+#if PJSIP_PARSER_LAZY_HDRS
+/* Check if the header has not been parsed yet, see PJSIP_PARSER_LAZY_HDRS.
+ * Lazy header has PJSIP_H_OTHER type, so check that first.
+ */
+#define IS_LAZY_HDR(hdr)    ((hdr)->type==PJSIP_H_OTHER && \
+			     pjsip_hdr_is_lazy(hdr))
+
+/* Check if lazy header has the name, either the name in the message or
+ * the name of the header once it is parsed.
+ */
+static pj_bool_t lazy_hdr_has_name(const pjsip_hdr *hdr,
+				   const pj_str_t *name)
+{
+    const pjsip_lazy_hdr *lhdr = (const pjsip_lazy_hdr*)hdr;
+    pj_str_t hname;
+
+    if (pj_stricmp(&lhdr->name, name) == 0)
+	return PJ_TRUE;
+
+    hname.ptr = pjsip_hdr_names[lhdr->htype].name;
+    hname.slen = pjsip_hdr_names[lhdr->htype].name_len;
+    return pj_stricmp(&hname, name) == 0;
+}
+
+/* Parse lazy header, the message is modified even when it's const. */
+#define PARSE_LAZY_HDR(hdr) \
+	    ((const pjsip_hdr*)pjsip_lazy_hdr_parse((pjsip_lazy_hdr*)(hdr)))
+#endif	/* PJSIP_PARSER_LAZY_HDRS */
+
 PJ_DEF(void*)  pjsip_msg_find_hdr( const pjsip_msg *msg, 
 				   pjsip_hdr_e hdr_type, const void *start)
 {
@@ -362,9 +391,20 @@ PJ_DEF(void*)  pjsip_msg_find_hdr( const pjsip_msg *msg,
     if (hdr == NULL) {
 	hdr = msg->hdr.next;
     }
-    for (; hdr!=end; hdr = hdr->next) {
+    while (hdr != end) {
+#if PJSIP_PARSER_LAZY_HDRS
+	if (IS_LAZY_HDR(hdr)) {
+	    /* Parse the header and check the result */
+	    if (((const pjsip_lazy_hdr*)hdr)->htype == hdr_type)
+		hdr = PARSE_LAZY_HDR(hdr);
+	    else
+		hdr = hdr->next;
+	    continue;
+	}
+#endif
 	if (hdr->type == hdr_type)
 	    return (void*)hdr;
+	hdr = hdr->next;
     }
     return NULL;
 }
@@ -378,9 +418,24 @@ PJ_DEF(void*)  pjsip_msg_find_hdr_by_name( const pjsip_msg *msg,
     if (hdr == NULL) {
 	hdr = msg->hdr.next;
     }
-    for (; hdr!=end; hdr = hdr->next) {
+    while (hdr != end) {
+#if PJSIP_PARSER_LAZY_HDRS
+	if (IS_LAZY_HDR(hdr)) {
+	    const pjsip_hdr *next = hdr->next;
+
+	    /* The parsed header may have the other name of the header */
+	    if (lazy_hdr_has_name(hdr, name) &&
+		(hdr = PARSE_LAZY_HDR(hdr)) != next)
+	    {
+		return (void*)hdr;
+	    }
+	    hdr = next;
+	    continue;
+	}
+#endif
 	if (pj_stricmp(&hdr->name, name) == 0)
 	    return (void*)hdr;
+	hdr = hdr->next;
     }
     return NULL;
 }
@@ -395,11 +450,26 @@ PJ_DEF(void*)  pjsip_msg_find_hdr_by_names( const pjsip_msg *msg,
     if (hdr == NULL) {
 	hdr = msg->hdr.next;
     }
-    for (; hdr!=end; hdr = hdr->next) {
+    while (hdr != end) {
+#if PJSIP_PARSER_LAZY_HDRS
+	if (IS_LAZY_HDR(hdr)) {
+	    const pjsip_hdr *next = hdr->next;
+
+	    if ((lazy_hdr_has_name(hdr, name) ||
+		 lazy_hdr_has_name(hdr, sname)) &&
+		(hdr = PARSE_LAZY_HDR(hdr)) != next)
+	    {
+		return (void*)hdr;
+	    }
+	    hdr = next;
+	    continue;
+	}
+#endif
 	if (pj_stricmp(&hdr->name, name) == 0)
 	    return (void*)hdr;
 	if (pj_stricmp(&hdr->name, sname) == 0)
 	    return (void*)hdr;
+	hdr = hdr->next;
     }
     return NULL;
 }
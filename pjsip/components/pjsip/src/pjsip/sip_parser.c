@@ -24,6 +24,7 @@
 #include <pjsip/sip_auth_parser.h>
 #include <pjsip/sip_errno.h>
 #include <pjsip/sip_transport.h>        /* rdata structure */
+#include <pjsip/print_util.h>
 #include <pjlib-util/scanner.h>
 #include <pjlib-util/util_string.h>
 #include <pj/except.h>
@@ -72,6 +73,8 @@ typedef struct handler_rec
     pj_size_t		  hname_len;
     pj_uint32_t		  hname_hash;
     pjsip_parse_hdr_func *handler;
+    pj_bool_t		  builtin;
+    pjsip_hdr_e		  lazy_type;	/* PJSIP_H_OTHER if not lazy.	*/
 } handler_rec;
 
 // static handler_rec handler[PJSIP_MAX_HEADER_TYPES];
@@ -79,6 +82,81 @@ static handler_rec *handler;
 static unsigned handler_count;
 static int parser_is_initialized;
 
+/*
+ * Perfect hash table for the header names known at build time, including
+ * the ones registered by other pjsip modules. Other names are registered
+ * in the handler array above.
+ *
+ * The hash is calculated from the length, first, middle and last character
+ * of the name, case insensitively, see PHASH_CALC(). The tables below are
+ * generated offline, and when a name is added, the hash must be adjusted
+ * so that all names still fall into different slots. init_parser() checks
+ * this in debug build.
+ */
+#define PHASH_SIZE	128
+#define PHASH_LC(c)	((pj_uint8_t)(c) | 0x20)
+#define PHASH_CALC(p,len)   (((unsigned)(len) + PHASH_LC((p)[0]) + \
+			      PHASH_LC((p)[(len)-1]) + \
+			      3 * PHASH_LC((p)[(len)/2])) & (PHASH_SIZE-1))
+
+static const char *const phash_names[] =
+{
+    "Accept",			/* 1  */
+    "Allow",			/* 2  */
+    "Authorization",		/* 3  */
+    "Call-ID",			/* 4  */
+    "i",			/* 5  */
+    "Contact",			/* 6  */
+    "m",			/* 7  */
+    "Content-Length",		/* 8  */
+    "l",			/* 9  */
+    "Content-Type",		/* 10 */
+    "c",			/* 11 */
+    "CSeq",			/* 12 */
+    "Event",			/* 13 */
+    "o",			/* 14 */
+    "Expires",			/* 15 */
+    "From",			/* 16 */
+    "f",			/* 17 */
+    "Max-Forwards",		/* 18 */
+    "Min-Expires",		/* 19 */
+    "Min-SE",			/* 20 */
+    "Proxy-Authenticate",	/* 21 */
+    "Proxy-Authorization",	/* 22 */
+    "Record-Route",		/* 23 */
+    "Replaces",			/* 24 */
+    "Require",			/* 25 */
+    "Retry-After",		/* 26 */
+    "Route",			/* 27 */
+    "Session-Expires",		/* 28 */
+    "x",			/* 29 */
+    "Subscription-State",	/* 30 */
+    "Supported",		/* 31 */
+    "k",			/* 32 */
+    "To",			/* 33 */
+    "t",			/* 34 */
+    "Unsupported",		/* 35 */
+    "Via",			/* 36 */
+    "v",			/* 37 */
+    "WWW-Authenticate"		/* 38 */
+};
+
+/* Hash slot to the name number above, zero for empty slot. */
+static const pj_uint8_t phash_slot[PHASH_SIZE] =
+{
+     0,  0,  0,  0,  0,  0,  0, 12,  0,  0,  1,  0,  0, 13,  5,  0,
+    24,  0,  4,  0,  0, 36,  0,  3, 32,  0, 15, 38,  0,  9,  0, 21,
+     0,  2,  7,  0, 16, 30,  0,  0,  0, 22,  0,  0, 14, 31,  0,  0,
+    10,  0, 33,  0, 35,  0,  0,  0,  0,  0,  6, 27,  0, 25,  0,  0,
+     0,  0, 18,  0,  0, 34,  0,  0,  0,  0,  0,  0,  0,  0,  0, 37,
+     0,  0,  0, 19,  0,  0,  0,  0,  0, 29,  0,  0,  0,  0,  0, 20,
+     8,  0,  0,  0,  0,  0,  0,  0,  0,  0, 23,  0,  0,  0,  0,  0,
+    11,  0,  0,  0,  0,  0, 26,  0,  0,  0,  0,  0, 28,  0,  0, 17
+};
+
+/* Handlers of the names above, the handler is NULL until registered. */
+static handler_rec phash_handler[PJ_ARRAY_SIZE(phash_names)];
+
 /*
  * URI parser records.
  */
@@ -115,8 +193,13 @@ static pj_cis_buf_t *cis_buf;
 /*
  * Forward decl.
  */
+#if PJSIP_PARSER_FAST_PATH
+static pjsip_msg *  int_parse_msg_fast( pjsip_parse_ctx *ctx,
+					pjsip_parser_err_report *err_list);
+#else
 static pjsip_msg *  int_parse_msg( pjsip_parse_ctx *ctx,
 				   pjsip_parser_err_report *err_list);
+#endif
 static void	    int_parse_param( pj_scanner *scanner,
 				     pj_pool_t *pool,
 				     pj_str_t *pname,
@@ -178,6 +261,9 @@ static pjsip_hdr*   parse_hdr_to( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_unsupported( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_via( pjsip_parse_ctx *ctx );
 static pjsip_hdr*   parse_hdr_generic_string( pjsip_parse_ctx *ctx);
+static pjsip_hdr*   parse_hdr_lazy( pjsip_parse_ctx *ctx,
+				    pjsip_hdr_e htype,
+				    const pj_str_t *hname);
 
 /* Convert non NULL terminated string to integer. */
 static unsigned long pj_strtoul_mindigit(const pj_str_t *str,
@@ -223,11 +309,79 @@ static void on_syntax_error(pj_scanner *scanner)
     PJ_THROW(-1);
 }
 
+#if PJSIP_PARSER_FAST_PATH
+/* Scanner used by the fast path, which records syntax errors instead
+ * of throwing them.
+ */
+typedef struct fast_scanner
+{
+    pj_scanner	    scanner;
+    pj_bool_t	    has_error;	/* An error was found in current line.	*/
+    int		    err_code;	/* Same as the exception id.		*/
+    pj_scan_state   err_state;	/* Where the error was found.		*/
+} fast_scanner;
+
+static void on_fast_syntax_error(pj_scanner *scanner);
+
+#define IS_FAST_MODE(scanner)	((scanner)->callback == &on_fast_syntax_error)
+
+/* Record the first error of the line. Moving the scanner to EOF makes
+ * the rest of the header parser fail quickly, and the error position is
+ * restored by int_parse_msg_fast() afterwards.
+ */
+static void fast_scan_error(pj_scanner *scanner, int err_code)
+{
+    fast_scanner *fscanner = (fast_scanner*)scanner;
+
+    if (!fscanner->has_error) {
+	fscanner->has_error = PJ_TRUE;
+	fscanner->err_code = err_code;
+	pj_scan_save_state(scanner, &fscanner->err_state);
+    }
+    scanner->curptr = scanner->end;
+}
+
+/* Syntax error handler for the fast path. */
+static void on_fast_syntax_error(pj_scanner *scanner)
+{
+    fast_scan_error(scanner, -1);
+}
+
+#endif	/* PJSIP_PARSER_FAST_PATH */
+
+/* Report syntax error found by the parser itself. This throws, unless
+ * the fast path is parsing, in which case the caller continues with
+ * the scanner at EOF.
+ */
+PJ_INLINE(void) syntax_error(pj_scanner *scanner)
+{
+    (*scanner->callback)(scanner);
+}
+
+/* Check if the fast path has found an error in current header. Parsing
+ * then continues with the scanner at EOF, but must not leave results
+ * that the exception would have skipped.
+ */
+PJ_INLINE(pj_bool_t) parse_failed(const pj_scanner *scanner)
+{
+#if PJSIP_PARSER_FAST_PATH
+    return IS_FAST_MODE(scanner) && ((const fast_scanner*)scanner)->has_error;
+#else
+    PJ_UNUSED_ARG(scanner);
+    return PJ_FALSE;
+#endif
+}
+
 /* Syntax error handler for parser. */
-static void on_str_parse_error(const pj_str_t *str, int rc)
+static void on_str_parse_error(pj_scanner *scanner, const pj_str_t *str,
+			       int rc)
 {
     char *s;
 
+    /* Only the first error of a header is reported */
+    if (parse_failed(scanner))
+	return;
+
     switch(rc) {
     case PJ_EINVAL:
         s = "NULL input string, invalid input string, or NULL return "\
@@ -249,17 +403,25 @@ static void on_str_parse_error(const pj_str_t *str, int rc)
     } else {
         PJ_LOG(1, (THIS_FILE, "Can't parse input string: %s", s));
     }
+
+#if PJSIP_PARSER_FAST_PATH
+    if (IS_FAST_MODE(scanner)) {
+	fast_scan_error(scanner, -2);
+	return;
+    }
+#endif
     PJ_THROW(-2);
 }
 
-static void strtoi_validate(const pj_str_t *str, int min_val,
-			    int max_val, int *value)
+static void strtoi_validate(pj_scanner *scanner, const pj_str_t *str,
+			    int min_val, int max_val, int *value)
 {
     long retval;
     pj_status_t status;
 
     if (!str || !value) {
-        on_str_parse_error(str, PJ_EINVAL);
+        on_str_parse_error(scanner, str, PJ_EINVAL);
+	return;
     }
     status = pj_strtol2(str, &retval);
     if (status != PJ_EINVAL) {
@@ -274,7 +436,73 @@ static void strtoi_validate(const pj_str_t *str, int min_val,
     }
 
     if (status != PJ_SUCCESS)
-	on_str_parse_error(str, status);
+	on_str_parse_error(scanner, str, status);
+}
+
+#if PJSIP_PARSER_LAZY_HDRS
+/* Headers that are not needed by rdata's msg_info, hence are parsed on
+ * demand.
+ */
+static const pjsip_hdr_e lazy_hdr_types[] =
+{
+    PJSIP_H_ACCEPT,
+    PJSIP_H_ALLOW,
+    PJSIP_H_AUTHORIZATION,
+    PJSIP_H_CONTACT,
+    PJSIP_H_EXPIRES,
+    PJSIP_H_MIN_EXPIRES,
+    PJSIP_H_PROXY_AUTHENTICATE,
+    PJSIP_H_PROXY_AUTHORIZATION,
+    PJSIP_H_RETRY_AFTER,
+    PJSIP_H_UNSUPPORTED,
+    PJSIP_H_WWW_AUTHENTICATE
+};
+
+/* Set the header type if the handler is to be called on demand. */
+static void init_lazy_hdr_type(handler_rec *rec)
+{
+    unsigned i;
+
+    for (i=0; i<PJ_ARRAY_SIZE(lazy_hdr_types); ++i) {
+	const pjsip_hdr_name_info_t *info;
+
+	info = &pjsip_hdr_names[lazy_hdr_types[i]];
+	if (pj_ansi_stricmp(rec->hname, info->name)==0 ||
+	    (info->sname && pj_ansi_stricmp(rec->hname, info->sname)==0))
+	{
+	    rec->lazy_type = lazy_hdr_types[i];
+	    break;
+	}
+    }
+}
+
+/* Set the header type of the handlers that are called on demand. */
+static void init_lazy_hdr_types(void)
+{
+    unsigned i;
+
+    for (i=0; i<handler_count; ++i)
+	init_lazy_hdr_type(&handler[i]);
+    for (i=0; i<PJ_ARRAY_SIZE(phash_handler); ++i) {
+	if (phash_handler[i].handler)
+	    init_lazy_hdr_type(&phash_handler[i]);
+    }
+}
+#endif	/* PJSIP_PARSER_LAZY_HDRS */
+
+/* Check if the header should be kept unparsed. Only headers in received
+ * message are parsed on demand.
+ */
+PJ_INLINE(pj_bool_t) is_lazy_hdr(const pjsip_parse_ctx *ctx,
+				 const handler_rec *rec)
+{
+#if PJSIP_PARSER_LAZY_HDRS
+    return ctx->rdata != NULL && rec->lazy_type != PJSIP_H_OTHER;
+#else
+    PJ_UNUSED_ARG(ctx);
+    PJ_UNUSED_ARG(rec);
+    return PJ_FALSE;
+#endif
 }
 
 /* Get parser constants. */
@@ -322,6 +550,7 @@ static pj_status_t init_parser()
 {
     /* Character Input Specification buffer. */
     pj_status_t status;
+    unsigned i;
 
     /*
      * Init character input spec (cis)
@@ -335,6 +564,14 @@ static pj_status_t init_parser()
         handler = pj_calloc(1, PJSIP_MAX_HEADER_TYPES * sizeof(handler_rec));
     }
 
+#if defined(PJ_DEBUG) && PJ_DEBUG != 0
+    /* Check the perfect hash tables. */
+    for (i=0; i<PJ_ARRAY_SIZE(phash_names); ++i) {
+	pj_size_t len = pj_ansi_strlen(phash_names[i]);
+	pj_assert(phash_slot[PHASH_CALC(phash_names[i], len)] == i+1);
+    }
+#endif
+
     status = pj_cis_init(cis_buf, &pconst.pjsip_DIGIT_SPEC);
     PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
     pj_cis_add_num(&pconst.pjsip_DIGIT_SPEC);
@@ -514,12 +751,26 @@ static pj_status_t init_parser()
     status = pjsip_register_hdr_parser( "Via", "v", &parse_hdr_via);
     PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
 
+    /* Mark the parsers above as built-in. These report syntax errors
+     * through syntax_error(), hence can run on the fast path.
+     */
+    for (i=0; i<handler_count; ++i)
+	handler[i].builtin = PJ_TRUE;
+    for (i=0; i<PJ_ARRAY_SIZE(phash_handler); ++i) {
+	if (phash_handler[i].handler)
+	    phash_handler[i].builtin = PJ_TRUE;
+    }
+
     /*
      * Register auth parser.
      */
 
     status = pjsip_auth_init_parser();
 
+#if PJSIP_PARSER_LAZY_HDRS
+    if (status == PJ_SUCCESS)
+	init_lazy_hdr_types();
+#endif
 
     return status;
 }
@@ -540,6 +791,7 @@ void deinit_sip_parser(void)
         /* Clear header handlers */
         pj_bzero(handler, sizeof(handler));
         handler_count = 0;
+        pj_bzero(phash_handler, sizeof(phash_handler));
 
         /* Clear URI handlers */
         pj_bzero(uri_handler, sizeof(uri_handler));
@@ -592,6 +844,8 @@ static pj_status_t int_register_parser( const char *name,
 
     /* Initialize temporary handler. */
     rec.handler = fptr;
+    rec.builtin = PJ_FALSE;
+    rec.lazy_type = PJSIP_H_OTHER;
     rec.hname_len = strlen(name);
     if (rec.hname_len >= sizeof(rec.hname)) {
 	pj_assert(!"Header name is too long!");
@@ -630,6 +884,50 @@ static pj_status_t int_register_parser( const char *name,
     return PJ_SUCCESS;
 }
 
+/* Find the perfect hash table entry for the header name. */
+PJ_INLINE(handler_rec*) phash_find(const char *name, pj_size_t len)
+{
+    unsigned idx;
+
+    if (len == 0)
+	return NULL;
+
+    idx = phash_slot[PHASH_CALC(name, len)];
+    if (idx == 0 || pj_ansi_strnicmp(phash_names[idx-1], name, len) != 0 ||
+	phash_names[idx-1][len] != '\0')
+    {
+	return NULL;
+    }
+
+    return &phash_handler[idx-1];
+}
+
+/* Register handler in the perfect hash table. Returns PJ_ENOTFOUND if the
+ * name is not in the table.
+ */
+static pj_status_t phash_register_parser( const char *name, pj_size_t len,
+					  pjsip_parse_hdr_func *fptr )
+{
+    handler_rec *rec = phash_find(name, len);
+
+    if (rec == NULL)
+	return PJ_ENOTFOUND;
+
+    if (rec->handler) {
+	pj_assert(0);
+	return PJ_EEXISTS;
+    }
+
+    pj_bzero(rec, sizeof(*rec));
+    pj_memcpy(rec->hname, name, len);
+    rec->hname_len = len;
+    rec->handler = fptr;
+    rec->builtin = PJ_FALSE;
+    rec->lazy_type = PJSIP_H_OTHER;
+
+    return PJ_SUCCESS;
+}
+
 /* Register parser handler. If both header name and short name are valid,
  * then two instances of handler will be registered.
  */
@@ -649,20 +947,26 @@ PJ_DEF(pj_status_t) pjsip_register_hdr_parser( const char *hname,
 	return PJ_ENAMETOOLONG;
     }
 
-    /* Register the normal Mixed-Case name */
-    status = int_register_parser(hname, fptr);
-    if (status != PJ_SUCCESS) {
-	return status;
-    }
+    /* Well known name is registered in the perfect hash table, which
+     * is case insensitive.
+     */
+    status = phash_register_parser(hname, len, fptr);
+    if (status == PJ_ENOTFOUND) {
+	/* Register the normal Mixed-Case name */
+	status = int_register_parser(hname, fptr);
+	if (status != PJ_SUCCESS) {
+	    return status;
+	}
 
-    /* Get the lower-case name */
-    for (i=0; i<len; ++i) {
-	hname_lcase[i] = (char)pj_tolower(hname[i]);
-    }
-    hname_lcase[len] = '\0';
+	/* Get the lower-case name */
+	for (i=0; i<len; ++i) {
+	    hname_lcase[i] = (char)pj_tolower(hname[i]);
+	}
+	hname_lcase[len] = '\0';
 
-    /* Register the lower-case version of the name */
-    status = int_register_parser(hname_lcase, fptr);
+	/* Register the lower-case version of the name */
+	status = int_register_parser(hname_lcase, fptr);
+    }
     if (status != PJ_SUCCESS) {
 	return status;
     }
@@ -670,7 +974,10 @@ PJ_DEF(pj_status_t) pjsip_register_hdr_parser( const char *hname,
 
     /* Register the shortname version of the name */
     if (hshortname) {
-        status = int_register_parser(hshortname, fptr);
+	status = phash_register_parser(hshortname,
+				       pj_ansi_strlen(hshortname), fptr);
+	if (status == PJ_ENOTFOUND)
+	    status = int_register_parser(hshortname, fptr);
         if (status != PJ_SUCCESS)
 	    return status;
     }
@@ -679,8 +986,8 @@ PJ_DEF(pj_status_t) pjsip_register_hdr_parser( const char *hname,
 
 
 /* Find handler to parse the header name. */
-static pjsip_parse_hdr_func * find_handler_imp(pj_uint32_t  hash,
-					       const pj_str_t *hname)
+static const handler_rec* find_handler_imp(pj_uint32_t  hash,
+					   const pj_str_t *hname)
 {
     handler_rec *first;
     int		 comp;
@@ -706,28 +1013,35 @@ static pjsip_parse_hdr_func * find_handler_imp(pj_uint32_t  hash,
 	}
     }
 
-    return comp==0 ? first->handler : NULL;
+    return comp==0 ? first : NULL;
 }
 
 
 /* Find handler to parse the header name. */
-static pjsip_parse_hdr_func* find_handler(const pj_str_t *hname)
+static const handler_rec* find_handler(const pj_str_t *hname)
 {
     pj_uint32_t hash;
     char hname_copy[PJSIP_MAX_HNAME_LEN];
     pj_str_t tmp;
-    pjsip_parse_hdr_func *func;
+    const handler_rec *rec;
+
+    /* Most headers are found in the perfect hash table. It matches the
+     * same names as the exact and lowercase lookups below, only faster.
+     */
+    rec = phash_find(hname->ptr, hname->slen);
+    if (rec)
+	return rec->handler ? rec : NULL;
 
     if (hname->slen >= PJSIP_MAX_HNAME_LEN) {
 	/* Guaranteed not to be able to find handler. */
         return NULL;
     }
 
-    /* First, common case, try to find handler with exact name */
+    /* Next, try to find handler with exact name */
     hash = pj_hash_calc(0, hname->ptr, (unsigned)hname->slen);
-    func = find_handler_imp(hash, hname);
-    if (func)
-	return func;
+    rec = find_handler_imp(hash, hname);
+    if (rec)
+	return rec;
 
 
     /* If not found, try converting the header name to lowercase and
@@ -764,6 +1078,47 @@ PJ_DEF(pj_status_t) pjsip_register_uri_parser( char *scheme,
     return PJ_SUCCESS;
 }
 
+#if PJSIP_PARSER_FAST_PATH
+/* Call a URI parser registered by other module on the fast path. Such
+ * parser may throw, so call it under an exception handler and turn the
+ * exception into the fast path error.
+ */
+static void* fast_call_uri_parser(pjsip_parse_uri_func *func,
+				  pj_scanner *scanner, pj_pool_t *pool,
+				  pj_bool_t parse_params)
+{
+    void *volatile uri = NULL;
+    PJ_USE_EXCEPTION;
+
+    scanner->callback = &on_syntax_error;
+    PJ_TRY {
+	uri = (*func)(scanner, pool, parse_params);
+    }
+    PJ_CATCH_ANY {
+	fast_scan_error(scanner, PJ_GET_EXCEPTION());
+	uri = NULL;
+    }
+    PJ_END;
+    scanner->callback = &on_fast_syntax_error;
+
+    return uri;
+}
+#endif
+
+/* Call URI parser. */
+static void* call_uri_parser(pjsip_parse_uri_func *func, pj_scanner *scanner,
+			     pj_pool_t *pool, pj_bool_t parse_params)
+{
+#if PJSIP_PARSER_FAST_PATH
+    if (IS_FAST_MODE(scanner) && func != &int_parse_sip_url &&
+	func != &int_parse_other_uri)
+    {
+	return fast_call_uri_parser(func, scanner, pool, parse_params);
+    }
+#endif
+    return (*func)(scanner, pool, parse_params);
+}
+
 /* Public function to parse SIP message. */
 PJ_DEF(pjsip_msg*) pjsip_parse_msg( pj_pool_t *pool,
                                     char *buf, pj_size_t size,
@@ -780,7 +1135,11 @@ PJ_DEF(pjsip_msg*) pjsip_parse_msg( pj_pool_t *pool,
     context.pool = pool;
     context.rdata = NULL;
 
+#if PJSIP_PARSER_FAST_PATH
+    msg = int_parse_msg_fast(&context, err_list);
+#else
     msg = int_parse_msg(&context, err_list);
+#endif
 
     pj_scan_fini(&scanner);
     return msg;
@@ -800,130 +1159,172 @@ PJ_DEF(pjsip_msg *) pjsip_parse_rdata( char *buf, pj_size_t size,
     context.pool = rdata->tp_info.pool;
     context.rdata = rdata;
 
+#if PJSIP_PARSER_FAST_PATH
+    rdata->msg_info.msg = int_parse_msg_fast(&context,
+					     &rdata->msg_info.parse_err);
+#else
     rdata->msg_info.msg = int_parse_msg(&context, &rdata->msg_info.parse_err);
+#endif
 
     pj_scan_fini(&scanner);
     return rdata->msg_info.msg;
 }
 
-/* Determine if a message has been received. */
-PJ_DEF(pj_status_t) pjsip_find_msg( const char *buf, pj_size_t size,
-				  pj_bool_t is_datagram, pj_size_t *msg_size)
-{
 #if PJ_HAS_TCP
-    const char *volatile hdr_end;
-    const char *volatile body_start;
-    const char *pos;
-    const char *volatile line;
-    int content_length = -1;
-    pj_str_t cur_msg;
-    pj_status_t status = PJSIP_EMISSINGHDR;
-    pj_str_t end_hdr = { "\n\r\n", 3};
+/* Parse the header in [line, end) if it is a Content-Length header. */
+static void find_msg_clen(const char *line, const char *end,
+			  int *content_length, pj_status_t *status)
+{
+    if ( ((*line=='C' || *line=='c') &&
+          strnicmp_alnum(line, "Content-Length", 14) == 0) ||
+	 ((*line=='l' || *line=='L') &&
+          (*(line+1)==' ' || *(line+1)=='\t' || *(line+1)==':')))
+    {
+	/* Try to parse the header. */
+	pj_scanner scanner;
+	PJ_USE_EXCEPTION;
 
+	/* The buffer passed to the scanner is not NULL terminated,
+         * but should be safe. See ticket #2063.
+	 */
+	pj_scan_init(&scanner, (char*)line, end-line,
+		     PJ_SCAN_AUTOSKIP_WS_HEADER, &on_syntax_error);
 
-    *msg_size = size;
+	PJ_TRY {
+	    pj_str_t str_clen;
 
-    /* For datagram, the whole datagram IS the message. */
-    if (is_datagram) {
+	    /* Get "Content-Length" or "L" name */
+	    if (*line=='C' || *line=='c')
+		pj_scan_advance_n(&scanner, 14, PJ_TRUE);
+	    else if (*line=='l' || *line=='L')
+		pj_scan_advance_n(&scanner, 1, PJ_TRUE);
 
-	    return PJ_SUCCESS;
-    }
+	    /* Get colon */
+	    if (pj_scan_get_char(&scanner) != ':') {
 
+		PJ_THROW(-1);
+	    }
 
-    /* Find the end of header area by finding an empty line.
-     * Don't use plain strstr() since we want to be able to handle
-     * NULL character in the message
-     */
-    cur_msg.ptr = (char*)buf; cur_msg.slen = size;
-    pos = pj_strstr(&cur_msg, &end_hdr);
-    if (pos == NULL) {
+	    /* Get number */
+	    pj_scan_get(&scanner, &pconst.pjsip_DIGIT_SPEC, &str_clen);
 
-	    return PJSIP_EPARTIALMSG;
-    }
+	    /* Get newline. */
+	    pj_scan_get_newline(&scanner);
 
-    hdr_end = pos+1;
-    body_start = pos+3;
+	    /* Found a valid Content-Length header. */
+	    strtoi_validate(&scanner, &str_clen, PJSIP_MIN_CONTENT_LENGTH,
+			    PJSIP_MAX_CONTENT_LENGTH, content_length);
+	}
+	PJ_CATCH_ANY {
+	    int eid = PJ_GET_EXCEPTION();
+	    if (eid == -1) {
+		*status = PJSIP_EMISSINGHDR;
+	    } else if (eid == -2) {
+		*status = PJSIP_EINVALIDHDR;
+	    }
+	    *content_length = -1;
+	}
+	PJ_END
 
-    /* Find "Content-Length" header the hard way. */
-    line = pj_strchr(&cur_msg, '\n');
-    while (line && line < hdr_end) {
-	++line;
-	if ( ((*line=='C' || *line=='c') &&
-              strnicmp_alnum(line, "Content-Length", 14) == 0) ||
-	     ((*line=='l' || *line=='L') &&
-              (*(line+1)==' ' || *(line+1)=='\t' || *(line+1)==':')))
-	{
-	    /* Try to parse the header. */
-	    pj_scanner scanner;
-	    PJ_USE_EXCEPTION;
+	pj_scan_fini(&scanner);
+    }
+}
+#endif	/* PJ_HAS_TCP */
 
-	    /* The buffer passed to the scanner is not NULL terminated,
-             * but should be safe. See ticket #2063.
-	     */
-	    pj_scan_init(&scanner, (char*)line, hdr_end-line,
-			 PJ_SCAN_AUTOSKIP_WS_HEADER, &on_syntax_error);
+/* Determine if a message has been received. */
+PJ_DEF(pj_status_t) pjsip_find_msg( const char *buf, pj_size_t size,
+				  pj_bool_t is_datagram, pj_size_t *msg_size)
+{
+    pjsip_find_msg_state state;
 
-	    PJ_TRY {
-		pj_str_t str_clen;
+    pj_bzero(&state, sizeof(state));
+    return pjsip_find_msg2(buf, size, is_datagram, &state, msg_size);
+}
 
-		/* Get "Content-Length" or "L" name */
-		if (*line=='C' || *line=='c')
-		    pj_scan_advance_n(&scanner, 14, PJ_TRUE);
-		else if (*line=='l' || *line=='L')
-		    pj_scan_advance_n(&scanner, 1, PJ_TRUE);
+/* Determine if a message has been received, resuming from previous scan. */
+PJ_DEF(pj_status_t) pjsip_find_msg2( const char *buf, pj_size_t size,
+				     pj_bool_t is_datagram,
+				     pjsip_find_msg_state *state,
+				     pj_size_t *msg_size)
+{
+#if PJ_HAS_TCP
+    *msg_size = size;
 
-		/* Get colon */
-		if (pj_scan_get_char(&scanner) != ':') {
+    /* For datagram, the whole datagram IS the message. */
+    if (is_datagram) {
 
-		    PJ_THROW(-1);
-		}
+	    return PJ_SUCCESS;
+    }
 
-		/* Get number */
-		pj_scan_get(&scanner, &pconst.pjsip_DIGIT_SPEC, &str_clen);
+    /* The state must describe a prefix of this buffer, otherwise start
+     * all over again.
+     */
+    if (state->scan > size || state->body > size)
+	pj_bzero(state, sizeof(*state));
 
-		/* Get newline. */
-		pj_scan_get_newline(&scanner);
+    /* Find the end of header area by finding an empty line, checking each
+     * complete header for "Content-Length" along the way. Don't use plain
+     * strchr() since we want to be able to handle NULL character in the
+     * message.
+     */
+    while (state->body == 0) {
+	const char *nl;
+	pj_size_t next;
+
+	nl = (const char*)pj_memchr(buf + state->scan, '\n',
+				    size - state->scan);
+	if (nl == NULL) {
+	    state->scan = size;
+	    return PJSIP_EPARTIALMSG;
+	}
 
-		/* Found a valid Content-Length header. */
-		strtoi_validate(&str_clen, PJSIP_MIN_CONTENT_LENGTH,
-				PJSIP_MAX_CONTENT_LENGTH, &content_length);
-	    }
-	    PJ_CATCH_ANY {
-		int eid = PJ_GET_EXCEPTION();
-		if (eid == -1) {
-		    status = PJSIP_EMISSINGHDR;
-		} else if (eid == -2) {
-		    status = PJSIP_EINVALIDHDR;
-		}
-		content_length = -1;
-	    }
-	    PJ_END
+	/* Whether the header ends here depends on the next line. */
+	next = nl - buf + 1;
+	if (next == size || (buf[next] == '\r' && next+1 == size)) {
+	    state->scan = next - 1;
+	    return PJSIP_EPARTIALMSG;
+	}
 
-	    pj_scan_fini(&scanner);
+	/* Continuation line. */
+	if (buf[next] == ' ' || buf[next] == '\t') {
+	    state->scan = next;
+	    continue;
 	}
 
-	/* Found valid Content-Length? */
-	if (content_length != -1)
-	    break;
+	/* Header in [line, next) is complete. Skip the start line. */
+	if (state->line != 0 && state->content_length == 0) {
+	    int content_length = -1;
+	    pj_status_t status = state->status ? state->status :
+						 PJSIP_EMISSINGHDR;
+
+	    find_msg_clen(buf + state->line, buf + next, &content_length,
+			  &status);
+	    state->status = status;
+	    if (content_length != -1)
+		state->content_length = content_length + 1;
+	}
 
-	/* Go to next line. */
-	cur_msg.slen -= (line - cur_msg.ptr);
-	cur_msg.ptr = (char*)line;
-	line = pj_strchr(&cur_msg, '\n');
+	if (buf[next] == '\r' && buf[next+1] == '\n') {
+	    /* Empty line, body starts after it. */
+	    state->body = next + 2;
+	} else {
+	    state->line = state->scan = next;
+	}
     }
 
     /* Found Content-Length? */
-    if (content_length == -1) {
+    if (state->content_length == 0) {
 
-	    return status;
+	    return state->status ? state->status : PJSIP_EMISSINGHDR;
     }
 
     /* Enough packet received? */
-    *msg_size = (body_start - buf) + content_length;
+    *msg_size = state->body + state->content_length - 1;
     return (*msg_size) <= size ? PJ_SUCCESS : PJSIP_EPARTIALMSG;
 #else
     PJ_UNUSED_ARG(buf);
     PJ_UNUSED_ARG(is_datagram);
+    PJ_UNUSED_ARG(state);
     *msg_size = size;
     return PJ_SUCCESS;
 #endif
@@ -969,10 +1370,10 @@ static void parse_sip_version(pj_scanner *scanner)
 
     pj_scan_get( scanner, &pconst.pjsip_ALPHA_SPEC, &sip);
     if (pj_scan_get_char(scanner) != '/')
-	on_syntax_error(scanner);
+	syntax_error(scanner);
     pj_scan_get_n( scanner, 3, &version);
     if (pj_stricmp(&sip, &SIP) || pj_stricmp(&version, &V2))
-	on_syntax_error(scanner);
+	syntax_error(scanner);
 }
 
 static pj_bool_t is_next_sip_version(pj_scanner *scanner)
@@ -992,6 +1393,225 @@ static pj_bool_t is_next_sip_version(pj_scanner *scanner)
     return c && (c=='/' || c==' ' || c=='\t') && pj_stricmp(&sip, &SIP)==0;
 }
 
+/* Add parsing error at the current scanner position to the list. */
+static void report_parse_error( pj_pool_t *pool,
+				pjsip_parser_err_report *err_list,
+				int except_code, const pj_scanner *scanner,
+				const pj_str_t *hname)
+{
+    pjsip_parser_err_report *err_info;
+
+    if (!err_list)
+	return;
+
+    err_info = PJ_POOL_ALLOC_T(pool, pjsip_parser_err_report);
+    err_info->except_code = except_code;
+    err_info->line = scanner->line;
+    /* Scanner's column is zero based, so add 1 */
+    err_info->col = pj_scan_get_col(scanner) + 1;
+    if (hname)
+	err_info->hname = *hname;
+    else
+	err_info->hname.slen = 0;
+
+    pj_list_insert_before(err_list, err_info);
+}
+
+/* Parse the rest of the message as body of the specified type. */
+static pjsip_msg_body *int_parse_msg_body( pjsip_parse_ctx *ctx,
+					   const pjsip_ctype_hdr *ctype_hdr)
+{
+    /* New: if Content-Type indicates that this is a multipart
+     * message body, parse it.
+     */
+    const pj_str_t STR_MULTIPART = { "multipart", 9 };
+    pj_scanner *scanner = ctx->scanner;
+    pj_pool_t *pool = ctx->pool;
+    pjsip_msg_body *body;
+
+    if (pj_stricmp(&ctype_hdr->media.type, &STR_MULTIPART)==0) {
+	body = pjsip_multipart_parse(pool, scanner->curptr,
+				     scanner->end - scanner->curptr,
+				     &ctype_hdr->media, 0);
+    } else {
+	body = PJ_POOL_ALLOC_T(pool, pjsip_msg_body);
+	pjsip_media_type_cp(pool, &body->content_type,
+			    &ctype_hdr->media);
+
+	body->data = scanner->curptr;
+	body->len = (unsigned)(scanner->end - scanner->curptr);
+	body->print_body = &pjsip_print_text_body;
+	body->clone_data = &pjsip_clone_text_data;
+    }
+
+    return body;
+}
+
+#if PJSIP_PARSER_FAST_PATH
+/* Call a header parser registered by other module on the fast path,
+ * see fast_call_uri_parser().
+ */
+static pjsip_hdr* fast_call_hdr_parser(pjsip_parse_hdr_func *func,
+				       pjsip_parse_ctx *ctx)
+{
+    pj_scanner *scanner = ctx->scanner;
+    pjsip_hdr *volatile hdr = NULL;
+    PJ_USE_EXCEPTION;
+
+    scanner->callback = &on_syntax_error;
+    PJ_TRY {
+	hdr = (*func)(ctx);
+    }
+    PJ_CATCH_ANY {
+	fast_scan_error(scanner, PJ_GET_EXCEPTION());
+	hdr = NULL;
+    }
+    PJ_END;
+    scanner->callback = &on_fast_syntax_error;
+
+    return hdr;
+}
+
+/* Parse SIP message without exception handler. Errors are handled the
+ * same way as int_parse_msg() does, i.e. the error is reported, and the
+ * rest of the line is skipped if the error is in a header.
+ */
+static pjsip_msg *int_parse_msg_fast( pjsip_parse_ctx *ctx,
+				      pjsip_parser_err_report *err_list)
+{
+    fast_scanner fscanner;
+    pjsip_parse_ctx fctx;
+    pj_scanner *scanner = &fscanner.scanner;
+    pj_pool_t *pool = ctx->pool;
+    pjsip_ctype_hdr *ctype_hdr = NULL;
+    pjsip_msg *msg;
+
+    /* Work on a copy of the scanner using the non-throwing callback */
+    fscanner.scanner = *ctx->scanner;
+    fscanner.scanner.callback = &on_fast_syntax_error;
+    fscanner.has_error = PJ_FALSE;
+
+    fctx = *ctx;
+    fctx.scanner = scanner;
+
+    /* Skip leading newlines. */
+    while (IS_NEWLINE(*scanner->curptr)) {
+	pj_scan_get_newline(scanner);
+    }
+
+    /* Check if we still have valid packet.
+     * Sometimes endpoints just send blank (CRLF) packets just to keep
+     * NAT bindings open.
+     */
+    if (pj_scan_is_eof(scanner))
+	return NULL;
+
+    /* Parse request or status line */
+    if (is_next_sip_version(scanner)) {
+	msg = pjsip_msg_create(pool, PJSIP_RESPONSE_MSG);
+	int_parse_status_line( scanner, &msg->line.status );
+    } else {
+	msg = pjsip_msg_create(pool, PJSIP_REQUEST_MSG);
+	int_parse_req_line(scanner, pool, &msg->line.req );
+    }
+
+    if (fscanner.has_error) {
+	pj_str_t hname;
+
+	hname = pj_str(msg->type == PJSIP_REQUEST_MSG ? "Request Line" :
+						         "Status Line");
+	pj_scan_restore_state(scanner, &fscanner.err_state);
+	report_parse_error(pool, err_list, fscanner.err_code, scanner,
+			   &hname);
+	return NULL;
+    }
+
+    /* Parse headers. */
+    do {
+	const handler_rec *rec;
+	pjsip_hdr *hdr = NULL;
+	pj_str_t hname;
+
+	/* Init hname just in case parsing fails. */
+	hname.slen = 0;
+
+	/* Get hname. */
+	pj_scan_get( scanner, &pconst.pjsip_TOKEN_SPEC, &hname);
+	if (pj_scan_get_char( scanner ) != ':') {
+	    syntax_error(scanner);
+	} else if ((rec = find_handler(&hname)) != NULL &&
+		   is_lazy_hdr(&fctx, rec))
+	{
+	    hdr = parse_hdr_lazy(&fctx, rec->lazy_type, &hname);
+	} else if (rec) {
+	    if (rec->builtin)
+		hdr = (*rec->handler)(&fctx);
+	    else
+		hdr = fast_call_hdr_parser(rec->handler, &fctx);
+
+	    if (!fscanner.has_error && hdr &&
+		hdr->type == PJSIP_H_CONTENT_TYPE)
+	    {
+		ctype_hdr = (pjsip_ctype_hdr*)hdr;
+	    }
+	} else {
+	    hdr = parse_hdr_generic_string(&fctx);
+	    hdr->name = hdr->sname = hname;
+	}
+
+	if (fscanner.has_error) {
+	    /* Drop the header and skip until next line, watching for
+	     * header continuation.
+	     */
+	    pj_scan_restore_state(scanner, &fscanner.err_state);
+	    report_parse_error(pool, err_list, fscanner.err_code, scanner,
+			       &hname);
+	    fscanner.has_error = PJ_FALSE;
+
+	    if (!pj_scan_is_eof(scanner)) {
+		do {
+		    pj_scan_skip_line(scanner);
+		} while (IS_SPACE(*scanner->curptr));
+	    }
+
+	    /* Restore flag. Flag may be set in int_parse_sip_url() */
+	    scanner->skip_ws = PJ_SCAN_AUTOSKIP_WS_HEADER;
+
+	    /* Same as int_parse_msg(), the message is rejected if the
+	     * error is in the last header.
+	     */
+	    if (pj_scan_is_eof(scanner) || IS_NEWLINE(*scanner->curptr))
+		return NULL;
+
+	    continue;
+	}
+
+	/* Single parse of header line can produce multiple headers. */
+	if (hdr)
+	    pj_list_insert_nodes_before(&msg->hdr, hdr);
+
+	/* Parse until EOF or an empty line is found. */
+    } while (!pj_scan_is_eof(scanner) && !IS_NEWLINE(*scanner->curptr));
+
+    /* If empty line is found, eat it. */
+    if (!pj_scan_is_eof(scanner)) {
+	if (IS_NEWLINE(*scanner->curptr)) {
+	    pj_scan_get_newline(scanner);
+	}
+    }
+
+    /* If we have Content-Type header, treat the rest of the message
+     * as body.
+     */
+    if (ctype_hdr && scanner->curptr!=scanner->end) {
+	msg->body = int_parse_msg_body(&fctx, ctype_hdr);
+    }
+
+    return msg;
+}
+#endif	/* PJSIP_PARSER_FAST_PATH */
+
+#if !PJSIP_PARSER_FAST_PATH
 /* Internal function to parse SIP message */
 static pjsip_msg *int_parse_msg( pjsip_parse_ctx *ctx,
 				 pjsip_parser_err_report *err_list)
@@ -1045,7 +1665,7 @@ retry_parse:
 parse_headers:
 	/* Parse headers. */
 	do {
-	    pjsip_parse_hdr_func * func;
+	    const handler_rec *rec;
 	    pjsip_hdr *hdr = NULL;
 
 	    /* Init hname just in case parsing fails.
@@ -1061,14 +1681,16 @@ parse_headers:
 	    }
 
 	    /* Find handler. */
-	    func = find_handler(&hname);
+	    rec = find_handler(&hname);
 
 	    /* Call the handler if found.
 	     * If no handler is found, then treat the header as generic
 	     * hname/hvalue pair.
 	     */
-	    if (func) {
-		hdr = (*func)(ctx);
+	    if (rec && is_lazy_hdr(ctx, rec)) {
+		hdr = parse_hdr_lazy(ctx, rec->lazy_type, &hname);
+	    } else if (rec) {
+		hdr = (*rec->handler)(ctx);
 
 		/* Note:
 		 *  hdr MAY BE NULL, if parsing does not yield a new header
@@ -1114,28 +1736,7 @@ parse_headers:
 	 * as body.
 	 */
 	if (ctype_hdr && scanner->curptr!=scanner->end) {
-	    /* New: if Content-Type indicates that this is a multipart
-	     * message body, parse it.
-	     */
-	    const pj_str_t STR_MULTIPART = { "multipart", 9 };
-	    pjsip_msg_body *body;
-
-	    if (pj_stricmp(&ctype_hdr->media.type, &STR_MULTIPART)==0) {
-		body = pjsip_multipart_parse(pool, scanner->curptr,
-					     scanner->end - scanner->curptr,
-					     &ctype_hdr->media, 0);
-	    } else {
-		body = PJ_POOL_ALLOC_T(pool, pjsip_msg_body);
-		pjsip_media_type_cp(pool, &body->content_type,
-		                    &ctype_hdr->media);
-
-		body->data = scanner->curptr;
-		body->len = (unsigned)(scanner->end - scanner->curptr);
-		body->print_body = &pjsip_print_text_body;
-		body->clone_data = &pjsip_clone_text_data;
-	    }
-
-	    msg->body = body;
+	    msg->body = int_parse_msg_body(ctx, ctype_hdr);
 	}
     }
     PJ_CATCH_ANY
@@ -1144,23 +1745,19 @@ parse_headers:
 	 * Skip until newline, and parse next header.
 	 */
 	if (err_list) {
-	    pjsip_parser_err_report *err_info;
+	    pj_str_t err_hname;
 
-	    err_info = PJ_POOL_ALLOC_T(pool, pjsip_parser_err_report);
-	    err_info->except_code = PJ_GET_EXCEPTION();
-	    err_info->line = scanner->line;
-	    /* Scanner's column is zero based, so add 1 */
-	    err_info->col = pj_scan_get_col(scanner) + 1;
 	    if (parsing_headers)
-		err_info->hname = hname;
+		err_hname = hname;
 	    else if (msg && msg->type == PJSIP_REQUEST_MSG)
-		err_info->hname = pj_str("Request Line");
+		err_hname = pj_str("Request Line");
 	    else if (msg && msg->type == PJSIP_RESPONSE_MSG)
-		err_info->hname = pj_str("Status Line");
+		err_hname = pj_str("Status Line");
 	    else
-		err_info->hname.slen = 0;
+		err_hname.slen = 0;
 
-	    pj_list_insert_before(err_list, err_info);
+	    report_parse_error(pool, err_list, PJ_GET_EXCEPTION(), scanner,
+			       &err_hname);
 	}
 
 	if (parsing_headers) {
@@ -1188,6 +1785,7 @@ parse_headers:
 
     return msg;
 }
+#endif	/* !PJSIP_PARSER_FAST_PATH */
 
 
 /* Parse parameter (pname ["=" pvalue]). */
@@ -1333,7 +1931,8 @@ static void int_parse_uri_host_port( pj_scanner *scanner,
 	pj_str_t port;
 	pj_scan_get_char(scanner);
 	pj_scan_get(scanner, &pconst.pjsip_DIGIT_SPEC, &port);
-	strtoi_validate(&port, PJSIP_MIN_PORT, PJSIP_MAX_PORT, p_port);
+	strtoi_validate(scanner, &port, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
+			p_port);
     } else {
 	*p_port = 0;
     }
@@ -1399,13 +1998,13 @@ static pjsip_uri *int_parse_uri_or_name_addr( pj_scanner *scanner, pj_pool_t *po
 
 	    if (func == NULL) {
 		/* Unsupported URI scheme */
-
-		PJ_THROW(-1);
+		syntax_error(scanner);
+		return NULL;
 	    }
 
 	    uri = (pjsip_uri*)
-	    	  (*func)(scanner, pool,
-			  (opt & PJSIP_PARSE_URI_IN_FROM_TO_HDR)==0);
+	    	  call_uri_parser(func, scanner, pool,
+				  (opt & PJSIP_PARSE_URI_IN_FROM_TO_HDR)==0);
 
 
 	} else {
@@ -1445,17 +2044,19 @@ static pjsip_uri *int_parse_uri(pj_scanner *scanner, pj_pool_t *pool,
 	colon = pj_scan_peek(scanner, &pconst.pjsip_TOKEN_SPEC, &scheme);
 
 	if (colon != ':') {
-	    PJ_THROW(-1);
+	    syntax_error(scanner);
+	    return NULL;
 	}
 
 	func = find_uri_handler(&scheme);
 	if (func)  {
-	    return (pjsip_uri*)(*func)(scanner, pool, parse_params);
+	    return (pjsip_uri*)call_uri_parser(func, scanner, pool,
+					       parse_params);
 
 	} else {
 	    /* Unsupported URI scheme */
-	    PJ_THROW(-1);
-	    UNREACHED({ return NULL; /* Not reached. */ })
+	    syntax_error(scanner);
+	    return NULL;
 	}
 
     /*
@@ -1479,8 +2080,9 @@ static void* int_parse_sip_url( pj_scanner *scanner,
     pj_scan_get(scanner, &pconst.pjsip_TOKEN_SPEC, &scheme);
     colon = pj_scan_get_char(scanner);
     if (colon != ':') {
-
-	PJ_THROW(-1);
+	syntax_error(scanner);
+	scanner->skip_ws = skip_ws;
+	return NULL;
     }
 
     if (parser_stricmp(scheme, pconst.pjsip_SIP_STR)==0) {
@@ -1490,13 +2092,9 @@ static void* int_parse_sip_url( pj_scanner *scanner,
 	url = pjsip_sip_uri_create(pool, 1);
 
     } else {
-
-	    PJ_THROW(-1);
-	/* should not reach here */
-	UNREACHED({
-	    pj_assert(0);
-	    return 0;
-	})
+	syntax_error(scanner);
+	scanner->skip_ws = skip_ws;
+	return NULL;
     }
 
     if (int_is_next_user(scanner)) {
@@ -1523,7 +2121,7 @@ static void* int_parse_sip_url( pj_scanner *scanner,
 	    url->transport_param = pvalue;
 
 	} else if (!parser_stricmp(pname, pconst.pjsip_TTL_STR) && pvalue.slen) {
-	    strtoi_validate(&pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
+	    strtoi_validate(scanner, &pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
 			    &url->ttl_param);
 	} else if (!parser_stricmp(pname, pconst.pjsip_MADDR_STR) && pvalue.slen) {
 	    url->maddr_param = pvalue;
@@ -1600,12 +2198,13 @@ static pjsip_name_addr *int_parse_name_addr( pj_scanner *scanner,
 	 * Allowing (invalid) name-addr to pass URI verification will
 	 * cause us to send invalid URI to the wire.
 	 */
-	PJ_THROW( -1);
+	syntax_error(scanner);
+	return name_addr;
     }
     name_addr->uri = int_parse_uri( scanner, pool, PJ_TRUE );
     if (has_bracket) {
 	if (pj_scan_get_char(scanner) != '>')
-	    PJ_THROW( -1);
+	    syntax_error(scanner);
     }
 
     return name_addr;
@@ -1629,7 +2228,7 @@ static void* int_parse_other_uri(pj_scanner *scanner,
 
     pj_scan_get(scanner, &pc->pjsip_TOKEN_SPEC, &uri->scheme);
     if (pj_scan_get_char(scanner) != ':') {
-	    PJ_THROW(-1);
+	syntax_error(scanner);
     }
 
     pj_scan_get(scanner, &pc->pjsip_OTHER_URI_CONTENT, &uri->content);
@@ -1660,10 +2259,10 @@ static void int_parse_status_line( pj_scanner *scanner,
 
     parse_sip_version(scanner);
     pj_scan_get( scanner, &pconst.pjsip_DIGIT_SPEC, &token);
-    strtoi_validate(&token, PJSIP_MIN_STATUS_CODE, PJSIP_MAX_STATUS_CODE,
-                    &status_line->code);
+    strtoi_validate(scanner, &token, PJSIP_MIN_STATUS_CODE,
+		    PJSIP_MAX_STATUS_CODE, &status_line->code);
     if (*scanner->curptr != '\r' && *scanner->curptr != '\n')
-	pj_scan_get( scanner, &pconst.pjsip_NOT_NEWLINE, &status_line->reason);
+	pj_scan_get_until_newline( scanner, &status_line->reason);
     else
 	status_line->reason.slen=0, status_line->reason.ptr=NULL;
     pj_scan_get_newline( scanner );
@@ -1733,12 +2332,14 @@ static void parse_generic_array_hdr( pjsip_generic_array_hdr *hdr,
 
     if (hdr->count >= PJ_ARRAY_SIZE(hdr->values)) {
 	/* Too many elements */
-	on_syntax_error(scanner);
+	syntax_error(scanner);
 	return;
     }
 
     pj_scan_get( scanner, &pconst.pjsip_NOT_COMMA_OR_NEWLINE,
 		 &hdr->values[hdr->count]);
+    if (parse_failed(scanner))
+	return;
     hdr->count++;
 
     while ((hdr->count < PJSIP_GENERIC_ARRAY_MAX_COUNT) &&
@@ -1747,6 +2348,8 @@ static void parse_generic_array_hdr( pjsip_generic_array_hdr *hdr,
 	pj_scan_get_char(scanner);
 	pj_scan_get( scanner, &pconst.pjsip_NOT_COMMA_OR_NEWLINE,
 		     &hdr->values[hdr->count]);
+	if (parse_failed(scanner))
+	    return;
 	hdr->count++;
     }
 
@@ -1774,11 +2377,11 @@ static void parse_generic_string_hdr( pjsip_generic_string_hdr *hdr,
     while (pj_cis_match(&pconst.pjsip_NOT_NEWLINE, *scanner->curptr)) {
 	pj_str_t next, tmp;
 
-	pj_scan_get( scanner, &pconst.pjsip_NOT_NEWLINE, &hdr->hvalue);
+	pj_scan_get_until_newline( scanner, &hdr->hvalue);
 	if (pj_scan_is_eof(scanner) || IS_NEWLINE(*scanner->curptr))
 	    break;
 	/* mangled, get next fraction */
-	pj_scan_get( scanner, &pconst.pjsip_NOT_NEWLINE, &next);
+	pj_scan_get_until_newline( scanner, &next);
 	/* concatenate */
 	tmp.ptr = (char*)pj_pool_alloc(ctx->pool,
 				       hdr->hvalue.slen + next.slen + 2);
@@ -1824,10 +2427,10 @@ static pjsip_hdr* parse_hdr_allow(pjsip_parse_ctx *ctx)
 static pjsip_hdr* parse_hdr_call_id(pjsip_parse_ctx *ctx)
 {
     pjsip_cid_hdr *hdr = pjsip_cid_hdr_create(ctx->pool);
-    pj_scan_get( ctx->scanner, &pconst.pjsip_NOT_NEWLINE, &hdr->id);
+    pj_scan_get_until_newline( ctx->scanner, &hdr->id);
     parse_hdr_end(ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !parse_failed(ctx->scanner))
         ctx->rdata->msg_info.cid = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -1845,7 +2448,7 @@ static void int_parse_contact_param( pjsip_contact_hdr *hdr,
 	if (!parser_stricmp(pname, pconst.pjsip_Q_STR) && pvalue.slen) {
 	    char *dot_pos = (char*) pj_memchr(pvalue.ptr, '.', pvalue.slen);
 	    if (!dot_pos) {
-		strtoi_validate(&pvalue, PJSIP_MIN_Q1000, PJSIP_MAX_Q1000,
+		strtoi_validate(scanner, &pvalue, PJSIP_MIN_Q1000, PJSIP_MAX_Q1000,
                                 &hdr->q1000);
 		hdr->q1000 *= 1000;
 	    } else {
@@ -1853,7 +2456,7 @@ static void int_parse_contact_param( pjsip_contact_hdr *hdr,
 		unsigned long qval_frac;
 
 		tmp.slen = dot_pos - pvalue.ptr;
-		strtoi_validate(&tmp, PJSIP_MIN_Q1000, PJSIP_MAX_Q1000,
+		strtoi_validate(scanner, &tmp, PJSIP_MIN_Q1000, PJSIP_MAX_Q1000,
                                 &hdr->q1000);
                 hdr->q1000 *= 1000;
 
@@ -1864,8 +2467,8 @@ static void int_parse_contact_param( pjsip_contact_hdr *hdr,
 		}
 		qval_frac = pj_strtoul_mindigit(&pvalue, 3);
 		if ((unsigned)hdr->q1000 > (PJ_MAXINT32 - qval_frac)) {
-
-		    PJ_THROW(-1);
+		    syntax_error(scanner);
+		    return;
 		}
 		hdr->q1000 += qval_frac;
 	    }
@@ -1937,7 +2540,7 @@ static pjsip_hdr* parse_hdr_content_len( pjsip_parse_ctx *ctx )
     hdr->len = pj_strtoul(&digit);
     parse_hdr_end(ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !parse_failed(ctx->scanner))
         ctx->rdata->msg_info.clen = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -1965,7 +2568,7 @@ static pjsip_hdr* parse_hdr_content_type( pjsip_parse_ctx *ctx )
 
     parse_hdr_end(ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !parse_failed(ctx->scanner))
         ctx->rdata->msg_info.ctype = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -1979,7 +2582,8 @@ static pjsip_hdr* parse_hdr_cseq( pjsip_parse_ctx *ctx )
     int cseq_val = 0;
 
     pj_scan_get( ctx->scanner, &pconst.pjsip_DIGIT_SPEC, &cseq);
-    strtoi_validate(&cseq, PJSIP_MIN_CSEQ, PJSIP_MAX_CSEQ, &cseq_val);
+    strtoi_validate(ctx->scanner, &cseq, PJSIP_MIN_CSEQ, PJSIP_MAX_CSEQ,
+		    &cseq_val);
 
     hdr = pjsip_cseq_hdr_create(ctx->pool);
     hdr->cseq = cseq_val;
@@ -1988,7 +2592,7 @@ static pjsip_hdr* parse_hdr_cseq( pjsip_parse_ctx *ctx )
     parse_hdr_end( ctx->scanner );
 
     pjsip_method_init_np(&hdr->method, &method);
-    if (ctx->rdata) {
+    if (ctx->rdata && !parse_failed(ctx->scanner)) {
         ctx->rdata->msg_info.cseq = hdr;
     }
 
@@ -2036,7 +2640,7 @@ static pjsip_hdr* parse_hdr_from( pjsip_parse_ctx *ctx )
 {
     pjsip_from_hdr *hdr = pjsip_from_hdr_create(ctx->pool);
     parse_hdr_fromto(ctx->scanner, ctx->pool, hdr);
-    if (ctx->rdata)
+    if (ctx->rdata && !parse_failed(ctx->scanner))
         ctx->rdata->msg_info.from = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2072,8 +2676,8 @@ static pjsip_hdr* parse_hdr_retry_after(pjsip_parse_ctx *ctx)
     hdr = pjsip_retry_after_hdr_create(ctx->pool, 0);
 
     pj_scan_get(scanner, &pconst.pjsip_DIGIT_SPEC, &tmp);
-    strtoi_validate(&tmp, PJSIP_MIN_RETRY_AFTER, PJSIP_MAX_RETRY_AFTER,
-                    &hdr->ivalue);
+    strtoi_validate(scanner, &tmp, PJSIP_MIN_RETRY_AFTER,
+		    PJSIP_MAX_RETRY_AFTER, &hdr->ivalue);
 
     while (!pj_scan_is_eof(scanner) && *scanner->curptr!='\r' &&
 	   *scanner->curptr!='\n')
@@ -2088,7 +2692,7 @@ static pjsip_hdr* parse_hdr_retry_after(pjsip_parse_ctx *ctx)
 	    int_parse_param(scanner, ctx->pool, &prm->name, &prm->value, 0);
 	    pj_list_push_back(&hdr->param, prm);
 	} else {
-	    on_syntax_error(scanner);
+	    syntax_error(scanner);
 	}
     }
 
@@ -2122,7 +2726,7 @@ static pjsip_hdr* parse_hdr_to( pjsip_parse_ctx *ctx )
     pjsip_to_hdr *hdr = pjsip_to_hdr_create(ctx->pool);
     parse_hdr_fromto(ctx->scanner, ctx->pool, hdr);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !parse_failed(ctx->scanner))
         ctx->rdata->msg_info.to = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2161,7 +2765,7 @@ static void int_parse_via_param( pjsip_via_hdr *hdr, pj_scanner *scanner,
 	    hdr->branch_param = pvalue;
 
 	} else if (!parser_stricmp(pname, pconst.pjsip_TTL_STR) && pvalue.slen) {
-	    strtoi_validate(&pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
+	    strtoi_validate(scanner, &pvalue, PJSIP_MIN_TTL, PJSIP_MAX_TTL,
                             &hdr->ttl_param);
 
 	} else if (!parser_stricmp(pname, pconst.pjsip_MADDR_STR) && pvalue.slen) {
@@ -2172,7 +2776,7 @@ static void int_parse_via_param( pjsip_via_hdr *hdr, pj_scanner *scanner,
 
 	} else if (!parser_stricmp(pname, pconst.pjsip_RPORT_STR)) {
 	    if (pvalue.slen) {
-		strtoi_validate(&pvalue, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
+		strtoi_validate(scanner, &pvalue, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
 			        &hdr->rport_param);
             } else
 		hdr->rport_param = 0;
@@ -2192,7 +2796,7 @@ static pjsip_hdr* parse_hdr_max_forwards( pjsip_parse_ctx *ctx )
     hdr = pjsip_max_fwd_hdr_create(ctx->pool, 0);
     parse_generic_int_hdr(hdr, ctx->scanner);
 
-    if (ctx->rdata)
+    if (ctx->rdata && !parse_failed(ctx->scanner))
         ctx->rdata->msg_info.max_fwd = hdr;
 
     return (pjsip_hdr*)hdr;
@@ -2245,7 +2849,8 @@ static pjsip_hdr* parse_hdr_rr( pjsip_parse_ctx *ctx)
     } while (1);
     parse_hdr_end(scanner);
 
-    if (ctx->rdata && ctx->rdata->msg_info.record_route==NULL)
+    if (ctx->rdata && !parse_failed(scanner) &&
+	ctx->rdata->msg_info.record_route==NULL)
         ctx->rdata->msg_info.record_route = first;
 
     return (pjsip_hdr*)first;
@@ -2273,7 +2878,8 @@ static pjsip_hdr* parse_hdr_route( pjsip_parse_ctx *ctx )
     } while (1);
     parse_hdr_end(scanner);
 
-    if (ctx->rdata && ctx->rdata->msg_info.route==NULL)
+    if (ctx->rdata && !parse_failed(scanner) &&
+	ctx->rdata->msg_info.route==NULL)
         ctx->rdata->msg_info.route = first;
 
     return (pjsip_hdr*)first;
@@ -2294,7 +2900,7 @@ static pjsip_hdr* parse_hdr_via( pjsip_parse_ctx *ctx )
 
 	parse_sip_version(scanner);
 	if (pj_scan_get_char(scanner) != '/')
-	    on_syntax_error(scanner);
+	    syntax_error(scanner);
 
 	pj_scan_get( scanner, &pconst.pjsip_TOKEN_SPEC, &hdr->transport);
 	int_parse_host(scanner, &hdr->sent_by.host);
@@ -2303,7 +2909,7 @@ static pjsip_hdr* parse_hdr_via( pjsip_parse_ctx *ctx )
 	    pj_str_t digit;
 	    pj_scan_get_char(scanner);
 	    pj_scan_get(scanner, &pconst.pjsip_DIGIT_SPEC, &digit);
-	    strtoi_validate(&digit, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
+	    strtoi_validate(scanner, &digit, PJSIP_MIN_PORT, PJSIP_MAX_PORT,
                             &hdr->sent_by.port);
 	}
 
@@ -2324,7 +2930,8 @@ static pjsip_hdr* parse_hdr_via( pjsip_parse_ctx *ctx )
 
     parse_hdr_end(scanner);
 
-    if (ctx->rdata && ctx->rdata->msg_info.via == NULL)
+    if (ctx->rdata && !parse_failed(scanner) &&
+	ctx->rdata->msg_info.via == NULL)
         ctx->rdata->msg_info.via = first;
 
     return (pjsip_hdr*)first;
@@ -2340,6 +2947,124 @@ static pjsip_hdr* parse_hdr_generic_string( pjsip_parse_ctx *ctx )
     return (pjsip_hdr*)hdr;
 }
 
+/*
+ * Lazy header, see PJSIP_PARSER_LAZY_HDRS.
+ */
+static int lazy_hdr_print( pjsip_lazy_hdr *hdr, char *buf, pj_size_t size);
+static pjsip_lazy_hdr* lazy_hdr_clone( pj_pool_t *pool,
+				       const pjsip_lazy_hdr *rhs);
+static pjsip_lazy_hdr* lazy_hdr_shallow_clone( pj_pool_t *pool,
+					       const pjsip_lazy_hdr *rhs);
+
+static pjsip_hdr_vptr lazy_hdr_vptr =
+{
+    (pjsip_hdr_clone_fptr) &lazy_hdr_clone,
+    (pjsip_hdr_clone_fptr) &lazy_hdr_shallow_clone,
+    (pjsip_hdr_print_fptr) &lazy_hdr_print,
+};
+
+static int lazy_hdr_print( pjsip_lazy_hdr *hdr, char *buf, pj_size_t size)
+{
+    char *p = buf;
+
+    if ((pj_ssize_t)size < hdr->name.slen + hdr->hvalue.slen + 5)
+	return -1;
+
+    pj_memcpy(p, hdr->name.ptr, hdr->name.slen);
+    p += hdr->name.slen;
+    *p++ = ':';
+    *p++ = ' ';
+    pj_memcpy(p, hdr->hvalue.ptr, hdr->hvalue.slen);
+    p += hdr->hvalue.slen;
+    *p = '\0';
+
+    return (int)(p - buf);
+}
+
+static pjsip_lazy_hdr* lazy_hdr_clone( pj_pool_t *pool,
+				       const pjsip_lazy_hdr *rhs)
+{
+    pjsip_lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, pjsip_lazy_hdr);
+
+    pj_memcpy(hdr, rhs, sizeof(*hdr));
+    pj_strdup(pool, &hdr->name, &rhs->name);
+    hdr->sname = hdr->name;
+    /* The scanner needs the value to be NULL terminated */
+    pj_strdup_with_null(pool, &hdr->hvalue, &rhs->hvalue);
+    hdr->pool = pool;
+    return hdr;
+}
+
+static pjsip_lazy_hdr* lazy_hdr_shallow_clone( pj_pool_t *pool,
+					       const pjsip_lazy_hdr *rhs)
+{
+    pjsip_lazy_hdr *hdr = PJ_POOL_ALLOC_T(pool, pjsip_lazy_hdr);
+
+    pj_memcpy(hdr, rhs, sizeof(*hdr));
+    hdr->pool = pool;
+    return hdr;
+}
+
+/* Keep the header value unparsed. The value spans until the end of the
+ * header, including continuation lines, and the scanner is moved to the
+ * next header.
+ */
+static pjsip_hdr* parse_hdr_lazy( pjsip_parse_ctx *ctx,
+				  pjsip_hdr_e htype,
+				  const pj_str_t *hname)
+{
+    pj_scanner *scanner = ctx->scanner;
+    pjsip_lazy_hdr *hdr;
+    char *s = scanner->curptr;
+    pj_bool_t quoted = PJ_FALSE;
+
+    hdr = PJ_POOL_ALLOC_T(ctx->pool, pjsip_lazy_hdr);
+    pj_list_init(hdr);
+    hdr->type = PJSIP_H_OTHER;
+    hdr->name = hdr->sname = *hname;
+    hdr->vptr = &lazy_hdr_vptr;
+    hdr->htype = htype;
+    hdr->pool = ctx->pool;
+    hdr->hvalue.ptr = s;
+
+    for (;;) {
+	/* Find the end of line. Quoted string may contain CR, but not LF,
+	 * same as pj_scan_get_quote().
+	 */
+	while (s < scanner->end && *s != '\n') {
+	    if (*s == '"') {
+		quoted = !quoted;
+	    } else if (quoted) {
+		if (*s == '\\' && s+1 < scanner->end && *(s+1) != '\n')
+		    ++s;
+	    } else if (*s == '\r') {
+		break;
+	    }
+	    ++s;
+	}
+	hdr->hvalue.slen = s - hdr->hvalue.ptr;
+
+	if (s == scanner->end)
+	    break;
+
+	/* Eat the newline */
+	if (*s == '\r')
+	    ++s;
+	if (s < scanner->end && *s == '\n')
+	    ++s;
+	++scanner->line;
+	scanner->start_line = s;
+	quoted = PJ_FALSE;
+
+	/* Done unless the next line is a continuation */
+	if (s == scanner->end || !IS_SPACE(*s))
+	    break;
+    }
+
+    scanner->curptr = s;
+    return (pjsip_hdr*)hdr;
+}
+
 /* Public function to parse a header value. */
 PJ_DEF(void*) pjsip_parse_hdr( pj_pool_t *pool, const pj_str_t *hname,
 			       char *buf, pj_size_t size, int *parsed_len )
@@ -2358,9 +3083,9 @@ PJ_DEF(void*) pjsip_parse_hdr( pj_pool_t *pool, const pj_str_t *hname,
 
     PJ_TRY
     {
-        pjsip_parse_hdr_func *func = find_handler(hname);
-        if (func) {
-            hdr = (*func)(&context);
+        const handler_rec *rec = find_handler(hname);
+        if (rec) {
+            hdr = (*rec->handler)(&context);
         } else {
             hdr = parse_hdr_generic_string(&context);
             hdr->type = PJSIP_H_OTHER;
@@ -2407,7 +3132,7 @@ retry_parse:
     {
 	/* Parse headers. */
 	do {
-	    pjsip_parse_hdr_func * func;
+	    const handler_rec *rec;
 	    pjsip_hdr *hdr = NULL;
 
 	    /* Init hname just in case parsing fails.
@@ -2422,14 +3147,14 @@ retry_parse:
 	    }
 
 	    /* Find handler. */
-	    func = find_handler(&hname);
+	    rec = find_handler(&hname);
 
 	    /* Call the handler if found.
 	     * If no handler is found, then treat the header as generic
 	     * hname/hvalue pair.
 	     */
-	    if (func) {
-		hdr = (*func)(&ctx);
+	    if (rec) {
+		hdr = (*rec->handler)(&ctx);
 	    } else {
 		hdr = parse_hdr_generic_string(&ctx);
 		hdr->name = hdr->sname = hname;
@@ -2489,4 +3214,94 @@ retry_parse:
     PJ_END;
 
     return PJ_SUCCESS;
-}
\ No newline at end of file
+}
+
+/* Check if the header is lazy header. */
+PJ_DEF(pj_bool_t) pjsip_hdr_is_lazy(const void *hdr)
+{
+    return ((const pjsip_hdr*)hdr)->vptr == &lazy_hdr_vptr;
+}
+
+/* Parse lazy header and put the result in its place. */
+PJ_DEF(pjsip_hdr*) pjsip_lazy_hdr_parse(pjsip_lazy_hdr *lhdr)
+{
+    pjsip_hdr *next = (pjsip_hdr*)lhdr->next;
+    pjsip_hdr *hdr = NULL, *h;
+    const handler_rec *rec;
+    pj_scanner *scanner;
+    pjsip_parse_ctx ctx;
+#if PJSIP_PARSER_FAST_PATH
+    fast_scanner fscanner;
+#else
+    pj_scanner int_scanner;
+    PJ_USE_EXCEPTION;
+#endif
+
+    PJ_ASSERT_RETURN(pjsip_hdr_is_lazy(lhdr), (pjsip_hdr*)lhdr);
+
+    /* The value is followed by either newline or NULL, which stops the
+     * scanner the same way as the end of the header does in the message.
+     */
+#if PJSIP_PARSER_FAST_PATH
+    scanner = &fscanner.scanner;
+    pj_scan_init(scanner, lhdr->hvalue.ptr, lhdr->hvalue.slen,
+		 PJ_SCAN_AUTOSKIP_WS_HEADER, &on_fast_syntax_error);
+    fscanner.has_error = PJ_FALSE;
+#else
+    scanner = &int_scanner;
+    pj_scan_init(scanner, lhdr->hvalue.ptr, lhdr->hvalue.slen,
+		 PJ_SCAN_AUTOSKIP_WS_HEADER, &on_syntax_error);
+#endif
+
+    ctx.scanner = scanner;
+    ctx.pool = lhdr->pool;
+    ctx.rdata = NULL;
+
+    rec = find_handler(&lhdr->name);
+    pj_assert(rec != NULL);
+
+#if PJSIP_PARSER_FAST_PATH
+    if (rec) {
+	if (rec->builtin)
+	    hdr = (*rec->handler)(&ctx);
+	else
+	    hdr = fast_call_hdr_parser(rec->handler, &ctx);
+	if (fscanner.has_error)
+	    hdr = NULL;
+    }
+#else
+    PJ_TRY {
+	if (rec)
+	    hdr = (*rec->handler)(&ctx);
+    }
+    PJ_CATCH_ANY {
+	hdr = NULL;
+    }
+    PJ_END;
+#endif
+
+    pj_scan_fini(scanner);
+
+    pj_list_erase(lhdr);
+    if (!hdr) {
+	PJ_LOG(4,(THIS_FILE, "Error parsing header: '%.*s', header is "
+		  "removed", (int)lhdr->name.slen, lhdr->name.ptr));
+	return next;
+    }
+
+    /* Keep the name as it appears in the message, like the headers that
+     * were parsed with the message: the full name in its original case,
+     * or the compact name as the short name.
+     */
+    for (h = hdr; ; h = h->next) {
+	if (pj_stricmp(&h->name, &lhdr->name) == 0)
+	    h->name = lhdr->name;
+	else
+	    h->sname = lhdr->name;
+	if (h->next == hdr)
+	    break;
+    }
+
+    pj_list_insert_nodes_before(next, hdr);
+    return hdr;
+}
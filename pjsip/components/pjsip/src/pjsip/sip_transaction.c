@@ -67,14 +67,49 @@ static pj_status_t mod_tsx_layer_unload(void);
 static pj_bool_t   mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata);
 static pj_bool_t   mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata);
 
+/* A shard of the transaction hash table. */
+typedef struct tsx_shard
+{
+    pj_mutex_t		*mutex;
+    pj_hash_table_t	*htable;
+} tsx_shard;
+
+#if PJSIP_TSX_RTX_WHEEL_TICK
+/* Node of the retransmission wheel, embedded in the transaction. */
+typedef struct pjsip_tsx_rtx_node tsx_rtx_node;
+
+/* Retransmission timer wheel shared by all transactions. Slot "cur"
+ * expired at time "base", a node in slot (cur+n) % SIZE expires n ticks
+ * after base. Expired nodes are moved to the "fire" list until their
+ * transaction is retransmitted.
+ */
+typedef struct tsx_rtx_wheel
+{
+    pj_mutex_t		*mutex;
+    pj_timer_entry	 tick;
+    pj_bool_t		 ticking;
+    pj_bool_t		 stopped;
+    unsigned		 cnt;
+    unsigned		 cur;
+    pj_time_val		 base;
+    tsx_rtx_node	 slot[PJSIP_TSX_RTX_WHEEL_SIZE];
+    tsx_rtx_node	 fire;
+} tsx_rtx_wheel;
+
+/* Slot number of the nodes in the fire list */
+#define RTX_SLOT_FIRE	PJSIP_TSX_RTX_WHEEL_SIZE
+#endif
+
 /* Transaction layer module definition. */
 static struct mod_tsx_layer
 {
     struct pjsip_module  mod;
     pj_pool_t		*pool;
     pjsip_endpoint	*endpt;
-    pj_mutex_t		*mutex;
-    pj_hash_table_t	*htable;
+    tsx_shard		 shard[PJSIP_TSX_LAYER_SHARD_CNT];
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    tsx_rtx_wheel	 rtx;
+#endif
 } mod_tsx_layer = 
 {   {
 		NULL, NULL,			/* List's prev and next.    */
@@ -91,6 +126,12 @@ static struct mod_tsx_layer
     }
 };
 
+/* Get the shard of the transaction table for the key hash value. The
+ * hash table uses the lower bits of the value, so use the upper bits.
+ */
+#define TSX_SHARD(hval)	\
+	    (&mod_tsx_layer.shard[((hval) >> 16) % PJSIP_TSX_LAYER_SHARD_CNT])
+
 /* Role names */
 static const char *role_name[] = 
 {
@@ -143,6 +184,10 @@ static pj_status_t tsx_on_state_destroyed(	pjsip_transaction *tsx,
 					        pjsip_event *event);
 static void        tsx_timer_callback( pj_timer_heap_t *theap, 
 			               pj_timer_entry *entry);
+#if PJSIP_TSX_RTX_WHEEL_TICK
+static void	   rtx_wheel_on_tick( pj_timer_heap_t *theap,
+				      pj_timer_entry *entry);
+#endif
 static void	   tsx_tp_state_callback(
 				       pjsip_transport *tp,
 				       pjsip_transport_state state,
@@ -414,6 +459,28 @@ PJ_DEF(pj_status_t) pjsip_tsx_create_key( pj_pool_t *pool, pj_str_t *key,
  **
  *****************************************************************************
  **/
+/* Destroy the mutexes of the first cnt shards of the transaction table,
+ * and the mutex of the retransmission wheel.
+ */
+static void tsx_layer_destroy_mutexes(unsigned cnt)
+{
+    unsigned i;
+
+    for (i=0; i<cnt; ++i) {
+	if (mod_tsx_layer.shard[i].mutex) {
+	    pj_mutex_destroy(mod_tsx_layer.shard[i].mutex);
+	    mod_tsx_layer.shard[i].mutex = NULL;
+	}
+    }
+
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    if (mod_tsx_layer.rtx.mutex) {
+	pj_mutex_destroy(mod_tsx_layer.rtx.mutex);
+	mod_tsx_layer.rtx.mutex = NULL;
+    }
+#endif
+}
+
 /*
  * Create transaction layer module and registers it to the endpoint.
  */
@@ -427,6 +494,7 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
 	pj_time_val t1_timer_val = { PJSIP_T1_TIMEOUT/1000, PJSIP_T1_TIMEOUT%1000 };
 	pj_time_val t4_timer_val = { PJSIP_T4_TIMEOUT/1000, PJSIP_T4_TIMEOUT%1000 };
     pj_pool_t *pool;
+    unsigned i;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(mod_tsx_layer.endpt==NULL, PJ_EINVALIDOP);
@@ -461,26 +529,51 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_init_module(pjsip_endpoint *endpt)
     mod_tsx_layer.endpt = endpt;
 
 
-    /* Create hash table. */
-    mod_tsx_layer.htable = pj_hash_create( pool, pjsip_cfg()->tsx.max_count );
-    if (!mod_tsx_layer.htable) {
-	pjsip_endpt_release_pool(endpt, pool);
-	return PJ_ENOMEM;
+    /* Create hash table and mutex of each shard. */
+    for (i=0; i<PJSIP_TSX_LAYER_SHARD_CNT; ++i) {
+	tsx_shard *shard = &mod_tsx_layer.shard[i];
+
+	shard->htable = pj_hash_create( pool, pjsip_cfg()->tsx.max_count /
+					      PJSIP_TSX_LAYER_SHARD_CNT );
+	if (!shard->htable) {
+	    tsx_layer_destroy_mutexes(i);
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return PJ_ENOMEM;
+	}
+
+	status = pj_mutex_create_recursive(pool, "tsxlayer", &shard->mutex);
+	if (status != PJ_SUCCESS) {
+	    tsx_layer_destroy_mutexes(i);
+	    pjsip_endpt_release_pool(endpt, pool);
+	    return status;
+	}
     }
 
-    /* Create group lock. */
-    status = pj_mutex_create_recursive(pool, "tsxlayer", &mod_tsx_layer.mutex);
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    /* Create the retransmission wheel. */
+    status = pj_mutex_create_simple(pool, "tsxrtx", &mod_tsx_layer.rtx.mutex);
     if (status != PJ_SUCCESS) {
+	tsx_layer_destroy_mutexes(PJSIP_TSX_LAYER_SHARD_CNT);
 	pjsip_endpt_release_pool(endpt, pool);
 	return status;
     }
 
+    for (i=0; i<PJSIP_TSX_RTX_WHEEL_SIZE; ++i)
+	pj_list_init(&mod_tsx_layer.rtx.slot[i]);
+    pj_list_init(&mod_tsx_layer.rtx.fire);
+    pj_timer_entry_init(&mod_tsx_layer.rtx.tick, 0, NULL, &rtx_wheel_on_tick);
+    mod_tsx_layer.rtx.ticking = PJ_FALSE;
+    mod_tsx_layer.rtx.stopped = PJ_FALSE;
+    mod_tsx_layer.rtx.cnt = 0;
+    mod_tsx_layer.rtx.cur = 0;
+#endif
+
     /*
      * Register transaction layer module to endpoint.
      */
     status = pjsip_endpt_register_module( endpt, &mod_tsx_layer.mod );
     if (status != PJ_SUCCESS) {
-	pj_mutex_destroy(mod_tsx_layer.mutex);
+	tsx_layer_destroy_mutexes(PJSIP_TSX_LAYER_SHARD_CNT);
 	pjsip_endpt_release_pool(endpt, pool);
 	return status;
     }
@@ -520,26 +613,53 @@ PJ_DEF(pj_status_t) pjsip_tsx_layer_destroy(void)
 }
 
 
+/* Get the shard of the transaction table for the transaction. */
+static tsx_shard *tsx_get_shard(pjsip_transaction *tsx)
+{
+#ifdef PRECALC_HASH
+    return TSX_SHARD(tsx->hashed_key);
+#else
+    return TSX_SHARD(pj_hash_calc_tolower(0, NULL, &tsx->transaction_key));
+#endif
+}
+
+/* Get the number of transactions in all shards. */
+static unsigned tsx_layer_count(void)
+{
+    unsigned i, count = 0;
+
+    for (i=0; i<PJSIP_TSX_LAYER_SHARD_CNT; ++i) {
+	pj_mutex_lock(mod_tsx_layer.shard[i].mutex);
+	count += pj_hash_count(mod_tsx_layer.shard[i].htable);
+	pj_mutex_unlock(mod_tsx_layer.shard[i].mutex);
+    }
+
+    return count;
+}
+
 /*
  * Register the transaction to the hash table.
  */
 static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
 {
+    tsx_shard *shard;
+
     pj_assert(tsx->transaction_key.slen != 0);
 
     /* Lock hash table mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    shard = tsx_get_shard(tsx);
+    pj_mutex_lock(shard->mutex);
 
     /* Check if no transaction with the same key exists. 
      * Do not use PJ_ASSERT_RETURN since it evaluates the expression
      * twice!
      */
-    if(pj_hash_get_lower(mod_tsx_layer.htable, 
+    if(pj_hash_get_lower(shard->htable, 
 		         tsx->transaction_key.ptr,
 		         (unsigned)tsx->transaction_key.slen, 
 		         NULL))
     {
-	pj_mutex_unlock(mod_tsx_layer.mutex);
+	pj_mutex_unlock(shard->mutex);
 	PJ_LOG(2,(THIS_FILE, 
 		  "Unable to register %.*s transaction (key exists)",
 		  (int)tsx->method.name.slen,
@@ -554,18 +674,18 @@ static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
 
     /* Register the transaction to the hash table. */
 #ifdef PRECALC_HASH
-    pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable,
+    pj_hash_set_lower( tsx->pool, shard->htable,
                        tsx->transaction_key.ptr,
     		       (unsigned)tsx->transaction_key.slen, 
 		       tsx->hashed_key, tsx);
 #else
-    pj_hash_set_lower( tsx->pool, mod_tsx_layer.htable,
+    pj_hash_set_lower( tsx->pool, shard->htable,
                        tsx->transaction_key.ptr,
     		       tsx->transaction_key.slen, 0, tsx);
 #endif
 
     /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(shard->mutex);
 
     return PJ_SUCCESS;
 }
@@ -576,6 +696,8 @@ static pj_status_t mod_tsx_layer_register_tsx( pjsip_transaction *tsx)
  */
 static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
 {
+    tsx_shard *shard;
+
     if (mod_tsx_layer.mod.id == -1) {
 	/* The transaction layer has been unregistered. This could happen
 	 * if the transaction was pending on transport and the application
@@ -589,15 +711,16 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
     //pj_assert(tsx->state != PJSIP_TSX_STATE_NULL);
 
     /* Lock hash table mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    shard = tsx_get_shard(tsx);
+    pj_mutex_lock(shard->mutex);
 
     /* Register the transaction to the hash table. */
 #ifdef PRECALC_HASH
-    pj_hash_set_lower( NULL, mod_tsx_layer.htable, tsx->transaction_key.ptr,
+    pj_hash_set_lower( NULL, shard->htable, tsx->transaction_key.ptr,
     		       (unsigned)tsx->transaction_key.slen, tsx->hashed_key, 
 		       NULL);
 #else
-    pj_hash_set_lower( NULL, mod_tsx_layer.htable, tsx->transaction_key.ptr,
+    pj_hash_set_lower( NULL, shard->htable, tsx->transaction_key.ptr,
     		       tsx->transaction_key.slen, 0, NULL);
 #endif
 
@@ -607,7 +730,7 @@ static void mod_tsx_layer_unregister_tsx( pjsip_transaction *tsx)
 		tsx->transaction_key.ptr));
 
     /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(shard->mutex);
 }
 
 
@@ -622,9 +745,7 @@ PJ_DEF(unsigned) pjsip_tsx_layer_get_tsx_count(void)
     /* Are we registered? */
     PJ_ASSERT_RETURN(mod_tsx_layer.endpt!=NULL, 0);
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
-    count = pj_hash_count(mod_tsx_layer.htable);
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    count = tsx_layer_count();
 
     return count;
 }
@@ -637,11 +758,15 @@ static pjsip_transaction* find_tsx( const pj_str_t *key, pj_bool_t lock,
 				    pj_bool_t add_ref )
 {
     pjsip_transaction *tsx;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
+    tsx_shard *shard;
+
+    hval = pj_hash_calc_tolower(0, NULL, key);
+    shard = TSX_SHARD(hval);
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    pj_mutex_lock(shard->mutex);
     tsx = (pjsip_transaction*)
-    	  pj_hash_get_lower( mod_tsx_layer.htable, key->ptr, 
+    	  pj_hash_get_lower( shard->htable, key->ptr, 
 			     (unsigned)key->slen, &hval );
     
     /* Prevent the transaction to get deleted before we have chance to lock it.
@@ -649,7 +774,7 @@ static pjsip_transaction* find_tsx( const pj_str_t *key, pj_bool_t lock,
     if (tsx)
         pj_grp_lock_add_ref(tsx->grp_lock);
     
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+    pj_mutex_unlock(shard->mutex);
 
     TSX_TRACE_((THIS_FILE, 
 		"Finding tsx with hkey=0x%p and key=%.*s: found %p",
@@ -708,27 +833,32 @@ static pj_status_t mod_tsx_layer_start(void)
  */
 static pj_status_t mod_tsx_layer_stop(void)
 {
-    pj_hash_iterator_t it_buf, *it;
+    unsigned i;
 
     PJ_LOG(4,(THIS_FILE, "Stopping transaction layer module"));
 
-    pj_mutex_lock(mod_tsx_layer.mutex);
-
-    /* Destroy all transactions. */
-    it = pj_hash_first(mod_tsx_layer.htable, &it_buf);
-    while (it) {
-	pjsip_transaction *tsx = (pjsip_transaction*) 
-				 pj_hash_this(mod_tsx_layer.htable, it);
-	pj_hash_iterator_t *next = pj_hash_next(mod_tsx_layer.htable, it);
-	if (tsx) {
-	    pjsip_tsx_terminate(tsx, PJSIP_SC_SERVICE_UNAVAILABLE);
-	    mod_tsx_layer_unregister_tsx(tsx);
-	    tsx_shutdown(tsx);
+    for (i=0; i<PJSIP_TSX_LAYER_SHARD_CNT; ++i) {
+	tsx_shard *shard = &mod_tsx_layer.shard[i];
+	pj_hash_iterator_t it_buf, *it;
+
+	pj_mutex_lock(shard->mutex);
+
+	/* Destroy all transactions. */
+	it = pj_hash_first(shard->htable, &it_buf);
+	while (it) {
+	    pjsip_transaction *tsx = (pjsip_transaction*) 
+				     pj_hash_this(shard->htable, it);
+	    pj_hash_iterator_t *next = pj_hash_next(shard->htable, it);
+	    if (tsx) {
+		pjsip_tsx_terminate(tsx, PJSIP_SC_SERVICE_UNAVAILABLE);
+		mod_tsx_layer_unregister_tsx(tsx);
+		tsx_shutdown(tsx);
+	    }
+	    it = next;
 	}
-	it = next;
-    }
 
-    pj_mutex_unlock(mod_tsx_layer.mutex);
+	pj_mutex_unlock(shard->mutex);
+    }
 
     PJ_LOG(4,(THIS_FILE, "Stopped transaction layer module"));
 
@@ -741,8 +871,8 @@ static void tsx_layer_destroy(pjsip_endpoint *endpt)
 {
     PJ_UNUSED_ARG(endpt);
 
-    /* Destroy mutex. */
-    pj_mutex_destroy(mod_tsx_layer.mutex);
+    /* Destroy mutexes. */
+    tsx_layer_destroy_mutexes(PJSIP_TSX_LAYER_SHARD_CNT);
 
     /* Release pool. */
     pjsip_endpt_release_pool(mod_tsx_layer.endpt, mod_tsx_layer.pool);
@@ -759,13 +889,26 @@ static void tsx_layer_destroy(pjsip_endpoint *endpt)
  */
 static pj_status_t mod_tsx_layer_unload(void)
 {
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    /* Stop the retransmission wheel now, the timer heap is destroyed
+     * before the exit callbacks are called.
+     */
+    pj_mutex_lock(mod_tsx_layer.rtx.mutex);
+    mod_tsx_layer.rtx.stopped = PJ_TRUE;
+    if (mod_tsx_layer.rtx.ticking) {
+	pjsip_endpt_cancel_timer(mod_tsx_layer.endpt, &mod_tsx_layer.rtx.tick);
+	mod_tsx_layer.rtx.ticking = PJ_FALSE;
+    }
+    pj_mutex_unlock(mod_tsx_layer.rtx.mutex);
+#endif
+
     /* Only self destroy when there's no transaction in the table.
      * Transaction may refuse to destroy when it has pending
      * transmission. If we destroy the module now, application will
      * crash when the pending transaction finally got error response
      * from transport and when it tries to unregister itself.
      */
-    if (pj_hash_count(mod_tsx_layer.htable) != 0) {
+    if (tsx_layer_count() != 0) {
 	pj_status_t status;
 	status = pjsip_endpt_atexit(mod_tsx_layer.endpt, &tsx_layer_destroy);
 	if (status != PJ_SUCCESS) {
@@ -787,17 +930,20 @@ static pj_status_t mod_tsx_layer_unload(void)
 static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 {
     pj_str_t key;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
     pjsip_transaction *tsx;
+    tsx_shard *shard;
 
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAS,
 			 &rdata->msg_info.cseq->method, rdata);
 
     /* Find transaction. */
-    pj_mutex_lock( mod_tsx_layer.mutex );
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    shard = TSX_SHARD(hval);
+    pj_mutex_lock( shard->mutex );
 
     tsx = (pjsip_transaction*) 
-    	  pj_hash_get_lower( mod_tsx_layer.htable, key.ptr, (unsigned)key.slen, 
+    	  pj_hash_get_lower( shard->htable, key.ptr, (unsigned)key.slen, 
 			     &hval );
 
 
@@ -811,7 +957,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 	 * Reject the request so that endpoint passes the request to
 	 * upper layer modules.
 	 */
-	pj_mutex_unlock( mod_tsx_layer.mutex);
+	pj_mutex_unlock( shard->mutex);
 	return PJ_FALSE;
     }
 
@@ -821,7 +967,7 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
     pj_grp_lock_add_ref(tsx->grp_lock);
     
     /* Unlock hash table. */
-    pj_mutex_unlock( mod_tsx_layer.mutex );
+    pj_mutex_unlock( shard->mutex );
 
     /* Simulate race condition! */
     PJ_RACE_ME(5);
@@ -841,17 +987,20 @@ static pj_bool_t mod_tsx_layer_on_rx_request(pjsip_rx_data *rdata)
 static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
 {
     pj_str_t key;
-    pj_uint32_t hval = 0;
+    pj_uint32_t hval;
     pjsip_transaction *tsx;
+    tsx_shard *shard;
 
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAC,
 			 &rdata->msg_info.cseq->method, rdata);
 
     /* Find transaction. */
-    pj_mutex_lock( mod_tsx_layer.mutex );
+    hval = pj_hash_calc_tolower(0, NULL, &key);
+    shard = TSX_SHARD(hval);
+    pj_mutex_lock( shard->mutex );
 
     tsx = (pjsip_transaction*) 
-    	  pj_hash_get_lower( mod_tsx_layer.htable, key.ptr, (unsigned)key.slen, 
+    	  pj_hash_get_lower( shard->htable, key.ptr, (unsigned)key.slen, 
 			     &hval );
 
 
@@ -865,7 +1014,7 @@ static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
 	 * Reject the request so that endpoint passes the request to
 	 * upper layer modules.
 	 */
-	pj_mutex_unlock( mod_tsx_layer.mutex);
+	pj_mutex_unlock( shard->mutex);
 	return PJ_FALSE;
     }
 
@@ -875,7 +1024,7 @@ static pj_bool_t mod_tsx_layer_on_rx_response(pjsip_rx_data *rdata)
     pj_grp_lock_add_ref(tsx->grp_lock);
 
     /* Unlock hash table. */
-    pj_mutex_unlock( mod_tsx_layer.mutex );
+    pj_mutex_unlock( shard->mutex );
 
     /* Simulate race condition! */
     PJ_RACE_ME(5);
@@ -906,22 +1055,26 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
 {
 #if PJ_LOG_MAX_LEVEL >= 3
     pj_hash_iterator_t itbuf, *it;
+    unsigned i, count;
 
-    /* Lock mutex. */
-    pj_mutex_lock(mod_tsx_layer.mutex);
+    count = tsx_layer_count();
 
     PJ_LOG(3, (THIS_FILE, "Dumping transaction table:"));
-    PJ_LOG(3, (THIS_FILE, " Total %d transactions", 
-			  pj_hash_count(mod_tsx_layer.htable)));
+    PJ_LOG(3, (THIS_FILE, " Total %d transactions", count));
 
-    if (detail) {
-	it = pj_hash_first(mod_tsx_layer.htable, &itbuf);
-	if (it == NULL) {
-	    PJ_LOG(3, (THIS_FILE, " - none - "));
-	} else {
+    if (detail && count == 0) {
+	PJ_LOG(3, (THIS_FILE, " - none - "));
+    } else if (detail) {
+	for (i=0; i<PJSIP_TSX_LAYER_SHARD_CNT; ++i) {
+	    tsx_shard *shard = &mod_tsx_layer.shard[i];
+
+	    /* Lock mutex. */
+	    pj_mutex_lock(shard->mutex);
+
+	    it = pj_hash_first(shard->htable, &itbuf);
 	    while (it != NULL) {
 		pjsip_transaction *tsx = (pjsip_transaction*) 
-					 pj_hash_this(mod_tsx_layer.htable,it);
+					 pj_hash_this(shard->htable, it);
 
 		PJ_LOG(3, (THIS_FILE, " %s %s|%d|%s",
 			   tsx->obj_name,
@@ -931,13 +1084,13 @@ PJ_DEF(void) pjsip_tsx_layer_dump(pj_bool_t detail)
 			   tsx->status_code,
 			   pjsip_tsx_state_str(tsx->state)));
 
-		it = pj_hash_next(mod_tsx_layer.htable, it);
+		it = pj_hash_next(shard->htable, it);
 	    }
+
+	    /* Unlock mutex. */
+	    pj_mutex_unlock(shard->mutex);
 	}
     }
-
-    /* Unlock mutex. */
-    pj_mutex_unlock(mod_tsx_layer.mutex);
 #endif
 }
 
@@ -959,6 +1112,179 @@ static void unlock_timer(pjsip_transaction *tsx)
     pj_mutex_unlock(tsx->mutex_b);
 }
 
+#if PJSIP_TSX_RTX_WHEEL_TICK
+/* Schedule the next tick of the retransmission wheel if it has nodes.
+ * Wheel mutex must be held.
+ */
+static void rtx_wheel_schedule_tick(const pj_time_val *now)
+{
+    tsx_rtx_wheel *w = &mod_tsx_layer.rtx;
+    pj_time_val delay;
+
+    if (w->ticking || w->stopped || w->cnt == 0)
+	return;
+
+    /* Next tick is at base + TICK */
+    delay.sec = 0;
+    delay.msec = PJSIP_TSX_RTX_WHEEL_TICK;
+    pj_time_val_normalize(&delay);
+    PJ_TIME_VAL_ADD(delay, w->base);
+    if (PJ_TIME_VAL_GT(delay, *now)) {
+	PJ_TIME_VAL_SUB(delay, *now);
+    } else {
+	delay.sec = delay.msec = 0;
+    }
+
+    if (pjsip_endpt_schedule_timer(mod_tsx_layer.endpt, &w->tick,
+				   &delay) == PJ_SUCCESS)
+    {
+	w->ticking = PJ_TRUE;
+    }
+}
+
+/* Put the retransmission timer of the transaction in the wheel. Returns
+ * PJ_ETOOBIG if the delay is beyond the span of the wheel, in which case
+ * the timer heap should be used instead.
+ */
+static pj_status_t rtx_wheel_add(pjsip_transaction *tsx,
+				 const pj_time_val *delay)
+{
+    tsx_rtx_wheel *w = &mod_tsx_layer.rtx;
+    tsx_rtx_node *node = &tsx->rtx_node;
+    pj_time_val now, due;
+    long ticks;
+
+    pj_gettickcount(&now);
+
+    pj_mutex_lock(w->mutex);
+
+    if (w->stopped || node->slot != -1) {
+	pj_mutex_unlock(w->mutex);
+	return w->stopped ? PJ_ETOOBIG : PJ_EINVALIDOP;
+    }
+
+    /* Restart the wheel from now if it is idle. */
+    if (!w->ticking)
+	w->base = now;
+
+    /* Round the expiration up to the next tick. */
+    due = now;
+    PJ_TIME_VAL_ADD(due, *delay);
+    PJ_TIME_VAL_SUB(due, w->base);
+    ticks = (PJ_TIME_VAL_MSEC(due) + PJSIP_TSX_RTX_WHEEL_TICK - 1) /
+	    PJSIP_TSX_RTX_WHEEL_TICK;
+    if (ticks < 1)
+	ticks = 1;
+    if (ticks >= PJSIP_TSX_RTX_WHEEL_SIZE) {
+	pj_mutex_unlock(w->mutex);
+	return PJ_ETOOBIG;
+    }
+
+    node->slot = (w->cur + ticks) % PJSIP_TSX_RTX_WHEEL_SIZE;
+    pj_list_push_back(&w->slot[node->slot], node);
+    ++w->cnt;
+
+    /* The wheel keeps a reference, like the timer heap does. */
+    tsx->retransmit_timer.id = RETRANSMIT_TIMER;
+    pj_grp_lock_add_ref(tsx->grp_lock);
+
+    rtx_wheel_schedule_tick(&now);
+
+    pj_mutex_unlock(w->mutex);
+
+    return PJ_SUCCESS;
+}
+
+/* Remove the retransmission timer of the transaction from the wheel.
+ * Returns non-zero if it was in the wheel.
+ */
+static int rtx_wheel_remove(pjsip_transaction *tsx)
+{
+    tsx_rtx_wheel *w = &mod_tsx_layer.rtx;
+    tsx_rtx_node *node = &tsx->rtx_node;
+
+    pj_mutex_lock(w->mutex);
+    if (node->slot == -1) {
+	pj_mutex_unlock(w->mutex);
+	return 0;
+    }
+
+    if (node->slot != RTX_SLOT_FIRE)
+	--w->cnt;
+    pj_list_erase(node);
+    node->slot = -1;
+    tsx->retransmit_timer.id = TIMER_INACTIVE;
+    pj_mutex_unlock(w->mutex);
+
+    pj_grp_lock_dec_ref(tsx->grp_lock);
+    return 1;
+}
+
+/* Retransmission wheel tick: retransmit the transactions of all the slots
+ * that have expired.
+ */
+static void rtx_wheel_on_tick(pj_timer_heap_t *theap, pj_timer_entry *entry)
+{
+    tsx_rtx_wheel *w = &mod_tsx_layer.rtx;
+    pj_time_val now, next;
+
+    PJ_UNUSED_ARG(entry);
+
+    pj_gettickcount(&now);
+
+    pj_mutex_lock(w->mutex);
+    w->ticking = PJ_FALSE;
+
+    /* Move the nodes of the expired slots to the fire list. */
+    for (;;) {
+	tsx_rtx_node *slot, *node;
+
+	next.sec = 0;
+	next.msec = PJSIP_TSX_RTX_WHEEL_TICK;
+	pj_time_val_normalize(&next);
+	PJ_TIME_VAL_ADD(next, w->base);
+	if (PJ_TIME_VAL_GT(next, now))
+	    break;
+
+	w->base = next;
+	w->cur = (w->cur + 1) % PJSIP_TSX_RTX_WHEEL_SIZE;
+
+	slot = &w->slot[w->cur];
+	for (node=slot->next; node!=slot; node=node->next) {
+	    node->slot = RTX_SLOT_FIRE;
+	    --w->cnt;
+	}
+	pj_list_merge_last(&w->fire, slot);
+    }
+
+    rtx_wheel_schedule_tick(&now);
+    pj_mutex_unlock(w->mutex);
+
+    /* Retransmit, one transaction at a time since they may be cancelled
+     * by other threads meanwhile.
+     */
+    for (;;) {
+	tsx_rtx_node *node;
+	pjsip_transaction *tsx;
+
+	pj_mutex_lock(w->mutex);
+	if (pj_list_empty(&w->fire)) {
+	    pj_mutex_unlock(w->mutex);
+	    break;
+	}
+	node = w->fire.next;
+	pj_list_erase(node);
+	node->slot = -1;
+	tsx = node->tsx;
+	pj_mutex_unlock(w->mutex);
+
+	/* Reference was added when the node was put in the wheel. */
+	tsx_timer_callback(theap, &tsx->retransmit_timer);
+	pj_grp_lock_dec_ref(tsx->grp_lock);
+    }
+}
+#endif	/* PJSIP_TSX_RTX_WHEEL_TICK */
+
 /* Utility: schedule a timer */
 static pj_status_t tsx_schedule_timer(pjsip_transaction *tsx,
                                       pj_timer_entry *entry,
@@ -969,6 +1295,16 @@ static pj_status_t tsx_schedule_timer(pjsip_transaction *tsx,
     pj_status_t status;
 
     pj_assert(active_id != 0);
+
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    /* Retransmission timers go to the wheel unless the delay is too long */
+    if (entry == &tsx->retransmit_timer && !pj_timer_entry_running(entry)) {
+	status = rtx_wheel_add(tsx, delay);
+	if (status != PJ_ETOOBIG)
+	    return status;
+    }
+#endif
+
     status = pj_timer_heap_schedule_w_grp_lock(timer_heap, entry,
                                                delay, active_id,
                                                tsx->grp_lock);
@@ -981,9 +1317,34 @@ static int tsx_cancel_timer(pjsip_transaction *tsx,
                             pj_timer_entry *entry)
 {
     pj_timer_heap_t *timer_heap = pjsip_endpt_get_timer_heap(tsx->endpt);
+
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    if (entry == &tsx->retransmit_timer && rtx_wheel_remove(tsx))
+	return 1;
+#endif
+
     return pj_timer_heap_cancel_if_active(timer_heap, entry, TIMER_INACTIVE);
 }
 
+/* Utility: check if a timer is scheduled */
+static pj_bool_t tsx_timer_running(pjsip_transaction *tsx,
+				   pj_timer_entry *entry)
+{
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    if (entry == &tsx->retransmit_timer) {
+	int slot = tsx->rtx_node.slot;
+
+	/* Nodes in the fire list are like timers popped from the heap */
+	if (slot >= 0 && slot != RTX_SLOT_FIRE)
+	    return PJ_TRUE;
+    }
+#else
+    PJ_UNUSED_ARG(tsx);
+#endif
+
+    return pj_timer_entry_running(entry);
+}
+
 /* Create and initialize basic transaction structure.
  * This function is called by both UAC and UAS creation.
  */
@@ -1016,6 +1377,11 @@ static pj_status_t tsx_create( pjsip_module *tsx_user,
     tsx->timeout_timer.id = TIMER_INACTIVE;
     tsx->timeout_timer.user_data = tsx;
     tsx->timeout_timer.cb = &tsx_timer_callback;
+#if PJSIP_TSX_RTX_WHEEL_TICK
+    pj_list_init(&tsx->rtx_node);
+    tsx->rtx_node.tsx = tsx;
+    tsx->rtx_node.slot = -1;
+#endif
     
     if (grp_lock) {
 	tsx->grp_lock = grp_lock;
@@ -2402,7 +2768,7 @@ static pj_status_t tsx_retransmit( pjsip_transaction *tsx, int resched)
 {
     pj_status_t status;
 
-    if (resched && pj_timer_entry_running(&tsx->retransmit_timer)) {
+    if (resched && tsx_timer_running(tsx, &tsx->retransmit_timer)) {
 	/* We've been asked to reschedule but the timer is already rerunning.
 	 * This can only happen in a race condition where, between removing
 	 * this retransmit timer from the heap and actually scheduling it,
@@ -134,6 +134,14 @@ struct pjsip_tpmgr
 
     /* List of free transport entry. */
     transport	     tp_entry_freelist;
+
+#if PJSIP_TDATA_CACHE_SIZE
+    /* Recycled transmit data, and the cache statistics. */
+    pjsip_tx_data    tdata_cache;
+    unsigned	     tdata_cache_cnt;
+    unsigned	     tdata_cache_hit;
+    unsigned	     tdata_cache_miss;
+#endif
 };
 
 
@@ -449,6 +457,18 @@ PJ_DEF(void) pjsip_tpselector_dec_ref(pjsip_tpselector *sel)
  *
  *****************************************************************************/
 
+#if PJSIP_TDATA_CACHE_SIZE
+/* Release the pools of transmit data. */
+static void tx_data_release_pools(pjsip_tpmgr *mgr, pjsip_tx_data *tdata)
+{
+    pj_pool_t *cache_pool = tdata->cache_pool;
+
+    if (tdata->pool)
+	pjsip_endpt_release_pool( mgr->endpt, tdata->pool );
+    pjsip_endpt_release_pool( mgr->endpt, cache_pool );
+}
+#endif
+
 /*
  * Create new transmit buffer.
  */
@@ -461,6 +481,60 @@ PJ_DEF(pj_status_t) pjsip_tx_data_create( pjsip_tpmgr *mgr,
 
     PJ_ASSERT_RETURN(mgr && p_tdata, PJ_EINVAL);
 
+#if PJSIP_TDATA_CACHE_SIZE
+    /* Reuse recycled transmit data, if any. */
+    pj_lock_acquire(mgr->lock);
+    if (!pj_list_empty(&mgr->tdata_cache)) {
+	tdata = mgr->tdata_cache.next;
+	pj_list_erase(tdata);
+	--mgr->tdata_cache_cnt;
+	++mgr->tdata_cache_hit;
+    } else {
+	tdata = NULL;
+	++mgr->tdata_cache_miss;
+    }
+    pj_lock_release(mgr->lock);
+
+    if (tdata)
+	goto on_init;
+
+    /* The structure lives in its own pool so that the message pool can be
+     * reset when it is recycled.
+     */
+    pool = pjsip_endpt_create_pool( mgr->endpt, "tdtc%p",
+				    sizeof(pjsip_tx_data) + 256,
+				    PJSIP_POOL_INC_TDATA );
+    if (!pool)
+	return PJ_ENOMEM;
+
+    tdata = PJ_POOL_ZALLOC_T(pool, pjsip_tx_data);
+    tdata->cache_pool = pool;
+    tdata->mgr = mgr;
+    pj_ansi_snprintf(tdata->obj_name, sizeof(tdata->obj_name), "tdta%p", tdata);
+
+    tdata->pool = pjsip_endpt_create_pool( mgr->endpt, tdata->obj_name,
+					   PJSIP_POOL_LEN_TDATA,
+					   PJSIP_POOL_INC_TDATA );
+    if (!tdata->pool) {
+	tx_data_release_pools(mgr, tdata);
+	return PJ_ENOMEM;
+    }
+
+    status = pj_atomic_create(pool, 0, &tdata->ref_cnt);
+    if (status != PJ_SUCCESS) {
+	tx_data_release_pools(mgr, tdata);
+	return status;
+    }
+
+    status = pj_lock_create_null_mutex(pool, "tdta%p", &tdata->lock);
+    if (status != PJ_SUCCESS) {
+	pj_atomic_destroy(tdata->ref_cnt);
+	tx_data_release_pools(mgr, tdata);
+	return status;
+    }
+
+on_init:
+#else
     pool = pjsip_endpt_create_pool( mgr->endpt, "tdta%p",
 				    PJSIP_POOL_LEN_TDATA,
 				    PJSIP_POOL_INC_TDATA );
@@ -485,6 +559,7 @@ PJ_DEF(pj_status_t) pjsip_tx_data_create( pjsip_tpmgr *mgr,
 	pjsip_endpt_release_pool( mgr->endpt, tdata->pool );
 	return status;
     }
+#endif
 
     pj_ioqueue_op_key_init(&tdata->op_key.key, sizeof(tdata->op_key.key));
     pj_list_init(tdata);
@@ -513,6 +588,50 @@ PJ_DEF(void) pjsip_tx_data_add_ref( pjsip_tx_data *tdata )
     pj_atomic_inc(tdata->ref_cnt);
 }
 
+#if PJSIP_TDATA_CACHE_SIZE
+/*
+ * Reset transmit data whose reference counter has reached zero and put it
+ * in the transport manager's cache. Returns PJ_FALSE if the cache is full.
+ */
+static pj_bool_t tx_data_recycle(pjsip_tx_data *tdata)
+{
+    pjsip_tpmgr *mgr = tdata->mgr;
+    pjsip_tx_data saved;
+
+    /* Unlocked check, to avoid resetting the pool for nothing. */
+    if (mgr->tdata_cache_cnt >= PJSIP_TDATA_CACHE_SIZE)
+	return PJ_FALSE;
+
+    pj_pool_reset(tdata->pool);
+
+    /* Clear everything but the retained objects. */
+    pj_memcpy(&saved, tdata, sizeof(saved));
+    pj_bzero(tdata, sizeof(*tdata));
+    tdata->pool = saved.pool;
+    pj_memcpy(tdata->obj_name, saved.obj_name, sizeof(tdata->obj_name));
+    tdata->mgr = mgr;
+    tdata->lock = saved.lock;
+    tdata->ref_cnt = saved.ref_cnt;
+    tdata->cache_pool = saved.cache_pool;
+    tdata->cache_buf = saved.cache_buf;
+
+    pj_lock_acquire(mgr->lock);
+    if (mgr->tdata_cache_cnt < PJSIP_TDATA_CACHE_SIZE) {
+	pj_list_push_back(&mgr->tdata_cache, tdata);
+	++mgr->tdata_cache_cnt;
+	tdata = NULL;
+    }
+    pj_lock_release(mgr->lock);
+
+    if (tdata) {
+	pj_atomic_destroy( tdata->ref_cnt );
+	pj_lock_destroy( tdata->lock );
+	tx_data_release_pools(mgr, tdata);
+    }
+    return PJ_TRUE;
+}
+#endif
+
 static void tx_data_destroy(pjsip_tx_data *tdata)
 {
     PJ_LOG(5,(tdata->obj_name, "Destroying txdata %s",
@@ -529,9 +648,18 @@ static void tx_data_destroy(pjsip_tx_data *tdata)
     pj_lock_release(tdata->mgr->lock);
 #endif
 
+#if PJSIP_TDATA_CACHE_SIZE
+    if (tx_data_recycle(tdata))
+	return;
+
+    pj_atomic_destroy( tdata->ref_cnt );
+    pj_lock_destroy( tdata->lock );
+    tx_data_release_pools( tdata->mgr, tdata );
+#else
     pj_atomic_destroy( tdata->ref_cnt );
     pj_lock_destroy( tdata->lock );
     pjsip_endpt_release_pool( tdata->mgr->endpt, tdata->pool );
+#endif
 }
 
 /*
@@ -574,8 +702,18 @@ PJ_DEF(pj_status_t) pjsip_tx_data_encode(pjsip_tx_data *tdata)
 	PJ_USE_EXCEPTION;
 
 	PJ_TRY {
+#if PJSIP_TDATA_CACHE_SIZE
+	    /* Keep the buffer when the transmit data is recycled. */
+	    if (tdata->cache_buf == NULL) {
+		tdata->cache_buf = (char*)
+				   pj_pool_alloc(tdata->cache_pool,
+						 PJSIP_MAX_PKT_LEN);
+	    }
+	    tdata->buf.start = tdata->cache_buf;
+#else
 	    tdata->buf.start = (char*) 
 			       pj_pool_alloc(tdata->pool, PJSIP_MAX_PKT_LEN);
+#endif
 	}
 	PJ_CATCH_ANY {
 	    return PJ_ENOMEM;
@@ -1562,6 +1700,9 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_create( pj_pool_t *pool,
     pj_list_init(&mgr->factory_list);
     pj_list_init(&mgr->tdata_list);
     pj_list_init(&mgr->tp_entry_freelist);
+#if PJSIP_TDATA_CACHE_SIZE
+    pj_list_init(&mgr->tdata_cache);
+#endif
 
     mgr->table = pj_hash_create(mgr->pool, PJSIP_TPMGR_HTABLE_SIZE);
     if (!mgr->table)
@@ -1888,6 +2029,20 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
 	PJ_LOG(3,(THIS_FILE, "Cleaned up dangling transmit buffer(s)."));
     }
 
+#if PJSIP_TDATA_CACHE_SIZE
+    /*
+     * Destroy recycled transmit buffers.
+     */
+    while (!pj_list_empty(&mgr->tdata_cache)) {
+	pjsip_tx_data *tdata = mgr->tdata_cache.next;
+	pj_list_erase(tdata);
+	pj_atomic_destroy( tdata->ref_cnt );
+	pj_lock_destroy( tdata->lock );
+	tx_data_release_pools(mgr, tdata);
+    }
+    mgr->tdata_cache_cnt = 0;
+#endif
+
 #if defined(PJ_DEBUG) && PJ_DEBUG!=0
     pj_atomic_destroy(mgr->tdata_counter);
 #endif
@@ -1968,6 +2123,8 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	    }
 
 	    current_pkt = p;
+	    pj_bzero(&rdata->pkt_info.find_state,
+		     sizeof(rdata->pkt_info.find_state));
 	    if (remaining_len == 0) {
 		return total_processed;
 	    }
@@ -1988,10 +2145,14 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	/* For TCP transport, check if the whole message has been received. */
 	if ((tr->flag & PJSIP_TRANSPORT_DATAGRAM) == 0) {
 	    pj_status_t msg_status;
-	    msg_status = pjsip_find_msg(current_pkt, remaining_len, PJ_FALSE, 
-                                        &msg_fragment_size);
+	    msg_status = pjsip_find_msg2(current_pkt, remaining_len, PJ_FALSE,
+					 &rdata->pkt_info.find_state,
+                                         &msg_fragment_size);
 	    if (msg_status != PJ_SUCCESS) {
 		if (remaining_len == PJSIP_MAX_PKT_LEN) {
+		    pj_bzero(&rdata->pkt_info.find_state,
+			     sizeof(rdata->pkt_info.find_state));
+
 		    mgr->on_rx_msg(mgr->endpt, PJSIP_ERXOVERFLOW, rdata);
 		    
 		    /* Notify application about the message overflow */
@@ -2008,7 +2169,9 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 		    /* Exhaust all data. */
 		    return rdata->pkt_info.len;
 		} else {
-		    /* Not enough data in packet. */
+		    /* Not enough data in packet, keep the framing state so
+		     * that the next read only scans the new data.
+		     */
 		    return total_processed;
 		}
 	    }
@@ -2170,6 +2333,8 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 
 
 finish_process_fragment:
+	pj_bzero(&rdata->pkt_info.find_state,
+		 sizeof(rdata->pkt_info.find_state));
 	total_processed += msg_fragment_size;
 	current_pkt += msg_fragment_size;
 	remaining_len -= msg_fragment_size;
@@ -2457,6 +2622,17 @@ PJ_DEF(void) pjsip_tpmgr_dump_transports(pjsip_tpmgr *mgr)
 	      pj_atomic_get(mgr->tdata_counter)));
 #endif
 
+#if PJSIP_TDATA_CACHE_SIZE
+    {
+	unsigned total = mgr->tdata_cache_hit + mgr->tdata_cache_miss;
+
+	PJ_LOG(3,(THIS_FILE, " Transmit buffer cache: %u cached, "
+		  "%u/%u reused (%u%%)",
+		  mgr->tdata_cache_cnt, mgr->tdata_cache_hit, total,
+		  total ? mgr->tdata_cache_hit * 100 / total : 0));
+    }
+#endif
+
     PJ_LOG(3, (THIS_FILE, " Dumping listeners:"));
     factory = mgr->factory_list.next;
     while (factory != &mgr->factory_list) {
@@ -122,6 +122,13 @@ struct tcp_transport
     /* Pending transmission list. */
     struct delayed_tdata     delayed_list;
 
+    /* Delayed transmissions being flushed together with one sendv().
+     * flush_op_key.tdata is set while the flush is in progress.
+     */
+    struct delayed_tdata     flush_list;
+    pjsip_tx_data_op_key     flush_op_key;
+    pj_iovec_t		     flush_iov[PJ_SOCK_MAX_IOV];
+
     /* Group lock to be used by TCP transport and ioqueue key */
     pj_grp_lock_t	    *grp_lock;
 
@@ -640,6 +647,7 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     tcp->sock = sock;
     /*tcp->listener = listener;*/
     pj_list_init(&tcp->delayed_list);
+    pj_list_init(&tcp->flush_list);
     tcp->base.pool = pool;
 
     pj_ansi_snprintf(tcp->base.obj_name, PJ_MAX_OBJ_NAME, 
@@ -720,6 +728,8 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     tcp->ka_timer.user_data = (void*)tcp;
     tcp->ka_timer.cb = &tcp_keep_alive_timer;
     pj_ioqueue_op_key_init(&tcp->ka_op_key.key, sizeof(pj_ioqueue_op_key_t));
+    pj_ioqueue_op_key_init(&tcp->flush_op_key.key,
+			   sizeof(pj_ioqueue_op_key_t));
     pj_strdup(tcp->base.pool, &tcp->ka_pkt, &ka_pkt);
 
     /* Initialize initial timer. */
@@ -754,7 +764,36 @@ on_error:
 }
 
 
-/* Flush all delayed transmision once the socket is connected. */
+/* Report the result of a coalesced flush to each message in it. */
+static pj_bool_t on_flush_sent(struct tcp_transport *tcp,
+			       pj_ssize_t bytes_sent)
+{
+    pj_bool_t ret = PJ_TRUE;
+
+    while (!pj_list_empty(&tcp->flush_list)) {
+	struct delayed_tdata *pending_tx;
+	pjsip_tx_data *tdata;
+	pj_ssize_t size;
+
+	pending_tx = tcp->flush_list.next;
+	pj_list_erase(pending_tx);
+
+	tdata = pending_tx->tdata_op_key->tdata;
+	size = (bytes_sent > 0) ? tdata->buf.cur - tdata->buf.start :
+				  bytes_sent;
+	ret = on_data_sent(tcp->asock,
+			   (pj_ioqueue_op_key_t*)pending_tx->tdata_op_key,
+			   size);
+    }
+    tcp->flush_op_key.tdata = NULL;
+
+    return ret;
+}
+
+
+/* Flush all delayed transmision once the socket is connected. Messages
+ * are coalesced, up to PJ_SOCK_MAX_IOV of them are sent with one sendv().
+ */
 static void tcp_flush_pending_tx(struct tcp_transport *tcp)
 {
     pj_time_val now;
@@ -783,8 +822,50 @@ static void tcp_flush_pending_tx(struct tcp_transport *tcp)
             continue;
         }
 
-	/* send! */
 	size = tdata->buf.cur - tdata->buf.start;
+
+	if (tcp->flush_op_key.tdata == NULL &&
+	    !pj_list_empty(&tcp->delayed_list))
+	{
+	    /* More messages are waiting, send them together. */
+	    unsigned cnt = 1;
+
+	    pj_list_push_back(&tcp->flush_list, pending_tx);
+	    tcp->flush_iov[0].buf = tdata->buf.start;
+	    tcp->flush_iov[0].len = size;
+
+	    while (cnt < PJ_SOCK_MAX_IOV &&
+		   !pj_list_empty(&tcp->delayed_list))
+	    {
+		struct delayed_tdata *next_tx = tcp->delayed_list.next;
+		pjsip_tx_data *next = next_tx->tdata_op_key->tdata;
+
+		/* Leave the expired one to the outer loop */
+		if (next_tx->timeout.sec > 0 &&
+		    PJ_TIME_VAL_GT(now, next_tx->timeout))
+		{
+		    break;
+		}
+
+		pj_list_erase(next_tx);
+		pj_list_push_back(&tcp->flush_list, next_tx);
+		tcp->flush_iov[cnt].buf = next->buf.start;
+		tcp->flush_iov[cnt].len = next->buf.cur - next->buf.start;
+		++cnt;
+	    }
+
+	    tcp->flush_op_key.tdata = tdata;
+	    status = pj_activesock_sendv(tcp->asock, &tcp->flush_op_key.key,
+					 tcp->flush_iov, cnt, &size, 0);
+	    if (status != PJ_EPENDING) {
+		pj_lock_release(tcp->base.lock);
+		on_flush_sent(tcp, (status == PJ_SUCCESS) ? size : -status);
+		pj_lock_acquire(tcp->base.lock);
+	    }
+	    continue;
+	}
+
+	/* send! */
 	status = pj_activesock_send(tcp->asock, op_key, tdata->buf.start, 
 				    &size, 0);
 	if (status != PJ_EPENDING) {
@@ -1214,6 +1295,10 @@ static pj_bool_t on_data_sent(pj_activesock_t *asock,
     				pj_activesock_get_user_data(asock);
     pjsip_tx_data_op_key *tdata_op_key = (pjsip_tx_data_op_key*)op_key;
 
+    /* Completion of delayed messages sent together */
+    if (tdata_op_key == &tcp->flush_op_key)
+	return on_flush_sent(tcp, bytes_sent);
+
     /* Note that op_key may be the op_key from keep-alive, thus
      * it will not have tdata etc.
      */
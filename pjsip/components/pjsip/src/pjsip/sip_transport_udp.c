@@ -80,9 +80,46 @@ struct udp_transport
 
     /* Group lock to be used by UDP transport and ioqueue key */
     pj_grp_lock_t      *grp_lock;
+
+#if PJSIP_UDP_SOCK_CNT > 1
+    /* Additional sockets bound to the same address with SO_REUSEPORT
+     * (see PJSIP_UDP_SOCK_CNT). Socket number n (n > 0) is xsock[n-1],
+     * it is read by the rdata whose index modulo sock_cnt is n.
+     */
+    unsigned		sock_cnt;
+    unsigned		sock_max;
+    pj_sock_t		xsock[PJSIP_UDP_SOCK_CNT-1];
+    pj_ioqueue_key_t   *xkey[PJSIP_UDP_SOCK_CNT-1];
+
+    /* QoS and socket options of the transport, applied again to the
+     * additional sockets recreated by pjsip_udp_transport_restart2().
+     */
+    pj_qos_type		qos_type;
+    pj_qos_params	qos_params;
+    pj_sockopt_params	sockopt_params;
+#endif
 };
 
 
+/*
+ * Get the ioqueue key of the socket read by the specified rdata.
+ */
+static pj_ioqueue_key_t *udp_rdata_key(struct udp_transport *tp,
+				       int rdata_index)
+{
+#if PJSIP_UDP_SOCK_CNT > 1
+    unsigned n = (unsigned)rdata_index % tp->sock_cnt;
+
+    if (n != 0)
+	return tp->xkey[n-1];
+#else
+    PJ_UNUSED_ARG(rdata_index);
+#endif
+
+    return tp->key;
+}
+
+
 /*
  * Initialize transport's receive buffer from the specified pool.
  */
@@ -214,12 +251,19 @@ static void udp_on_read_complete( pj_ioqueue_key_t *key,
 				   " callback error"));
 	}
 
+#if PJ_HAS_SOCK_MMSG
+	/* Leave the read pending, the ioqueue will complete it together
+	 * with the other rdata using one recvmmsg().
+	 */
+	flags = PJ_IOQUEUE_ALWAYS_ASYNC;
+#else
 	if (i >= MAX_IMMEDIATE_PACKET) {
 	    /* Force ioqueue_recvfrom() to return PJ_EPENDING */
 	    flags = PJ_IOQUEUE_ALWAYS_ASYNC;
 	} else {
 	    flags = 0;
 	}
+#endif
 
 	/* Reset pool. 
 	 * Need to copy rdata fields to temp variable because they will
@@ -402,6 +446,29 @@ static pj_status_t udp_send_msg( pjsip_transport *transport,
 }
 
 
+/* Unregister and close the additional sockets, if any */
+static void udp_close_xsocks(struct udp_transport *tp)
+{
+#if PJSIP_UDP_SOCK_CNT > 1
+    unsigned n;
+
+    for (n=0; n+1<tp->sock_cnt; ++n) {
+	if (tp->xkey[n]) {
+	    /* This implicitly closes the socket */
+	    pj_ioqueue_unregister(tp->xkey[n]);
+	    tp->xkey[n] = NULL;
+	} else if (tp->xsock[n] != PJ_INVALID_SOCKET) {
+	    pj_sock_close(tp->xsock[n]);
+	}
+	tp->xsock[n] = PJ_INVALID_SOCKET;
+    }
+    tp->sock_cnt = 1;
+#else
+    PJ_UNUSED_ARG(tp);
+#endif
+}
+
+
 /* Clean up UDP resources */
 static void udp_on_destroy(void *arg)
 {
@@ -465,6 +532,7 @@ static pj_status_t udp_destroy( pjsip_transport *transport )
 	    tp->sock = PJ_INVALID_SOCKET;
 	}
     }
+    udp_close_xsocks(tp);
 
     /* Must poll ioqueue because IOCP calls the callback when socket
      * is closed. We poll the ioqueue until all pending callbacks 
@@ -514,9 +582,44 @@ static pj_status_t udp_shutdown(pjsip_transport *transport)
 }
 
 
+/* Adjust the send and receive buffer sizes of the socket */
+static void udp_set_sock_buf(pj_sock_t sock)
+{
+#if PJSIP_UDP_SO_RCVBUF_SIZE || PJSIP_UDP_SO_SNDBUF_SIZE
+    long sobuf_size;
+    pj_status_t status;
+#endif
+
+    /* Adjust socket rcvbuf size */
+#if PJSIP_UDP_SO_RCVBUF_SIZE
+    sobuf_size = PJSIP_UDP_SO_RCVBUF_SIZE;
+    status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), pj_SO_RCVBUF(),
+				&sobuf_size, sizeof(sobuf_size));
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(4,(THIS_FILE, status, "Error setting SO_RCVBUF"));
+    }
+#endif
+
+    /* Adjust socket sndbuf size */
+#if PJSIP_UDP_SO_SNDBUF_SIZE
+    sobuf_size = PJSIP_UDP_SO_SNDBUF_SIZE;
+    status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), pj_SO_SNDBUF(),
+				&sobuf_size, sizeof(sobuf_size));
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(4,(THIS_FILE, status, "Error setting SO_SNDBUF"));
+    }
+#endif
+
+#if !PJSIP_UDP_SO_RCVBUF_SIZE && !PJSIP_UDP_SO_SNDBUF_SIZE
+    PJ_UNUSED_ARG(sock);
+#endif
+}
+
+
 /* Create socket */
 static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
-				 int addr_len, pj_sock_t *p_sock)
+				 int addr_len, pj_bool_t reuse_port,
+				 pj_sock_t *p_sock)
 {
     pj_sock_t sock;
     pj_sockaddr_in tmp_addr;
@@ -540,6 +643,20 @@ static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
 	}
     }
 
+#ifdef SO_REUSEPORT
+    if (reuse_port) {
+	int enabled = 1;
+
+	status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), SO_REUSEPORT,
+				    &enabled, sizeof(enabled));
+	if (status != PJ_SUCCESS) {
+	    PJ_PERROR(4,(THIS_FILE, status, "Error setting SO_REUSEPORT"));
+	}
+    }
+#else
+    PJ_UNUSED_ARG(reuse_port);
+#endif
+
     status = pj_sock_bind(sock, local_a, addr_len);
     if (status != PJ_SUCCESS) {
 	pj_sock_close(sock);
@@ -551,6 +668,73 @@ static pj_status_t create_socket(int af, const pj_sockaddr_t *local_a,
 }
 
 
+#if PJSIP_UDP_SOCK_CNT > 1
+/* Create up to cnt more sockets bound to the (already bound) address of
+ * sock with SO_REUSEPORT. Returns the number of sockets created.
+ */
+static unsigned create_xsocks(pj_sock_t sock, unsigned cnt,
+			      pj_sock_t xsock[])
+{
+#ifdef SO_REUSEPORT
+    pj_sockaddr bound_addr;
+    int addr_len;
+    unsigned n;
+    pj_status_t status;
+
+    addr_len = sizeof(bound_addr);
+    status = pj_sock_getsockname(sock, &bound_addr, &addr_len);
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(4,(THIS_FILE, status, "Error getting UDP socket address"));
+	return 0;
+    }
+
+    for (n=0; n<cnt; ++n) {
+	status = create_socket(bound_addr.addr.sa_family, &bound_addr,
+			       addr_len, PJ_TRUE, &xsock[n]);
+	if (status != PJ_SUCCESS) {
+	    PJ_PERROR(4,(THIS_FILE, status,
+			 "Error creating SO_REUSEPORT UDP socket, only %d "
+			 "socket(s) will be used", n+1));
+	    break;
+	}
+	udp_set_sock_buf(xsock[n]);
+    }
+
+    return n;
+#else
+    PJ_UNUSED_ARG(sock);
+    PJ_UNUSED_ARG(xsock);
+    PJ_LOG(4,(THIS_FILE, "SO_REUSEPORT is not supported, only one UDP "
+			 "socket will be used instead of %d", cnt+1));
+    return 0;
+#endif
+}
+
+/* Save the QoS and socket options of the transport, so that restart can
+ * apply them to the additional sockets it recreates.
+ */
+static void udp_save_sock_opts(struct udp_transport *tp,
+			       const pjsip_udp_transport_cfg *cfg)
+{
+    unsigned i;
+
+    tp->qos_type = cfg->qos_type;
+    pj_memcpy(&tp->qos_params, &cfg->qos_params, sizeof(cfg->qos_params));
+    pj_memcpy(&tp->sockopt_params, &cfg->sockopt_params,
+	      sizeof(cfg->sockopt_params));
+
+    /* The option values belong to the caller, copy them to the pool */
+    for (i=0; i<tp->sockopt_params.cnt; ++i) {
+	int optlen = tp->sockopt_params.options[i].optlen;
+	void *optval = pj_pool_alloc(tp->base.pool, optlen);
+
+	pj_memcpy(optval, cfg->sockopt_params.options[i].optval, optlen);
+	tp->sockopt_params.options[i].optval = optval;
+    }
+}
+#endif
+
+
 /* Generate transport's published address */
 static pj_status_t get_published_name(pj_sock_t sock,
 				      char hostbuf[],
@@ -655,30 +839,8 @@ static void udp_set_socket(struct udp_transport *tp,
 			   pj_sock_t sock,
 			   const pjsip_host_port *a_name)
 {
-#if PJSIP_UDP_SO_RCVBUF_SIZE || PJSIP_UDP_SO_SNDBUF_SIZE
-    long sobuf_size;
-    pj_status_t status;
-#endif
-
-    /* Adjust socket rcvbuf size */
-#if PJSIP_UDP_SO_RCVBUF_SIZE
-    sobuf_size = PJSIP_UDP_SO_RCVBUF_SIZE;
-    status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), pj_SO_RCVBUF(),
-				&sobuf_size, sizeof(sobuf_size));
-    if (status != PJ_SUCCESS) {
-	PJ_PERROR(4,(THIS_FILE, status, "Error setting SO_RCVBUF"));
-    }
-#endif
-
-    /* Adjust socket sndbuf size */
-#if PJSIP_UDP_SO_SNDBUF_SIZE
-    sobuf_size = PJSIP_UDP_SO_SNDBUF_SIZE;
-    status = pj_sock_setsockopt(sock, pj_SOL_SOCKET(), pj_SO_SNDBUF(),
-				&sobuf_size, sizeof(sobuf_size));
-    if (status != PJ_SUCCESS) {
-	PJ_PERROR(4,(THIS_FILE, status, "Error setting SO_SNDBUF"));
-    }
-#endif
+    /* Adjust socket buffer sizes */
+    udp_set_sock_buf(sock);
 
     /* Set the socket. */
     tp->sock = sock;
@@ -692,6 +854,9 @@ static pj_status_t register_to_ioqueue(struct udp_transport *tp)
 {
     pj_ioqueue_t *ioqueue;
     pj_ioqueue_callback ioqueue_cb;
+#if PJSIP_UDP_SOCK_CNT > 1
+    unsigned n;
+#endif
     pj_status_t status;
 
     /* Ignore if already registered */
@@ -717,8 +882,24 @@ static pj_status_t register_to_ioqueue(struct udp_transport *tp)
     ioqueue_cb.on_read_complete = &udp_on_read_complete;
     ioqueue_cb.on_write_complete = &udp_on_write_complete;
 
-    return pj_ioqueue_register_sock2(tp->base.pool, ioqueue, tp->sock,
-				     tp->grp_lock, tp, &ioqueue_cb, &tp->key);
+    status = pj_ioqueue_register_sock2(tp->base.pool, ioqueue, tp->sock,
+				       tp->grp_lock, tp, &ioqueue_cb,
+				       &tp->key);
+    if (status != PJ_SUCCESS)
+	return status;
+
+#if PJSIP_UDP_SOCK_CNT > 1
+    /* Register the additional sockets with the same group lock */
+    for (n=0; n+1<tp->sock_cnt; ++n) {
+	status = pj_ioqueue_register_sock2(tp->base.pool, ioqueue,
+					   tp->xsock[n], tp->grp_lock, tp,
+					   &ioqueue_cb, &tp->xkey[n]);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+#endif
+
+    return PJ_SUCCESS;
 }
 
 /* Start ioqueue asynchronous reading to all rdata */
@@ -729,11 +910,12 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 
     /* Start reading the ioqueue. */
     for (i=0; i<tp->rdata_cnt; ++i) {
+	pj_ioqueue_key_t *key = udp_rdata_key(tp, i);
 	pj_ssize_t size;
 
 	size = sizeof(tp->rdata[i]->pkt_info.packet);
 	tp->rdata[i]->pkt_info.src_addr_len = sizeof(tp->rdata[i]->pkt_info.src_addr);
-	status = pj_ioqueue_recvfrom(tp->key, 
+	status = pj_ioqueue_recvfrom(key, 
 				     &tp->rdata[i]->tp_info.op_key.op_key,
 				     tp->rdata[i]->pkt_info.packet,
 				     &size, PJ_IOQUEUE_ALWAYS_ASYNC,
@@ -741,7 +923,7 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 				     &tp->rdata[i]->pkt_info.src_addr_len);
 	if (status == PJ_SUCCESS) {
 	    pj_assert(!"Shouldn't happen because PJ_IOQUEUE_ALWAYS_ASYNC!");
-	    udp_on_read_complete(tp->key, &tp->rdata[i]->tp_info.op_key.op_key,
+	    udp_on_read_complete(key, &tp->rdata[i]->tp_info.op_key.op_key,
 				 size);
 	} else if (status != PJ_EPENDING) {
 	    /* Error! */
@@ -761,6 +943,8 @@ static pj_status_t start_async_read(struct udp_transport *tp)
 static pj_status_t transport_attach( pjsip_endpoint *endpt,
 				     pjsip_transport_type_e type,
 				     pj_sock_t sock,
+				     const pj_sock_t xsock[],
+				     unsigned xsock_cnt,
 				     const pjsip_host_port *a_name,
 				     unsigned async_cnt,
 				     pjsip_transport **p_transport)
@@ -793,12 +977,30 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
     /* Create pool. */
     pool = pjsip_endpt_create_pool(endpt, format, PJSIP_POOL_LEN_TRANSPORT, 
 				   PJSIP_POOL_INC_TRANSPORT);
-    if (!pool)
+    if (!pool) {
+#if PJSIP_UDP_SOCK_CNT > 1
+	for (i=0; i<xsock_cnt; ++i)
+	    pj_sock_close(xsock[i]);
+#endif
 	return PJ_ENOMEM;
+    }
 
     /* Create the UDP transport object. */
     tp = PJ_POOL_ZALLOC_T(pool, struct udp_transport);
 
+#if PJSIP_UDP_SOCK_CNT > 1
+    /* Attach the additional sockets before anything can fail, so that
+     * udp_destroy() closes them on error.
+     */
+    pj_assert(xsock_cnt < PJSIP_UDP_SOCK_CNT);
+    for (i=0; i<xsock_cnt; ++i)
+	tp->xsock[i] = xsock[i];
+    tp->sock_cnt = tp->sock_max = xsock_cnt + 1;
+#else
+    PJ_UNUSED_ARG(xsock);
+    PJ_ASSERT_RETURN(xsock_cnt == 0, PJ_EINVAL);
+#endif
+
     /* Save pool. */
     tp->base.pool = pool;
 
@@ -878,6 +1080,17 @@ static pj_status_t transport_attach( pjsip_endpoint *endpt,
      */
     pjsip_transport_add_ref(&tp->base);
 
+#if PJ_HAS_SOCK_MMSG
+    /* Keep enough reads pending to fill a whole recvmmsg() batch. */
+    if (async_cnt < PJ_SOCK_MAX_MMSG)
+	async_cnt = PJ_SOCK_MAX_MMSG;
+#endif
+
+#if PJSIP_UDP_SOCK_CNT > 1
+    /* Each socket has its own set of async_cnt pending reads */
+    async_cnt *= tp->sock_max;
+#endif
+
     /* Create rdata and put it in the array. */
     tp->rdata_cnt = 0;
     tp->rdata = (pjsip_rx_data**)
@@ -931,8 +1144,8 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_attach( pjsip_endpoint *endpt,
 						unsigned async_cnt,
 						pjsip_transport **p_transport)
 {
-    return transport_attach(endpt, PJSIP_TRANSPORT_UDP, sock, a_name,
-			    async_cnt, p_transport);
+    return transport_attach(endpt, PJSIP_TRANSPORT_UDP, sock, NULL, 0,
+			    a_name, async_cnt, p_transport);
 }
 
 PJ_DEF(pj_status_t) pjsip_udp_transport_attach2( pjsip_endpoint *endpt,
@@ -942,7 +1155,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_attach2( pjsip_endpoint *endpt,
 						 unsigned async_cnt,
 						 pjsip_transport **p_transport)
 {
-    return transport_attach(endpt, type, sock, a_name,
+    return transport_attach(endpt, type, sock, NULL, 0, a_name,
 			    async_cnt, p_transport);
 }
 
@@ -971,10 +1184,13 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
 					pjsip_transport **p_transport)
 {
     pj_sock_t sock;
+    pj_sock_t xsock[PJSIP_UDP_SOCK_CNT];
+    unsigned i, xsock_cnt = 0;
     pj_status_t status;
     pjsip_host_port addr_name;
     char addr_buf[PJ_INET6_ADDRSTRLEN];
     pjsip_transport_type_e transport_type;
+    pjsip_transport *tp;
     pj_uint16_t af;
     int addr_len;
 
@@ -990,17 +1206,25 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
 	addr_len = sizeof(pj_sockaddr_in6);
     }
 
-    status = create_socket(af, &cfg->bind_addr, addr_len, &sock);
+    status = create_socket(af, &cfg->bind_addr, addr_len,
+			   (PJSIP_UDP_SOCK_CNT > 1), &sock);
     if (status != PJ_SUCCESS)
 	return status;
 
-    /* Apply QoS, if specified */
-    pj_sock_apply_qos2(sock, cfg->qos_type, &cfg->qos_params,
-		       2, THIS_FILE, "SIP UDP transport");
+#if PJSIP_UDP_SOCK_CNT > 1
+    /* Open the additional sockets on the address that has been bound */
+    xsock_cnt = create_xsocks(sock, PJSIP_UDP_SOCK_CNT-1, xsock);
+#endif
+
+    /* Apply QoS and sockopt, if specified */
+    xsock[xsock_cnt] = sock;
+    for (i=0; i<=xsock_cnt; ++i) {
+	pj_sock_apply_qos2(xsock[i], cfg->qos_type, &cfg->qos_params,
+			   2, THIS_FILE, "SIP UDP transport");
 
-    /* Apply sockopt, if specified */
-    if (cfg->sockopt_params.cnt)
-	pj_sock_setsockopt_params(sock, &cfg->sockopt_params);
+	if (cfg->sockopt_params.cnt)
+	    pj_sock_setsockopt_params(xsock[i], &cfg->sockopt_params);
+    }
 
     if (cfg->addr_name.host.slen == 0) {
 	/* Address name is not specified.
@@ -1009,16 +1233,27 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_start2(
 	status = get_published_name(sock, addr_buf, sizeof(addr_buf),
 				    &addr_name);
 	if (status != PJ_SUCCESS) {
-	    pj_sock_close(sock);
+	    for (i=0; i<=xsock_cnt; ++i)
+		pj_sock_close(xsock[i]);
 	    return status;
 	}
     } else {
 	addr_name = cfg->addr_name;
     }
 
-    return pjsip_udp_transport_attach2(endpt, transport_type, sock,
-				       &addr_name, cfg->async_cnt,
-				       p_transport);
+    status = transport_attach(endpt, transport_type, sock, xsock, xsock_cnt,
+			      &addr_name, cfg->async_cnt, &tp);
+    if (status != PJ_SUCCESS)
+	return status;
+
+#if PJSIP_UDP_SOCK_CNT > 1
+    udp_save_sock_opts((struct udp_transport*)tp, cfg);
+#endif
+
+    if (p_transport)
+	*p_transport = tp;
+
+    return PJ_SUCCESS;
 }
 
 /*
@@ -1109,7 +1344,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_pause(pjsip_transport *transport,
 
     /* Cancel the ioqueue operation. */
     for (i=0; i<(unsigned)tp->rdata_cnt; ++i) {
-	pj_ioqueue_post_completion(tp->key, 
+	pj_ioqueue_post_completion(udp_rdata_key(tp, i),
 				   &tp->rdata[i]->tp_info.op_key.op_key, -1);
     }
 
@@ -1127,6 +1362,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_pause(pjsip_transport *transport,
 	    }
 	}
 	tp->sock = PJ_INVALID_SOCKET;
+	udp_close_xsocks(tp);
 	
     }
 
@@ -1197,14 +1433,36 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
 	    }
 	}
 	tp->sock = PJ_INVALID_SOCKET;
+	udp_close_xsocks(tp);
 
 	/* Create the socket if it's not specified */
 	if (sock == PJ_INVALID_SOCKET) {
+	    pj_bool_t reuse_port = PJ_FALSE;
+
+#if PJSIP_UDP_SOCK_CNT > 1
+	    reuse_port = (tp->sock_max > 1);
+#endif
 	    status = create_socket(local?local->addr.sa_family:pj_AF_UNSPEC(), 
 				   local, local?pj_sockaddr_get_len(local):0, 
-				   &sock);
+				   reuse_port, &sock);
 	    if (status != PJ_SUCCESS)
 		return status;
+
+#if PJSIP_UDP_SOCK_CNT > 1
+	    /* Also recreate the additional sockets, with the QoS and socket
+	     * options the transport was started with.
+	     */
+	    tp->sock_cnt = 1 + create_xsocks(sock, tp->sock_max-1, tp->xsock);
+	    for (i=0; i+1 < (int)tp->sock_cnt; ++i) {
+		pj_sock_apply_qos2(tp->xsock[i], tp->qos_type,
+				   &tp->qos_params, 2, THIS_FILE,
+				   "SIP UDP transport");
+
+		if (tp->sockopt_params.cnt)
+		    pj_sock_setsockopt_params(tp->xsock[i],
+					      &tp->sockopt_params);
+	    }
+#endif
 	}
 
 	/* If transport published name is not specified, calculate it
@@ -1215,6 +1473,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
 					&bound_name);
 	    if (status != PJ_SUCCESS) {
 		pj_sock_close(sock);
+		udp_close_xsocks(tp);
 		return status;
 	    }
 
@@ -1226,6 +1485,7 @@ PJ_DEF(pj_status_t) pjsip_udp_transport_restart2(pjsip_transport *transport,
 				     &tp->base.addr_len);
         if (status != PJ_SUCCESS) {
             pj_sock_close(sock);
+            udp_close_xsocks(tp);
             return status;
         }
 
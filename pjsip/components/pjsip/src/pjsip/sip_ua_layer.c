@@ -69,6 +69,14 @@ struct dlg_set
     struct dlg_set_head  dlg_list;
 };
 
+/* A shard of the dialog hash table. */
+typedef struct ua_shard
+{
+    pj_mutex_t		*mutex;
+    pj_hash_table_t	*dlg_table;
+    struct dlg_set	 free_dlgset_nodes;
+} ua_shard;
+
 
 /*
  * Module interface.
@@ -79,9 +87,8 @@ static struct user_agent
     pj_pool_t		*pool;
     pjsip_endpoint	*endpt;
     pj_mutex_t		*mutex;
-    pj_hash_table_t	*dlg_table;
+    ua_shard		 shard[PJSIP_UA_LAYER_SHARD_CNT];
     pjsip_ua_init_param  param;
-    struct dlg_set	 free_dlgset_nodes;
 
 } mod_ua = 
 {
@@ -102,6 +109,48 @@ static struct user_agent
   }
 };
 
+/* Get the shard of the dialog hash table for the local tag hash value.
+ * The hash table uses the lower bits of the value, so use the upper bits.
+ */
+#define UA_SHARD(hval)	\
+	    (&mod_ua.shard[((hval) >> 16) % PJSIP_UA_LAYER_SHARD_CNT])
+
+/* Lock all shards, in order. */
+static void ua_lock_all(void)
+{
+    unsigned i;
+
+    for (i=0; i<PJSIP_UA_LAYER_SHARD_CNT; ++i)
+	pj_mutex_lock(mod_ua.shard[i].mutex);
+}
+
+/* Unlock all shards. */
+static void ua_unlock_all(void)
+{
+    unsigned i;
+
+    for (i=PJSIP_UA_LAYER_SHARD_CNT; i>0; --i)
+	pj_mutex_unlock(mod_ua.shard[i-1].mutex);
+}
+
+/* Lock the shard, or all shards if shard is NULL. */
+static void ua_lock(ua_shard *shard)
+{
+    if (shard)
+	pj_mutex_lock(shard->mutex);
+    else
+	ua_lock_all();
+}
+
+/* Unlock the shard, or all shards if shard is NULL. */
+static void ua_unlock(ua_shard *shard)
+{
+    if (shard)
+	pj_mutex_unlock(shard->mutex);
+    else
+	ua_unlock_all();
+}
+
 /* 
  * mod_ua_load()
  *
@@ -109,6 +158,7 @@ static struct user_agent
  */
 static pj_status_t mod_ua_load(pjsip_endpoint *endpt)
 {
+    unsigned i;
     pj_status_t status;
 
     /* Initialize the user agent. */
@@ -118,15 +168,26 @@ static pj_status_t mod_ua_load(pjsip_endpoint *endpt)
     if (mod_ua.pool == NULL)
 	return PJ_ENOMEM;
 
-    status = pj_mutex_create_recursive(mod_ua.pool, " ua%p", &mod_ua.mutex);
+    /* This mutex only protects the pool. */
+    status = pj_mutex_create_simple(mod_ua.pool, " ua%p", &mod_ua.mutex);
     if (status != PJ_SUCCESS)
 	return status;
 
-    mod_ua.dlg_table = pj_hash_create(mod_ua.pool, PJSIP_MAX_DIALOG_COUNT);
-    if (mod_ua.dlg_table == NULL)
-	return PJ_ENOMEM;
+    for (i=0; i<PJSIP_UA_LAYER_SHARD_CNT; ++i) {
+	ua_shard *shard = &mod_ua.shard[i];
+
+	status = pj_mutex_create_recursive(mod_ua.pool, " ua%p",
+					   &shard->mutex);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	shard->dlg_table = pj_hash_create(mod_ua.pool, PJSIP_MAX_DIALOG_COUNT /
+						       PJSIP_UA_LAYER_SHARD_CNT);
+	if (shard->dlg_table == NULL)
+	    return PJ_ENOMEM;
 
-    pj_list_init(&mod_ua.free_dlgset_nodes);
+	pj_list_init(&shard->free_dlgset_nodes);
+    }
 
     /* Initialize dialog lock. */
     status = pj_thread_local_alloc(&pjsip_dlg_lock_tls_id);
@@ -146,8 +207,16 @@ static pj_status_t mod_ua_load(pjsip_endpoint *endpt)
  */
 static pj_status_t mod_ua_unload(void)
 {
+    unsigned i;
+
     pj_thread_local_free(pjsip_dlg_lock_tls_id);
     pj_mutex_destroy(mod_ua.mutex);
+    for (i=0; i<PJSIP_UA_LAYER_SHARD_CNT; ++i) {
+	if (mod_ua.shard[i].mutex) {
+	    pj_mutex_destroy(mod_ua.shard[i].mutex);
+	    mod_ua.shard[i].mutex = NULL;
+	}
+    }
 
     /* Release pool */
     if (mod_ua.pool) {
@@ -260,16 +329,19 @@ PJ_DEF(void) pjsip_ua_create_dlg_set_key( pj_pool_t *pool,
  * This will first look in the free nodes list, then allocate
  * a new one from UA's pool when one is not available.
  */
-static struct dlg_set *alloc_dlgset_node(void)
+static struct dlg_set *alloc_dlgset_node(ua_shard *shard)
 {
     struct dlg_set *set;
 
-    if (!pj_list_empty(&mod_ua.free_dlgset_nodes)) {
-	set = mod_ua.free_dlgset_nodes.next;
+    if (!pj_list_empty(&shard->free_dlgset_nodes)) {
+	set = shard->free_dlgset_nodes.next;
 	pj_list_erase(set);
 	return set;
     } else {
+	/* The UA pool is shared by the shards */
+	pj_mutex_lock(mod_ua.mutex);
 	set = PJ_POOL_ALLOC_T(mod_ua.pool, struct dlg_set);
+	pj_mutex_unlock(mod_ua.mutex);
 	return set;
     }
 }
@@ -281,6 +353,8 @@ static struct dlg_set *alloc_dlgset_node(void)
 PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 					   pjsip_dialog *dlg )
 {
+    ua_shard *shard;
+
     /* Sanity check. */
     PJ_ASSERT_RETURN(ua && dlg, PJ_EINVAL);
 
@@ -293,15 +367,16 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
     //		     (dlg->role==PJSIP_ROLE_UAS && dlg->remote.info->tag.slen
     //		      && dlg->remote.tag_hval != 0), PJ_EBUG);
 
-    /* Lock the user agent. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the shard of the dialog set. */
+    shard = UA_SHARD(dlg->local.tag_hval);
+    pj_mutex_lock(shard->mutex);
 
     /* For UAC, check if there is existing dialog in the same set. */
     if (dlg->role == PJSIP_ROLE_UAC) {
 	struct dlg_set *dlg_set;
 
 	dlg_set = (struct dlg_set*)
-		  pj_hash_get_lower( mod_ua.dlg_table,
+		  pj_hash_get_lower( shard->dlg_table,
                                      dlg->local.info->tag.ptr, 
 			             (unsigned)dlg->local.info->tag.slen,
 			             &dlg->local.tag_hval);
@@ -319,14 +394,14 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 	    /* This is the first dialog in the dialog set. 
 	     * Create the dialog set and add this dialog to it.
 	     */
-	    dlg_set = alloc_dlgset_node();
+	    dlg_set = alloc_dlgset_node(shard);
 	    pj_list_init(&dlg_set->dlg_list);
 	    pj_list_push_back(&dlg_set->dlg_list, dlg);
 
 	    dlg->dlg_set = dlg_set;
 
 	    /* Register the dialog set in the hash table. */
-	    pj_hash_set_np_lower(mod_ua.dlg_table, 
+	    pj_hash_set_np_lower(shard->dlg_table, 
 			         dlg->local.info->tag.ptr,
                                  (unsigned)dlg->local.info->tag.slen,
 			         dlg->local.tag_hval, dlg_set->ht_entry,
@@ -337,20 +412,20 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 	/* For UAS, create the dialog set with a single dialog as member. */
 	struct dlg_set *dlg_set;
 
-	dlg_set = alloc_dlgset_node();
+	dlg_set = alloc_dlgset_node(shard);
 	pj_list_init(&dlg_set->dlg_list);
 	pj_list_push_back(&dlg_set->dlg_list, dlg);
 
 	dlg->dlg_set = dlg_set;
 
-	pj_hash_set_np_lower(mod_ua.dlg_table, 
+	pj_hash_set_np_lower(shard->dlg_table, 
 		             dlg->local.info->tag.ptr,
                              (unsigned)dlg->local.info->tag.slen,
 		             dlg->local.tag_hval, dlg_set->ht_entry, dlg_set);
     }
 
-    /* Unlock user agent. */
-    pj_mutex_unlock(mod_ua.mutex);
+    /* Unlock the shard. */
+    pj_mutex_unlock(shard->mutex);
 
     /* Done. */
     return PJ_SUCCESS;
@@ -360,6 +435,7 @@ PJ_DEF(pj_status_t) pjsip_ua_register_dlg( pjsip_user_agent *ua,
 PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
 					     pjsip_dialog *dlg )
 {
+    ua_shard *shard;
     struct dlg_set *dlg_set;
     pjsip_dialog *d;
 
@@ -369,8 +445,9 @@ PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
     /* Check that dialog has been registered. */
     PJ_ASSERT_RETURN(dlg->dlg_set, PJ_EINVALIDOP);
 
-    /* Lock user agent. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the shard of the dialog set. */
+    shard = UA_SHARD(dlg->local.tag_hval);
+    pj_mutex_lock(shard->mutex);
 
     /* Find this dialog from the dialog set. */
     dlg_set = (struct dlg_set*) dlg->dlg_set;
@@ -381,7 +458,7 @@ PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
 
     if (d != dlg) {
 	pj_assert(!"Dialog is not registered!");
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(shard->mutex);
 	return PJ_EINVALIDOP;
     }
 
@@ -390,16 +467,16 @@ PJ_DEF(pj_status_t) pjsip_ua_unregister_dlg( pjsip_user_agent *ua,
 
     /* If dialog list is empty, remove the dialog set from the hash table. */
     if (pj_list_empty(&dlg_set->dlg_list)) {
-	pj_hash_set_lower(NULL, mod_ua.dlg_table, dlg->local.info->tag.ptr,
+	pj_hash_set_lower(NULL, shard->dlg_table, dlg->local.info->tag.ptr,
 		          (unsigned)dlg->local.info->tag.slen, 
 			  dlg->local.tag_hval, NULL);
 
 	/* Return dlg_set to free nodes. */
-	pj_list_push_back(&mod_ua.free_dlgset_nodes, dlg_set);
+	pj_list_push_back(&shard->free_dlgset_nodes, dlg_set);
     }
 
-    /* Unlock user agent. */
-    pj_mutex_unlock(mod_ua.mutex);
+    /* Unlock the shard. */
+    pj_mutex_unlock(shard->mutex);
 
     /* Done. */
     return PJ_SUCCESS;
@@ -428,13 +505,17 @@ PJ_DEF(pjsip_dialog*) pjsip_tsx_get_dlg( pjsip_transaction *tsx )
  */
 PJ_DEF(unsigned) pjsip_ua_get_dlg_set_count(void)
 {
-    unsigned count;
+    unsigned i, count = 0;
 
     PJ_ASSERT_RETURN(mod_ua.endpt, 0);
 
-    pj_mutex_lock(mod_ua.mutex);
-    count = pj_hash_count(mod_ua.dlg_table);
-    pj_mutex_unlock(mod_ua.mutex);
+    for (i=0; i<PJSIP_UA_LAYER_SHARD_CNT; ++i) {
+	ua_shard *shard = &mod_ua.shard[i];
+
+	pj_mutex_lock(shard->mutex);
+	count += pj_hash_count(shard->dlg_table);
+	pj_mutex_unlock(shard->mutex);
+    }
 
     return count;
 }
@@ -448,21 +529,25 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 					   const pj_str_t *remote_tag,
 					   pj_bool_t lock_dialog)
 {
+    ua_shard *shard;
+    pj_uint32_t hval;
     struct dlg_set *dlg_set;
     pjsip_dialog *dlg;
 
     PJ_ASSERT_RETURN(call_id && local_tag && remote_tag, NULL);
 
-    /* Lock user agent. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the shard of the dialog set. */
+    hval = pj_hash_calc_tolower(0, NULL, local_tag);
+    shard = UA_SHARD(hval);
+    pj_mutex_lock(shard->mutex);
 
     /* Lookup the dialog set. */
     dlg_set = (struct dlg_set*)
-    	      pj_hash_get_lower(mod_ua.dlg_table, local_tag->ptr,
-                                (unsigned)local_tag->slen, NULL);
+    	      pj_hash_get_lower(shard->dlg_table, local_tag->ptr,
+                                (unsigned)local_tag->slen, &hval);
     if (dlg_set == NULL) {
 	/* Not found */
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(shard->mutex);
 	return NULL;
     }
 
@@ -478,7 +563,7 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 
     if (dlg == (pjsip_dialog*)&dlg_set->dlg_list) {
 	/* Not found */
-	pj_mutex_unlock(mod_ua.mutex);
+	pj_mutex_unlock(shard->mutex);
 	return NULL;
     }
 
@@ -488,7 +573,7 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 	PJ_LOG(6, (THIS_FILE, "Dialog not found: local and remote tags "
 		              "matched but not call id"));
 
-        pj_mutex_unlock(mod_ua.mutex);
+        pj_mutex_unlock(shard->mutex);
         return NULL;
     }
 
@@ -496,36 +581,62 @@ PJ_DEF(pjsip_dialog*) pjsip_ua_find_dialog(const pj_str_t *call_id,
 	if (pjsip_dlg_try_inc_lock(dlg) != PJ_SUCCESS) {
 
 	    /*
-	     * Unable to acquire dialog's lock while holding the user
-	     * agent's mutex. Release the UA mutex before retrying once
+	     * Unable to acquire dialog's lock while holding the shard's
+	     * mutex. Release the shard mutex before retrying once
 	     * more.
 	     *
 	     * THIS MAY CAUSE RACE CONDITION!
 	     */
 
-	    /* Unlock user agent. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    /* Unlock the shard. */
+	    pj_mutex_unlock(shard->mutex);
 	    /* Lock dialog */
 	    pjsip_dlg_inc_lock(dlg);
 
 	} else {
-	    /* Unlock user agent. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    /* Unlock the shard. */
+	    pj_mutex_unlock(shard->mutex);
 	}
 
     } else {
-	/* Unlock user agent. */
-	pj_mutex_unlock(mod_ua.mutex);
+	/* Unlock the shard. */
+	pj_mutex_unlock(shard->mutex);
     }
 
     return dlg;
 }
 
 
+/*
+ * Get the shard to lock to find the dialog set for an incoming message,
+ * or NULL if all shards must be locked.
+ */
+static ua_shard *get_shard_for_msg( pjsip_rx_data *rdata, pj_uint32_t *hval )
+{
+    pj_str_t *tag;
+
+    /* CANCEL request is matched with the INVITE transaction, the dialog
+     * set can be in any shard.
+     */
+    if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG) {
+	if (rdata->msg_info.cseq->method.id == PJSIP_CANCEL_METHOD)
+	    return NULL;
+	tag = &rdata->msg_info.to->tag;
+    } else {
+	tag = &rdata->msg_info.from->tag;
+    }
+
+    *hval = pj_hash_calc_tolower(0, NULL, tag);
+    return UA_SHARD(*hval);
+}
+
 /*
  * Find the first dialog in dialog set in hash table for an incoming message.
+ * The shard returned by get_shard_for_msg() must be locked.
  */
-static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
+static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata,
+					     ua_shard *shard,
+					     pj_uint32_t hval )
 {
     /* CANCEL message doesn't have To tag, so we must lookup the dialog
      * by finding the INVITE UAS transaction being cancelled.
@@ -578,8 +689,8 @@ static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
 
 	/* Lookup the dialog set. */
 	dlg_set = (struct dlg_set*)
-		  pj_hash_get_lower(mod_ua.dlg_table, tag->ptr, 
-				    (unsigned)tag->slen, NULL);
+		  pj_hash_get_lower(shard->dlg_table, tag->ptr, 
+				    (unsigned)tag->slen, &hval);
 	return dlg_set;
     }
 }
@@ -587,6 +698,8 @@ static struct dlg_set *find_dlg_set_for_msg( pjsip_rx_data *rdata )
 /* On received requests. */
 static pj_bool_t mod_ua_on_rx_request(pjsip_rx_data *rdata)
 {
+    ua_shard *shard;
+    pj_uint32_t hval = 0;
     struct dlg_set *dlg_set;
     pj_str_t *from_tag;
     pjsip_dialog *dlg;
@@ -605,20 +718,22 @@ static pj_bool_t mod_ua_on_rx_request(pjsip_rx_data *rdata)
     if (rdata->msg_info.msg->line.req.method.id == PJSIP_REGISTER_METHOD)
 	return PJ_FALSE;
 
+    shard = get_shard_for_msg(rdata, &hval);
+
 retry_on_deadlock:
 
-    /* Lock user agent before looking up the dialog hash table. */
-    pj_mutex_lock(mod_ua.mutex);
+    /* Lock the shard before looking up the dialog hash table. */
+    ua_lock(shard);
 
     /* Lookup the dialog set, based on the To tag header. */
-    dlg_set = find_dlg_set_for_msg(rdata);
+    dlg_set = find_dlg_set_for_msg(rdata, shard, hval);
 
     /* If dialog is not found, respond with 481 (Call/Transaction
      * Does Not Exist).
      */
     if (dlg_set == NULL) {
 	/* Unable to find dialog. */
-	pj_mutex_unlock(mod_ua.mutex);
+	ua_unlock(shard);
 
 	if (rdata->msg_info.msg->line.req.method.id != PJSIP_ACK_METHOD) {
 	    PJ_LOG(5,(THIS_FILE, 
@@ -659,7 +774,7 @@ retry_on_deadlock:
 
 	if (first_dlg->remote.info->tag.slen != 0) {
 	    /* Not found. Mulfunction UAC? */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    ua_unlock(shard);
 
 	    if (rdata->msg_info.msg->line.req.method.id != PJSIP_ACK_METHOD) {
 		PJ_LOG(5,(THIS_FILE, 
@@ -688,16 +803,16 @@ retry_on_deadlock:
     status = pjsip_dlg_try_inc_lock(dlg);
     if (status != PJ_SUCCESS) {
 	/* Failed to acquire dialog mutex immediately, this could be 
-	 * because of deadlock. Release UA mutex, yield, and retry 
+	 * because of deadlock. Release UA lock, yield, and retry 
 	 * the whole thing once again.
 	 */
-	pj_mutex_unlock(mod_ua.mutex);
+	ua_unlock(shard);
 	pj_thread_sleep(0);
 	goto retry_on_deadlock;
     }
 
     /* Done with processing in UA layer, release lock */
-    pj_mutex_unlock(mod_ua.mutex);
+    ua_unlock(shard);
 
     /* Pass to dialog. */
     pjsip_dlg_on_rx_request(dlg, rdata);
@@ -715,6 +830,8 @@ retry_on_deadlock:
 static pj_bool_t mod_ua_on_rx_response(pjsip_rx_data *rdata)
 {
     pjsip_transaction *tsx;
+    ua_shard *shard;
+    pj_uint32_t hval = 0;
     struct dlg_set *dlg_set;
     pjsip_dialog *dlg;
     pj_status_t status;
@@ -729,12 +846,15 @@ static pj_bool_t mod_ua_on_rx_response(pjsip_rx_data *rdata)
      * the response is a forked response.
      */
 
+    /* The From tag of the response is the local tag of the dialog. */
+    shard = get_shard_for_msg(rdata, &hval);
+
 retry_on_deadlock:
 
     dlg = NULL;
 
     /* Lock user agent dlg table before we're doing anything. */
-    pj_mutex_lock(mod_ua.mutex);
+    ua_lock(shard);
 
     /* Check if transaction is present. */
     tsx = pjsip_rdata_get_tsx(rdata);
@@ -743,10 +863,19 @@ retry_on_deadlock:
 	dlg = pjsip_tsx_get_dlg(tsx);
 	if (!dlg) {
 	    /* Unlock dialog hash table. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    ua_unlock(shard);
 	    return PJ_FALSE;
 	}
 
+	/* The dialog set must be in the locked shard, otherwise (e.g. the
+	 * From tag has been modified) lock all shards.
+	 */
+	if (shard && UA_SHARD(dlg->local.tag_hval) != shard) {
+	    ua_unlock(shard);
+	    shard = NULL;
+	    goto retry_on_deadlock;
+	}
+
 	/* Get the dialog set. */
 	dlg_set = (struct dlg_set*) dlg->dlg_set;
 
@@ -770,21 +899,21 @@ retry_on_deadlock:
 	     * or a very late response.
 	     */
 	    /* Unlock dialog hash table. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    ua_unlock(shard);
 	    return PJ_FALSE;
 	}
 
 
 	/* Get the dialog set. */
 	dlg_set = (struct dlg_set*)
-		  pj_hash_get_lower(mod_ua.dlg_table, 
+		  pj_hash_get_lower(UA_SHARD(hval)->dlg_table, 
 			            rdata->msg_info.from->tag.ptr,
 			            (unsigned)rdata->msg_info.from->tag.slen,
-			            NULL);
+			            &hval);
 
 	if (!dlg_set) {
 	    /* Unlock dialog hash table. */
-	    pj_mutex_unlock(mod_ua.mutex);
+	    ua_unlock(shard);
 
 	    /* Strayed 2xx response!! */
 	    PJ_LOG(4,(THIS_FILE, 
@@ -854,7 +983,7 @@ retry_on_deadlock:
 		dlg = (*mod_ua.param.on_dlg_forked)(dlg_set->dlg_list.next, 
 						    rdata);
 		if (dlg == NULL) {
-		    pj_mutex_unlock(mod_ua.mutex);
+		    ua_unlock(shard);
 		    return PJ_TRUE;
 		}
 	    } else {
@@ -898,15 +1027,15 @@ retry_on_deadlock:
     if (status != PJ_SUCCESS) {
 	/* Failed to acquire dialog mutex. This could indicate a deadlock
 	 * situation, and for safety, try to avoid deadlock by releasing
-	 * UA mutex, yield, and retry the whole processing once again.
+	 * UA lock, yield, and retry the whole processing once again.
 	 */
-	pj_mutex_unlock(mod_ua.mutex);
+	ua_unlock(shard);
 	pj_thread_sleep(0);
 	goto retry_on_deadlock;
     }
 
     /* We're done with processing in the UA layer, we can release the mutex */
-    pj_mutex_unlock(mod_ua.mutex);
+    ua_unlock(shard);
 
     /* Pass the response to the dialog. */
     pjsip_dlg_on_rx_response(dlg, rdata);
@@ -952,21 +1081,29 @@ PJ_DEF(void) pjsip_ua_dump(pj_bool_t detail)
 #if PJ_LOG_MAX_LEVEL >= 3
     pj_hash_iterator_t itbuf, *it;
     char dlginfo[128];
+    unsigned i, count = 0;
+
+    ua_lock_all();
 
-    pj_mutex_lock(mod_ua.mutex);
+    for (i=0; i<PJSIP_UA_LAYER_SHARD_CNT; ++i)
+	count += pj_hash_count(mod_ua.shard[i].dlg_table);
 
-    PJ_LOG(3, (THIS_FILE, "Number of dialog sets: %u", 
-			  pj_hash_count(mod_ua.dlg_table)));
+    PJ_LOG(3, (THIS_FILE, "Number of dialog sets: %u", count));
 
-    if (detail && pj_hash_count(mod_ua.dlg_table)) {
+    if (detail && count) {
 	PJ_LOG(3, (THIS_FILE, "Dumping dialog sets:"));
-	it = pj_hash_first(mod_ua.dlg_table, &itbuf);
-	for (; it != NULL; it = pj_hash_next(mod_ua.dlg_table, it))  {
+    }
+
+    for (i=0; detail && i<PJSIP_UA_LAYER_SHARD_CNT; ++i) {
+	pj_hash_table_t *dlg_table = mod_ua.shard[i].dlg_table;
+
+	it = pj_hash_first(dlg_table, &itbuf);
+	for (; it != NULL; it = pj_hash_next(dlg_table, it))  {
 	    struct dlg_set *dlg_set;
 	    pjsip_dialog *dlg;
 	    const char *title;
 
-	    dlg_set = (struct dlg_set*) pj_hash_this(mod_ua.dlg_table, it);
+	    dlg_set = (struct dlg_set*) pj_hash_this(dlg_table, it);
 	    if (!dlg_set || pj_list_empty(&dlg_set->dlg_list)) continue;
 
 	    /* First dialog in dialog set. */
@@ -988,7 +1125,7 @@ PJ_DEF(void) pjsip_ua_dump(pj_bool_t detail)
 	}
     }
 
-    pj_mutex_unlock(mod_ua.mutex);
+    ua_unlock_all();
 #endif
 }
 
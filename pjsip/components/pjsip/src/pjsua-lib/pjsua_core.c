@@ -515,6 +515,7 @@ static pjsip_module pjsua_options_handler =
     NULL,				/* on_tx_request.	*/
     NULL,				/* on_tx_response()	*/
     NULL,				/* on_tsx_state()	*/
+    PJSIP_MOD_RX_METHOD(PJSIP_OPTIONS_METHOD)	/* rx_method_mask */
 
 };
 